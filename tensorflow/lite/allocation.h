@@ -57,9 +57,21 @@ class Allocation {
   const Type type_;
 };
 
+// How MMAPAllocation maps the model file.
+struct MMAPOptions {
+  // Read the whole file in when mapping it (MAP_POPULATE), so the weights do
+  // not page fault during the first Invoke()s.
+  bool populate = false;
+  // Ask for huge pages backing the mapping (madvise(MADV_HUGEPAGE)). Only
+  // effective where the kernel supports huge pages for file mappings.
+  bool huge_pages = false;
+};
+
 class MMAPAllocation : public Allocation {
  public:
   MMAPAllocation(const char* filename, ErrorReporter* error_reporter);
+  MMAPAllocation(const char* filename, const MMAPOptions& options,
+                 ErrorReporter* error_reporter);
   virtual ~MMAPAllocation();
   const void* base() const override;
   size_t bytes() const override;
@@ -0,0 +1,152 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/arena_allocator.h"
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TFLITE_ARENA_ALLOCATOR_USE_MMAP
+#endif
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+namespace tflite {
+namespace {
+
+class NewArenaAllocator : public ArenaAllocator {
+ public:
+  void* Allocate(size_t bytes) override {
+    return new (std::nothrow) char[bytes];
+  }
+  void Deallocate(void* buffer, size_t bytes) override {
+    delete[] static_cast<char*>(buffer);
+  }
+};
+
+#ifdef TFLITE_ARENA_ALLOCATOR_USE_MMAP
+size_t RoundUp(size_t bytes, size_t multiple) {
+  return (bytes + multiple - 1) / multiple * multiple;
+}
+
+size_t PageBytes() {
+  static const size_t page_bytes = sysconf(_SC_PAGESIZE);
+  return page_bytes;
+}
+
+// Default huge page size as reported in /proc/meminfo, 2MB if unknown.
+size_t HugePageBytes() {
+  static const size_t huge_page_bytes = [] {
+    size_t kilobytes = 2048;
+    FILE* meminfo = fopen("/proc/meminfo", "r");
+    if (meminfo != nullptr) {
+      char line[128];
+      while (fgets(line, sizeof(line), meminfo) != nullptr) {
+        if (sscanf(line, "Hugepagesize: %zu kB", &kilobytes) == 1) break;
+      }
+      fclose(meminfo);
+    }
+    return kilobytes * 1024;
+  }();
+  return huge_page_bytes;
+}
+
+void BindToNode(void* buffer, size_t bytes, int numa_node) {
+#ifdef SYS_mbind
+  constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> node_mask(numa_node / kBitsPerWord + 1, 0);
+  node_mask[numa_node / kBitsPerWord] |= 1UL << (numa_node % kBitsPerWord);
+  // Not fatal: the pages just land wherever the default policy puts them.
+  syscall(SYS_mbind, buffer, bytes, MPOL_BIND, node_mask.data(),
+          node_mask.size() * kBitsPerWord + 1, 0);
+#endif
+}
+#endif  // TFLITE_ARENA_ALLOCATOR_USE_MMAP
+
+}  // namespace
+
+ArenaAllocator* DefaultArenaAllocator() {
+  static NewArenaAllocator* allocator = new NewArenaAllocator;
+  return allocator;
+}
+
+size_t PageArenaAllocator::MappedBytes(size_t bytes) const {
+#ifdef TFLITE_ARENA_ALLOCATOR_USE_MMAP
+  // Whole huge pages, so the tail of the buffer can be backed by one too. It
+  // also keeps the size valid for munmap() of a MAP_HUGETLB mapping.
+  if (options_.huge_pages != PageArenaAllocatorOptions::HugePages::kNone) {
+    return RoundUp(bytes, HugePageBytes());
+  }
+  return RoundUp(bytes, PageBytes());
+#else
+  return bytes;
+#endif
+}
+
+void* PageArenaAllocator::Allocate(size_t bytes) {
+#ifdef TFLITE_ARENA_ALLOCATOR_USE_MMAP
+  if (bytes == 0) return nullptr;
+  const size_t mapped_bytes = MappedBytes(bytes);
+  void* buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (options_.huge_pages == PageArenaAllocatorOptions::HugePages::kExplicit) {
+    buffer = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  const bool explicit_huge_pages = buffer != MAP_FAILED;
+  if (!explicit_huge_pages) {
+    buffer = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+    if (options_.huge_pages != PageArenaAllocatorOptions::HugePages::kNone) {
+      madvise(buffer, mapped_bytes, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  // The policy has to be set before the first touch to have any effect.
+  if (options_.numa_node >= 0) {
+    BindToNode(buffer, mapped_bytes, options_.numa_node);
+  }
+  if (options_.prefault) {
+    volatile char* pages = static_cast<char*>(buffer);
+    for (size_t offset = 0; offset < mapped_bytes; offset += PageBytes()) {
+      pages[offset] = 0;
+    }
+  }
+  return buffer;
+#else
+  return DefaultArenaAllocator()->Allocate(bytes);
+#endif
+}
+
+void PageArenaAllocator::Deallocate(void* buffer, size_t bytes) {
+  if (buffer == nullptr) return;
+#ifdef TFLITE_ARENA_ALLOCATOR_USE_MMAP
+  munmap(buffer, MappedBytes(bytes));
+#else
+  DefaultArenaAllocator()->Deallocate(buffer, bytes);
+#endif
+}
+
+}  // namespace tflite
@@ -0,0 +1,85 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_ARENA_ALLOCATOR_H_
+#define TENSORFLOW_LITE_ARENA_ALLOCATOR_H_
+
+#include <cstddef>
+
+namespace tflite {
+
+// Provides the underlying buffers of the memory arenas (activations and
+// persistent tensors). Buffers are few and large, and only obtained when an
+// arena grows, typically in AllocateTensors().
+class ArenaAllocator {
+ public:
+  virtual ~ArenaAllocator() {}
+
+  // Returns a buffer of at least `bytes` bytes, or nullptr.
+  virtual void* Allocate(size_t bytes) = 0;
+
+  // Releases a buffer returned by Allocate(bytes).
+  virtual void Deallocate(void* buffer, size_t bytes) = 0;
+};
+
+// The allocator arenas use unless told otherwise: plain operator new[].
+ArenaAllocator* DefaultArenaAllocator();
+
+// How a PageArenaAllocator backs its buffers.
+struct PageArenaAllocatorOptions {
+  enum class HugePages {
+    // Regular pages.
+    kNone,
+    // Ask for transparent huge pages (madvise(MADV_HUGEPAGE)).
+    kTransparent,
+    // Reserved huge pages (MAP_HUGETLB). Falls back to kTransparent when none
+    // are available.
+    kExplicit,
+  };
+  HugePages huge_pages = HugePages::kNone;
+
+  // NUMA node the pages are bound to (mbind(MPOL_BIND)), -1 for the default
+  // policy of the calling thread.
+  int numa_node = -1;
+
+  // Touch every page when the buffer is allocated, so the page faults (and
+  // the huge page / NUMA placement) happen there instead of in the first
+  // Invoke().
+  bool prefault = false;
+};
+
+// Backs buffers with anonymous mmap()s that can be placed on huge pages and a
+// given NUMA node. Every option is best effort: one the system does not
+// support is skipped and the buffer is still returned. Falls back to the
+// default allocator where mmap is not available.
+class PageArenaAllocator : public ArenaAllocator {
+ public:
+  explicit PageArenaAllocator(const PageArenaAllocatorOptions& options)
+      : options_(options) {}
+
+  void* Allocate(size_t bytes) override;
+  void Deallocate(void* buffer, size_t bytes) override;
+
+  const PageArenaAllocatorOptions& options() const { return options_; }
+
+ private:
+  // Size of the mapping backing a `bytes` long buffer.
+  size_t MappedBytes(size_t bytes) const;
+
+  PageArenaAllocatorOptions options_;
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_ARENA_ALLOCATOR_H_
@@ -22,6 +22,8 @@ limitations under the License.
 #include <type_traits>
 #include <utility>
 
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/kmdebug.h"
 
 namespace tflite {
@@ -29,6 +31,22 @@ namespace {
 
 constexpr int32_t kNodeNotAssigned = std::numeric_limits<int32_t>::max();
 
+// Product of the dimensions before 'axis'. When it is 1, slices along 'axis'
+// are contiguous byte ranges of the whole tensor.
+int OuterSize(const TfLiteIntArray* dims, int axis) {
+  int outer_size = 1;
+  for (int i = 0; i < axis; ++i) {
+    outer_size *= dims->data[i];
+  }
+  return outer_size;
+}
+
+// A view can only stand in for a copy if no requantization is involved.
+bool SameTypeAndQuantization(const TfLiteTensor& a, const TfLiteTensor& b) {
+  return a.type == b.type && a.params.scale == b.params.scale &&
+         a.params.zero_point == b.params.zero_point;
+}
+
 }  // namespace
 
 ArenaPlanner::ArenaPlanner(TfLiteContext* context,
@@ -60,9 +78,24 @@ TfLiteStatus ArenaPlanner::ResetAllocations() {
   TF_LITE_ENSURE_STATUS(persistent_arena_.ClearPlan());
   allocs_.clear();
   allocs_.resize(graph_info_->num_tensors());
+  aliases_.clear();
+  aliases_.resize(graph_info_->num_tensors());
+  plan_is_empty_ = true;
   return kTfLiteOk;
 }
 
+void ArenaPlanner::SetArenaAllocator(ArenaAllocator* allocator) {
+  arena_.SetAllocator(allocator);
+  persistent_arena_.SetAllocator(allocator);
+}
+
+void ArenaPlanner::SetPlanCacheCapacity(int capacity) {
+  plan_cache_capacity_ = std::max(capacity, 0);
+  while (plan_cache_.size() > static_cast<size_t>(plan_cache_capacity_)) {
+    plan_cache_.pop_back();
+  }
+}
+
 TfLiteStatus ArenaPlanner::ResetAllocationsAfter(int node) {
   for (int i = 0; i < static_cast<int>(allocs_.size()); ++i) {
     if (allocs_[i].first_node > node && allocs_[i].size > 0) {
@@ -219,7 +252,22 @@ TfLiteStatus ArenaPlanner::ExecuteAllocations(int first_node, int last_node) {
     }
   }
 
-  TF_LITE_ENSURE_STATUS(CalculateAllocations(first_node, last_node));
+  PlanAliases(first_node, last_node);
+  // Only a plan made from scratch can be cached: an incremental one also
+  // depends on what was allocated before.
+  std::vector<int64_t> signature;
+  bool restored = false;
+  if (plan_cache_capacity_ > 0 && plan_is_empty_) {
+    signature = PlanSignature(first_node, last_node);
+    TF_LITE_ENSURE_STATUS(RestoreCachedPlan(signature, &restored));
+  }
+  if (!restored) {
+    TF_LITE_ENSURE_STATUS(CalculateAllocations(first_node, last_node));
+    if (!signature.empty()) {
+      CachePlan(std::move(signature), first_node, last_node);
+    }
+  }
+  plan_is_empty_ = false;
   TF_LITE_ENSURE_STATUS(Commit());
 
   for (int i = 0; i < static_cast<int>(graph_info_->num_tensors()); ++i) {
@@ -232,6 +280,218 @@ TfLiteStatus ArenaPlanner::ExecuteAllocations(int first_node, int last_node) {
   return kTfLiteOk;
 }
 
+void ArenaPlanner::PlanAliases(int first_node, int last_node) {
+  const int num_tensors = graph_info_->num_tensors();
+  aliases_.resize(num_tensors);
+  // Re-plan the aliases of the nodes being (re)allocated. Aliases whose
+  // slice tensor was allocated by an earlier call are kept as they are, since
+  // that tensor would not get arena memory in this round.
+  for (int i = 0; i < num_tensors; ++i) {
+    const TensorAlias& alias = aliases_[i];
+    if (alias.parent != -1 && alias.node >= first_node &&
+        alias.node <= last_node && alloc_node_[i] >= first_node) {
+      aliases_[i] = TensorAlias();
+    }
+  }
+
+  // Graph outputs count as an extra reader so they never become a view.
+  std::vector<int> num_readers(num_tensors, 0);
+  for (size_t i = 0; i < graph_info_->num_execution_nodes(); ++i) {
+    const TfLiteIntArray* node_inputs = graph_info_->node(i).inputs;
+    for (int j = 0; j < node_inputs->size; ++j) {
+      if (node_inputs->data[j] != kTfLiteOptionalTensor) {
+        ++num_readers[node_inputs->data[j]];
+      }
+    }
+  }
+  for (int tensor_index : graph_info_->outputs()) {
+    ++num_readers[tensor_index];
+  }
+
+  for (size_t i = first_node; i <= static_cast<size_t>(last_node) &&
+                              i < graph_info_->num_execution_nodes();
+       ++i) {
+    const TfLiteRegistration* registration = graph_info_->registration(i);
+    if (registration == nullptr) continue;
+    if (registration->builtin_code == kTfLiteBuiltinConcatenation) {
+      TryAliasConcatenation(i, first_node, num_readers);
+    } else if (registration->builtin_code == kTfLiteBuiltinSplit) {
+      TryAliasSplit(i, first_node);
+    }
+  }
+}
+
+bool ArenaPlanner::IsAliasable(int tensor_index) const {
+  if (tensor_index == kTfLiteOptionalTensor || tensor_index < 0 ||
+      tensor_index >= static_cast<int>(aliases_.size())) {
+    return false;
+  }
+  const TfLiteTensor& tensor = *graph_info_->tensor(tensor_index);
+  return tensor.allocation_type == kTfLiteArenaRw && tensor.dims != nullptr &&
+         tensor.bytes > 0 && aliases_[tensor_index].parent == -1;
+}
+
+bool ArenaPlanner::IsConcatenationSlice(int tensor_index, int first_node,
+                                        const std::vector<int>& num_readers,
+                                        const TfLiteTensor& output) const {
+  if (!IsAliasable(tensor_index) || num_readers[tensor_index] != 1 ||
+      alloc_node_[tensor_index] == kNodeNotAssigned ||
+      alloc_node_[tensor_index] < first_node) {
+    return false;
+  }
+  if (std::find(graph_info_->inputs().begin(), graph_info_->inputs().end(),
+                tensor_index) != graph_info_->inputs().end() ||
+      std::find(graph_info_->variables().begin(),
+                graph_info_->variables().end(),
+                tensor_index) != graph_info_->variables().end()) {
+    return false;
+  }
+  return SameTypeAndQuantization(*graph_info_->tensor(tensor_index), output);
+}
+
+bool ArenaPlanner::TryAliasConcatenation(int node_index, int first_node,
+                                         const std::vector<int>& num_readers) {
+  const TfLiteNode& node = graph_info_->node(node_index);
+  const auto* params =
+      reinterpret_cast<const TfLiteConcatenationParams*>(node.builtin_data);
+  if (params == nullptr || params->activation != kTfLiteActNone ||
+      node.inputs->size < 2 || node.outputs->size != 1) {
+    return false;
+  }
+  const int output_index = node.outputs->data[0];
+  if (!IsAliasable(output_index)) return false;
+  const TfLiteTensor& output = *graph_info_->tensor(output_index);
+  int axis = params->axis;
+  if (axis < 0) axis += output.dims->size;
+  if (axis < 0 || axis >= output.dims->size) return false;
+  if (OuterSize(output.dims, axis) != 1) {
+    return axis == output.dims->size - 1 &&
+           TryAliasChannelConcatenation(node_index, first_node, num_readers);
+  }
+
+  // Every input must be an intermediate that only this concat reads, so it
+  // can be produced straight into its slot of the output.
+  size_t total_bytes = 0;
+  for (int i = 0; i < node.inputs->size; ++i) {
+    const int input_index = node.inputs->data[i];
+    if (!IsConcatenationSlice(input_index, first_node, num_readers, output)) {
+      return false;
+    }
+    total_bytes += graph_info_->tensor(input_index)->bytes;
+  }
+  if (total_bytes != output.bytes) return false;
+
+  size_t offset = 0;
+  for (int i = 0; i < node.inputs->size; ++i) {
+    const int input_index = node.inputs->data[i];
+    aliases_[input_index].parent = output_index;
+    aliases_[input_index].offset = offset;
+    aliases_[input_index].node = node_index;
+    offset += graph_info_->tensor(input_index)->bytes;
+    // The output has to exist as soon as its first slice is produced.
+    alloc_node_[output_index] =
+        std::min(alloc_node_[output_index], alloc_node_[input_index]);
+  }
+  return true;
+}
+
+bool ArenaPlanner::TryAliasChannelConcatenation(
+    int node_index, int first_node, const std::vector<int>& num_readers) {
+  const TfLiteNode& node = graph_info_->node(node_index);
+  const int output_index = node.outputs->data[0];
+  const TfLiteTensor& output = *graph_info_->tensor(output_index);
+  const int axis = output.dims->size - 1;
+  const int output_channels = output.dims->data[axis];
+  const size_t rows = OuterSize(output.dims, axis);
+  if (output_channels <= 0 || rows == 0 ||
+      output.bytes % (rows * output_channels) != 0) {
+    return false;
+  }
+  const size_t element_size = output.bytes / (rows * output_channels);
+
+  // The slices must tile the output channels exactly.
+  int total_channels = 0;
+  for (int i = 0; i < node.inputs->size; ++i) {
+    const TfLiteTensor* input = graph_info_->tensor(node.inputs->data[i]);
+    if (input->dims == nullptr || input->dims->size != output.dims->size ||
+        input->bytes != rows * input->dims->data[axis] * element_size) {
+      return false;
+    }
+    total_channels += input->dims->data[axis];
+  }
+  if (total_channels != output_channels) return false;
+
+  bool aliased = false;
+  int channel_offset = 0;
+  for (int i = 0; i < node.inputs->size; ++i) {
+    const int input_index = node.inputs->data[i];
+    const int producer = alloc_node_[input_index];
+    const int channels = graph_info_->tensor(input_index)->dims->data[axis];
+    if (IsConcatenationSlice(input_index, first_node, num_readers, output) &&
+        graph_info_->node(producer).outputs->data[0] == input_index &&
+        graph_info_->SupportsStridedOutput(producer)) {
+      aliases_[input_index].parent = output_index;
+      aliases_[input_index].offset = channel_offset * element_size;
+      aliases_[input_index].node = node_index;
+      aliases_[input_index].row_stride = output_channels;
+      alloc_node_[output_index] = std::min(alloc_node_[output_index], producer);
+      aliased = true;
+    }
+    channel_offset += channels;
+  }
+  return aliased;
+}
+
+bool ArenaPlanner::TryAliasSplit(int node_index, int first_node) {
+  const TfLiteNode& node = graph_info_->node(node_index);
+  if (node.inputs->size != 2 || node.outputs->size < 1) return false;
+  // Split's inputs are (axis, value). The axis has to be known now.
+  const TfLiteTensor& axis_tensor = *graph_info_->tensor(node.inputs->data[0]);
+  if (axis_tensor.allocation_type != kTfLiteMmapRo ||
+      axis_tensor.type != kTfLiteInt32 || axis_tensor.data.raw == nullptr) {
+    return false;
+  }
+  const int input_index = node.inputs->data[1];
+  if (!IsAliasable(input_index) || alloc_node_[input_index] < first_node) {
+    return false;
+  }
+  const TfLiteTensor& input = *graph_info_->tensor(input_index);
+  int axis = axis_tensor.data.i32[0];
+  if (axis < 0) axis += input.dims->size;
+  if (axis < 0 || axis >= input.dims->size ||
+      OuterSize(input.dims, axis) != 1) {
+    return false;
+  }
+
+  // Outputs that are never released (graph outputs, unused outputs) would
+  // pin the input forever; leave those splits alone.
+  size_t total_bytes = 0;
+  for (int i = 0; i < node.outputs->size; ++i) {
+    const int output_index = node.outputs->data[i];
+    if (!IsAliasable(output_index) ||
+        dealloc_node_[output_index] == kNodeNotAssigned) {
+      return false;
+    }
+    const TfLiteTensor& output = *graph_info_->tensor(output_index);
+    if (!SameTypeAndQuantization(output, input)) return false;
+    total_bytes += output.bytes;
+  }
+  if (total_bytes != input.bytes) return false;
+
+  size_t offset = 0;
+  for (int i = 0; i < node.outputs->size; ++i) {
+    const int output_index = node.outputs->data[i];
+    aliases_[output_index].parent = input_index;
+    aliases_[output_index].offset = offset;
+    aliases_[output_index].node = node_index;
+    offset += graph_info_->tensor(output_index)->bytes;
+    // The input has to outlive every slice.
+    dealloc_node_[input_index] =
+        std::max(dealloc_node_[input_index], dealloc_node_[output_index]);
+  }
+  return true;
+}
+
 TfLiteStatus ArenaPlanner::ReleaseNonPersistentMemory() {
   // Clear non-persistent arena's buffer.
   TF_LITE_ENSURE_STATUS(arena_.ReleaseBuffer());
@@ -262,6 +522,10 @@ bool ArenaPlanner::HasNonPersistentMemory() {
   return arena_.GetBufferSize() != 0;
 }
 
+size_t ArenaPlanner::GetNonPersistentMemorySize() {
+  return arena_.GetBufferSize();
+}
+
 TfLiteStatus ArenaPlanner::Commit() {
   TF_LITE_ENSURE_STATUS(arena_.Commit(context_));
   TF_LITE_ENSURE_STATUS(persistent_arena_.Commit(context_));
@@ -324,12 +588,15 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(int first_node, int last_node) {
     if (tensor.allocation_type == kTfLiteArenaRw &&
         allocs_[tensor_index].size != 0) {
       TF_LITE_ENSURE_STATUS(arena_.Deallocate(context_, allocs_[tensor_index]));
+      allocs_[tensor_index].reset();
     }
   }
 
   // Vector of ids of already allocated tensors, ordered by offset.
   for (const auto& tensor_index : tensor_order) {
     TfLiteTensor& tensor = *graph_info_->tensor(tensor_index);
+    // Views live inside their parent's allocation.
+    if (aliases_[tensor_index].parent != -1) continue;
     if (tensor.allocation_type == kTfLiteArenaRw) {
       // std::cout << "All/ocates tensor " << tensor_index << "\n";
       TF_LITE_ENSURE_STATUS(
@@ -350,8 +617,90 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(int first_node, int last_node) {
   return kTfLiteOk;
 }
 
+std::vector<int64_t> ArenaPlanner::PlanSignature(int first_node,
+                                                 int last_node) const {
+  const int num_tensors = graph_info_->num_tensors();
+  std::vector<int64_t> signature = {first_node, last_node, num_tensors};
+  for (int i = 0; i < num_tensors; ++i) {
+    if (alloc_node_[i] < first_node || alloc_node_[i] > last_node) continue;
+    const TfLiteTensor& tensor = *graph_info_->tensor(i);
+    signature.push_back(i);
+    signature.push_back(tensor.allocation_type);
+    signature.push_back(tensor.bytes);
+    signature.push_back(alloc_node_[i]);
+    signature.push_back(dealloc_node_[i]);
+    signature.push_back(aliases_[i].parent);
+  }
+  return signature;
+}
+
+TfLiteStatus ArenaPlanner::RestoreCachedPlan(
+    const std::vector<int64_t>& signature, bool* restored) {
+  *restored = false;
+  auto it = std::find_if(plan_cache_.begin(), plan_cache_.end(),
+                         [&signature](const CachedPlan& plan) {
+                           return plan.signature == signature;
+                         });
+  if (it == plan_cache_.end()) return kTfLiteOk;
+  if (it != plan_cache_.begin()) {
+    CachedPlan plan = std::move(*it);
+    plan_cache_.erase(it);
+    plan_cache_.push_front(std::move(plan));
+  }
+  const CachedPlan& plan = plan_cache_.front();
+  for (const ArenaAllocWithUsageInterval& alloc : plan.allocs) {
+    allocs_[alloc.tensor] = alloc;
+    TF_LITE_ENSURE_STATUS(arena_.RestoreAlloc(context_, alloc));
+  }
+  for (const ArenaAllocWithUsageInterval& alloc : plan.persistent_allocs) {
+    allocs_[alloc.tensor] = alloc;
+    TF_LITE_ENSURE_STATUS(persistent_arena_.RestoreAlloc(context_, alloc));
+  }
+  ++plan_cache_hits_;
+  *restored = true;
+  return kTfLiteOk;
+}
+
+void ArenaPlanner::CachePlan(std::vector<int64_t> signature, int first_node,
+                             int last_node) {
+  CachedPlan plan;
+  plan.signature = std::move(signature);
+  for (int i = 0; i < static_cast<int>(graph_info_->num_tensors()); ++i) {
+    if (alloc_node_[i] < first_node || alloc_node_[i] > last_node) continue;
+    if (allocs_[i].tensor != i) continue;
+    const TfLiteTensor& tensor = *graph_info_->tensor(i);
+    if (tensor.allocation_type == kTfLiteArenaRw) {
+      plan.allocs.push_back(allocs_[i]);
+    } else if (tensor.allocation_type == kTfLiteArenaRwPersistent) {
+      plan.persistent_allocs.push_back(allocs_[i]);
+    }
+  }
+  plan_cache_.push_front(std::move(plan));
+  if (plan_cache_.size() > static_cast<size_t>(plan_cache_capacity_)) {
+    plan_cache_.pop_back();
+  }
+}
+
+int32_t ArenaPlanner::TensorRowStride(int tensor_index) const {
+  if (tensor_index < 0 || tensor_index >= static_cast<int>(aliases_.size()) ||
+      aliases_[tensor_index].parent == -1) {
+    return 0;
+  }
+  return aliases_[tensor_index].row_stride;
+}
+
 TfLiteStatus ArenaPlanner::ResolveTensorAllocation(int tensor_index) {
   TfLiteTensor& tensor = *graph_info_->tensor(tensor_index);
+  if (tensor.allocation_type == kTfLiteArenaRw &&
+      tensor_index < static_cast<int>(aliases_.size()) &&
+      aliases_[tensor_index].parent != -1) {
+    const TensorAlias& alias = aliases_[tensor_index];
+    TF_LITE_ENSURE_STATUS(ResolveTensorAllocation(alias.parent));
+    char* parent_data = graph_info_->tensor(alias.parent)->data.raw;
+    tensor.data.raw =
+        parent_data == nullptr ? nullptr : parent_data + alias.offset;
+    return kTfLiteOk;
+  }
   if (tensor.allocation_type == kTfLiteArenaRw) {
     // Skip resolution if the size of the tensor is zero, leaving it as a
     // nullptr.
@@ -16,9 +16,11 @@ limitations under the License.
 #define TENSORFLOW_LITE_ARENA_PLANNER_H_
 
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <vector>
 
+#include "tensorflow/lite/arena_allocator.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/graph_info.h"
 #include "tensorflow/lite/memory_planner.h"
@@ -43,6 +45,17 @@ struct AllocationInfo;
 // execution. Since dynamic tensors don't have sizes until after the
 // corresponding operation is executed, this class supports incremental
 // planning.
+//
+// CONCATENATION and SPLIT nodes whose tensors are contiguous slices of each
+// other (every dimension before the axis is 1) are planned in place: the
+// inputs of such a concat become views into its output, and the outputs of
+// such a split become views into its input. The kernels notice this and skip
+// the copy.
+//
+// Optionally the planner remembers complete plans (SetPlanCacheCapacity), so
+// going back to a tensor shape it has planned before, e.g. when an input
+// alternates between a few batch sizes or resolutions, restores the offsets
+// instead of recomputing them.
 class ArenaPlanner : public MemoryPlanner {
  public:
   // Ownership of 'context' is not taken and it must remain util the
@@ -63,10 +76,32 @@ class ArenaPlanner : public MemoryPlanner {
   TfLiteStatus ReleaseNonPersistentMemory() override;
   TfLiteStatus AcquireNonPersistentMemory() override;
   bool HasNonPersistentMemory() override;
+  size_t GetNonPersistentMemorySize() override;
 
   // Returns the base arena location for a given allocation type.
   std::intptr_t BasePointer(TfLiteAllocationType type);
 
+  // Keeps up to 'capacity' complete plans, least recently used dropped first.
+  // A plan is reused when the graph is planned from scratch (the first
+  // ExecuteAllocations() after ResetAllocations()) and every tensor has the
+  // same size, lifetime and allocation type as when the plan was made.
+  // 0 (the default) disables the cache.
+  void SetPlanCacheCapacity(int capacity);
+
+  // Elements between the starts of two consecutive innermost rows if the
+  // tensor is planned as a strided view into a larger tensor, e.g. one input's
+  // channels inside an NHWC CONCATENATION output; 0 for a dense tensor. Only
+  // nodes that can write such an output (GraphInfo::SupportsStridedOutput)
+  // are given one.
+  int32_t TensorRowStride(int tensor_index) const;
+
+  // Number of ExecuteAllocations() calls answered from the plan cache.
+  int plan_cache_hits() const { return plan_cache_hits_; }
+
+  // Allocator of the buffers of both arenas (activations and persistent
+  // tensors), see SimpleMemoryArena::SetAllocator.
+  void SetArenaAllocator(ArenaAllocator* allocator);
+
  private:
   // Make sure all the arenas have reserved enough memory to store all their
   // tensors.
@@ -86,6 +121,18 @@ class ArenaPlanner : public MemoryPlanner {
   // for all tensors affected by ops in the interval [first_node, last_node].
   TfLiteStatus CalculateAllocations(int first_node, int last_node);
 
+  // Describes everything CalculateAllocations(first_node, last_node) depends
+  // on when nothing is allocated yet.
+  std::vector<int64_t> PlanSignature(int first_node, int last_node) const;
+
+  // Restores the plan cached under 'signature', if any. Sets 'restored'.
+  TfLiteStatus RestoreCachedPlan(const std::vector<int64_t>& signature,
+                                 bool* restored);
+
+  // Caches the allocations just calculated for [first_node, last_node].
+  void CachePlan(std::vector<int64_t> signature, int first_node,
+                 int last_node);
+
   // Assign absolute memory location to a tensor, based on its relative
   // position inside the corresponding arena buffer.
   TfLiteStatus ResolveTensorAllocation(int tensor_index);
@@ -98,6 +145,28 @@ class ArenaPlanner : public MemoryPlanner {
   // 'node_index'.
   TfLiteStatus CalculateDeallocationOfInternalTensors(int node_index);
 
+  // Finds CONCATENATION / SPLIT nodes in [first_node, last_node] that can run
+  // in place and turns their slice tensors into aliases of the whole tensor.
+  void PlanAliases(int first_node, int last_node);
+  bool TryAliasConcatenation(int node_index, int first_node,
+                             const std::vector<int>& num_readers);
+  // Concatenation on the innermost axis with more than one row (e.g. channels
+  // in NHWC): the slices interleave, so only inputs whose producer can write
+  // a strided output become (strided) views; the kernel copies the others.
+  bool TryAliasChannelConcatenation(int node_index, int first_node,
+                                    const std::vector<int>& num_readers);
+  bool TryAliasSplit(int node_index, int first_node);
+
+  // True if 'tensor_index' is an intermediate that only the concatenation
+  // with output 'output' reads, so it could be produced straight into it.
+  bool IsConcatenationSlice(int tensor_index, int first_node,
+                            const std::vector<int>& num_readers,
+                            const TfLiteTensor& output) const;
+
+  // True if tensor 'tensor_index' is an arena tensor that may become (or
+  // own) an alias.
+  bool IsAliasable(int tensor_index) const;
+
   TfLiteContext* context_;
   std::unique_ptr<GraphInfo> graph_info_;
 
@@ -112,6 +181,19 @@ class ArenaPlanner : public MemoryPlanner {
   // the node's operation.
   std::vector<int32_t> dealloc_node_;
 
+  // A tensor planned as a view into (part of) another tensor's memory.
+  struct TensorAlias {
+    // Tensor owning the memory, -1 if the tensor is not an alias.
+    int32_t parent = -1;
+    // Byte offset of the view inside the parent.
+    size_t offset = 0;
+    // Concat / split node that created the alias.
+    int32_t node = -1;
+    // Elements between rows of a strided view, 0 if the view is dense.
+    int32_t row_stride = 0;
+  };
+  std::vector<TensorAlias> aliases_;
+
   // Raw memory buffer that is allocated for all temporary and graph outputs
   // that are declared kTfLiteArenaRw.
   SimpleMemoryArena arena_;
@@ -131,6 +213,20 @@ class ArenaPlanner : public MemoryPlanner {
 
   // Number of bytes that tensor buffers should be aligned to.
   int tensor_alignment_;
+
+  // Allocations of one complete plan.
+  struct CachedPlan {
+    std::vector<int64_t> signature;
+    std::vector<ArenaAllocWithUsageInterval> allocs;
+    std::vector<ArenaAllocWithUsageInterval> persistent_allocs;
+  };
+  // Most recently used first.
+  std::deque<CachedPlan> plan_cache_;
+  int plan_cache_capacity_ = 0;
+  int plan_cache_hits_ = 0;
+
+  // True until the first ExecuteAllocations() after ResetAllocations().
+  bool plan_is_empty_ = true;
 };
 
 }  // namespace tflite
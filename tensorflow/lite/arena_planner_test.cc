@@ -16,10 +16,14 @@ limitations under the License.
 
 #include <cstdarg>
 #include <cstdint>
+#include <map>
+#include <set>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/testing/util.h"
 
 namespace tflite {
@@ -97,6 +101,9 @@ class TestGraph {
       TfLiteIntArrayFree(node.outputs);
       TfLiteIntArrayFree(node.temporaries);
     }
+    for (auto& tensor : tensors_) {
+      if (tensor.dims) TfLiteIntArrayFree(tensor.dims);
+    }
   }
 
   const std::vector<TfLiteNode>& nodes() { return nodes_; }
@@ -109,15 +116,55 @@ class TestGraph {
     variables_ = variables;
   }
 
+  // Gives a tensor a float shape (and the matching size).
+  void SetShape(int tensor_index, std::initializer_list<int> shape) {
+    TfLiteTensor& tensor = tensors_[tensor_index];
+    if (tensor.dims) TfLiteIntArrayFree(tensor.dims);
+    tensor.dims = TfLiteIntArrayCreate(shape.size());
+    int num_elements = 1;
+    int i = 0;
+    for (int dim : shape) {
+      tensor.dims->data[i++] = dim;
+      num_elements *= dim;
+    }
+    tensor.type = kTfLiteFloat32;
+    tensor.bytes = num_elements * sizeof(float);
+  }
+
+  // Makes a node look like the given builtin op to the planner.
+  void SetBuiltin(int node_index, int builtin_code, void* builtin_data) {
+    registrations_[node_index] = TfLiteRegistration();
+    registrations_[node_index].builtin_code = builtin_code;
+    nodes_[node_index].builtin_data = builtin_data;
+  }
+
+  const TfLiteRegistration* registration(int node_index) const {
+    auto it = registrations_.find(node_index);
+    return it == registrations_.end() ? nullptr : &it->second;
+  }
+
+  // Marks a node as able to write its output as a strided view.
+  void SetSupportsStridedOutput(int node_index) {
+    strided_output_nodes_.insert(node_index);
+  }
+
+  bool SupportsStridedOutput(int node_index) const {
+    return strided_output_nodes_.count(node_index) != 0;
+  }
+
   void Swap(TestGraph* other) {
     std::swap(nodes_, other->nodes_);
     std::swap(tensors_, other->tensors_);
     std::swap(inputs_, other->inputs_);
     std::swap(outputs_, other->outputs_);
     std::swap(variables_, other->variables_);
+    std::swap(registrations_, other->registrations_);
+    std::swap(strided_output_nodes_, other->strided_output_nodes_);
   }
 
  private:
+  std::map<int, TfLiteRegistration> registrations_;
+  std::set<int> strided_output_nodes_;
   std::vector<TfLiteNode> nodes_;
   std::vector<TfLiteTensor> tensors_;
   std::vector<int> inputs_;
@@ -145,6 +192,12 @@ class TestGraphInfo : public GraphInfo {
   const std::vector<int>& variables() const override {
     return graph_->variables();
   }
+  const TfLiteRegistration* registration(size_t index) const override {
+    return graph_->registration(index);
+  }
+  bool SupportsStridedOutput(size_t index) const override {
+    return graph_->SupportsStridedOutput(index);
+  }
 
  private:
   TestGraph* graph_;
@@ -745,6 +798,205 @@ TEST_F(ArenaPlannerTest, GraphWithIntermediates) {
   EXPECT_EQ(GetOffset(2), GetOffsetAfter(5));
 }
 
+TEST_F(ArenaPlannerTest, ConcatenationInputsAreOutputSlices) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}},     // First slice
+                      {{0}, {2}, {}},     // Second slice
+                      {{1, 2}, {3}, {}},  // Concatenation
+                      {{3}, {4}, {}},     // Consumer
+                  },
+                  {4});
+  graph.SetShape(1, {1, 2, 4, 3});
+  graph.SetShape(2, {1, 3, 4, 3});
+  graph.SetShape(3, {1, 5, 4, 3});
+  TfLiteConcatenationParams params = {/*axis=*/1, kTfLiteActNone};
+  graph.SetBuiltin(2, kTfLiteBuiltinConcatenation, &params);
+  SetGraph(&graph);
+  Execute(0, 10);
+
+  EXPECT_EQ(GetOffset(1), GetOffset(3));
+  EXPECT_EQ(GetOffset(2), GetOffset(3) + (*graph.tensors())[1].bytes);
+  // The consumer's output must not overlap the concatenated tensor.
+  EXPECT_TRUE(GetOffset(4) >= GetOffsetAfter(3) ||
+              GetOffsetAfter(4) <= GetOffset(3));
+}
+
+TEST_F(ArenaPlannerTest, ChannelConcatenationIsNotAliased) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}},     // First slice
+                      {{0}, {2}, {}},     // Second slice
+                      {{1, 2}, {3}, {}},  // Concatenation
+                      {{3}, {4}, {}},     // Consumer
+                  },
+                  {4});
+  graph.SetShape(1, {1, 4, 4, 2});
+  graph.SetShape(2, {1, 4, 4, 3});
+  graph.SetShape(3, {1, 4, 4, 5});
+  // Channel slices interleave in NHWC and neither producer can write a
+  // strided output, so they can not be views.
+  TfLiteConcatenationParams params = {/*axis=*/3, kTfLiteActNone};
+  graph.SetBuiltin(2, kTfLiteBuiltinConcatenation, &params);
+  SetGraph(&graph);
+  Execute(0, 10);
+
+  EXPECT_NE(GetOffset(1), GetOffset(3));
+  EXPECT_NE(GetOffset(2), GetOffset(3));
+}
+
+TEST_F(ArenaPlannerTest, ChannelConcatenationInputsAreStridedViews) {
+  // A YOLO style CSP block: two convs concatenated on NHWC channels.
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}},     // First conv
+                      {{0}, {2}, {}},     // Second conv
+                      {{1, 2}, {3}, {}},  // Concatenation
+                      {{3}, {4}, {}},     // Consumer
+                  },
+                  {4});
+  graph.SetShape(1, {1, 4, 4, 2});
+  graph.SetShape(2, {1, 4, 4, 3});
+  graph.SetShape(3, {1, 4, 4, 5});
+  graph.SetSupportsStridedOutput(0);
+  graph.SetSupportsStridedOutput(1);
+  TfLiteConcatenationParams params = {/*axis=*/-1, kTfLiteActNone};
+  graph.SetBuiltin(2, kTfLiteBuiltinConcatenation, &params);
+  SetGraph(&graph);
+  Execute(0, 10);
+
+  EXPECT_EQ(GetOffset(1), GetOffset(3));
+  EXPECT_EQ(GetOffset(2), GetOffset(3) + 2 * sizeof(float));
+  EXPECT_EQ(planner_->TensorRowStride(1), 5);
+  EXPECT_EQ(planner_->TensorRowStride(2), 5);
+  EXPECT_EQ(planner_->TensorRowStride(3), 0);
+  EXPECT_TRUE(GetOffset(4) >= GetOffsetAfter(3) ||
+              GetOffsetAfter(4) <= GetOffset(3));
+}
+
+TEST_F(ArenaPlannerTest, ChannelConcatenationAliasesOnlyStridedProducers) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}},     // Conv
+                      {{0}, {2}, {}},     // Op with a dense output only
+                      {{1, 2}, {3}, {}},  // Concatenation
+                      {{3}, {4}, {}},     // Consumer
+                  },
+                  {4});
+  graph.SetShape(1, {1, 4, 4, 2});
+  graph.SetShape(2, {1, 4, 4, 3});
+  graph.SetShape(3, {1, 4, 4, 5});
+  graph.SetSupportsStridedOutput(0);
+  TfLiteConcatenationParams params = {/*axis=*/3, kTfLiteActNone};
+  graph.SetBuiltin(2, kTfLiteBuiltinConcatenation, &params);
+  SetGraph(&graph);
+  Execute(0, 10);
+
+  EXPECT_EQ(GetOffset(1), GetOffset(3));
+  EXPECT_EQ(planner_->TensorRowStride(1), 5);
+  // The dense input is copied by the kernel, so it needs its own memory.
+  EXPECT_EQ(planner_->TensorRowStride(2), 0);
+  EXPECT_TRUE(GetOffset(2) >= GetOffsetAfter(3) ||
+              GetOffsetAfter(2) <= GetOffset(3));
+}
+
+TEST_F(ArenaPlannerTest, SplitOutputsAreInputSlices) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}},        // Producer
+                      {{5, 1}, {2, 3}, {}},  // Split
+                      {{2}, {4}, {}},        // First slice consumer
+                      {{3}, {6}, {}},        // Second slice consumer
+                  },
+                  {4, 6});
+  graph.SetShape(1, {1, 6, 4, 3});
+  graph.SetShape(2, {1, 3, 4, 3});
+  graph.SetShape(3, {1, 3, 4, 3});
+  int32_t axis = 1;
+  TfLiteTensor& axis_tensor = (*graph.tensors())[5];
+  axis_tensor.allocation_type = kTfLiteMmapRo;
+  axis_tensor.type = kTfLiteInt32;
+  axis_tensor.data.i32 = &axis;
+  axis_tensor.bytes = sizeof(axis);
+  TfLiteSplitParams params = {/*num_splits=*/2};
+  graph.SetBuiltin(1, kTfLiteBuiltinSplit, &params);
+  SetGraph(&graph);
+  Execute(0, 10);
+
+  EXPECT_EQ(GetOffset(2), GetOffset(1));
+  EXPECT_EQ(GetOffset(3), GetOffset(1) + (*graph.tensors())[2].bytes);
+  // The split input stays alive until its last slice has been consumed.
+  EXPECT_TRUE(GetOffset(4) >= GetOffsetAfter(1) ||
+              GetOffsetAfter(4) <= GetOffset(1));
+  EXPECT_TRUE(GetOffset(6) >= GetOffsetAfter(1) ||
+              GetOffsetAfter(6) <= GetOffset(1));
+}
+
+TEST_F(ArenaPlannerTest, PlanCacheRestoresPreviousShape) {
+  TestGraph graph({0, 1},
+                  {
+                      /* in, out, tmp */
+                      {{0, 1}, {2}, {}},     // First op
+                      {{2, 0}, {4, 5}, {}},  // Second op
+                      {{4, 5}, {3}, {6}}     // Third op
+                  },
+                  {3});
+  (*graph.tensors())[6].allocation_type = kTfLiteArenaRwPersistent;
+  SetGraph(&graph);
+  planner_->SetPlanCacheCapacity(2);
+  Execute(0, 10);
+  std::vector<std::ptrdiff_t> offsets;
+  for (int i = 0; i < 7; ++i) offsets.push_back(GetOffset(i));
+  EXPECT_EQ(planner_->plan_cache_hits(), 0);
+
+  // Another shape is planned from scratch.
+  TfLiteTensor& resized = (*graph.tensors())[2];
+  const size_t bytes = resized.bytes;
+  resized.bytes = bytes * 4;
+  ASSERT_EQ(planner_->ResetAllocations(), kTfLiteOk);
+  Execute(0, 10);
+  EXPECT_EQ(planner_->plan_cache_hits(), 0);
+
+  // Going back restores the first plan.
+  resized.bytes = bytes;
+  ASSERT_EQ(planner_->ResetAllocations(), kTfLiteOk);
+  Execute(0, 10);
+  EXPECT_EQ(planner_->plan_cache_hits(), 1);
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(GetOffset(i), offsets[i]) << "tensor " << i;
+  }
+
+  // An incremental plan is not looked up.
+  ASSERT_EQ(planner_->ResetAllocations(), kTfLiteOk);
+  Execute(0, 0);
+  Execute(1, 10);
+  EXPECT_EQ(planner_->plan_cache_hits(), 1);
+}
+
+TEST_F(ArenaPlannerTest, PlanCacheEvictsLeastRecentlyUsed) {
+  TestGraph graph({0}, {{{0}, {1}, {}}, {{1}, {2}, {}}}, {2});
+  SetGraph(&graph);
+  planner_->SetPlanCacheCapacity(1);
+  TfLiteTensor& resized = (*graph.tensors())[1];
+  const size_t bytes = resized.bytes;
+  Execute(0, 10);
+  resized.bytes = bytes * 2;
+  ASSERT_EQ(planner_->ResetAllocations(), kTfLiteOk);
+  Execute(0, 10);
+  resized.bytes = bytes;
+  ASSERT_EQ(planner_->ResetAllocations(), kTfLiteOk);
+  Execute(0, 10);
+  EXPECT_EQ(planner_->plan_cache_hits(), 0);
+  ASSERT_EQ(planner_->ResetAllocations(), kTfLiteOk);
+  Execute(0, 10);
+  EXPECT_EQ(planner_->plan_cache_hits(), 1);
+}
+
 }  // namespace
 }  // namespace tflite
 
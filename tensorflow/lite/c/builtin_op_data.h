@@ -73,6 +73,11 @@ typedef enum {
   kTfLiteActTanh,
   kTfLiteActSignBit,
   kTfLiteActSigmoid,
+  // Not part of the schema. Only set by the interpreter builder when it folds
+  // a following LEAKY_RELU / HARD_SWISH node into a float conv (see
+  // InterpreterBuilder::SetActivationFusion).
+  kTfLiteActLeakyRelu,  // x > 0 ? x : x * alpha
+  kTfLiteActHardSwish,  // x * relu6(x + 3) / 6
 } TfLiteFusedActivation;
 
 typedef struct {
@@ -86,6 +91,9 @@ typedef struct {
   // Note: Version 2 supports dilation values not equal to 1.
   int dilation_width_factor;
   int dilation_height_factor;
+
+  // Alpha of a folded LEAKY_RELU (activation == kTfLiteActLeakyRelu).
+  float leaky_relu_alpha;
 } TfLiteConvParams;
 
 typedef struct {
@@ -120,6 +128,9 @@ typedef struct {
   // Parameters for DepthwiseConv version 2 or above.
   int dilation_width_factor;
   int dilation_height_factor;
+
+  // Alpha of a folded LEAKY_RELU (activation == kTfLiteActLeakyRelu).
+  float leaky_relu_alpha;
 } TfLiteDepthwiseConvParams;
 
 typedef struct {
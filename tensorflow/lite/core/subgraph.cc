@@ -33,7 +33,6 @@ limitations under the License.
 #include <cmath>
 #include "thread"
 // #include "tensorflow/lite/kmdebug.h"
-// #include "tensorflow/lite/kmcontext.h"
 #include <fstream> //HOON. for YOLO parsing
 #include "tensorflow/lite/hoon.h"
 //#define debug
@@ -198,6 +197,26 @@ class InterpreterInfo : public GraphInfo {
   const std::vector<int>& variables() const override {
     return subgraph_->variables();
   }
+  const TfLiteRegistration* registration(size_t index) const override {
+    int node_index = subgraph_->execution_plan()[index];
+    return &subgraph_->nodes_and_registration()[node_index].second;
+  }
+  bool SupportsStridedOutput(size_t index) const override {
+    // Only the float CONV_2D kernel honors TensorRowStride(), and not
+    // inside a tiled region, which writes the region output itself.
+    int node_index = subgraph_->execution_plan()[index];
+    const auto& node_and_registration =
+        subgraph_->nodes_and_registration()[node_index];
+    const TfLiteNode& node = node_and_registration.first;
+    if (node_and_registration.second.builtin_code != kTfLiteBuiltinConv2d ||
+        node.delegate != nullptr || node.inputs->size < 2 ||
+        node.outputs->size != 1 || subgraph_->IsInTiledRegion(index)) {
+      return false;
+    }
+    const auto& tensors = subgraph_->tensors();
+    return tensors[node.inputs->data[0]].type == kTfLiteFloat32 &&
+           tensors[node.inputs->data[1]].type == kTfLiteFloat32;
+  }
 
  public:
   Subgraph* subgraph_;
@@ -233,6 +252,7 @@ Subgraph::Subgraph(ErrorReporter* error_reporter,
   // Reserve some space for the tensors to avoid excessive resizing.
   tensors_.reserve(kTensorsReservedCapacity);
   nodes_and_registration().reserve(kTensorsReservedCapacity);
+  kmcontext_.setContext(&context_, &execution_plan_, &nodes_and_registration_);
   // Invalid to call these these except from TfLiteDelegate
   SwitchToKernelContext();
 }
@@ -467,6 +487,14 @@ void Subgraph::SetExternalContext(TfLiteExternalContextType type,
   }
 }
 
+void Subgraph::UseOwnExternalContexts() {
+  if (HasOwnExternalContexts()) return;
+  for (int i = 0; i < kTfLiteMaxExternalContexts; ++i) {
+    own_external_contexts_[i] = external_contexts_[i];
+  }
+  external_contexts_ = own_external_contexts_;
+}
+
 void Subgraph::SetExternalContext(struct TfLiteContext* context,
                                   TfLiteExternalContextType type,
                                   TfLiteExternalContext* ctx) {
@@ -695,6 +723,7 @@ TfLiteStatus Subgraph::AllocateTensors() {
       // of memory-planning change (for eg, ResizeInputTensor), the state would
       // be kStateUninvokable.
       memory_planner_->AcquireNonPersistentMemory();
+      released_idle_ = false;
     }	
     return kTfLiteOk;
   }
@@ -705,6 +734,7 @@ TfLiteStatus Subgraph::AllocateTensors() {
   if (memory_planner_) {
     TF_LITE_ENSURE_STATUS(memory_planner_->ResetAllocations());
   }
+  ResetTiledRegions();
 
   TF_LITE_ENSURE_STATUS(PrepareOpsAndTensors());
 
@@ -715,7 +745,6 @@ TfLiteStatus Subgraph::AllocateTensors() {
   // variable tensors. They should call `ResetVariableTensors` directly
   // instead.
   ResetVariableTensors(); 
-  // KMCONTEXT(); // to use tflite->interpreter->subgraph  main structure ..
   return kTfLiteOk;
 }
 
@@ -905,9 +934,67 @@ TfLiteStatus Subgraph::ReleaseNonPersistentMemory() {
   if (memory_planner_) {
     TF_LITE_ENSURE_STATUS(memory_planner_->ReleaseNonPersistentMemory());
   }
+  released_idle_ = false;
   return kTfLiteOk;
 }
 
+TfLiteStatus Subgraph::ReleaseIdleMemory(int64_t min_idle_us,
+                                         size_t* released_bytes) {
+  if (released_bytes) *released_bytes = 0;
+  std::unique_lock<std::mutex> lock(mtx_memory_, std::try_to_lock);
+  if (!lock.owns_lock()) return kTfLiteOk;  // Invoke() is running.
+  // Pinned by a caller between filling inputs and reading outputs. A pin
+  // taken after this check reacquires the memory before using it.
+  if (memory_pins_ > 0) return kTfLiteOk;
+  if (!memory_planner_ || state_ == kStateUninvokable ||
+      !memory_planner_->HasNonPersistentMemory()) {
+    return kTfLiteOk;
+  }
+  const int64_t idle_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - last_use_)
+          .count();
+  if (idle_us < min_idle_us) return kTfLiteOk;
+
+  const size_t bytes = memory_planner_->GetNonPersistentMemorySize();
+  TF_LITE_ENSURE_STATUS(memory_planner_->ReleaseNonPersistentMemory());
+  released_idle_ = true;
+  released_size_ = bytes;
+  memory_release_stats_.releases++;
+  if (released_bytes) *released_bytes = bytes;
+  return kTfLiteOk;
+}
+
+TfLiteStatus Subgraph::AcquireIdleMemoryLocked() {
+  if (!released_idle_) return kTfLiteOk;
+  const auto start = std::chrono::steady_clock::now();
+  TF_LITE_ENSURE_STATUS(memory_planner_->AcquireNonPersistentMemory());
+  released_idle_ = false;
+  last_use_ = std::chrono::steady_clock::now();
+  memory_release_stats_.reacquires++;
+  memory_release_stats_.reacquire_us +=
+      std::chrono::duration_cast<std::chrono::microseconds>(last_use_ - start)
+          .count();
+  return kTfLiteOk;
+}
+
+TfLiteStatus Subgraph::AcquireNonPersistentMemory() {
+  std::lock_guard<std::mutex> lock(mtx_memory_);
+  last_use_ = std::chrono::steady_clock::now();
+  return AcquireIdleMemoryLocked();
+}
+
+MemoryReleaseStats Subgraph::GetMemoryReleaseStats() {
+  std::lock_guard<std::mutex> lock(mtx_memory_);
+  MemoryReleaseStats stats = memory_release_stats_;
+  if (released_idle_) {
+    stats.released_bytes = released_size_;
+  } else if (memory_planner_) {
+    stats.resident_bytes = memory_planner_->GetNonPersistentMemorySize();
+  }
+  return stats;
+}
+
 TfLiteStatus Subgraph::OpPrepare(const TfLiteRegistration& op_reg,
                                  TfLiteNode* node) {
   if (op_reg.prepare == nullptr) {
@@ -978,10 +1065,13 @@ TfLiteStatus Subgraph::PrepareOpsAndTensors() {
 #endif
   if (!memory_planner_) {
     // std::cout << "Reset Memory Planner" << "\n";
-    memory_planner_.reset(new ArenaPlanner(
+    auto* arena_planner = new ArenaPlanner(
         &context_, std::unique_ptr<GraphInfo>(new InterpreterInfo(this)),
         /*preserve_inputs=*/true, /*preserve_intermediates*/ false,
-        kDefaultTensorAlignment));
+        kDefaultTensorAlignment);
+    arena_planner->SetPlanCacheCapacity(arena_plan_cache_capacity_);
+    arena_planner->SetArenaAllocator(arena_allocator_);
+    memory_planner_.reset(arena_planner);
     memory_planner_->PlanAllocations();
   }
 
@@ -1052,6 +1142,14 @@ TfLiteStatus Subgraph::Invoke(UnitType eType, std::mutex& mtx_lock,
   //  ReportError("Got NULLPTR for qSharedData!");
   //  return kTfLiteError;
   //}
+  // Serializes with ReleaseIdleMemory(); the idle timer restarts when this
+  // invoke returns (the guard goes out of scope before the lock).
+  std::unique_lock<std::mutex> memory_lock(mtx_memory_);
+  struct IdleTimerRestart {
+    std::chrono::steady_clock::time_point* last_use;
+    ~IdleTimerRestart() { *last_use = std::chrono::steady_clock::now(); }
+  } idle_timer_restart{&last_use_};
+
   //Minsung
   //Code for DetailedTimeMeasure
 
@@ -1067,9 +1165,17 @@ TfLiteStatus Subgraph::Invoke(UnitType eType, std::mutex& mtx_lock,
   }
 
   TfLiteStatus status = kTfLiteOk;
+  deadline_exceeded_ = false;
+  if (node_latency_ema_.size() != nodes_and_registration_.size()) {
+    node_latency_ema_.assign(nodes_and_registration_.size(), 0.0);
+  }
+  node_latency_last_.assign(nodes_and_registration_.size(), 0.0);
   if (state_ == kStateUninvokable) {
     ReportError("Invoke called on model that is not ready.");
 	return kTfLiteError;
+  } else if (released_idle_) {
+    // Released while idle, bring it back transparently.
+    TF_LITE_ENSURE_STATUS(AcquireIdleMemoryLocked());
   } else if (memory_planner_ && !memory_planner_->HasNonPersistentMemory()) {
     ReportError("Non-persistent memory is not available.");
 	return kTfLiteError;
@@ -1113,7 +1219,6 @@ TfLiteStatus Subgraph::Invoke(UnitType eType, std::mutex& mtx_lock,
     const char* op_name = nullptr;
     
     if (profiler_) op_name = GetTFLiteOpName(registration);
-    TFLITE_SCOPED_TAGGED_OPERATOR_PROFILE(profiler_.get(), op_name, node_index);
 
     for (int i = 0; i < node.outputs->size; ++i) {
       int tensor_index = node.outputs->data[i];
@@ -1165,6 +1270,16 @@ TfLiteStatus Subgraph::Invoke(UnitType eType, std::mutex& mtx_lock,
       ReportError("Client requested cancel during Invoke()");
 	  return kTfLiteError;
     }
+    if (has_deadline_) {
+      auto remaining = std::chrono::microseconds(
+          static_cast<int64_t>(EstimateRemainingUs(execution_plan_index)));
+      if (std::chrono::steady_clock::now() + remaining > deadline_) {
+        deadline_exceeded_ = true;
+        ReportError("Deadline would be missed at node %d, aborting Invoke()",
+                    node_index);
+        return kTfLiteError;
+      }
+    }
 
     // if(node_index == 0){
     //   auto input_pointer = (float *)tensor(0)->data.data;
@@ -1210,9 +1325,33 @@ TfLiteStatus Subgraph::Invoke(UnitType eType, std::mutex& mtx_lock,
     //std::cout << "==================================" << "\n";
     //PrintNodeInfo(node_index, node, registration);
     // PrintInputTensor(node, eType);
-    if (OpInvoke(registration, &node) != kTfLiteOk) {	
-      return ReportOpError(&context_, node, registration, node_index,
-                           "failed to invoke");
+    auto op_begin = std::chrono::steady_clock::now();
+    TiledRegionState* tiled_region = TiledRegionAt(execution_plan_index);
+    {
+      // The op's profile event closes before its latency is booked, so time
+      // a profiler adds to the op (see UnitSim) counts in the history too.
+      TFLITE_SCOPED_TAGGED_OPERATOR_PROFILE(profiler_.get(), op_name,
+                                            node_index);
+      if (tiled_region != nullptr) {
+        // The whole region runs band by band here; its time is booked on the
+        // first node.
+        if (tiled_region->region->Invoke(&context_) != kTfLiteOk) {
+          return ReportOpError(&context_, node, registration, node_index,
+                               "failed to invoke tiled region");
+        }
+      } else if (OpInvoke(registration, &node) != kTfLiteOk) {
+        return ReportOpError(&context_, node, registration, node_index,
+                             "failed to invoke");
+      }
+    }
+    double op_us = std::chrono::duration<double, std::micro>(
+                       std::chrono::steady_clock::now() - op_begin).count();
+    double& ema = node_latency_ema_[node_index];
+    ema = (ema == 0.0) ? op_us
+                       : ema + kNodeLatencyEmaAlpha * (op_us - ema);
+    node_latency_last_[node_index] = op_us;
+    if (tiled_region != nullptr) {
+      execution_plan_index = tiled_region->last_plan_index;
     }
     
     //PrintOutputTensor(node, eType); //hoon
@@ -1475,7 +1614,198 @@ TfLiteStatus Subgraph::Invoke(UnitType eType){
   std::mutex mtx_lock_;
   std::mutex mtx_lock_debug;
   std::condition_variable temp_cond;
-  Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug, temp_cond, nullptr);
+  return Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug, temp_cond, nullptr);
+}
+
+double Subgraph::EstimateRemainingUs(int execution_plan_index) const {
+  double remaining = 0;
+  for (size_t i = execution_plan_index; i < execution_plan_.size(); ++i) {
+    const size_t node_index = execution_plan_[i];
+    if (node_index < node_latency_ema_.size()) {
+      remaining += node_latency_ema_[node_index];
+    }
+  }
+  return remaining;
+}
+
+TfLiteStatus Subgraph::EnableTiledRegion(int first_plan_index,
+                                         int last_plan_index,
+                                         size_t cache_bytes) {
+  if (first_plan_index < 0 || last_plan_index < first_plan_index ||
+      last_plan_index >= execution_plan_.size()) {
+    ReportError("Invalid tiled region [%d, %d]", first_plan_index,
+                last_plan_index);
+    return kTfLiteError;
+  }
+  for (const auto& other : tiled_regions_) {
+    if (first_plan_index <= other.last_plan_index &&
+        other.first_plan_index <= last_plan_index) {
+      ReportError("Tiled region [%d, %d] overlaps region [%d, %d]",
+                  first_plan_index, last_plan_index, other.first_plan_index,
+                  other.last_plan_index);
+      return kTfLiteError;
+    }
+  }
+
+  const TiledExecutionPlanner* planner = GetTiledExecutionPlanner();
+  if (planner == nullptr) {
+    ReportError("No tiled execution planner installed");
+    return kTfLiteError;
+  }
+
+  std::vector<int> intermediates;
+  for (int i = first_plan_index; i <= last_plan_index; ++i) {
+    const int node_index = execution_plan_[i];
+    const TfLiteNode& node = nodes_and_registration_[node_index].first;
+    if (node.delegate != nullptr ||
+        !planner->IsTileableOp(nodes_and_registration_[node_index].second) ||
+        node.inputs->size < 1 || node.outputs->size != 1) {
+      ReportError("Node %d can not be part of a tiled region", node_index);
+      return kTfLiteError;
+    }
+    if (i == first_plan_index) continue;
+    const TfLiteNode& previous =
+        nodes_and_registration_[execution_plan_[i - 1]].first;
+    if (node.inputs->data[0] != previous.outputs->data[0]) {
+      ReportError("Node %d does not consume the output of node %d", node_index,
+                  execution_plan_[i - 1]);
+      return kTfLiteError;
+    }
+    intermediates.push_back(previous.outputs->data[0]);
+  }
+
+  // Intermediates only ever exist one band at a time, so nothing but the next
+  // node of the region may read them.
+  for (int tensor_index : intermediates) {
+    const TfLiteTensor& tensor = tensors_[tensor_index];
+    int readers = 0;
+    for (int node_index : execution_plan_) {
+      const TfLiteIntArray* node_inputs =
+          nodes_and_registration_[node_index].first.inputs;
+      for (int i = 0; i < node_inputs->size; ++i) {
+        if (node_inputs->data[i] == tensor_index) ++readers;
+      }
+    }
+    if (readers != 1 || tensor.type != kTfLiteFloat32 ||
+        tensor.allocation_type != kTfLiteArenaRw || tensor.is_variable ||
+        std::find(outputs_.begin(), outputs_.end(), tensor_index) !=
+            outputs_.end()) {
+      ReportError("Tensor %d is used outside of the tiled region",
+                  tensor_index);
+      return kTfLiteError;
+    }
+  }
+
+  for (int tensor_index : intermediates) {
+    tensors_[tensor_index].allocation_type = kTfLiteCustom;
+    tensors_[tensor_index].data.raw = nullptr;
+  }
+  TiledRegionState state;
+  state.first_plan_index = first_plan_index;
+  state.last_plan_index = last_plan_index;
+  state.cache_bytes = cache_bytes;
+  state.intermediates = std::move(intermediates);
+  tiled_regions_.push_back(std::move(state));
+  // The intermediates left the arena, plan it again.
+  state_ = kStateUninvokable;
+  return kTfLiteOk;
+}
+
+int Subgraph::TiledRegionBandRows(int first_plan_index) const {
+  for (const auto& state : tiled_regions_) {
+    if (state.first_plan_index != first_plan_index) continue;
+    if (state.fell_back) return -1;
+    return state.region ? state.region->band_rows() : 0;
+  }
+  return 0;
+}
+
+bool Subgraph::IsInTiledRegion(int plan_index) const {
+  for (const auto& state : tiled_regions_) {
+    if (plan_index >= state.first_plan_index &&
+        plan_index <= state.last_plan_index) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int32_t Subgraph::tensor_row_stride(int tensor_index) const {
+  if (!memory_planner_) return 0;
+  // PrepareOpsAndTensors() only ever creates an ArenaPlanner.
+  return static_cast<const ArenaPlanner*>(memory_planner_.get())
+      ->TensorRowStride(tensor_index);
+}
+
+void Subgraph::SetArenaPlanCacheCapacity(int capacity) {
+  arena_plan_cache_capacity_ = capacity;
+  if (memory_planner_) {
+    // PrepareOpsAndTensors() only ever creates an ArenaPlanner.
+    static_cast<ArenaPlanner*>(memory_planner_.get())
+        ->SetPlanCacheCapacity(capacity);
+  }
+}
+
+TfLiteStatus Subgraph::SetArenaAllocator(ArenaAllocator* allocator) {
+  if (memory_planner_) {
+    ReportError("SetArenaAllocator() must be called before AllocateTensors().");
+    return kTfLiteError;
+  }
+  arena_allocator_ = allocator;
+  return kTfLiteOk;
+}
+
+Subgraph::TiledRegionState* Subgraph::TiledRegionAt(int execution_plan_index) {
+  for (auto& state : tiled_regions_) {
+    if (state.first_plan_index != execution_plan_index) continue;
+    if (state.fell_back) return nullptr;
+    if (state.region) return &state;
+
+    std::vector<TiledExecutionPlanner::Node> nodes;
+    for (int i = state.first_plan_index; i <= state.last_plan_index; ++i) {
+      const auto& node_and_reg = nodes_and_registration_[execution_plan_[i]];
+      nodes.push_back({&node_and_reg.first, &node_and_reg.second});
+    }
+    // A node of the region waiting for a dynamic tensor is not prepared yet,
+    // so its shapes are unknown.
+    if (next_execution_plan_index_to_prepare_ > state.last_plan_index &&
+        GetTiledExecutionPlanner()->Plan(&context_, nodes, state.cache_bytes,
+                                         &state.region) == kTfLiteOk) {
+      TFLITE_LOG(tflite::TFLITE_LOG_INFO,
+                 "Tiled region [%d, %d]: %d bands of %d rows, %zu bytes "
+                 "scratch.",
+                 state.first_plan_index, state.last_plan_index,
+                 state.region->num_bands(), state.region->band_rows(),
+                 state.region->scratch_bytes());
+      return &state;
+    }
+
+    // Not tileable: give the intermediates real memory and run node by node.
+    TFLITE_LOG(tflite::TFLITE_LOG_WARNING,
+               "Tiled region [%d, %d] can not be tiled, running it node by "
+               "node.",
+               state.first_plan_index, state.last_plan_index);
+    state.region.reset();
+    state.fell_back = true;
+    for (int tensor_index : state.intermediates) {
+      TfLiteTensor& tensor = tensors_[tensor_index];
+      state.fallback_buffers.emplace_back(tensor.bytes);
+      tensor.data.raw = state.fallback_buffers.back().data();
+    }
+    return nullptr;
+  }
+  return nullptr;
+}
+
+void Subgraph::ResetTiledRegions() {
+  for (auto& state : tiled_regions_) {
+    state.region.reset();
+    state.fell_back = false;
+    state.fallback_buffers.clear();
+    for (int tensor_index : state.intermediates) {
+      tensors_[tensor_index].data.raw = nullptr;
+    }
+  }
 }
 
 TfLiteStatus Subgraph::ResizeTensor(TfLiteContext* context,
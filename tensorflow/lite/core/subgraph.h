@@ -23,16 +23,21 @@ limitations under the License.
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <chrono>
+#include <atomic>
 #include "condition_variable"
 #include "cstring"
 
 #include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/arena_allocator.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/core/api/profiler.h"
 #include "tensorflow/lite/core/macros.h"
 #include "tensorflow/lite/delegates/nnapi/nnapi_delegate.h"
 #include "tensorflow/lite/experimental/resource/resource_base.h"
+#include "tensorflow/lite/kmcontext.h"
 #include "tensorflow/lite/memory_planner.h"
+#include "tensorflow/lite/tiled_execution.h"
 #include "tensorflow/lite/util.h"
 
 //Minsung
@@ -68,6 +73,20 @@ class NNAPIDelegate;
 //Forward declare of UnitHandler since UnitHander Uses Interpreter & Subgraph
 class UnitHandler;
 
+// Counters of the idle memory release (ReleaseIdleMemory()) of one subgraph,
+// or summed over all subgraphs of an interpreter.
+struct MemoryReleaseStats {
+  // Idle releases of the non-persistent arena.
+  int64_t releases = 0;
+  // Arenas reacquired on demand after an idle release.
+  int64_t reacquires = 0;
+  // Total time spent reacquiring, in us.
+  int64_t reacquire_us = 0;
+  // Non-persistent bytes currently released / currently resident.
+  size_t released_bytes = 0;
+  size_t resident_bytes = 0;
+};
+
 class Subgraph {
  public:
   friend class Interpreter;
@@ -420,6 +439,11 @@ class Subgraph {
     return nodes_and_registration_;
   }
 
+  // Channel-wise partitioning context of this subgraph. Points at this
+  // subgraph's own context and nodes, so partitioning it leaves every other
+  // subgraph and interpreter untouched.
+  KmContext* kmcontext() { return &kmcontext_; }
+
   // Get a pointer to an operation and registration data structure if in bounds.
   const std::pair<TfLiteNode, TfLiteRegistration>* node_and_registration(
       int node_index) const {
@@ -451,6 +475,34 @@ class Subgraph {
   // AllocateTensors needs to be called before next invocation.
   TfLiteStatus ReleaseNonPersistentMemory();
 
+  // Releases the non-persistent memory if the subgraph has not been invoked
+  // (or reacquired) for at least `min_idle_us`. Unlike
+  // ReleaseNonPersistentMemory(), the memory is reacquired transparently by
+  // the next Invoke(). Input tensors live in that memory too, so callers
+  // filling inputs must call AcquireNonPersistentMemory() first.
+  // A running Invoke() is never released; `released_bytes` (optional)
+  // receives the bytes that were freed, 0 if nothing was.
+  // WARNING: This is an experimental API and subject to change.
+  TfLiteStatus ReleaseIdleMemory(int64_t min_idle_us,
+                                 size_t* released_bytes = nullptr);
+
+  // Reacquires the non-persistent memory after ReleaseIdleMemory(). No-op if
+  // it is resident. Counts as a use for the idle timer.
+  TfLiteStatus AcquireNonPersistentMemory();
+
+  // ReleaseIdleMemory() skips the subgraph while it is pinned. Pin before
+  // AcquireNonPersistentMemory() and unpin once the outputs have been read,
+  // so nothing is released between filling, invoking and reading.
+  void PinNonPersistentMemory() { ++memory_pins_; }
+  void UnpinNonPersistentMemory() { --memory_pins_; }
+
+  // True if the non-persistent memory is resident (or nothing is planned).
+  bool HasNonPersistentMemory() {
+    return !memory_planner_ || memory_planner_->HasNonPersistentMemory();
+  }
+
+  MemoryReleaseStats GetMemoryReleaseStats();
+
   // Update allocations for all tensors. This will redim dependent tensors using
   // the input tensor dimensionality as given. This is relatively expensive.
   // If you know that your sizes are not changing, you need not call this.
@@ -574,6 +626,14 @@ class Subgraph {
   // Set the value of an external context.
   void SetExternalContext(TfLiteExternalContextType type,
                           TfLiteExternalContext* ctx);
+
+  // Detaches this subgraph from the interpreter-wide external context table.
+  // The current entries are copied, and later SetExternalContext() calls only
+  // affect this subgraph (e.g. a per-partition CPU backend context).
+  void UseOwnExternalContexts();
+  bool HasOwnExternalContexts() const {
+    return external_contexts_ == own_external_contexts_;
+  }
   // Get the half precision flag.
   // WARNING: This is an experimental API and subject to change.
   bool GetAllowFp16PrecisionForFp32() const {
@@ -589,6 +649,78 @@ class Subgraph {
   // WARNING: This is an experimental API and subject to change.
   void SetCancellationFunction(void* data, bool (*check_cancelled_func)(void*));
 
+  // Sets an absolute deadline for the following Invoke() calls. Before every
+  // op the subgraph estimates the remaining time from the per-node latency
+  // history; if that estimate does not fit before the deadline, Invoke()
+  // aborts with `kTfLiteError` and DeadlineExceeded() returns true.
+  // WARNING: This is an experimental API and subject to change.
+  void SetDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+    has_deadline_ = true;
+  }
+  void ClearDeadline() { has_deadline_ = false; }
+
+  // True if the last Invoke() was aborted because of the deadline.
+  bool DeadlineExceeded() const { return deadline_exceeded_; }
+  // Forgets a deadline abort of an earlier Invoke(). The interpreter calls it
+  // for subgraphs the current invoke path does not run.
+  void ClearDeadlineExceeded() { deadline_exceeded_ = false; }
+
+  // Estimated time (us) to run the execution plan from
+  // `execution_plan_index` to the end. Nodes that have never run count as 0.
+  double EstimateRemainingUs(int execution_plan_index) const;
+
+  // Estimated time (us) for a whole Invoke() of this subgraph.
+  double EstimateInvokeUs() const { return EstimateRemainingUs(0); }
+
+  // Latency (us) of each node in the last Invoke(), indexed by node index.
+  // Nodes that did not run in it (or ran inside a tiled region) are 0.
+  const std::vector<double>& last_node_latency_us() const {
+    return node_latency_last_;
+  }
+
+  // Runs execution_plan()[first_plan_index .. last_plan_index] as one depth
+  // first tiled region through the installed TiledExecutionPlanner (the
+  // builtin kernels' tiled::TiledRegion): the chain is executed band by band
+  // of output rows sized to `cache_bytes` (0 = L2 size), and the tensors
+  // between its nodes get no arena memory. The nodes must be ops the planner
+  // can tile each consuming only the previous node's output, and those
+  // intermediate tensors must not be read anywhere else. Fails if no planner
+  // is installed.
+  // Must be called after delegates are applied (the indices refer to the
+  // current execution plan) and before AllocateTensors(). If the prepared
+  // shapes turn out not to be tileable the region falls back to plain node by
+  // node execution.
+  // WARNING: This is an experimental API and subject to change.
+  TfLiteStatus EnableTiledRegion(int first_plan_index, int last_plan_index,
+                                 size_t cache_bytes = 0);
+
+  // Band rows chosen for the tiled region starting at `first_plan_index`, 0
+  // if there is none or it is not planned (yet), -1 if it fell back.
+  int TiledRegionBandRows(int first_plan_index) const;
+
+  // True if execution plan index `plan_index` is part of a tiled region.
+  bool IsInTiledRegion(int plan_index) const;
+
+  // Elements between two innermost rows of tensor `tensor_index` if the
+  // memory planner made it a strided view into a larger tensor (see
+  // ArenaPlanner::TensorRowStride), 0 if it is dense. Kept here rather than in
+  // TfLiteTensor so the C struct layout does not change.
+  int32_t tensor_row_stride(int tensor_index) const;
+
+  // Makes the arena planner keep up to `capacity` complete memory plans, so
+  // AllocateTensors() after resizing inputs back to a shape planned before
+  // restores that plan instead of recomputing it (see
+  // ArenaPlanner::SetPlanCacheCapacity). 0 disables it.
+  void SetArenaPlanCacheCapacity(int capacity);
+
+  // Backs the memory arenas of this subgraph (activations and persistent
+  // tensors) with `allocator`, e.g. a PageArenaAllocator placing them on huge
+  // pages of a given NUMA node, pre-faulted in AllocateTensors(). nullptr
+  // restores the default. Ownership is not taken. Must be called before the
+  // first AllocateTensors().
+  TfLiteStatus SetArenaAllocator(ArenaAllocator* allocator);
+
   // Ensure the data in `tensor.data` is readable. In case delegate is used,
   // it might require to copy the data from delegate buffer to raw memory.
   // WARNING: This is an experimental API and subject to change.
@@ -956,6 +1088,11 @@ class Subgraph {
   // sits inside the associated TFLite interpreter instance.
   TfLiteExternalContext** external_contexts_;
 
+  // Subgraph-local copy of the external contexts, used instead of the
+  // interpreter's table after UseOwnExternalContexts().
+  TfLiteExternalContext* own_external_contexts_[kTfLiteMaxExternalContexts] =
+      {};
+
   // Node inputs/outputs are stored in TfLiteNode and TfLiteRegistration stores
   // function pointers to actual implementation.
   // Nodes should appear in the order in which they are instantiated at runtime.
@@ -963,6 +1100,10 @@ class Subgraph {
   std::vector<std::pair<TfLiteNode, TfLiteRegistration>>
       nodes_and_registration_;
 
+  // Channel-wise partitioning context bound to context_, execution_plan_ and
+  // nodes_and_registration_ above.
+  KmContext kmcontext_;
+
   // Whether the model is consistent. That is to say if the inputs and outputs
   // of every node and the global inputs and outputs are valid indexes into
   // the tensor array.
@@ -1038,6 +1179,12 @@ class Subgraph {
 
   std::unique_ptr<MemoryPlanner> memory_planner_;
 
+  // See SetArenaPlanCacheCapacity().
+  int arena_plan_cache_capacity_ = 0;
+
+  // See SetArenaAllocator(), nullptr for the default.
+  ArenaAllocator* arena_allocator_ = nullptr;
+
   // Contains <tensor idx, custom allocation> pairs for all applicable tensors.
   std::vector<std::pair<int, TfLiteCustomAllocation>> custom_allocations_;
 
@@ -1067,6 +1214,61 @@ class Subgraph {
   // `check_cancelled_func_`.
   void* cancellation_data_ = nullptr;
 
+  // Deadline set by SetDeadline(), only honoured when `has_deadline_`.
+  std::chrono::steady_clock::time_point deadline_;
+  bool has_deadline_ = false;
+  bool deadline_exceeded_ = false;
+
+  // Exponential moving average of each node's latency in us, indexed by node
+  // index. Feeds EstimateRemainingUs().
+  std::vector<double> node_latency_ema_;
+  static constexpr double kNodeLatencyEmaAlpha = 0.2;
+
+  // Latency of each node in the last Invoke(), see last_node_latency_us().
+  std::vector<double> node_latency_last_;
+
+  // Reacquires memory released by ReleaseIdleMemory(). Call with
+  // `mtx_memory_` held.
+  TfLiteStatus AcquireIdleMemoryLocked();
+
+  // Held for the whole Invoke(); ReleaseIdleMemory() only try-locks it, so a
+  // running invoke is never released.
+  std::mutex mtx_memory_;
+  // True while the non-persistent memory is released by ReleaseIdleMemory()
+  // (an explicit ReleaseNonPersistentMemory() still needs AllocateTensors()).
+  bool released_idle_ = false;
+  size_t released_size_ = 0;
+  // See PinNonPersistentMemory(). Not guarded by `mtx_memory_`, which a
+  // running Invoke() holds.
+  std::atomic<int> memory_pins_{0};
+  // Last Invoke() end or reacquire, the idle timer starts there.
+  std::chrono::steady_clock::time_point last_use_ =
+      std::chrono::steady_clock::now();
+  MemoryReleaseStats memory_release_stats_;
+
+  // A region registered with EnableTiledRegion().
+  struct TiledRegionState {
+    int first_plan_index;
+    int last_plan_index;
+    size_t cache_bytes;
+    // Tensors between the region's nodes (kTfLiteCustom, no arena memory).
+    std::vector<int> intermediates;
+    // Planned on the first Invoke() after (re)allocation.
+    std::unique_ptr<TiledExecution> region;
+    // Set when the region could not be tiled; the intermediates then live in
+    // `fallback_buffers` and the nodes run one by one.
+    bool fell_back = false;
+    std::vector<std::vector<char>> fallback_buffers;
+  };
+  std::vector<TiledRegionState> tiled_regions_;
+
+  // Returns the tiled region starting at `execution_plan_index`, planning it
+  // if needed, or nullptr if none (or it fell back to node by node).
+  TiledRegionState* TiledRegionAt(int execution_plan_index);
+
+  // Forgets the band plans, e.g. because tensors have been reallocated.
+  void ResetTiledRegions();
+
   // A map of resources. Owned by interpreter and shared by multiple subgraphs.
   resource::ResourceMap* resources_ = nullptr;
 
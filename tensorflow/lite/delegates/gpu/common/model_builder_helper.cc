@@ -390,6 +390,12 @@ absl::Status IsActivationSupported(TfLiteFusedActivation fused_activation) {
     case kTfLiteActSignBit:
       return absl::UnimplementedError(
           "TfLiteFusedActivation.kTfLiteActSignBit");
+    case kTfLiteActLeakyRelu:
+      return absl::UnimplementedError(
+          "TfLiteFusedActivation.kTfLiteActLeakyRelu");
+    case kTfLiteActHardSwish:
+      return absl::UnimplementedError(
+          "TfLiteFusedActivation.kTfLiteActHardSwish");
 
       // Do not add default; we want compilation error rather than run-time
       // error.
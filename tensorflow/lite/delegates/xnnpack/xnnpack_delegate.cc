@@ -999,6 +999,10 @@ class Subgraph {
         }
         return kTfLiteError;
       }
+      // CONCATENATION, SPLIT(_V), SLICE and STRIDED_SLICE stay on the builtin
+      // kernels : this XNNPACK has no copy-style concatenate/split/slice
+      // nodes, and emulating them (pad + add chain, one-hot 1x1 conv) costs
+      // more than the CPU round trip between partitions.
       default:
         return kTfLiteError;
     }
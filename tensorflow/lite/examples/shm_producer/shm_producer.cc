@@ -0,0 +1,121 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "tensorflow/lite/unit_shm.h"
+
+// Stands in for a camera process: publishes synthetic frames (a moving
+// gradient) into a shared memory frame ring that an inference process maps
+// with ShmFrameRing::Open() / UnitHandler::OpenFrameRing().
+//
+// Frames are written in the model's input layout, so the layout given here
+// must match the input tensor of the consumer's model.
+//
+// Usage: shm_producer <name> <width> <height> <channels> <uint8|int8|float32>
+//                     [fps=30] [frames=0 (for ever)]
+// e.g.   shm_producer /camera0 300 300 3 uint8 30
+
+#define SHM_PRODUCER_CHECK(x)                                \
+  if (!(x)) {                                                \
+    fprintf(stderr, "Error at %s:%d\n", __FILE__, __LINE__); \
+    exit(1);                                                 \
+  }
+
+namespace {
+
+bool ParseType(const char* name, TfLiteType* type) {
+  if (strcmp(name, "uint8") == 0) {
+    *type = kTfLiteUInt8;
+  } else if (strcmp(name, "int8") == 0) {
+    *type = kTfLiteInt8;
+  } else if (strcmp(name, "float32") == 0) {
+    *type = kTfLiteFloat32;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Gradient shifted by 'frame' pixels, values in the tensor's range.
+void FillFrame(const tflite::ShmRingLayout& layout, uint64_t frame,
+               uint8_t* data) {
+  for (int y = 0; y < layout.height; ++y) {
+    for (int x = 0; x < layout.width; ++x) {
+      const int value = (x + y + static_cast<int>(frame)) % 256;
+      for (int c = 0; c < layout.channels; ++c) {
+        const int i = (y * layout.width + x) * layout.channels + c;
+        switch (layout.type) {
+          case kTfLiteFloat32:
+            reinterpret_cast<float*>(data)[i] = value / 255.f;
+            break;
+          case kTfLiteInt8:
+            reinterpret_cast<int8_t*>(data)[i] = static_cast<int8_t>(value - 128);
+            break;
+          default:
+            data[i] = static_cast<uint8_t>(value);
+            break;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 6) {
+    fprintf(stderr,
+            "shm_producer <name> <width> <height> <channels> "
+            "<uint8|int8|float32> [fps] [frames]\n");
+    return 1;
+  }
+  tflite::ShmRingLayout layout;
+  layout.width = atoi(argv[2]);
+  layout.height = atoi(argv[3]);
+  layout.channels = atoi(argv[4]);
+  SHM_PRODUCER_CHECK(ParseType(argv[5], &layout.type));
+  layout.num_slots = 4;
+  const int fps = argc > 6 ? atoi(argv[6]) : 30;
+  const long frames = argc > 7 ? atol(argv[7]) : 0;
+  SHM_PRODUCER_CHECK(fps > 0);
+
+  tflite::ShmFrameRing ring;
+  SHM_PRODUCER_CHECK(ring.Create(argv[1], layout) == kTfLiteOk);
+
+  const auto period = std::chrono::microseconds(1000000 / fps);
+  auto next = std::chrono::steady_clock::now();
+  for (long i = 0; frames == 0 || i < frames; ++i) {
+    uint8_t* slot = ring.BeginFrame();
+    SHM_PRODUCER_CHECK(slot != nullptr);
+    FillFrame(layout, i, slot);
+    const uint64_t now_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    const uint64_t sequence = ring.PublishFrame(now_us);
+    if (sequence % (fps * 10) == 0) {
+      std::cout << "shm_producer : " << sequence << " frames published\n";
+    }
+    next += period;
+    std::this_thread::sleep_until(next);
+  }
+  return 0;
+}
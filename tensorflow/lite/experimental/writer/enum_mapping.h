@@ -39,6 +39,9 @@ inline ActivationFunctionType TfLiteActivationToSchemaActivation(
       return ActivationFunctionType_SIGN_BIT;
     case kTfLiteActSigmoid:
       return ActivationFunctionType_NONE;  // TODO(aselle): Add to schema
+    case kTfLiteActLeakyRelu:
+    case kTfLiteActHardSwish:
+      return ActivationFunctionType_NONE;  // Build-time fusion only.
   }
   return ActivationFunctionType_NONE;
 }
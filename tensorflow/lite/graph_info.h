@@ -59,6 +59,16 @@ class GraphInfo {
 
   // Returns the indices of the variable tensors.
   virtual const std::vector<int>& variables() const = 0;
+
+  // Returns the registration of the node at execution-plan index `index`, or
+  // nullptr if the implementation does not track registrations.
+  virtual const TfLiteRegistration* registration(size_t index) const {
+    return nullptr;
+  }
+
+  // True if the node at execution-plan index `index` can write its output as
+  // a strided view (see ArenaPlanner::TensorRowStride).
+  virtual bool SupportsStridedOutput(size_t index) const { return false; }
 };
 
 // Represents a subset of nodes in a TensorFlow Lite graph.
@@ -220,6 +220,7 @@ TfLiteStatus Interpreter::AllocateTensorsofAllSubgraphs(){
     if(subgraph(i)->AllocateTensors() != kTfLiteOk)
       return kTfLiteError;
   }
+  return kTfLiteOk;
 }
 
 // Minsung MUST_CHECK
@@ -292,6 +293,8 @@ void Interpreter::AddSubgraphs(int subgraphs_to_add,
   for (int i = 0; i < subgraphs_to_add; ++i) {
     Subgraph* subgraph = new Subgraph(error_reporter_, external_contexts_,
                                       &subgraphs_, &resources_);
+    subgraph->SetArenaPlanCacheCapacity(arena_plan_cache_capacity_);
+    subgraph->SetArenaAllocator(arena_allocator_);
     subgraphs_.emplace_back(subgraph);
   }
 }
@@ -319,9 +322,58 @@ TfLiteStatus Interpreter::ReleaseNonPersistentMemory() {
   // TODO(b/138790287): We could do this for all subgraphs whose tensors have
   // been allocated. However, AllocateTensors() relies on Control Flow ops to
   // allocate tensors on 'children' subgraphs. Revisit this if required.
+  // ReleaseIdleMemory() covers all subgraphs, as it does not depend on
+  // AllocateTensors() to get the memory back.
   return primary_subgraph().ReleaseNonPersistentMemory();
 }
 
+TfLiteStatus Interpreter::ReleaseIdleMemory(int64_t min_idle_us,
+                                            size_t* released_bytes) {
+  size_t total = 0;
+  TfLiteStatus status = kTfLiteOk;
+  for (auto& subgraph : subgraphs_) {
+    size_t bytes = 0;
+    if (subgraph->ReleaseIdleMemory(min_idle_us, &bytes) != kTfLiteOk) {
+      status = kTfLiteError;
+    }
+    total += bytes;
+  }
+  if (released_bytes) *released_bytes = total;
+  return status;
+}
+
+TfLiteStatus Interpreter::AcquireNonPersistentMemory() {
+  for (auto& subgraph : subgraphs_) {
+    TF_LITE_ENSURE_STATUS(subgraph->AcquireNonPersistentMemory());
+  }
+  return kTfLiteOk;
+}
+
+void Interpreter::PinNonPersistentMemory() {
+  for (auto& subgraph : subgraphs_) {
+    subgraph->PinNonPersistentMemory();
+  }
+}
+
+void Interpreter::UnpinNonPersistentMemory() {
+  for (auto& subgraph : subgraphs_) {
+    subgraph->UnpinNonPersistentMemory();
+  }
+}
+
+MemoryReleaseStats Interpreter::GetMemoryReleaseStats() {
+  MemoryReleaseStats total;
+  for (auto& subgraph : subgraphs_) {
+    MemoryReleaseStats stats = subgraph->GetMemoryReleaseStats();
+    total.releases += stats.releases;
+    total.reacquires += stats.reacquires;
+    total.reacquire_us += stats.reacquire_us;
+    total.released_bytes += stats.released_bytes;
+    total.resident_bytes += stats.resident_bytes;
+  }
+  return total;
+}
+
 //Minsung
 //Sets partitioning ratios of subgraphs
 //TODO : Set Filter Tensor for partitioning  
@@ -361,6 +413,27 @@ TfLiteStatus Interpreter::QuantizeSubgraph(){
   return kTfLiteOk;
 }
 
+TfLiteStatus Interpreter::ChannelPartitioning(const std::string& op_name,
+                                              float ratio, int subgraph_index){
+  KmContext* context = kmcontext(subgraph_index);
+  if(context == nullptr){
+    std::cout << "ERROR Interpreter has no subgraph " << subgraph_index << "\n";
+    return kTfLiteError;
+  }
+  if(ratio <= 0 || ratio > 1){
+    std::cout << "ERROR channel partitioning ratio " << ratio << " not in (0, 1]\n";
+    return kTfLiteError;
+  }
+  context->channelPartitioning(op_name, ratio);
+  return kTfLiteOk;
+}
+
+KmContext* Interpreter::kmcontext(int subgraph_index){
+  Subgraph* target = subgraph(subgraph_index);
+  if(target == nullptr) return nullptr;
+  return target->kmcontext();
+}
+
 // Minsung
 // Set experimental flag for deviding a model to multiple subgraphs
 void Interpreter::SetMultipleSubgraphs(bool flag){
@@ -380,121 +453,35 @@ TfLiteStatus Interpreter::Invoke(UnitType eType, std::mutex& mtx_lock,
                      std::queue<SharedContext*>* qSharedData) {
   ScopedRuntimeInstrumentationProfile scoped_runtime_event(installed_profiler_,
                                                            "invoke");
+  ResetDeadlineExceeded();
   if(eType == UnitType::CPU0){
   TF_LITE_ENSURE_STATUS_WITH_SCOPED_INSTRUMENTATION(
      scoped_runtime_event, primary_subgraph().Invoke(eType, mtx_lock, mtx_lock_,
                                          mtx_lock_debug, Ucontroller, qSharedData));
   }else if(eType == UnitType::GPU0){
     int subgraph_size = subgraphs_size();
+    // Later partitions read the outputs of earlier ones, none of them may be
+    // released in between.
+    PinNonPersistentMemory();
+    TfLiteStatus status = kTfLiteOk;
     //std::cout << "Invoke subgrph size : " << subgraph_size << "\n";
-    auto connect = [&](int source_subgraph, int dest_subgraph){
-      if(source_subgraph < subgraphs_size() && dest_subgraph <= subgraphs_size()){
-        Subgraph* source_graph = subgraph(source_subgraph);
-        Subgraph* dest_graph = subgraph(dest_subgraph);
-        int source_tensor_idx = source_graph->outputs()[0];
-        int dest_tensor_idx = dest_graph->GetInputsInMultipleSubgraphs();
-        TfLiteTensor* source_tensor = source_graph->tensor(source_tensor_idx);
-        TfLiteTensor* dest_tensor = dest_graph->tensor(dest_tensor_idx);
-        size_t source_byte_size = source_tensor->bytes;
-        size_t dest_byte_size = dest_tensor->bytes;
-        //source_graph->PrintTensor(*source_tensor, UnitType::GPU0);
-        if(source_byte_size != dest_byte_size){
-          std::cout << "Source tensor[" << source_tensor_idx << "] size "
-                    << static_cast<int>(source_byte_size)
-                    << " and Dest tensor["<< dest_tensor_idx <<"] size " 
-                    << static_cast<int>(dest_byte_size) << " missmatch!" << "\n";
-          return kTfLiteError;
-        }
-        auto data_source = (float*)source_tensor->data.data;
-        auto data_dest = (float*)dest_tensor->data.data;
-        memcpy(data_dest, data_source, source_byte_size);
-        //dest_graph->PrintTensor(*dest_tensor, UnitType::GPU0);
-        if(dest_tensor->data.raw == nullptr){
-          std::cout << "dest data nullptr!" << "\n";
-        }
-        // Save used(filled) output tensor for 
-        TensorAndIndex* used_output = new TensorAndIndex;
-        used_output->idx = source_tensor_idx;
-        used_output->tensor = source_tensor;
-        used_tensor_and_index.push_back(used_output);
-        std::cout << "Tensor connection done" << "\n";
-        return kTfLiteOk;
-      }
-    };
-    auto connectAdd = [&](int dest_subgraph){
-      Subgraph* dest_graph = subgraph(dest_subgraph);
-      std::vector<int> inputs = dest_graph->GetMultipleInputTensorIdx();
-      TfLiteTensor* source_tensor = nullptr;
-      TfLiteTensor* dest_tensor = nullptr;
-      // This work needs at least two tensors in both inptus and used_tensors.
-      if(inputs.size() < 2 || used_tensor_and_index.size() < 2){
-        std::cout << "ADD node input connection failed(size)" << 
-                " input size : "<< inputs.size() << " stored tensor size : " << 
-                  used_tensor_and_index.size() << "\n";
-        return kTfLiteError;
-      }
-      for(size_t i=0; i<inputs.size(); ++i){
-        for(size_t j=0; j<used_tensor_and_index.size(); ++j){
-          if(used_tensor_and_index[j]->idx == inputs[i]){
-            source_tensor = used_tensor_and_index[j]->tensor;
-            dest_graph->SwitchTensor(*source_tensor, used_tensor_and_index[j]->idx);
-            dest_tensor = dest_graph->tensor(inputs[i]);
-            if(source_tensor == nullptr){
-              std::cout << "Add node input connection failed(nullptr)" << "\n";
-              return kTfLiteError;
-            }
-            size_t source_byte_size = source_tensor->bytes;
-            size_t dest_byte_size = dest_tensor->bytes;
-            if(source_byte_size != dest_byte_size){
-              std::cout << "Source tensor[" << used_tensor_and_index[j]->idx << "] size "
-                        << static_cast<int>(source_byte_size)
-                        << " and Dest tensor["<< inputs[i] <<"] size " 
-                        << static_cast<int>(dest_byte_size) << " missmatch!" << "\n";
-              return kTfLiteError;
-            }
-            auto data_source = (float*)source_tensor->data.data;
-            auto data_dest = (float*)dest_tensor->data.data;
-            memcpy(data_dest, data_source, source_byte_size);
-          }
-        }
-      }
-      return kTfLiteOk;
-    };
-    struct timespec begin, end;
     for(int i=0; i<subgraph_size; i++){
-      //std::cout << "Invoke Subgraph idx : " << i << "\n";
-      clock_gettime(CLOCK_MONOTONIC, &begin);
-      if(i > 0){
-        if(strcmp(subgraph(i)->GetFirstOpName(), "ADD") == 0){
-          if(connectAdd(i) == kTfLiteError){
-            std::cout << "TENSOR CONNECTION FAILED" << "\n";
-            return kTfLiteError;
-          }
-        }
-        else{
-          if(connect(i-1, i) == kTfLiteError){
-            std::cout << "TENSOR CONNECTION FAILED" << "\n";
-            return kTfLiteError;
-          }
-        }
+      // Partition boundary : stop early if the rest can not finish in time.
+      if(has_deadline_ && i > 0 && !PartitionsFitDeadline(i)){
+        std::cout << "Deadline would be missed before partition " << i
+                  << ", aborting Invoke" << "\n";
+        status = kTfLiteError;
+        break;
+      }
+      if(InvokePartition(i, eType, mtx_lock, mtx_lock_, mtx_lock_debug,
+                         Ucontroller, qSharedData) != kTfLiteOk){
+        status = kTfLiteError;
+        break;
       }
-      clock_gettime(CLOCK_MONOTONIC, &end);
-      double latency = (end.tv_sec - begin.tv_sec) + \
-                        ((end.tv_nsec - begin.tv_nsec) / 1000000000.0);
-      //printf("Data transfer latency : %.6fs \n", latency);
-      //printf("Transfer start Timestamp %.6f \n", (begin.tv_sec + (begin.tv_nsec) / 1000000000.0));
-      //printf("Transfer end Timestamp %.6f \n", (end.tv_sec + (end.tv_nsec) / 1000000000.0));
-      clock_gettime(CLOCK_MONOTONIC, &begin);
-      if(subgraph(i)->Invoke(eType, mtx_lock, mtx_lock_,
-                            mtx_lock_debug, Ucontroller, qSharedData) != kTfLiteOk)
-        return kTfLiteError;
-      clock_gettime(CLOCK_MONOTONIC, &end);
-      latency = (end.tv_sec - begin.tv_sec) + \
-                        ((end.tv_nsec - begin.tv_nsec) / 1000000000.0);
-      //printf("Invoke latency : %.6fs, Invoke start timestamp : %.6fs, end timestamp : %.6fs \n",
-                   //     latency, (begin.tv_sec + (begin.tv_nsec) / 1000000000.0),
-                     //             (end.tv_sec + (end.tv_nsec) / 1000000000.0));
     }
+    UnpinNonPersistentMemory();
+    if(status != kTfLiteOk)
+      return status;
     //printf("final data ? %f \n", *(final_subgraph().tensor(163)->data.f + 954));
     if (!allow_buffer_handle_output_) {
       for (int tensor_index : outputs()) {
@@ -520,11 +507,205 @@ TfLiteStatus Interpreter::Invoke(UnitType eType, std::mutex& mtx_lock,
   return kTfLiteOk;
 }
 
+TfLiteStatus Interpreter::ConnectPartitions(int source_subgraph, int dest_subgraph){
+  if(source_subgraph < subgraphs_size() && dest_subgraph < subgraphs_size()){
+    Subgraph* source_graph = subgraph(source_subgraph);
+    Subgraph* dest_graph = subgraph(dest_subgraph);
+    int source_tensor_idx = source_graph->outputs()[0];
+    int dest_tensor_idx = dest_graph->GetInputsInMultipleSubgraphs();
+    TfLiteTensor* source_tensor = source_graph->tensor(source_tensor_idx);
+    TfLiteTensor* dest_tensor = dest_graph->tensor(dest_tensor_idx);
+    size_t source_byte_size = source_tensor->bytes;
+    size_t dest_byte_size = dest_tensor->bytes;
+    //source_graph->PrintTensor(*source_tensor, UnitType::GPU0);
+    if(source_byte_size != dest_byte_size){
+      std::cout << "Source tensor[" << source_tensor_idx << "] size "
+                << static_cast<int>(source_byte_size)
+                << " and Dest tensor["<< dest_tensor_idx <<"] size " 
+                << static_cast<int>(dest_byte_size) << " missmatch!" << "\n";
+      return kTfLiteError;
+    }
+    // Released arenas (see ReleaseIdleMemory) leave the data pointers null.
+    if(source_tensor->data.raw == nullptr || dest_tensor->data.raw == nullptr){
+      std::cout << "Source or dest data nullptr!" << "\n";
+      return kTfLiteError;
+    }
+    auto data_source = (float*)source_tensor->data.data;
+    auto data_dest = (float*)dest_tensor->data.data;
+    memcpy(data_dest, data_source, source_byte_size);
+    //dest_graph->PrintTensor(*dest_tensor, UnitType::GPU0);
+    // Save used(filled) output tensor for 
+    // Once per tensor, not per invoke.
+    bool stored = false;
+    for(TensorAndIndex& used_output : used_tensor_and_index){
+      if(used_output.idx == source_tensor_idx){
+        used_output.tensor = source_tensor;
+        stored = true;
+      }
+    }
+    if(!stored)
+      used_tensor_and_index.push_back({source_tensor, source_tensor_idx});
+    std::cout << "Tensor connection done" << "\n";
+    return kTfLiteOk;
+  }
+  return kTfLiteError;
+}
+
+TfLiteStatus Interpreter::ConnectAddPartition(int dest_subgraph){
+  Subgraph* dest_graph = subgraph(dest_subgraph);
+  std::vector<int> inputs = dest_graph->GetMultipleInputTensorIdx();
+  TfLiteTensor* source_tensor = nullptr;
+  TfLiteTensor* dest_tensor = nullptr;
+  // This work needs at least two tensors in both inptus and used_tensors.
+  if(inputs.size() < 2 || used_tensor_and_index.size() < 2){
+    std::cout << "ADD node input connection failed(size)" << 
+            " input size : "<< inputs.size() << " stored tensor size : " << 
+              used_tensor_and_index.size() << "\n";
+    return kTfLiteError;
+  }
+  for(size_t i=0; i<inputs.size(); ++i){
+    for(size_t j=0; j<used_tensor_and_index.size(); ++j){
+      if(used_tensor_and_index[j].idx == inputs[i]){
+        source_tensor = used_tensor_and_index[j].tensor;
+        dest_graph->SwitchTensor(*source_tensor, used_tensor_and_index[j].idx);
+        dest_tensor = dest_graph->tensor(inputs[i]);
+        if(source_tensor == nullptr){
+          std::cout << "Add node input connection failed(nullptr)" << "\n";
+          return kTfLiteError;
+        }
+        size_t source_byte_size = source_tensor->bytes;
+        size_t dest_byte_size = dest_tensor->bytes;
+        if(source_byte_size != dest_byte_size){
+          std::cout << "Source tensor[" << used_tensor_and_index[j].idx << "] size "
+                    << static_cast<int>(source_byte_size)
+                    << " and Dest tensor["<< inputs[i] <<"] size " 
+                    << static_cast<int>(dest_byte_size) << " missmatch!" << "\n";
+          return kTfLiteError;
+        }
+        if(source_tensor->data.raw == nullptr || dest_tensor->data.raw == nullptr){
+          std::cout << "Add node input connection failed(nullptr data)" << "\n";
+          return kTfLiteError;
+        }
+        auto data_source = (float*)source_tensor->data.data;
+        auto data_dest = (float*)dest_tensor->data.data;
+        memcpy(data_dest, data_source, source_byte_size);
+      }
+    }
+  }
+  return kTfLiteOk;
+}
+
+// Runs one partition of a partitioned (GPU0) interpreter : copies the
+// boundary tensors from the previous partition(s), then invokes it.
+TfLiteStatus Interpreter::InvokePartition(int i, UnitType eType,
+                     std::mutex& mtx_lock,
+                     std::mutex& mtx_lock_,
+                     std::mutex& mtx_lock_debug,
+                     std::condition_variable& Ucontroller,
+                     std::queue<SharedContext*>* qSharedData) {
+  struct timespec begin, end;
+  //std::cout << "Invoke Subgraph idx : " << i << "\n";
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  // The partition's inputs are written below, they need its arena.
+  if(subgraph(i)->AcquireNonPersistentMemory() != kTfLiteOk){
+    std::cout << "ACQUIRE MEMORY FAILED" << "\n";
+    return kTfLiteError;
+  }
+  if(i > 0){
+    if(strcmp(subgraph(i)->GetFirstOpName(), "ADD") == 0){
+      if(ConnectAddPartition(i) == kTfLiteError){
+        std::cout << "TENSOR CONNECTION FAILED" << "\n";
+        return kTfLiteError;
+      }
+    }
+    else{
+      if(ConnectPartitions(i-1, i) == kTfLiteError){
+        std::cout << "TENSOR CONNECTION FAILED" << "\n";
+        return kTfLiteError;
+      }
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double latency = (end.tv_sec - begin.tv_sec) + \
+                    ((end.tv_nsec - begin.tv_nsec) / 1000000000.0);
+  //printf("Data transfer latency : %.6fs \n", latency);
+  //printf("Transfer start Timestamp %.6f \n", (begin.tv_sec + (begin.tv_nsec) / 1000000000.0));
+  //printf("Transfer end Timestamp %.6f \n", (end.tv_sec + (end.tv_nsec) / 1000000000.0));
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  if(subgraph(i)->Invoke(eType, mtx_lock, mtx_lock_,
+                        mtx_lock_debug, Ucontroller, qSharedData) != kTfLiteOk)
+    return kTfLiteError;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  latency = (end.tv_sec - begin.tv_sec) + \
+                    ((end.tv_nsec - begin.tv_nsec) / 1000000000.0);
+  //printf("Invoke latency : %.6fs, Invoke start timestamp : %.6fs, end timestamp : %.6fs \n",
+               //     latency, (begin.tv_sec + (begin.tv_nsec) / 1000000000.0),
+                 //             (end.tv_sec + (end.tv_nsec) / 1000000000.0));
+  return kTfLiteOk;
+}
+
+bool Interpreter::PartitionsFitDeadline(int first_partition) {
+  double remaining = 0;
+  for(int i=first_partition; i<subgraphs_size(); ++i)
+    remaining += subgraph(i)->EstimateInvokeUs();
+  auto estimate = std::chrono::microseconds(static_cast<int64_t>(remaining));
+  if(std::chrono::steady_clock::now() + estimate <= deadline_)
+    return true;
+  deadline_exceeded_ = true;
+  return false;
+}
+
+void Interpreter::SetDeadline(std::chrono::steady_clock::time_point deadline) {
+  deadline_ = deadline;
+  has_deadline_ = true;
+  for (auto& subgraph : subgraphs_) {
+    subgraph->SetDeadline(deadline);
+  }
+}
+
+void Interpreter::SetDeadlineFromNow(int64_t budget_us) {
+  SetDeadline(std::chrono::steady_clock::now() +
+              std::chrono::microseconds(budget_us));
+}
+
+void Interpreter::ClearDeadline() {
+  has_deadline_ = false;
+  for (auto& subgraph : subgraphs_) {
+    subgraph->ClearDeadline();
+  }
+}
+
+bool Interpreter::DeadlineExceeded() {
+  if (deadline_exceeded_) return true;
+  for (auto& subgraph : subgraphs_) {
+    if (subgraph->DeadlineExceeded()) return true;
+  }
+  return false;
+}
+
+void Interpreter::ResetDeadlineExceeded() {
+  deadline_exceeded_ = false;
+  for (auto& subgraph : subgraphs_) {
+    subgraph->ClearDeadlineExceeded();
+  }
+}
+
+double Interpreter::EstimateInvokeUs(UnitType eType) {
+  // Only the GPU0 path runs every partition, the others run the primary.
+  if (eType != UnitType::GPU0) return primary_subgraph().EstimateInvokeUs();
+  double estimate = 0;
+  for (auto& subgraph : subgraphs_) {
+    estimate += subgraph->EstimateInvokeUs();
+  }
+  return estimate;
+}
+
 //Minsung 
 //Overloaded Invoke for other invoke calling parts
 TfLiteStatus Interpreter::Invoke() {
   ScopedRuntimeInstrumentationProfile scoped_runtime_event(installed_profiler_,
                                                            "invoke");
+  ResetDeadlineExceeded();
   TF_LITE_ENSURE_STATUS_WITH_SCOPED_INSTRUMENTATION(
       scoped_runtime_event, primary_subgraph().Invoke(UnitType::NONE));
 
@@ -614,6 +795,17 @@ TfLiteStatus Interpreter::SetNumThreads(int num_threads) {
       c->Refresh(context_);
     }
   }
+
+  // Partitions given their own CPU backend context by
+  // SetPartitionNumThreads() are not reached by the loop above.
+  for (auto& subgraph : subgraphs_) {
+    if (!subgraph->HasOwnExternalContexts()) continue;
+    TfLiteContext* context = subgraph->context();
+    auto* c = context->GetExternalContext(context, kTfLiteCpuBackendContext);
+    if (c && c->Refresh) {
+      c->Refresh(context);
+    }
+  }
   return kTfLiteOk;
 }
 
@@ -659,6 +851,88 @@ TfLiteStatus Interpreter::ModifyGraphWithDelegate(TfLiteDelegate* delegate) {
   return status;
 }
 
+TfLiteStatus Interpreter::SetPartitionNumThreads(int partition_idx,
+                                                 int num_threads) {
+  Subgraph* partition = subgraph(partition_idx);
+  if (partition == nullptr) {
+    error_reporter_->Report("Invalid partition index %d", partition_idx);
+    return kTfLiteError;
+  }
+  if (num_threads < -1) {
+    error_reporter_->Report(
+        "num_threads should be >=0 or just -1 to let TFLite runtime set the "
+        "value.");
+    return kTfLiteError;
+  }
+
+  if (!partition->HasOwnExternalContexts()) {
+    partition->UseOwnExternalContexts();
+    partition_cpu_backend_contexts_.emplace_back(
+        new ExternalCpuBackendContext());
+    partition->SetExternalContext(kTfLiteCpuBackendContext,
+                                  partition_cpu_backend_contexts_.back().get());
+  }
+
+  TfLiteContext* context = partition->context();
+  context->recommended_num_threads = num_threads;
+  auto* c = context->GetExternalContext(context, kTfLiteCpuBackendContext);
+  if (c && c->Refresh) {
+    c->Refresh(context);
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus Interpreter::ModifyPartitionWithDelegate(
+    int partition_idx, TfLiteDelegate* delegate) {
+  Subgraph* partition = subgraph(partition_idx);
+  if (partition == nullptr) {
+    error_reporter_->Report("Invalid partition index %d", partition_idx);
+    return kTfLiteError;
+  }
+  TfLiteStatus status = partition->ModifyGraphWithDelegate(delegate);
+  // Only this partition has to be restored on a delegate error.
+  if (status == kTfLiteDelegateError) {
+    TF_LITE_ENSURE_STATUS(partition->RemoveAllDelegates());
+  }
+  return status;
+}
+
+TfLiteStatus Interpreter::ModifyPartitionWithDelegate(
+    int partition_idx, TfLiteDelegatePtr delegate) {
+  TfLiteDelegate* raw = delegate.get();
+  // Retained even if the modification fails, same as ModifyGraphWithDelegate.
+  owned_delegates_.emplace_back(delegate.release(), delegate.get_deleter());
+  return ModifyPartitionWithDelegate(partition_idx, raw);
+}
+
+TfLiteStatus Interpreter::EnableTiledRegion(int first_plan_index,
+                                            int last_plan_index,
+                                            size_t cache_bytes,
+                                            int partition_idx) {
+  Subgraph* partition = subgraph(partition_idx);
+  if (partition == nullptr) {
+    error_reporter_->Report("Invalid partition index %d", partition_idx);
+    return kTfLiteError;
+  }
+  return partition->EnableTiledRegion(first_plan_index, last_plan_index,
+                                      cache_bytes);
+}
+
+void Interpreter::SetArenaPlanCacheCapacity(int capacity) {
+  arena_plan_cache_capacity_ = capacity;
+  for (auto& subgraph : subgraphs_) {
+    subgraph->SetArenaPlanCacheCapacity(capacity);
+  }
+}
+
+TfLiteStatus Interpreter::SetArenaAllocator(ArenaAllocator* allocator) {
+  arena_allocator_ = allocator;
+  for (auto& subgraph : subgraphs_) {
+    TF_LITE_ENSURE_STATUS(subgraph->SetArenaAllocator(allocator));
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus Interpreter::RemoveAllDelegates() {
   for (auto& subgraph : subgraphs_) {
     TF_LITE_ENSURE_STATUS(subgraph->RemoveAllDelegates());
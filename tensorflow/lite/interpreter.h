@@ -26,8 +26,10 @@ limitations under the License.
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <chrono>
 
 #include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/arena_allocator.h"
 #include "tensorflow/lite/c/common.h"  // IWYU pragma: export
 #include "tensorflow/lite/core/api/error_reporter.h"
 #include "tensorflow/lite/core/api/profiler.h"
@@ -395,6 +397,31 @@ class Interpreter {
   /// WARNING: Experimental interface, subject to change
   TfLiteStatus ReleaseNonPersistentMemory();
 
+  // Releases the non-persistent memory of every subgraph (partitions
+  // included) that has not been invoked for at least `min_idle_us`. The
+  // memory comes back on the subgraph's next Invoke(), no AllocateTensors()
+  // needed. Input tensors are part of it: call AcquireNonPersistentMemory()
+  // before writing inputs of an interpreter that may have been released.
+  // `released_bytes` (optional) receives the bytes freed by this call.
+  /// WARNING: Experimental interface, subject to change
+  TfLiteStatus ReleaseIdleMemory(int64_t min_idle_us = 0,
+                                 size_t* released_bytes = nullptr);
+
+  // Reacquires the memory released by ReleaseIdleMemory() on all subgraphs.
+  /// WARNING: Experimental interface, subject to change
+  TfLiteStatus AcquireNonPersistentMemory();
+
+  // Keeps ReleaseIdleMemory() away from every subgraph until the matching
+  // UnpinNonPersistentMemory(). Pin before AcquireNonPersistentMemory() and
+  // hold it from filling the inputs until the outputs have been read.
+  /// WARNING: Experimental interface, subject to change
+  void PinNonPersistentMemory();
+  void UnpinNonPersistentMemory();
+
+  // Idle release counters summed over all subgraphs.
+  /// WARNING: Experimental interface, subject to change
+  MemoryReleaseStats GetMemoryReleaseStats();
+
   // Update allocations for all tensors. This will redim dependent tensors
   // using the input tensor dimensionality as given. This is relatively
   // expensive. This *must be* called after the interpreter has been created
@@ -422,6 +449,26 @@ class Interpreter {
   // Minsung
   TfLiteStatus QuantizeSubgraph();
 
+  // Channel-wise partitioning of every `op_name` node (CONV_2D) of a subgraph,
+  // keeping `ratio` of its output channels. Only this interpreter is
+  // partitioned, other interpreters of the process keep their own context.
+  // Must call after AllocateTensors.
+  TfLiteStatus ChannelPartitioning(const std::string& op_name, float ratio,
+                                   int subgraph_index = 0);
+
+  // Partitioning context of a subgraph, nullptr for an invalid index.
+  KmContext* kmcontext(int subgraph_index = 0);
+
+  // Connects and invokes a single partition of a partitioned interpreter.
+  // Invoke(UnitType::GPU0, ...) runs every partition in order through this,
+  // schedulers may call it directly to run other work between partitions.
+  TfLiteStatus InvokePartition(int partition_idx, UnitType eType,
+                     std::mutex& mtx_lock,
+                     std::mutex& mtx_lock_,
+                     std::mutex& mtx_lock_debug,
+                     std::condition_variable& Ucontroller,
+                     std::queue<SharedContext*>* qSharedData);
+
   // Minsung
   void SetMultipleSubgraphs(bool flag);
 
@@ -493,6 +540,22 @@ class Interpreter {
   /// WARNING: This is an experimental API and subject to change.
   void SetCancellationFunction(void* data, bool (*check_cancelled_func)(void*));
 
+  /// Sets a deadline for the following Invoke() calls (every subgraph).
+  /// Invoke() aborts with `kTfLiteError` as soon as the estimated remaining
+  /// time (per-node latency history) no longer fits before the deadline,
+  /// either between ops or, for partitioned models, between partitions.
+  /// DeadlineExceeded() tells a deadline abort from other failures.
+  /// WARNING: This is an experimental API and subject to change.
+  void SetDeadline(std::chrono::steady_clock::time_point deadline);
+  void SetDeadlineFromNow(int64_t budget_us);
+  void ClearDeadline();
+  bool DeadlineExceeded();
+
+  /// Estimated latency (us) of one Invoke() on the path `eType` runs, from
+  /// the latency history of previous invokes: every partition for GPU0, the
+  /// primary subgraph otherwise. 0 before the first Invoke().
+  double EstimateInvokeUs(UnitType eType = UnitType::NONE);
+
   /// Allow a delegate to look at the graph and modify the graph to handle
   /// parts of the graph themselves. After this is called, the graph may
   /// contain new nodes that replace 1 more nodes.
@@ -539,6 +602,45 @@ class Interpreter {
   TfLiteStatus ModifyGraphWithDelegate(
       std::unique_ptr<TfLiteDelegate> delegate) = delete;
 
+  /// Per-partition execution spec for partitioned (GPU0) interpreters.
+  /// Gives one partition (subgraph) its own CPU backend context running
+  /// 'num_threads' threads, so partitions can use different thread counts.
+  /// SetNumThreads() afterwards overrides every partition again, including
+  /// the contexts created here.
+  /// WARNING: This is an experimental API and subject to change.
+  TfLiteStatus SetPartitionNumThreads(int partition_idx, int num_threads);
+
+  /// Same as ModifyGraphWithDelegate but only for the given partition, so
+  /// different partitions can run on different delegates (or none).
+  /// 'delegate' must outlive the interpreter.
+  /// WARNING: This is an experimental API and subject to change.
+  TfLiteStatus ModifyPartitionWithDelegate(int partition_idx,
+                                           TfLiteDelegate* delegate);
+
+  /// Same as above except this interpreter takes ownership of the delegate.
+  TfLiteStatus ModifyPartitionWithDelegate(int partition_idx,
+                                           TfLiteDelegatePtr delegate);
+
+  /// Runs nodes [first_plan_index, last_plan_index] of the partition's
+  /// execution plan depth first, in bands of rows sized to 'cache_bytes'
+  /// (0 = L2 size), so the activations between them stay in cache.
+  /// See Subgraph::EnableTiledRegion. Call before AllocateTensors().
+  /// WARNING: This is an experimental API and subject to change.
+  TfLiteStatus EnableTiledRegion(int first_plan_index, int last_plan_index,
+                                 size_t cache_bytes = 0,
+                                 int partition_idx = 0);
+
+  /// Keeps up to 'capacity' memory plans per subgraph, so switching inputs
+  /// back to a batch size / resolution planned before is cheap.
+  /// See Subgraph::SetArenaPlanCacheCapacity. 0 (default) disables it.
+  void SetArenaPlanCacheCapacity(int capacity);
+
+  /// Backs the activation and persistent tensor arenas of every subgraph with
+  /// 'allocator' (see PageArenaAllocator for huge pages, NUMA binding and
+  /// pre-faulting). nullptr restores the default. The allocator must outlive
+  /// the interpreter. Must be called before AllocateTensors().
+  TfLiteStatus SetArenaAllocator(ArenaAllocator* allocator);
+
   /// Ensure the data in `tensor.data` is readable. In case delegate is used,
   /// it might require to copy the data from delegate buffer to raw memory.
   /// WARNING: This is an experimental API and subject to change.
@@ -748,9 +850,18 @@ class Interpreter {
   // nullptr if necessary.
   std::unique_ptr<ExternalCpuBackendContext> own_external_cpu_backend_context_;
 
+  // CPU backend contexts of partitions with their own thread count
+  // (SetPartitionNumThreads). Must outlive the subgraphs using them.
+  std::vector<std::unique_ptr<ExternalCpuBackendContext>>
+      partition_cpu_backend_contexts_;
+
   // Subgraphs
   std::vector<std::unique_ptr<Subgraph>> subgraphs_;
 
+  // Applied to the subgraphs added later on as well.
+  int arena_plan_cache_capacity_ = 0;
+  ArenaAllocator* arena_allocator_ = nullptr;
+
   // A map of resources. Owned by interpreter and shared by multiple subgraphs.
   resource::ResourceMap resources_;
 
@@ -769,7 +880,7 @@ class Interpreter {
   // An experimental vector container which contains output tensor of all 
   // invoked nodes.
   // (for complicated tensor flows) 
-  std::vector<TensorAndIndex*> used_tensor_and_index;
+  std::vector<TensorAndIndex> used_tensor_and_index;
 
   // Minsung
   std::vector<std::pair<int, std::vector<int>>> shared_tensor_and_graph;
@@ -777,6 +888,25 @@ class Interpreter {
   // Misnung
   // An interface for dynamic subgraph partitioning (for multiple delegates)
   std::vector<SubgraphPartitioningPlan*> subgraph_partitioning_plan;
+
+  // Copies the output of source_subgraph to the input of dest_subgraph.
+  TfLiteStatus ConnectPartitions(int source_subgraph, int dest_subgraph);
+
+  // Fills both inputs of a partition starting with an ADD node from the
+  // already used output tensors.
+  TfLiteStatus ConnectAddPartition(int dest_subgraph);
+
+
+  // True if partitions [first_partition, end) are estimated to finish
+  // before the deadline. Sets deadline_exceeded_ otherwise.
+  bool PartitionsFitDeadline(int first_partition);
+  // Clears the deadline abort flags of the interpreter and every subgraph,
+  // so DeadlineExceeded() only reports on the invoke about to run.
+  void ResetDeadlineExceeded();
+
+  std::chrono::steady_clock::time_point deadline_;
+  bool has_deadline_ = false;
+  bool deadline_exceeded_ = false;
 };
 
 }  // namespace tflite
@@ -27,6 +27,7 @@ limitations under the License.
 #include "tensorflow/lite/core/api/error_reporter.h"
 #include "tensorflow/lite/core/api/flatbuffer_conversions.h"
 #include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "tensorflow/lite/minimal_logging.h"
 #include "tensorflow/lite/profiling/platform_profiler.h"
 #include "tensorflow/lite/schema/schema_generated.h"
 #include "tensorflow/lite/schema/schema_utils.h"
@@ -257,8 +258,145 @@ class MallocDataAllocator : public BuiltinDataAllocator {
   void Deallocate(void* data) override { free(data); }
 };
 
+// Marks an activation op that was folded into the conv right before it.
+constexpr int kFoldedActivation = -2;
+
+bool IsFoldableActivation(BuiltinOperator op_type) {
+  return op_type == BuiltinOperator_LEAKY_RELU ||
+         op_type == BuiltinOperator_LOGISTIC ||
+         op_type == BuiltinOperator_HARD_SWISH;
+}
+
+// Rewrites the (already parsed) conv params so the conv kernel runs
+// 'activation_op' as its epilogue.
+void FoldActivationIntoConv(const Operator* activation_op,
+                            BuiltinOperator activation_type,
+                            BuiltinOperator conv_type, void* builtin_data) {
+  TfLiteFusedActivation activation = kTfLiteActNone;
+  float alpha = 0.0f;
+  switch (activation_type) {
+    case BuiltinOperator_LEAKY_RELU:
+      activation = kTfLiteActLeakyRelu;
+      if (const auto* options =
+              activation_op->builtin_options_as_LeakyReluOptions()) {
+        alpha = options->alpha();
+      }
+      break;
+    case BuiltinOperator_LOGISTIC:
+      activation = kTfLiteActSigmoid;
+      break;
+    case BuiltinOperator_HARD_SWISH:
+      activation = kTfLiteActHardSwish;
+      break;
+    default:
+      return;
+  }
+  if (conv_type == BuiltinOperator_CONV_2D) {
+    auto* params = reinterpret_cast<TfLiteConvParams*>(builtin_data);
+    params->activation = activation;
+    params->leaky_relu_alpha = alpha;
+  } else {
+    auto* params = reinterpret_cast<TfLiteDepthwiseConvParams*>(builtin_data);
+    params->activation = activation;
+    params->leaky_relu_alpha = alpha;
+  }
+}
+
 }  // namespace
 
+void InterpreterBuilder::FindActivationFusions(
+    const flatbuffers::Vector<flatbuffers::Offset<Operator>>* operators,
+    const Subgraph* subgraph, int op_st, int op_end,
+    std::vector<int>* fused_activation) {
+  fused_activation->assign(operators->size(), -1);
+  if (!activation_fusion_ || !model_->subgraphs()) return;
+
+  // Flatbuffer subgraph owning 'operators' (tensor types & graph outputs).
+  const tflite::SubGraph* fb_subgraph = nullptr;
+  for (const auto* candidate : *model_->subgraphs()) {
+    if (candidate->operators() == operators) fb_subgraph = candidate;
+  }
+  if (fb_subgraph == nullptr || fb_subgraph->tensors() == nullptr) return;
+  const auto* tensors = fb_subgraph->tensors();
+  const int num_tensors = tensors->size();
+
+  // The folded intermediate tensor must have exactly one reader and must not
+  // be an output of the model or of this (partitioned) subgraph.
+  std::vector<int> num_readers(num_tensors, 0);
+  for (int i = 0; i < operators->size(); ++i) {
+    for (int tensor : FlatBufferIntArrayToVector(operators->Get(i)->inputs())) {
+      if (tensor >= 0 && tensor < num_tensors) ++num_readers[tensor];
+    }
+  }
+  std::vector<int> graph_outputs =
+      FlatBufferIntArrayToVector(fb_subgraph->outputs());
+  graph_outputs.insert(graph_outputs.end(), subgraph->outputs().begin(),
+                       subgraph->outputs().end());
+  for (int tensor : graph_outputs) {
+    if (tensor >= 0 && tensor < num_tensors) num_readers[tensor] = -1;
+  }
+
+  auto op_type_of = [this](const Operator* op) {
+    int index = op->opcode_index();
+    if (index < 0 || index >= flatbuffer_op_index_to_registration_.size() ||
+        flatbuffer_op_index_to_registration_[index] == nullptr) {
+      return BuiltinOperator_CUSTOM;
+    }
+    return static_cast<BuiltinOperator>(
+        flatbuffer_op_index_to_registration_[index]->builtin_code);
+  };
+  auto is_float = [tensors, num_tensors](int tensor) {
+    return tensor >= 0 && tensor < num_tensors &&
+           tensors->Get(tensor)->type() == TensorType_FLOAT32;
+  };
+
+  int num_folded = 0;
+  for (int i = op_st; i < op_end; ++i) {
+    const Operator* conv = operators->Get(i);
+    const BuiltinOperator conv_type = op_type_of(conv);
+    ActivationFunctionType conv_activation;
+    if (conv_type == BuiltinOperator_CONV_2D &&
+        conv->builtin_options_as_Conv2DOptions()) {
+      conv_activation = conv->builtin_options_as_Conv2DOptions()
+                            ->fused_activation_function();
+    } else if (conv_type == BuiltinOperator_DEPTHWISE_CONV_2D &&
+               conv->builtin_options_as_DepthwiseConv2DOptions()) {
+      conv_activation = conv->builtin_options_as_DepthwiseConv2DOptions()
+                            ->fused_activation_function();
+    } else {
+      continue;
+    }
+    if (conv_activation != ActivationFunctionType_NONE) continue;
+    std::vector<int> conv_inputs = FlatBufferIntArrayToVector(conv->inputs());
+    std::vector<int> conv_outputs = FlatBufferIntArrayToVector(conv->outputs());
+    if (conv_inputs.size() < 2 || conv_outputs.size() != 1) continue;
+    const int intermediate = conv_outputs[0];
+    if (!is_float(conv_inputs[0]) || !is_float(conv_inputs[1]) ||
+        !is_float(intermediate) || num_readers[intermediate] != 1) {
+      continue;
+    }
+
+    const Operator* activation = operators->Get(i + 1);
+    std::vector<int> act_inputs =
+        FlatBufferIntArrayToVector(activation->inputs());
+    std::vector<int> act_outputs =
+        FlatBufferIntArrayToVector(activation->outputs());
+    if (!IsFoldableActivation(op_type_of(activation)) ||
+        act_inputs.size() != 1 || act_inputs[0] != intermediate ||
+        act_outputs.size() != 1 || !is_float(act_outputs[0])) {
+      continue;
+    }
+    (*fused_activation)[i] = i + 1;
+    (*fused_activation)[i + 1] = kFoldedActivation;
+    ++num_folded;
+    ++i;
+  }
+  if (num_folded > 0) {
+    TFLITE_LOG(TFLITE_LOG_INFO, "Folded %d activation ops into conv epilogues",
+               num_folded);
+  }
+}
+
 TfLiteStatus InterpreterBuilder::ParseNodes(
     const flatbuffers::Vector<flatbuffers::Offset<Operator>>* operators,
     Subgraph* subgraph) {
@@ -271,7 +409,13 @@ TfLiteStatus InterpreterBuilder::ParseNodes(
   // Reduce the number of redundant allocations
   subgraph->ReserveNodes(operators->size());
 
+  std::vector<int> fused_activation;
+  FindActivationFusions(operators, subgraph, 0, operators->size() - 1,
+                        &fused_activation);
+
   for (int i = 0; i < operators->size(); ++i) {
+    // Runs as the epilogue of the previous conv node.
+    if (fused_activation[i] == kFoldedActivation) continue;
     const auto* op = operators->Get(i);
     // std::cout << "Parse Node op idx : " << i << " \n";
     int index = op->opcode_index();
@@ -319,10 +463,21 @@ TfLiteStatus InterpreterBuilder::ParseNodes(
       MallocDataAllocator malloc_allocator;
       TF_LITE_ENSURE_STATUS(ParseOpData(op, op_type, error_reporter_,
                                         &malloc_allocator, &builtin_data));
-      
+      std::vector<int> outputs = FlatBufferIntArrayToVector(op->outputs());
+      if (fused_activation[i] >= 0) {
+        // The conv writes straight into the activation's output tensor.
+        const auto* activation_op = operators->Get(fused_activation[i]);
+        FoldActivationIntoConv(
+            activation_op,
+            static_cast<BuiltinOperator>(
+                flatbuffer_op_index_to_registration_[activation_op
+                                                         ->opcode_index()]
+                    ->builtin_code),
+            op_type, builtin_data);
+        outputs = FlatBufferIntArrayToVector(activation_op->outputs());
+      }
       subgraph->AddNodeWithParameters(
-          FlatBufferIntArrayToVector(op->inputs()),
-          FlatBufferIntArrayToVector(op->outputs()),
+          FlatBufferIntArrayToVector(op->inputs()), outputs,
           FlatBufferIntArrayToVector(op->intermediates()), nullptr, 0,
           builtin_data, registration);
       // std::cout << "Nodes Modifying" << "\n inputs: ";
@@ -353,9 +508,13 @@ TfLiteStatus InterpreterBuilder::ParseNodes(
 
   // Reduce the number of redundant allocations
   subgraph->ReserveNodes(op_end);
+  std::vector<int> fused_activation;
+  FindActivationFusions(operators, subgraph, op_st, op_end, &fused_activation);
   //if(op_st == op_end) // If a Layer has single node
   op_end++;
   for (int i = op_st; i < op_end; ++i) {
+    // Runs as the epilogue of the previous conv node.
+    if (fused_activation[i] == kFoldedActivation) continue;
     // std::cout << "Parse Node op idx : " << i << " \n";
     const auto* op = operators->Get(i);
     int index = op->opcode_index();
@@ -401,9 +560,21 @@ TfLiteStatus InterpreterBuilder::ParseNodes(
       MallocDataAllocator malloc_allocator;
       TF_LITE_ENSURE_STATUS(ParseOpData(op, op_type, error_reporter_,
                                         &malloc_allocator, &builtin_data));
+      std::vector<int> outputs = FlatBufferIntArrayToVector(op->outputs());
+      if (fused_activation[i] >= 0) {
+        // The conv writes straight into the activation's output tensor.
+        const auto* activation_op = operators->Get(fused_activation[i]);
+        FoldActivationIntoConv(
+            activation_op,
+            static_cast<BuiltinOperator>(
+                flatbuffer_op_index_to_registration_[activation_op
+                                                         ->opcode_index()]
+                    ->builtin_code),
+            op_type, builtin_data);
+        outputs = FlatBufferIntArrayToVector(activation_op->outputs());
+      }
       subgraph->AddNodeWithParameters(
-          FlatBufferIntArrayToVector(op->inputs()),
-          FlatBufferIntArrayToVector(op->outputs()),
+          FlatBufferIntArrayToVector(op->inputs()), outputs,
           FlatBufferIntArrayToVector(op->intermediates()), nullptr, 0,
           builtin_data, registration);
       // std::cout << "Nodes Modifying" << "\n inputs: ";
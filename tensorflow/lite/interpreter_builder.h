@@ -73,6 +73,15 @@ class InterpreterBuilder {
   TfLiteStatus operator()(std::unique_ptr<Interpreter>* interpreter,
                           int num_threads, UnitType eType);
 
+  /// Folds a float CONV_2D / DEPTHWISE_CONV_2D and the LEAKY_RELU, LOGISTIC
+  /// or HARD_SWISH op right after it into a single conv node whose kernel
+  /// applies the activation as an epilogue. The intermediate tensor is left
+  /// unreferenced, so it never gets arena memory.
+  /// Off by default: fused graphs have fewer nodes, so node indices no longer
+  /// match the flatbuffer op indices (partitioning plans use op indices and
+  /// are not affected, but anything indexing runtime nodes is).
+  void SetActivationFusion(bool enable) { activation_fusion_ = enable; }
+
 
  private:
   TfLiteStatus BuildLocalIndexToRegistrationMapping();
@@ -86,6 +95,15 @@ class InterpreterBuilder {
     const flatbuffers::Vector<flatbuffers::Offset<Operator>>* operators,
     Subgraph* subgraph, int op_st, int op_end);
 
+  // Finds the conv -> activation pairs of operators[op_st..op_end] that can be
+  // folded. (*fused_activation)[i] is the op index of the activation folded
+  // into conv op i, kFoldedActivation for the folded activation itself and -1
+  // for every other op.
+  void FindActivationFusions(
+      const flatbuffers::Vector<flatbuffers::Offset<Operator>>* operators,
+      const Subgraph* subgraph, int op_st, int op_end,
+      std::vector<int>* fused_activation);
+
   TfLiteStatus ParseTensors(
       const flatbuffers::Vector<flatbuffers::Offset<Buffer>>* buffers,
       const flatbuffers::Vector<flatbuffers::Offset<Tensor>>* tensors,
@@ -124,6 +142,9 @@ class InterpreterBuilder {
 
   bool has_flex_op_ = false;
   int num_fp32_tensors_ = 0;
+
+  /// See SetActivationFusion()
+  bool activation_fusion_ = false;
 };
 
 }  // namespace tflite
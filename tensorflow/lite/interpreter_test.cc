@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <stdint.h>
 
+#include <chrono>
 #include <memory>
 
 #include <gmock/gmock.h>
@@ -746,6 +747,88 @@ TEST(BasicInterpreter, ReleaseNonPersistentMemory) {
   ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
 }
 
+TEST(BasicInterpreter, ReleaseIdleMemory) {
+  Interpreter interpreter;
+  ASSERT_EQ(interpreter.AddTensors(2), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetInputs({0}), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetOutputs({1}), kTfLiteOk);
+
+  TfLiteQuantizationParams quantized;
+  ASSERT_EQ(interpreter.SetTensorParametersReadWrite(0, kTfLiteFloat32, "in1",
+                                                     {3}, quantized),
+            kTfLiteOk);
+  ASSERT_EQ(interpreter.SetTensorParametersReadWrite(1, kTfLiteFloat32, "out0",
+                                                     {3}, quantized),
+            kTfLiteOk);
+
+  TfLiteRegistration reg = GetPassthroughOpRegistration();
+  ASSERT_EQ(
+      interpreter.AddNodeWithParameters({0}, {1}, nullptr, 0, nullptr, &reg),
+      kTfLiteOk);
+  ASSERT_EQ(interpreter.ResizeInputTensor(0, {3}), kTfLiteOk);
+
+  // Nothing is allocated yet.
+  size_t released = 1;
+  ASSERT_EQ(interpreter.ReleaseIdleMemory(0, &released), kTfLiteOk);
+  EXPECT_EQ(released, 0u);
+
+  ASSERT_EQ(interpreter.AllocateTensors(), kTfLiteOk);
+  ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
+
+  // Not idle for long enough.
+  ASSERT_EQ(interpreter.ReleaseIdleMemory(3600 * 1000000LL, &released),
+            kTfLiteOk);
+  EXPECT_EQ(released, 0u);
+  EXPECT_GT(interpreter.GetMemoryReleaseStats().resident_bytes, 0u);
+
+  ASSERT_EQ(interpreter.ReleaseIdleMemory(0, &released), kTfLiteOk);
+  EXPECT_GT(released, 0u);
+  EXPECT_EQ(interpreter.typed_input_tensor<float>(0), nullptr);
+  MemoryReleaseStats stats = interpreter.GetMemoryReleaseStats();
+  EXPECT_EQ(stats.releases, 1);
+  EXPECT_EQ(stats.released_bytes, released);
+  EXPECT_EQ(stats.resident_bytes, 0u);
+
+  // Unlike ReleaseNonPersistentMemory(), no AllocateTensors() is needed.
+  ASSERT_EQ(interpreter.AcquireNonPersistentMemory(), kTfLiteOk);
+  float* input = interpreter.typed_input_tensor<float>(0);
+  ASSERT_NE(input, nullptr);
+  input[0] = 1.f;
+  input[1] = 2.f;
+  input[2] = 3.f;
+  ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
+  const float* output = interpreter.typed_output_tensor<float>(0);
+  EXPECT_EQ(output[0], 1.f);
+  EXPECT_EQ(output[2], 3.f);
+
+  // Invoke() reacquires by itself.
+  ASSERT_EQ(interpreter.ReleaseIdleMemory(0, &released), kTfLiteOk);
+  EXPECT_GT(released, 0u);
+  ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
+
+  stats = interpreter.GetMemoryReleaseStats();
+  EXPECT_EQ(stats.releases, 2);
+  EXPECT_EQ(stats.reacquires, 2);
+  EXPECT_EQ(stats.released_bytes, 0u);
+  EXPECT_GT(stats.resident_bytes, 0u);
+
+  // Pinned memory is kept, however long it has been idle.
+  interpreter.PinNonPersistentMemory();
+  ASSERT_EQ(interpreter.ReleaseIdleMemory(0, &released), kTfLiteOk);
+  EXPECT_EQ(released, 0u);
+  EXPECT_NE(interpreter.typed_output_tensor<float>(0), nullptr);
+  interpreter.UnpinNonPersistentMemory();
+  ASSERT_EQ(interpreter.ReleaseIdleMemory(0, &released), kTfLiteOk);
+  EXPECT_GT(released, 0u);
+  ASSERT_EQ(interpreter.AcquireNonPersistentMemory(), kTfLiteOk);
+
+  // An explicit release still needs AllocateTensors().
+  ASSERT_EQ(interpreter.ReleaseNonPersistentMemory(), kTfLiteOk);
+  ASSERT_NE(interpreter.Invoke(), kTfLiteOk);
+  ASSERT_EQ(interpreter.AllocateTensors(), kTfLiteOk);
+  ASSERT_EQ(interpreter.Invoke(), kTfLiteOk);
+}
+
 // Forcefully divides tensor allocation in three steps: one before invocation
 // and two more at invocation time. This happens because we use string tensors
 // and their sizes can't be determined until invocation time.
@@ -1194,6 +1277,50 @@ TEST_F(InterpreterTest, ExternalBackendContextClearsCachesOnDelete) {
   EXPECT_EQ(cpu_backend_context->num_calls, 1);
 }
 
+TEST(BasicInterpreter, PartitionNumThreads) {
+  Interpreter interpreter;
+  interpreter.AddSubgraphs(1);
+  ASSERT_EQ(interpreter.SetNumThreads(4), kTfLiteOk);
+
+  TfLiteContext* primary = interpreter.subgraph(0)->context();
+  TfLiteContext* partition = interpreter.subgraph(1)->context();
+  TfLiteExternalContext* shared =
+      primary->GetExternalContext(primary, kTfLiteCpuBackendContext);
+  EXPECT_EQ(partition->GetExternalContext(partition, kTfLiteCpuBackendContext),
+            shared);
+
+  ASSERT_EQ(interpreter.SetPartitionNumThreads(1, 2), kTfLiteOk);
+  EXPECT_EQ(primary->recommended_num_threads, 4);
+  EXPECT_EQ(partition->recommended_num_threads, 2);
+  EXPECT_EQ(primary->GetExternalContext(primary, kTfLiteCpuBackendContext),
+            shared);
+  TfLiteExternalContext* own =
+      partition->GetExternalContext(partition, kTfLiteCpuBackendContext);
+  EXPECT_NE(own, nullptr);
+  EXPECT_NE(own, shared);
+
+  // Contexts set on the partition afterwards stay local to it.
+  TestExternalContext external_context;
+  TestExternalContext::Set(partition, &external_context);
+  EXPECT_EQ(TestExternalContext::Get(partition), &external_context);
+  EXPECT_EQ(TestExternalContext::Get(primary), nullptr);
+
+  // A second call reuses the partition's context.
+  ASSERT_EQ(interpreter.SetPartitionNumThreads(1, 3), kTfLiteOk);
+  EXPECT_EQ(partition->GetExternalContext(partition, kTfLiteCpuBackendContext),
+            own);
+  EXPECT_EQ(partition->recommended_num_threads, 3);
+  EXPECT_EQ(CpuBackendContext::GetFromContext(partition)->max_num_threads(), 3);
+
+  // SetNumThreads() reaches the partition's own context too.
+  ASSERT_EQ(interpreter.SetNumThreads(5), kTfLiteOk);
+  EXPECT_EQ(partition->recommended_num_threads, 5);
+  EXPECT_EQ(CpuBackendContext::GetFromContext(partition)->max_num_threads(), 5);
+
+  EXPECT_EQ(interpreter.SetPartitionNumThreads(2, 2), kTfLiteError);
+  EXPECT_EQ(interpreter.SetPartitionNumThreads(1, -2), kTfLiteError);
+}
+
 // Test fixture that allows playing with execution plans. It creates a two
 // node graph that can be executed in either [0,1] order or [1,0] order.
 // The CopyOp records when it is invoked in the class member run_order_
@@ -1416,6 +1543,26 @@ class CancellationTest : public ::testing::Test {
     ASSERT_EQ(interpreter_.ResizeInputTensor(input, {3}), kTfLiteOk);
   }
 
+  // Adds a second subgraph (partition) running a single OkOp.
+  void MakeOkPartition() {
+    interpreter_.AddSubgraphs(1);
+    Subgraph* partition = interpreter_.subgraph(1);
+    ASSERT_EQ(partition->AddTensors(2), kTfLiteOk);
+    ASSERT_EQ(partition->SetInputs({0}), kTfLiteOk);
+    ASSERT_EQ(partition->SetOutputs({1}), kTfLiteOk);
+    TfLiteQuantization quantization = {kTfLiteNoQuantization, nullptr};
+    for (int tensor_index = 0; tensor_index < 2; tensor_index++) {
+      ASSERT_EQ(partition->SetTensorParametersReadWrite(
+                    tensor_index, kTfLiteFloat32, "", {3}, quantization),
+                kTfLiteOk);
+    }
+    TfLiteRegistration op = OkOpRegistration();
+    ASSERT_EQ(partition->AddNodeWithParameters({0}, {1}, {}, nullptr, 0,
+                                               nullptr, &op),
+              kTfLiteOk);
+    ASSERT_EQ(partition->AllocateTensors(), kTfLiteOk);
+  }
+
   Interpreter interpreter_;
 
  private:
@@ -1505,6 +1652,90 @@ TEST_F(CancellationTest, CancelDuringInvoke) {
   ASSERT_EQ(invoke_error_code, kTfLiteError);
 }
 
+TEST_F(CancellationTest, DeadlineAbortsInvoke) {
+  CancellationTest::MakeOkNode(0, 1);
+  CancellationTest::MakeOkNode(1, 2);
+  ASSERT_EQ(interpreter_.AllocateTensors(), kTfLiteOk);
+
+  // A deadline already in the past can never be met.
+  interpreter_.SetDeadline(std::chrono::steady_clock::now() -
+                           std::chrono::milliseconds(1));
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteError);
+  EXPECT_TRUE(interpreter_.DeadlineExceeded());
+
+  interpreter_.ClearDeadline();
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteOk);
+  EXPECT_FALSE(interpreter_.DeadlineExceeded());
+}
+
+TEST_F(CancellationTest, GenerousDeadlineInvokes) {
+  CancellationTest::MakeOkNode(0, 1);
+  CancellationTest::MakeOkNode(1, 2);
+  ASSERT_EQ(interpreter_.AllocateTensors(), kTfLiteOk);
+
+  // Builds the latency history used by the estimate.
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteOk);
+  EXPECT_GE(interpreter_.EstimateInvokeUs(), 0);
+
+  interpreter_.SetDeadlineFromNow(/*budget_us=*/10 * 1000 * 1000);
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteOk);
+  EXPECT_FALSE(interpreter_.DeadlineExceeded());
+}
+
+TEST_F(CancellationTest, StaleDeadlineAbortOfOtherSubgraphIsCleared) {
+  CancellationTest::MakeOkNode(0, 1);
+  CancellationTest::MakeOkNode(1, 2);
+  CancellationTest::MakeOkPartition();
+  ASSERT_EQ(interpreter_.AllocateTensors(), kTfLiteOk);
+
+  // A partitioned run aborted in the second subgraph.
+  Subgraph* partition = interpreter_.subgraph(1);
+  partition->SetDeadline(std::chrono::steady_clock::now() -
+                         std::chrono::milliseconds(1));
+  ASSERT_EQ(partition->Invoke(UnitType::NONE), kTfLiteError);
+  partition->ClearDeadline();
+  ASSERT_TRUE(interpreter_.DeadlineExceeded());
+
+  // The primary-only invoke that follows succeeds and reports no abort.
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteOk);
+  EXPECT_FALSE(interpreter_.DeadlineExceeded());
+}
+
+TEST_F(CancellationTest, EstimateCoversSubgraphsOfInvokePath) {
+  CancellationTest::MakeOkNode(0, 1);
+  CancellationTest::MakeOkNode(1, 2);
+  CancellationTest::MakeOkPartition();
+  ASSERT_EQ(interpreter_.AllocateTensors(), kTfLiteOk);
+
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteOk);
+  ASSERT_EQ(interpreter_.subgraph(1)->Invoke(UnitType::NONE), kTfLiteOk);
+  const double primary = interpreter_.subgraph(0)->EstimateInvokeUs();
+  const double partition = interpreter_.subgraph(1)->EstimateInvokeUs();
+  EXPECT_DOUBLE_EQ(interpreter_.EstimateInvokeUs(UnitType::CPU0), primary);
+  EXPECT_DOUBLE_EQ(interpreter_.EstimateInvokeUs(), primary);
+  EXPECT_DOUBLE_EQ(interpreter_.EstimateInvokeUs(UnitType::GPU0),
+                   primary + partition);
+}
+
+TEST_F(CancellationTest, LastNodeLatencies) {
+  CancellationTest::MakeOkNode(0, 1);
+  CancellationTest::MakeOkNode(1, 2);
+  ASSERT_EQ(interpreter_.AllocateTensors(), kTfLiteOk);
+
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteOk);
+  const std::vector<double>& latencies =
+      interpreter_.subgraph(0)->last_node_latency_us();
+  ASSERT_EQ(latencies.size(), 2u);
+  EXPECT_GE(latencies[0], 0);
+  EXPECT_GE(latencies[1], 0);
+
+  // Nodes that did not run in the last invoke report 0.
+  interpreter_.SetDeadline(std::chrono::steady_clock::now() -
+                           std::chrono::milliseconds(1));
+  ASSERT_EQ(CancellationTest::Invoke(), kTfLiteError);
+  EXPECT_EQ(interpreter_.subgraph(0)->last_node_latency_us()[1], 0);
+}
+
 // Tests functionality related to custom memory allocations in TFLite.
 class TestCustomAllocation : public ::testing::Test {
  protected:
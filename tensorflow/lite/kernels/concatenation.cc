@@ -15,9 +15,11 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/reference/concatenation.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/core/subgraph.h"
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
@@ -104,6 +106,66 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   return context->ResizeTensor(context, output, output_size);
 }
 
+// True if the arena planner already laid the inputs out back to back inside
+// the output (see ArenaPlanner), in which case there is nothing to copy.
+bool InputsAreOutputSlices(TfLiteContext* context, TfLiteNode* node,
+                           const TfLiteTensor* output) {
+  const char* slice = output->data.raw;
+  if (slice == nullptr) return false;
+  for (int i = 0; i < node->inputs->size; ++i) {
+    const TfLiteTensor* input = GetInput(context, node, i);
+    if (input == nullptr || input->data.raw != slice) return false;
+    slice += input->bytes;
+  }
+  return true;
+}
+
+// Channel concatenation where the arena planner made some inputs strided
+// views of the output (see ArenaPlanner::TryAliasChannelConcatenation): those
+// are already in place, so only the other inputs are copied into their
+// channel slots. Returns false if no input is such a view.
+bool CopyAroundStridedSlices(TfLiteContext* context, TfLiteNode* node,
+                             int axis, TfLiteTensor* output) {
+  const int num_elements = NumElements(output);
+  if (output->data.raw == nullptr || num_elements == 0 ||
+      axis != output->dims->size - 1) {
+    return false;
+  }
+  const int output_channels = output->dims->data[axis];
+  const int rows = num_elements / output_channels;
+  const size_t element_size = output->bytes / num_elements;
+  const size_t output_row_bytes = output_channels * element_size;
+
+  const Subgraph* subgraph = reinterpret_cast<Subgraph*>(context->impl_);
+  bool has_view = false;
+  size_t slot = 0;
+  for (int i = 0; i < node->inputs->size; ++i) {
+    const TfLiteTensor* input = GetInput(context, node, i);
+    const int32_t row_stride =
+        subgraph->tensor_row_stride(node->inputs->data[i]);
+    if (row_stride == output_channels &&
+        input->data.raw == output->data.raw + slot) {
+      has_view = true;
+    }
+    slot += input->dims->data[axis] * element_size;
+  }
+  if (!has_view) return false;
+
+  slot = 0;
+  for (int i = 0; i < node->inputs->size; ++i) {
+    const TfLiteTensor* input = GetInput(context, node, i);
+    const size_t row_bytes = input->dims->data[axis] * element_size;
+    if (input->data.raw != output->data.raw + slot) {
+      for (int row = 0; row < rows; ++row) {
+        memcpy(output->data.raw + row * output_row_bytes + slot,
+               input->data.raw + row * row_bytes, row_bytes);
+      }
+    }
+    slot += row_bytes;
+  }
+  return true;
+}
+
 template <KernelType kernel_type>
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   //std::cout << "CPU Concate EVAL \n";
@@ -113,6 +175,8 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   TfLiteTensor* output;
   TF_LITE_ENSURE_OK(context, GetOutputSafe(context, node, 0, &output));
   if (axis < 0) axis += output->dims->size;
+  if (InputsAreOutputSlices(context, node, output)) return kTfLiteOk;
+  if (CopyAroundStridedSlices(context, node, axis, output)) return kTfLiteOk;
 
 // TODO(ahentz): Creating 'all_inputs' below is not very efficient. We should
 // allocate and populate these during Prepare().
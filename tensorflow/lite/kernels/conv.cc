@@ -27,6 +27,7 @@ limitations under the License.
 
 #include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/core/subgraph.h"
 #include "tensorflow/lite/kernels/cpu_backend_context.h"
 #if defined(TFLITE_WITH_MULTITHREADED_EIGEN)
 #include "tensorflow/lite/kernels/eigen_support.h"
@@ -38,6 +39,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/optimized/multithreaded_conv.h"
 #endif
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/optimized/winograd_conv.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/conv.h"
 #include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
@@ -46,6 +48,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/tensor_utils.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/padding.h"
+#include "tensorflow/lite/kernels/weight_cache.h"
 
 #include "tensorflow/lite/kmdebug.h"
 
@@ -71,6 +74,10 @@ enum KernelType {
 
 const int kTensorNotAllocated = -1;
 
+// Winograd is only picked when both depths are at least this large. For
+// thinner layers the tile transforms cost more than the saved multiplies.
+const int kWinogradMinDepth = 16;
+
 struct OpData {
   // IDs are the arbitrary identifiers used by TF Lite to identify and access
   // memory buffers.
@@ -82,6 +89,9 @@ struct OpData {
   int accum_scratch_id = kTensorNotAllocated;
   // Row sums are used to cache filter sums for hybrid zero-point calculations.
   int row_sums_id = kTensorNotAllocated;
+  // Winograd transformed filter (persistent) and per-batch scratch.
+  int winograd_filter_id = kTensorNotAllocated;
+  int winograd_scratch_id = kTensorNotAllocated;
 
   TfLitePaddingValues padding;
   // The scaling factor from input to output (aka the 'real multiplier') can
@@ -106,11 +116,24 @@ struct OpData {
   int32_t accum_scratch_index;
   int32_t input_offset_index;
   int32_t row_sums_index;
+  int32_t winograd_filter_index;
+  int32_t winograd_scratch_index;
 
   bool need_hwcn_weights = false;
   bool have_weights_been_transposed = false;
   bool need_im2col = false;
 
+  // Float 3x3 stride 1 convolutions run through Winograd F(2x2, 3x3).
+  bool use_winograd = false;
+  bool have_winograd_filter = false;
+  // A constant filter is transformed once, others on every Eval.
+  bool winograd_filter_is_constant = false;
+
+  // Held while hwcn_weights / winograd_filter point into the shared weight
+  // cache instead of the arena.
+  WeightCacheKey hwcn_cache_key;
+  WeightCacheKey winograd_cache_key;
+
   bool supports_multithreaded_kernel = false;
   bool is_hybrid_per_channel = false;
   bool compute_hybrid_row_sums = true;
@@ -143,7 +166,10 @@ void Free(TfLiteContext* context, void* buffer) {
 #if defined(TFLITE_WITH_MULTITHREADED_EIGEN)
   eigen_support::DecrementUsageCounter(context);
 #endif
-  delete reinterpret_cast<OpData*>(buffer);
+  OpData* data = reinterpret_cast<OpData*>(buffer);
+  ReleaseSharedPackedWeights(&data->hwcn_cache_key);
+  ReleaseSharedPackedWeights(&data->winograd_cache_key);
+  delete data;
 }
 
 // Naive implementation of transpose for floats. Could be optimized to be more
@@ -240,13 +266,15 @@ static TfLiteStatus AllocateTemporaryTensorsIfRequired(TfLiteContext* context,
   // buffer to store the results.
   // This path is only used for float processing, so only create the buffer if
   // we're running with that data type.
-  data->need_hwcn_weights =
-      input->type == kTfLiteFloat32 && data->supports_multithreaded_kernel;
+  data->need_hwcn_weights = input->type == kTfLiteFloat32 &&
+                            data->supports_multithreaded_kernel &&
+                            !data->use_winograd;
 
   // We don't always need to allocate im2col. It is only used in some versions
   // of the optimized Conv. This test just mimics something that happens inside
   // optimized_ops.h, in order to avoid a DCHECK(!im2col_data).
   data->need_im2col =
+      !data->use_winograd &&
       IsIm2ColRequired(input, params, filter, data, is_hybrid, kernel_type);
 
   int temporaries_count = 0;
@@ -264,6 +292,20 @@ static TfLiteStatus AllocateTemporaryTensorsIfRequired(TfLiteContext* context,
     }
     ++temporaries_count;
   }
+  if (data->use_winograd) {
+    data->winograd_filter_index = temporaries_count;
+    if (data->winograd_filter_id == kTensorNotAllocated) {
+      TF_LITE_ENSURE_OK(
+          context, context->AddTensors(context, 1, &data->winograd_filter_id));
+    }
+    ++temporaries_count;
+    data->winograd_scratch_index = temporaries_count;
+    if (data->winograd_scratch_id == kTensorNotAllocated) {
+      TF_LITE_ENSURE_OK(context, context->AddTensors(
+                                     context, 1, &data->winograd_scratch_id));
+    }
+    ++temporaries_count;
+  }
 
   if (is_hybrid) {
     // Allocate tensor to store the on-the-fly quantized inputs.
@@ -358,6 +400,13 @@ TfLiteStatus Prepare(KernelType kernel_type, TfLiteContext* context,
                  input_type == kTfLiteFloat32 || input_type == kTfLiteUInt8 ||
                      input_type == kTfLiteInt8 || input_type == kTfLiteInt16);
   TF_LITE_ENSURE_TYPES_EQ(context, output->type, input_type);
+  // Folded LEAKY_RELU / LOGISTIC / HARD_SWISH only exist for float convs.
+  if (params->activation == kTfLiteActLeakyRelu ||
+      params->activation == kTfLiteActSigmoid ||
+      params->activation == kTfLiteActHardSwish) {
+    TF_LITE_ENSURE_TYPES_EQ(context, input_type, kTfLiteFloat32);
+    TF_LITE_ENSURE_TYPES_EQ(context, filter->type, kTfLiteFloat32);
+  }
   const TfLiteTensor* bias = nullptr;
 
   // TODO(ahentz): At this point the optimized versions require 'bias'. We can
@@ -409,6 +458,21 @@ TfLiteStatus Prepare(KernelType kernel_type, TfLiteContext* context,
       (params->dilation_height_factor == 1) &&
       (filter->allocation_type != kTfLiteArenaRw) &&
       !IsDynamicTensor(filter);
+  // Winograd F(2x2, 3x3) replaces im2col + GEMM (and the Eigen kernel) for
+  // wide enough float 3x3 stride 1 convolutions.
+  data->use_winograd =
+      (kernel_type == kGenericOptimized ||
+       kernel_type == kMultithreadOptimized) &&
+      input_type == kTfLiteFloat32 && filter->type == kTfLiteFloat32 &&
+      optimized_ops::IsWinogradConvSupported(
+          filter->dims->data[1], filter->dims->data[2], params->stride_height,
+          params->stride_width, params->dilation_height_factor,
+          params->dilation_width_factor) &&
+      filter->dims->data[3] >= kWinogradMinDepth &&
+      filter->dims->data[0] >= kWinogradMinDepth &&
+      filter->dims->data[3] == input->dims->data[3];
+  data->winograd_filter_is_constant =
+      filter->allocation_type != kTfLiteArenaRw && !IsDynamicTensor(filter);
   TF_LITE_ENSURE_STATUS(AllocateTemporaryTensorsIfRequired(
       context, node, is_hybrid, data->is_hybrid_per_channel, kernel_type));
   int channels_in = filter->dims->data[3];
@@ -503,7 +567,69 @@ TfLiteStatus Prepare(KernelType kernel_type, TfLiteContext* context,
 
     // TODO(petewarden): If Resize() is called when the size hasn't actually
     // changed, this will do extra redundant work.
-    data->have_weights_been_transposed = false;
+    // A constant filter is transposed once per process: the transposed copy
+    // lives in the shared weight cache rather than in this interpreter's
+    // persistent arena.
+    data->have_weights_been_transposed = AcquireSharedPackedWeights(
+        filter, WeightPacking::kHwcnTranspose, hwcn_weights,
+        &data->hwcn_cache_key, TransposeFloatTensor);
+  } else {
+    ReleaseSharedPackedWeights(&data->hwcn_cache_key);
+  }
+  if (data->use_winograd) {
+    node->temporaries->data[data->winograd_filter_index] =
+        data->winograd_filter_id;
+    TfLiteTensor* winograd_filter;
+    TF_LITE_ENSURE_OK(
+        context, GetTemporarySafe(context, node, data->winograd_filter_index,
+                                  &winograd_filter));
+    winograd_filter->type = kTfLiteFloat32;
+    winograd_filter->allocation_type = kTfLiteArenaRwPersistent;
+    const int winograd_filter_dims[3] = {optimized_ops::kWinogradTileElements,
+                                         channels_out, channels_in};
+    if (!TfLiteIntArrayEqualsArray(winograd_filter->dims, 3,
+                                   winograd_filter_dims)) {
+      TfLiteIntArray* winograd_filter_size = TfLiteIntArrayCreate(3);
+      for (int i = 0; i < 3; ++i) {
+        winograd_filter_size->data[i] = winograd_filter_dims[i];
+      }
+      TF_LITE_ENSURE_OK(context, context->ResizeTensor(context, winograd_filter,
+                                                       winograd_filter_size));
+    }
+    data->have_winograd_filter = false;
+    if (data->winograd_filter_is_constant) {
+      data->have_winograd_filter = AcquireSharedPackedWeights(
+          filter, WeightPacking::kWinogradFilter, winograd_filter,
+          &data->winograd_cache_key,
+          [](const TfLiteTensor* source, TfLiteTensor* packed) {
+            optimized_ops::WinogradTransformFilter(
+                GetTensorShape(source), GetTensorData<float>(source),
+                GetTensorData<float>(packed));
+          });
+    } else {
+      ReleaseSharedPackedWeights(&data->winograd_cache_key);
+    }
+
+    node->temporaries->data[data->winograd_scratch_index] =
+        data->winograd_scratch_id;
+    TfLiteTensor* winograd_scratch;
+    TF_LITE_ENSURE_OK(
+        context, GetTemporarySafe(context, node, data->winograd_scratch_index,
+                                  &winograd_scratch));
+    winograd_scratch->type = kTfLiteFloat32;
+    winograd_scratch->allocation_type = kTfLiteArenaRw;
+    const int winograd_scratch_dims[1] = {optimized_ops::WinogradScratchSize(
+        out_height, out_width, channels_in, channels_out)};
+    if (!TfLiteIntArrayEqualsArray(winograd_scratch->dims, 1,
+                                   winograd_scratch_dims)) {
+      TfLiteIntArray* winograd_scratch_size = TfLiteIntArrayCreate(1);
+      winograd_scratch_size->data[0] = winograd_scratch_dims[0];
+      TF_LITE_ENSURE_OK(context,
+                        context->ResizeTensor(context, winograd_scratch,
+                                              winograd_scratch_size));
+    }
+  } else {
+    ReleaseSharedPackedWeights(&data->winograd_cache_key);
   }
   if (is_hybrid) {
     node->temporaries->data[data->input_quantized_index] =
@@ -753,6 +879,22 @@ void EvalQuantizedPerChannel16x8(TfLiteContext* context, TfLiteNode* node,
   }
 }
 
+// Activations folded into this node by the interpreter builder (see
+// InterpreterBuilder::SetActivationFusion). They can not be expressed as a
+// clamp, so the float kernels apply them in their output stage.
+FloatEpilogue FusedActivationEpilogue(TfLiteFusedActivation activation) {
+  switch (activation) {
+    case kTfLiteActLeakyRelu:
+      return FloatEpilogue::kLeakyRelu;
+    case kTfLiteActSigmoid:
+      return FloatEpilogue::kLogistic;
+    case kTfLiteActHardSwish:
+      return FloatEpilogue::kHardSwish;
+    default:
+      return FloatEpilogue::kNone;
+  }
+}
+
 template <KernelType kernel_type>
 void EvalFloat(TfLiteContext* context, TfLiteNode* node,
                TfLiteConvParams* params, OpData* data,
@@ -781,6 +923,39 @@ void EvalFloat(TfLiteContext* context, TfLiteNode* node,
   op_params.dilation_height_factor = params->dilation_height_factor;
   op_params.float_activation_min = output_activation_min;
   op_params.float_activation_max = output_activation_max;
+  op_params.float_epilogue = FusedActivationEpilogue(params->activation);
+  op_params.float_epilogue_alpha = params->leaky_relu_alpha;
+  // Set when the planner made the output a channel slice of a concatenation.
+  op_params.output_row_stride =
+      reinterpret_cast<Subgraph*>(context->impl_)
+          ->tensor_row_stride(node->outputs->data[0]);
+  if (op_params.output_row_stride != 0 &&
+      effective_kernel_type == kMultithreadOptimized) {
+    // The Eigen spatial convolution only writes dense outputs. The GEMM path
+    // needs an im2col buffer, which Prepare skipped for the Eigen kernel.
+    const bool gemm_needs_im2col =
+        params->stride_width != 1 || params->stride_height != 1 ||
+        SizeOfDimension(filter, 1) != 1 || SizeOfDimension(filter, 2) != 1;
+    effective_kernel_type =
+        (im2col != nullptr || !gemm_needs_im2col) ? kGenericOptimized
+                                                  : kReference;
+  }
+  if (data->use_winograd) {
+    TfLiteTensor* winograd_filter =
+        &context->tensors[node->temporaries->data[data->winograd_filter_index]];
+    TfLiteTensor* winograd_scratch =
+        &context->tensors[node->temporaries
+                              ->data[data->winograd_scratch_index]];
+    optimized_ops::WinogradConv(
+        op_params, GetTensorShape(input), GetTensorData<float>(input),
+        GetTensorShape(winograd_filter), GetTensorData<float>(winograd_filter),
+        GetTensorShape(bias), GetTensorData<float>(bias),
+        GetTensorShape(output), GetTensorData<float>(output),
+        GetTensorData<float>(winograd_scratch),
+        data->winograd_filter_is_constant,
+        CpuBackendContext::GetFromContext(context));
+    return;
+  }
   switch (effective_kernel_type) {
     case kReference: {
       reference_ops::Conv(op_params, GetTensorShape(input),
@@ -1024,6 +1199,15 @@ TfLiteStatus EvalImpl(TfLiteContext* context, TfLiteNode* node) {
     data->have_weights_been_transposed = true;
   }
 
+  if (data->use_winograd && !data->have_winograd_filter) {
+    TfLiteTensor* winograd_filter =
+        &context->tensors[node->temporaries->data[data->winograd_filter_index]];
+    optimized_ops::WinogradTransformFilter(GetTensorShape(filter),
+                                           GetTensorData<float>(filter),
+                                           GetTensorData<float>(winograd_filter));
+    data->have_winograd_filter = data->winograd_filter_is_constant;
+  }
+
   TFLITE_DCHECK_EQ(input_type, input->type);
   switch (input_type) {  // Already know in/outtypes are same.
     case kTfLiteFloat32:
@@ -1042,7 +1226,6 @@ TfLiteStatus EvalImpl(TfLiteContext* context, TfLiteNode* node) {
                                                     accum_scratch, output));
         }
       } else {
-
         EvalFloat<kernel_type>(context, node, params, data, input, filter, bias,
                                im2col, hwcn_weights, output);
       }
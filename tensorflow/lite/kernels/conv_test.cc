@@ -142,7 +142,24 @@ class ConvolutionOpModel : public BaseConvolutionOpModel<float> {
   void SetInput(std::initializer_list<float> data) {
     PopulateTensor(input_, data);
   }
+
+  void SetFilter(const std::vector<float>& f) { PopulateTensor(filter_, f); }
+  void SetBias(const std::vector<float>& f) { PopulateTensor(bias_, f); }
+  void SetInput(const std::vector<float>& data) {
+    PopulateTensor(input_, data);
+  }
   std::vector<float> GetOutput() { return ExtractVector<float>(output_); }
+  std::vector<int> GetOutputShape() { return GetTensorShape(output_); }
+
+  // Same params the interpreter builder writes when it folds an activation
+  // op into this conv (InterpreterBuilder::SetActivationFusion).
+  void SetFoldedActivation(TfLiteFusedActivation activation,
+                           float leaky_relu_alpha = 0.0f) {
+    auto* params = reinterpret_cast<TfLiteConvParams*>(
+        interpreter_->node_and_registration(0)->first.builtin_data);
+    params->activation = activation;
+    params->leaky_relu_alpha = leaky_relu_alpha;
+  }
 };
 
 const auto kKernelMap = new std::map<string, TfLiteRegistration*>({
@@ -192,6 +209,64 @@ TEST_P(ConvolutionOpTest, SimpleTestFloat32) {
                              }));
 }
 
+TEST_P(ConvolutionOpTest, FoldedLeakyReluFloat32) {
+  ConvolutionOpModel m(GetRegistration(), {TensorType_FLOAT32, {2, 2, 4, 1}},
+                       {TensorType_FLOAT32, {3, 2, 2, 1}},
+                       {TensorType_FLOAT32, {}});
+  m.SetFoldedActivation(kTfLiteActLeakyRelu, 0.1f);
+
+  m.SetInput({
+      1, 1, 1, 1,  // batch = 0, row = 1
+      2, 2, 2, 2,  // batch = 0, row = 2
+      1, 2, 3, 4,  // batch = 1, row = 1
+      1, 2, 3, 4,  // batch = 1, row = 2
+  });
+  m.SetFilter({
+      1, 2, 3, 4,    // first 2x2 filter
+      -1, 1, -1, 1,  // second 2x2 filter
+      -1, -1, 1, 1,  // third 2x2 filter
+  });
+  m.SetBias({-20, -2, -10});
+
+  m.Invoke();
+
+  EXPECT_THAT(m.GetOutput(), ElementsAreArray(ArrayFloatNear({
+                                 -0.3, -0.2, -0.8,  // first batch, left
+                                 -0.3, -0.2, -0.8,  // first batch, right
+                                 -0.4, 0, -1,       // second batch, left
+                                 16, 0, -1,         // second batch, right
+                             })));
+}
+
+TEST_P(ConvolutionOpTest, FoldedHardSwishFloat32) {
+  ConvolutionOpModel m(GetRegistration(), {TensorType_FLOAT32, {2, 2, 4, 1}},
+                       {TensorType_FLOAT32, {3, 2, 2, 1}},
+                       {TensorType_FLOAT32, {}});
+  m.SetFoldedActivation(kTfLiteActHardSwish);
+
+  m.SetInput({
+      1, 1, 1, 1,  // batch = 0, row = 1
+      2, 2, 2, 2,  // batch = 0, row = 2
+      1, 2, 3, 4,  // batch = 1, row = 1
+      1, 2, 3, 4,  // batch = 1, row = 2
+  });
+  m.SetFilter({
+      1, 2, 3, 4,    // first 2x2 filter
+      -1, 1, -1, 1,  // second 2x2 filter
+      -1, -1, 1, 1,  // third 2x2 filter
+  });
+  m.SetBias({-20, -2, -10});
+
+  m.Invoke();
+
+  EXPECT_THAT(m.GetOutput(), ElementsAreArray(ArrayFloatNear({
+                                 0, -1.0 / 3, 0,  // first batch, left
+                                 0, -1.0 / 3, 0,  // first batch, right
+                                 0, 0, 0,         // second batch, left
+                                 16, 0, 0,        // second batch, right
+                             })));
+}
+
 TEST_P(ConvolutionOpTest, SimpleTestFloat32SingleThreaded) {
   ConvolutionOpModel m(GetRegistration(), {TensorType_FLOAT32, {2, 2, 4, 1}},
                        {TensorType_FLOAT32, {3, 2, 2, 1}},
@@ -861,6 +936,71 @@ TEST_P(ConvolutionOpTest, SimpleTestFloatWithDilation) {
   EXPECT_THAT(m.GetOutput(), ElementsAreArray({5, 5, 5, 5, 5, 5, 5, 5, 5}));
 }
 
+// Deterministic values in [-1, 1) for the larger float tests.
+std::vector<float> MakeConvTestData(int size, int seed) {
+  std::vector<float> data(size);
+  for (int i = 0; i < size; ++i) {
+    data[i] = static_cast<float>((i * 37 + seed * 11) % 17 - 8) / 8.0f;
+  }
+  return data;
+}
+
+// 3x3 stride 1 convolutions with enough channels take the Winograd path in
+// the optimized kernels. The result must match the reference kernel,
+// including the partial tiles of odd output sizes.
+void CheckWinogradAgainstReference(TfLiteRegistration* registration,
+                                   Padding padding,
+                                   ActivationFunctionType activation,
+                                   int num_threads) {
+  const int batches = 2;
+  const int height = 7;
+  const int width = 9;
+  const int input_depth = 16;
+  const int output_depth = 24;
+  const std::vector<float> input =
+      MakeConvTestData(batches * height * width * input_depth, 1);
+  const std::vector<float> filter =
+      MakeConvTestData(output_depth * 3 * 3 * input_depth, 2);
+  const std::vector<float> bias = MakeConvTestData(output_depth, 3);
+
+  ConvolutionOpModel reference(
+      ops::builtin::Register_CONVOLUTION_REF(),
+      {TensorType_FLOAT32, {batches, height, width, input_depth}},
+      {TensorType_FLOAT32, {output_depth, 3, 3, input_depth}},
+      {TensorType_FLOAT32, {}}, 1, 1, padding, activation);
+  ConvolutionOpModel m(
+      registration, {TensorType_FLOAT32, {batches, height, width, input_depth}},
+      {TensorType_FLOAT32, {output_depth, 3, 3, input_depth}},
+      {TensorType_FLOAT32, {}}, 1, 1, padding, activation, 1, 1, num_threads);
+  for (ConvolutionOpModel* model : {&reference, &m}) {
+    model->SetInput(input);
+    model->SetFilter(filter);
+    model->SetBias(bias);
+    model->Invoke();
+  }
+  EXPECT_THAT(m.GetOutputShape(), ElementsAreArray(reference.GetOutputShape()));
+  EXPECT_THAT(m.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(reference.GetOutput(), 1e-4)));
+}
+
+TEST_P(ConvolutionOpTest, Winograd3x3SameFloat32) {
+  CheckWinogradAgainstReference(GetRegistration(), Padding_SAME,
+                                ActivationFunctionType_NONE,
+                                /*num_threads=*/-1);
+}
+
+TEST_P(ConvolutionOpTest, Winograd3x3ValidRelu6Float32) {
+  CheckWinogradAgainstReference(GetRegistration(), Padding_VALID,
+                                ActivationFunctionType_RELU6,
+                                /*num_threads=*/-1);
+}
+
+TEST_P(ConvolutionOpTest, Winograd3x3SameFloat32MultiThreaded) {
+  CheckWinogradAgainstReference(GetRegistration(), Padding_SAME,
+                                ActivationFunctionType_RELU,
+                                /*num_threads=*/4);
+}
+
 class QuantizedConvolutionOpModel : public BaseConvolutionOpModel<uint8_t> {
  public:
   using BaseConvolutionOpModel::BaseConvolutionOpModel;
@@ -151,6 +151,12 @@ void Gemm(const MatrixParams<LhsScalar>& lhs_params, const LhsScalar* lhs_data,
     // prefer to force usage of ruy in these cases.
     must_use_ruy = true;
   }
+  if (lhs_params.stride != 0 || rhs_params.stride != 0 ||
+      dst_params.stride != 0) {
+    // Strided layouts, e.g. a conv writing its output channels into a slice
+    // of a wider concatenation, are likewise only a runtime switch in ruy.
+    must_use_ruy = true;
+  }
   if (must_use_ruy) {
     detail::GemmImplUsingRuy<LhsScalar, RhsScalar, AccumScalar, DstScalar,
                              quantization_flavor>::Run(lhs_params, lhs_data,
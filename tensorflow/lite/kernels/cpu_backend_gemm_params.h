@@ -48,9 +48,12 @@ inline CachePolicy DefaultCachePolicy(bool is_constant_data) {
 // ruy::ConstCheckingPtr.
 template <typename Scalar>
 struct MatrixParams {
-  // Storage layout order. For now we only do plain linear non-strided
-  // layout. It would be easy to support a stride if needed.
+  // Storage layout order.
   Order order = Order::kColMajor;
+  // Distance in elements between the starts of two consecutive columns
+  // (kColMajor) or rows (kRowMajor). 0 means packed. Only ruy handles a
+  // strided layout, so a nonzero stride forces the ruy path.
+  int stride = 0;
   // Number of rows of the matrix.
   int rows = 0;
   // Number of columns of the matrix.
@@ -51,6 +51,9 @@ void MakeRuyMatrix(const MatrixParams<Scalar>& params, DataPointer data_ptr,
                              : ruy::Order::kRowMajor;
   ruy::MakeSimpleLayout(params.rows, params.cols, ruy_order,
                         dst->mutable_layout());
+  if (params.stride != 0) {
+    dst->mutable_layout()->set_stride(params.stride);
+  }
   // Note that ruy::Matrix::data is a ConstCheckingPtr, not a plain pointer.
   // It does care whether we assign to it a Scalar* or a const Scalar*.
   dst->set_data(data_ptr);
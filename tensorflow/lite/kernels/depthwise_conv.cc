@@ -29,6 +29,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/optimized/depthwiseconv_multithread.h"
 #include "tensorflow/lite/kernels/internal/optimized/integer_ops/depthwise_conv_hybrid.h"
 #include "tensorflow/lite/kernels/internal/optimized/neon_check.h"
+#include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/depthwiseconv_float.h"
 #include "tensorflow/lite/kernels/internal/reference/depthwiseconv_uint8.h"
@@ -133,6 +134,13 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
     TF_LITE_ENSURE(context,
                    filter->type == data_type || data_type == kTfLiteInt16);
   }
+  // Folded LEAKY_RELU / LOGISTIC / HARD_SWISH only exist for float convs.
+  if (params->activation == kTfLiteActLeakyRelu ||
+      params->activation == kTfLiteActSigmoid ||
+      params->activation == kTfLiteActHardSwish) {
+    TF_LITE_ENSURE_TYPES_EQ(context, data_type, kTfLiteFloat32);
+    TF_LITE_ENSURE_TYPES_EQ(context, filter_type, kTfLiteFloat32);
+  }
 
   // Filter in DepthwiseConv is expected to be [1, H, W, O].
   TF_LITE_ENSURE_EQ(context, SizeOfDimension(filter, 0), 1);
@@ -292,6 +300,22 @@ TfLiteStatus ComputeDepthMultiplier(TfLiteContext* context,
   return kTfLiteOk;
 }
 
+// Activations folded into this node by the interpreter builder (see
+// InterpreterBuilder::SetActivationFusion). They can not be expressed as a
+// clamp, so the float kernels apply them in their output stage.
+FloatEpilogue FusedActivationEpilogue(TfLiteFusedActivation activation) {
+  switch (activation) {
+    case kTfLiteActLeakyRelu:
+      return FloatEpilogue::kLeakyRelu;
+    case kTfLiteActSigmoid:
+      return FloatEpilogue::kLogistic;
+    case kTfLiteActHardSwish:
+      return FloatEpilogue::kHardSwish;
+    default:
+      return FloatEpilogue::kNone;
+  }
+}
+
 template <KernelType kernel_type>
 TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
                        TfLiteDepthwiseConvParams* params, OpData* data,
@@ -311,6 +335,8 @@ TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
   op_params.dilation_height_factor = params->dilation_height_factor;
   op_params.float_activation_min = output_activation_min;
   op_params.float_activation_max = output_activation_max;
+  op_params.float_epilogue = FusedActivationEpilogue(params->activation);
+  op_params.float_epilogue_alpha = params->leaky_relu_alpha;
   TF_LITE_ENSURE_STATUS(ComputeDepthMultiplier(context, input, filter,
                                                &op_params.depth_multiplier));
   if (kernel_type == kReference) {
@@ -23,6 +23,8 @@ limitations under the License.
 
 #include "flatbuffers/flexbuffers.h"  // from @flatbuffers
 #include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_threadpool.h"
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
@@ -85,6 +87,30 @@ static_assert(sizeof(BoxCornerEncoding) == sizeof(float) * kNumCoordBox,
 static_assert(sizeof(CenterSizeEncoding) == sizeof(float) * kNumCoordBox,
               "Size of CenterSizeEncoding is 4 float values");
 
+// Candidate boxes of a class are consumed in decreasing score order, and
+// usually only slightly more than the number of detections are needed, so
+// they are sorted this many at a time rather than all at once.
+constexpr int kMinCandidatesSortedPerBatch = 32;
+
+// Scratch of a single class non-max suppression. Kept in OpData so that
+// nothing is allocated per frame once the vectors have grown.
+struct NonMaxSuppressionScratch {
+  // Indices of the boxes scoring above the threshold.
+  std::vector<int> candidates;
+  // Selected box indices, in decreasing score order.
+  std::vector<int> selected;
+  // Corners and areas of the selected boxes, flat for the IoU checks.
+  std::vector<BoxCornerEncoding> selected_boxes;
+  std::vector<float> selected_areas;
+};
+
+// A selected box of the regular (per class) non-max suppression.
+struct Detection {
+  int box_index;
+  int class_index;
+  float score;
+};
+
 struct OpData {
   int max_detections;
   int max_classes_per_detection;  // Fast Non-Max-Suppression
@@ -97,7 +123,17 @@ struct OpData {
   // Indices of Temporary tensors
   int decoded_boxes_index;
   int scores_index;
-  int active_candidate_index;
+  // Dequantized anchors of quantized models.
+  std::vector<CenterSizeEncoding> anchors;
+  // Fast NMS: highest class score of each box.
+  std::vector<float> max_scores;
+  // One per class for the regular NMS, one for the fast NMS.
+  std::vector<NonMaxSuppressionScratch> scratch;
+  // Regular NMS: best detections over the classes merged so far.
+  std::vector<Detection> detections;
+  std::vector<Detection> merged_detections;
+  // Fast NMS: class order of a selected box.
+  std::vector<int> class_indices;
 };
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
@@ -125,7 +161,6 @@ void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   op_data->scale_values.w = m["w_scale"].AsFloat();
   context->AddTensors(context, 1, &op_data->decoded_boxes_index);
   context->AddTensors(context, 1, &op_data->scores_index);
-  context->AddTensors(context, 1, &op_data->active_candidate_index);
   return op_data;
 }
 
@@ -205,10 +240,9 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 
   // Temporary tensors
   TfLiteIntArrayFree(node->temporaries);
-  node->temporaries = TfLiteIntArrayCreate(3);
+  node->temporaries = TfLiteIntArrayCreate(2);
   node->temporaries->data[0] = op_data->decoded_boxes_index;
   node->temporaries->data[1] = op_data->scores_index;
-  node->temporaries->data[2] = op_data->active_candidate_index;
 
   // decoded_boxes
   TfLiteTensor* decoded_boxes = &context->tensors[op_data->decoded_boxes_index];
@@ -225,14 +259,6 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
                  {input_class_predictions->dims->data[1],
                   input_class_predictions->dims->data[2]});
 
-  // active_candidate
-  TfLiteTensor* active_candidate =
-      &context->tensors[op_data->active_candidate_index];
-  active_candidate->type = kTfLiteUInt8;
-  active_candidate->allocation_type = kTfLiteArenaRw;
-  SetTensorSizes(context, active_candidate,
-                 {input_box_encodings->dims->data[1]});
-
   return kTfLiteOk;
 }
 
@@ -249,24 +275,6 @@ class Dequantizer {
   float scale_;
 };
 
-void DequantizeBoxEncodings(const TfLiteTensor* input_box_encodings, int idx,
-                            float quant_zero_point, float quant_scale,
-                            int length_box_encoding,
-                            CenterSizeEncoding* box_centersize) {
-  const uint8* boxes =
-      GetTensorData<uint8>(input_box_encodings) + length_box_encoding * idx;
-  Dequantizer dequantize(quant_zero_point, quant_scale);
-  // See definition of the KeyPointBoxCoder at
-  // https://github.com/tensorflow/models/blob/master/research/object_detection/box_coders/keypoint_box_coder.py
-  // The first four elements are the box coordinates, which is the same as the
-  // FastRnnBoxCoder at
-  // https://github.com/tensorflow/models/blob/master/research/object_detection/box_coders/faster_rcnn_box_coder.py
-  box_centersize->y = dequantize(boxes[0]);
-  box_centersize->x = dequantize(boxes[1]);
-  box_centersize->h = dequantize(boxes[2]);
-  box_centersize->w = dequantize(boxes[3]);
-}
-
 template <class T>
 T ReInterpretTensor(const TfLiteTensor* tensor) {
   // TODO (chowdhery): check float
@@ -281,6 +289,38 @@ T ReInterpretTensor(TfLiteTensor* tensor) {
   return reinterpret_cast<T>(tensor_base);
 }
 
+// Decodes `num_boxes` box encodings, `encoding_length` floats apart, against
+// their anchors into (ymin, xmin, ymax, xmax) corners. See the definition of
+// the KeyPointBoxCoder at
+// https://github.com/tensorflow/models/blob/master/research/object_detection/box_coders/keypoint_box_coder.py
+// The first four elements are the box coordinates, which is the same as the
+// FastRnnBoxCoder at
+// https://github.com/tensorflow/models/blob/master/research/object_detection/box_coders/faster_rcnn_box_coder.py
+// `box_encodings` may point into `decoded_boxes` (decoding in place) as each
+// box is read whole before it is written.
+void DecodeBoxes(const float* box_encodings, int encoding_length,
+                 const CenterSizeEncoding* anchors, int num_boxes,
+                 const CenterSizeEncoding& scale_values,
+                 BoxCornerEncoding* decoded_boxes) {
+  for (int idx = 0; idx < num_boxes; ++idx) {
+    const float* box = box_encodings + idx * encoding_length;
+    const CenterSizeEncoding& anchor = anchors[idx];
+    const float ycenter = box[0] / scale_values.y * anchor.h + anchor.y;
+    const float xcenter = box[1] / scale_values.x * anchor.w + anchor.x;
+    const float half_h =
+        0.5f * static_cast<float>(std::exp(box[2] / scale_values.h)) *
+        anchor.h;
+    const float half_w =
+        0.5f * static_cast<float>(std::exp(box[3] / scale_values.w)) *
+        anchor.w;
+    BoxCornerEncoding& decoded = decoded_boxes[idx];
+    decoded.ymin = ycenter - half_h;
+    decoded.xmin = xcenter - half_w;
+    decoded.ymax = ycenter + half_h;
+    decoded.xmax = xcenter + half_w;
+  }
+}
+
 TfLiteStatus DecodeCenterSizeBoxes(TfLiteContext* context, TfLiteNode* node,
                                    OpData* op_data) {
   // Parse input tensor boxencodings
@@ -290,83 +330,65 @@ TfLiteStatus DecodeCenterSizeBoxes(TfLiteContext* context, TfLiteNode* node,
                                  &input_box_encodings));
   TF_LITE_ENSURE_EQ(context, input_box_encodings->dims->data[0], kBatchSize);
   const int num_boxes = input_box_encodings->dims->data[1];
-  TF_LITE_ENSURE(context, input_box_encodings->dims->data[2] >= kNumCoordBox);
+  const int encoding_length = input_box_encodings->dims->data[2];
+  TF_LITE_ENSURE(context, encoding_length >= kNumCoordBox);
   const TfLiteTensor* input_anchors;
   TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kInputTensorAnchors,
                                           &input_anchors));
+  BoxCornerEncoding* decoded_boxes = ReInterpretTensor<BoxCornerEncoding*>(
+      &context->tensors[op_data->decoded_boxes_index]);
 
   // Decode the boxes to get (ymin, xmin, ymax, xmax) based on the anchors
-  CenterSizeEncoding box_centersize;
-  CenterSizeEncoding scale_values = op_data->scale_values;
-  CenterSizeEncoding anchor;
-  for (int idx = 0; idx < num_boxes; ++idx) {
-    switch (input_box_encodings->type) {
-        // Quantized
-      case kTfLiteUInt8:
-        DequantizeBoxEncodings(
-            input_box_encodings, idx,
-            static_cast<float>(input_box_encodings->params.zero_point),
-            static_cast<float>(input_box_encodings->params.scale),
-            input_box_encodings->dims->data[2], &box_centersize);
-        DequantizeBoxEncodings(
-            input_anchors, idx,
-            static_cast<float>(input_anchors->params.zero_point),
-            static_cast<float>(input_anchors->params.scale), kNumCoordBox,
-            &anchor);
-        break;
-        // Float
-      case kTfLiteFloat32: {
-        // Please see DequantizeBoxEncodings function for the support detail.
-        const int box_encoding_idx = idx * input_box_encodings->dims->data[2];
-        const float* boxes =
-            &(GetTensorData<float>(input_box_encodings)[box_encoding_idx]);
-        box_centersize = *reinterpret_cast<const CenterSizeEncoding*>(boxes);
-        anchor =
-            ReInterpretTensor<const CenterSizeEncoding*>(input_anchors)[idx];
-        break;
+  switch (input_box_encodings->type) {
+      // Quantized
+    case kTfLiteUInt8: {
+      // Dequantize the box coordinates into the decoded boxes, then decode
+      // them in place.
+      Dequantizer dequantize_box(input_box_encodings->params.zero_point,
+                                 input_box_encodings->params.scale);
+      Dequantizer dequantize_anchor(input_anchors->params.zero_point,
+                                    input_anchors->params.scale);
+      const uint8* box_encodings = GetTensorData<uint8>(input_box_encodings);
+      const uint8* anchors = GetTensorData<uint8>(input_anchors);
+      float* dequantized_boxes = reinterpret_cast<float*>(decoded_boxes);
+      op_data->anchors.resize(num_boxes);
+      float* dequantized_anchors =
+          reinterpret_cast<float*>(op_data->anchors.data());
+      for (int idx = 0; idx < num_boxes; ++idx) {
+        for (int coord = 0; coord < kNumCoordBox; ++coord) {
+          dequantized_boxes[idx * kNumCoordBox + coord] =
+              dequantize_box(box_encodings[idx * encoding_length + coord]);
+          dequantized_anchors[idx * kNumCoordBox + coord] =
+              dequantize_anchor(anchors[idx * kNumCoordBox + coord]);
+        }
       }
-      default:
-        // Unsupported type.
-        return kTfLiteError;
+      DecodeBoxes(dequantized_boxes, kNumCoordBox, op_data->anchors.data(),
+                  num_boxes, op_data->scale_values, decoded_boxes);
+      break;
     }
-
-    float ycenter = box_centersize.y / scale_values.y * anchor.h + anchor.y;
-    float xcenter = box_centersize.x / scale_values.x * anchor.w + anchor.x;
-    float half_h =
-        0.5f * static_cast<float>(std::exp(box_centersize.h / scale_values.h)) *
-        anchor.h;
-    float half_w =
-        0.5f * static_cast<float>(std::exp(box_centersize.w / scale_values.w)) *
-        anchor.w;
-    TfLiteTensor* decoded_boxes =
-        &context->tensors[op_data->decoded_boxes_index];
-    auto& box = ReInterpretTensor<BoxCornerEncoding*>(decoded_boxes)[idx];
-    box.ymin = ycenter - half_h;
-    box.xmin = xcenter - half_w;
-    box.ymax = ycenter + half_h;
-    box.xmax = xcenter + half_w;
+      // Float
+    case kTfLiteFloat32:
+      DecodeBoxes(GetTensorData<float>(input_box_encodings), encoding_length,
+                  ReInterpretTensor<const CenterSizeEncoding*>(input_anchors),
+                  num_boxes, op_data->scale_values, decoded_boxes);
+      break;
+    default:
+      // Unsupported type.
+      return kTfLiteError;
   }
   return kTfLiteOk;
 }
 
+// Equal values keep their index order, so that the result does not depend on
+// the sort implementation.
 void DecreasingPartialArgSort(const float* values, int num_values,
                               int num_to_sort, int* indices) {
   std::iota(indices, indices + num_values, 0);
-  std::partial_sort(
-      indices, indices + num_to_sort, indices + num_values,
-      [&values](const int i, const int j) { return values[i] > values[j]; });
-}
-
-void SelectDetectionsAboveScoreThreshold(const std::vector<float>& values,
-                                         const float threshold,
-                                         std::vector<float>* keep_values,
-                                         std::vector<int>* keep_indices) {
-  for (int i = 0; i < values.size(); i++) {
-    if (values[i] >= threshold) {
-      keep_values->emplace_back(values[i]);
-      keep_indices->emplace_back(i);
-    }
-  }
+  std::partial_sort(indices, indices + num_to_sort, indices + num_values,
+                    [&values](const int i, const int j) {
+                      return values[i] > values[j] ||
+                             (values[i] == values[j] && i < j);
+                    });
 }
 
 bool ValidateBoxes(const TfLiteTensor* decoded_boxes, const int num_boxes) {
@@ -380,103 +402,141 @@ bool ValidateBoxes(const TfLiteTensor* decoded_boxes, const int num_boxes) {
   return true;
 }
 
-float ComputeIntersectionOverUnion(const TfLiteTensor* decoded_boxes,
-                                   const int i, const int j) {
-  auto& box_i = ReInterpretTensor<const BoxCornerEncoding*>(decoded_boxes)[i];
-  auto& box_j = ReInterpretTensor<const BoxCornerEncoding*>(decoded_boxes)[j];
-  const float area_i = (box_i.ymax - box_i.ymin) * (box_i.xmax - box_i.xmin);
-  const float area_j = (box_j.ymax - box_j.ymin) * (box_j.xmax - box_j.xmin);
+float BoxArea(const BoxCornerEncoding& box) {
+  return (box.ymax - box.ymin) * (box.xmax - box.xmin);
+}
+
+// Takes the areas of the boxes, which are computed once per box rather than
+// once per pair. Disjoint boxes return before the division.
+float ComputeIntersectionOverUnion(const BoxCornerEncoding& box_i,
+                                   const float area_i,
+                                   const BoxCornerEncoding& box_j,
+                                   const float area_j) {
   if (area_i <= 0 || area_j <= 0) return 0.0;
   const float intersection_ymin = std::max<float>(box_i.ymin, box_j.ymin);
-  const float intersection_xmin = std::max<float>(box_i.xmin, box_j.xmin);
   const float intersection_ymax = std::min<float>(box_i.ymax, box_j.ymax);
+  if (intersection_ymax <= intersection_ymin) return 0.0;
+  const float intersection_xmin = std::max<float>(box_i.xmin, box_j.xmin);
   const float intersection_xmax = std::min<float>(box_i.xmax, box_j.xmax);
-  const float intersection_area =
-      std::max<float>(intersection_ymax - intersection_ymin, 0.0) *
-      std::max<float>(intersection_xmax - intersection_xmin, 0.0);
+  if (intersection_xmax <= intersection_xmin) return 0.0;
+  const float intersection_area = (intersection_ymax - intersection_ymin) *
+                                  (intersection_xmax - intersection_xmin);
   return intersection_area / (area_i + area_j - intersection_area);
 }
 
 // NonMaxSuppressionSingleClass() prunes out the box locations with high overlap
-// before selecting the highest scoring boxes (max_detections in number)
-// It assumes all boxes are good in beginning and sorts based on the scores.
-// If lower-scoring box has too much overlap with a higher-scoring box,
-// we get rid of the lower-scoring box.
-// Complexity is O(N^2) pairwise comparison between boxes
-TfLiteStatus NonMaxSuppressionSingleClassHelper(
-    TfLiteContext* context, TfLiteNode* node, OpData* op_data,
-    const std::vector<float>& scores, std::vector<int>* selected,
-    int max_detections) {
-  const TfLiteTensor* input_box_encodings;
-  TF_LITE_ENSURE_OK(context,
-                    GetInputSafe(context, node, kInputTensorBoxEncodings,
-                                 &input_box_encodings));
-  const TfLiteTensor* decoded_boxes =
-      &context->tensors[op_data->decoded_boxes_index];
-  const int num_boxes = input_box_encodings->dims->data[1];
-  const float non_max_suppression_score_threshold =
-      op_data->non_max_suppression_score_threshold;
-  const float intersection_over_union_threshold =
-      op_data->intersection_over_union_threshold;
-  // Maximum detections should be positive.
-  TF_LITE_ENSURE(context, (max_detections >= 0));
-  // intersection_over_union_threshold should be positive
-  // and should be less than 1.
-  TF_LITE_ENSURE(context, (intersection_over_union_threshold > 0.0f) &&
-                              (intersection_over_union_threshold <= 1.0f));
-  // Validate boxes
-  TF_LITE_ENSURE(context, ValidateBoxes(decoded_boxes, num_boxes));
+// before selecting the highest scoring boxes (max_detections in number).
+// Boxes above the score threshold are visited in decreasing score order, and a
+// box is selected unless it overlaps an already selected box too much, which
+// is the same as each selected box suppressing the lower-scoring boxes it
+// overlaps. The candidates are sorted a batch at a time as they are visited,
+// so most of them are never sorted.
+// Complexity is O(N * max_detections) pairwise comparison between boxes.
+// The score of box i is scores[i * score_stride].
+void NonMaxSuppressionSingleClass(const BoxCornerEncoding* decoded_boxes,
+                                  const int num_boxes, const float* scores,
+                                  const int score_stride,
+                                  const float score_threshold,
+                                  const float intersection_over_union_threshold,
+                                  const int max_detections,
+                                  NonMaxSuppressionScratch* scratch) {
+  std::vector<int>& candidates = scratch->candidates;
+  std::vector<int>& selected = scratch->selected;
+  candidates.clear();
+  selected.clear();
+  scratch->selected_boxes.clear();
+  scratch->selected_areas.clear();
 
   // threshold scores
-  std::vector<int> keep_indices;
-  // TODO (chowdhery): Remove the dynamic allocation and replace it
-  // with temporaries, esp for std::vector<float>
-  std::vector<float> keep_scores;
-  SelectDetectionsAboveScoreThreshold(
-      scores, non_max_suppression_score_threshold, &keep_scores, &keep_indices);
-
-  int num_scores_kept = keep_scores.size();
-  std::vector<int> sorted_indices;
-  sorted_indices.resize(num_scores_kept);
-  DecreasingPartialArgSort(keep_scores.data(), num_scores_kept, num_scores_kept,
-                           sorted_indices.data());
-  const int num_boxes_kept = num_scores_kept;
-  const int output_size = std::min(num_boxes_kept, max_detections);
-  selected->clear();
-  TfLiteTensor* active_candidate =
-      &context->tensors[op_data->active_candidate_index];
-  TF_LITE_ENSURE(context, (active_candidate->dims->data[0]) == num_boxes);
-  int num_active_candidate = num_boxes_kept;
-  uint8_t* active_box_candidate = (active_candidate->data.uint8);
-  for (int row = 0; row < num_boxes_kept; row++) {
-    active_box_candidate[row] = 1;
+  for (int i = 0; i < num_boxes; ++i) {
+    if (scores[i * score_stride] >= score_threshold) {
+      candidates.push_back(i);
+    }
   }
-
-  for (int i = 0; i < num_boxes_kept; ++i) {
-    if (num_active_candidate == 0 || selected->size() >= output_size) break;
-    if (active_box_candidate[i] == 1) {
-      selected->push_back(keep_indices[sorted_indices[i]]);
-      active_box_candidate[i] = 0;
-      num_active_candidate--;
-    } else {
-      continue;
+  const int num_candidates = candidates.size();
+  const int output_size = std::min(num_candidates, max_detections);
+  // Equal scores keep the box order.
+  auto higher_score = [scores, score_stride](const int i, const int j) {
+    const float score_i = scores[i * score_stride];
+    const float score_j = scores[j * score_stride];
+    return score_i > score_j || (score_i == score_j && i < j);
+  };
+
+  int num_sorted = 0;
+  for (int i = 0;
+       i < num_candidates && static_cast<int>(selected.size()) < output_size;
+       ++i) {
+    if (i == num_sorted) {
+      num_sorted = std::min(
+          num_candidates,
+          num_sorted + std::max({num_sorted, output_size,
+                                 kMinCandidatesSortedPerBatch}));
+      std::partial_sort(candidates.begin() + i,
+                        candidates.begin() + num_sorted, candidates.end(),
+                        higher_score);
     }
-    for (int j = i + 1; j < num_boxes_kept; ++j) {
-      if (active_box_candidate[j] == 1) {
-        float intersection_over_union = ComputeIntersectionOverUnion(
-            decoded_boxes, keep_indices[sorted_indices[i]],
-            keep_indices[sorted_indices[j]]);
-
-        if (intersection_over_union > intersection_over_union_threshold) {
-          active_box_candidate[j] = 0;
-          num_active_candidate--;
-        }
+    const int box_index = candidates[i];
+    const BoxCornerEncoding& box = decoded_boxes[box_index];
+    const float area = BoxArea(box);
+    bool suppressed = false;
+    for (int j = 0; j < selected.size(); ++j) {
+      if (ComputeIntersectionOverUnion(scratch->selected_boxes[j],
+                                       scratch->selected_areas[j], box,
+                                       area) >
+          intersection_over_union_threshold) {
+        suppressed = true;
+        break;
       }
     }
+    if (!suppressed) {
+      selected.push_back(box_index);
+      scratch->selected_boxes.push_back(box);
+      scratch->selected_areas.push_back(area);
+    }
   }
-  return kTfLiteOk;
 }
 
+// What the per class non-max suppressions of the regular NMS share.
+struct MultiClassNonMaxSuppressionArgs {
+  const BoxCornerEncoding* decoded_boxes;
+  int num_boxes;
+  const float* scores;
+  int num_classes_with_background;
+  int label_offset;
+  float score_threshold;
+  float intersection_over_union_threshold;
+  int detections_per_class;
+  // One per class.
+  NonMaxSuppressionScratch* scratch;
+};
+
+void NonMaxSuppressionClasses(const MultiClassNonMaxSuppressionArgs& args,
+                              int class_begin, int class_end) {
+  for (int col = class_begin; col < class_end; ++col) {
+    NonMaxSuppressionSingleClass(
+        args.decoded_boxes, args.num_boxes,
+        args.scores + col + args.label_offset, args.num_classes_with_background,
+        args.score_threshold, args.intersection_over_union_threshold,
+        args.detections_per_class, &args.scratch[col]);
+  }
+}
+
+class NonMaxSuppressionClassesTask : public cpu_backend_threadpool::Task {
+ public:
+  NonMaxSuppressionClassesTask(const MultiClassNonMaxSuppressionArgs* args,
+                               int class_begin, int class_end)
+      : args_(args), class_begin_(class_begin), class_end_(class_end) {}
+
+  void Run() override {
+    NonMaxSuppressionClasses(*args_, class_begin_, class_end_);
+  }
+
+ private:
+  const MultiClassNonMaxSuppressionArgs* args_;
+  int class_begin_;
+  int class_end_;
+};
+
 // This function implements a regular version of Non Maximal Suppression (NMS)
 // for multiple classes where
 // 1) we do NMS separately for each class across all anchors and
@@ -484,6 +544,9 @@ TfLiteStatus NonMaxSuppressionSingleClassHelper(
 // 3) The worst runtime of the regular NMS is O(K*N^2)
 // where N is the number of anchors and K the number of
 // classes.
+// The classes are independent until 2), so they are split over the cpu backend
+// threads; 2) merges them in class order, so the result does not depend on the
+// number of threads.
 TfLiteStatus NonMaxSuppressionMultiClassRegularHelper(TfLiteContext* context,
                                                       TfLiteNode* node,
                                                       OpData* op_data,
@@ -527,80 +590,86 @@ TfLiteStatus NonMaxSuppressionMultiClassRegularHelper(TfLiteContext* context,
   TF_LITE_ENSURE(context, num_detections_per_class > 0);
 
   // For each class, perform non-max suppression.
-  std::vector<float> class_scores(num_boxes);
-
-  std::vector<int> box_indices_after_regular_non_max_suppression(
-      num_boxes + max_detections);
-  std::vector<float> scores_after_regular_non_max_suppression(num_boxes +
-                                                              max_detections);
-
-  int size_of_sorted_indices = 0;
-  std::vector<int> sorted_indices;
-  sorted_indices.resize(num_boxes + max_detections);
-  std::vector<float> sorted_values;
-  sorted_values.resize(max_detections);
+  op_data->scratch.resize(num_classes);
+  MultiClassNonMaxSuppressionArgs args;
+  args.decoded_boxes = ReInterpretTensor<const BoxCornerEncoding*>(
+      decoded_boxes);
+  args.num_boxes = num_boxes;
+  args.scores = scores;
+  args.num_classes_with_background = num_classes_with_background;
+  args.label_offset = label_offset;
+  args.score_threshold = op_data->non_max_suppression_score_threshold;
+  args.intersection_over_union_threshold =
+      op_data->intersection_over_union_threshold;
+  args.detections_per_class = num_detections_per_class;
+  args.scratch = op_data->scratch.data();
+
+  CpuBackendContext* cpu_backend_context =
+      CpuBackendContext::GetFromContext(context);
+  const int thread_count =
+      std::min(num_classes, cpu_backend_context->max_num_threads());
+  if (thread_count > 1) {
+    std::vector<NonMaxSuppressionClassesTask> tasks;
+    tasks.reserve(thread_count);
+    int class_begin = 0;
+    for (int i = 0; i < thread_count; ++i) {
+      const int class_end =
+          class_begin + (num_classes - class_begin) / (thread_count - i);
+      tasks.emplace_back(&args, class_begin, class_end);
+      class_begin = class_end;
+    }
+    cpu_backend_threadpool::Execute(tasks.size(), tasks.data(),
+                                    cpu_backend_context);
+  } else {
+    NonMaxSuppressionClasses(args, 0, num_classes);
+  }
 
+  // Merge the selections of each class, which are in decreasing score order,
+  // into the max_detections highest scores. On equal scores the detections
+  // merged earlier come first.
+  std::vector<Detection>& detections = op_data->detections;
+  std::vector<Detection>& merged = op_data->merged_detections;
+  detections.clear();
   for (int col = 0; col < num_classes; col++) {
-    for (int row = 0; row < num_boxes; row++) {
-      // Get scores of boxes corresponding to all anchors for single class
-      class_scores[row] =
-          *(scores + row * num_classes_with_background + col + label_offset);
-    }
-    // Perform non-maximal suppression on single class
-    std::vector<int> selected;
-    TF_LITE_ENSURE_STATUS(NonMaxSuppressionSingleClassHelper(
-        context, node, op_data, class_scores, &selected,
-        num_detections_per_class));
-    // Add selected indices from non-max suppression of boxes in this class
-    int output_index = size_of_sorted_indices;
-    for (const auto& selected_index : selected) {
-      box_indices_after_regular_non_max_suppression[output_index] =
-          (selected_index * num_classes_with_background + col + label_offset);
-      scores_after_regular_non_max_suppression[output_index] =
-          class_scores[selected_index];
-      output_index++;
-    }
-    // Sort the max scores among the selected indices
-    // Get the indices for top scores
-    int num_indices_to_sort = std::min(output_index, max_detections);
-    DecreasingPartialArgSort(scores_after_regular_non_max_suppression.data(),
-                             output_index, num_indices_to_sort,
-                             sorted_indices.data());
-
-    // Copy values to temporary vectors
-    for (int row = 0; row < num_indices_to_sort; row++) {
-      int temp = sorted_indices[row];
-      sorted_indices[row] = box_indices_after_regular_non_max_suppression[temp];
-      sorted_values[row] = scores_after_regular_non_max_suppression[temp];
-    }
-    // Copy scores and indices from temporary vectors
-    for (int row = 0; row < num_indices_to_sort; row++) {
-      box_indices_after_regular_non_max_suppression[row] = sorted_indices[row];
-      scores_after_regular_non_max_suppression[row] = sorted_values[row];
+    const std::vector<int>& selected = op_data->scratch[col].selected;
+    const float* class_scores = scores + col + label_offset;
+    merged.clear();
+    int detection_index = 0;
+    int selected_index = 0;
+    while (static_cast<int>(merged.size()) < max_detections) {
+      const bool detections_left = detection_index < detections.size();
+      const bool selected_left = selected_index < selected.size();
+      if (!detections_left && !selected_left) break;
+      const int box_index = selected_left ? selected[selected_index] : 0;
+      const float score =
+          selected_left ? class_scores[box_index * num_classes_with_background]
+                        : 0.0f;
+      if (detections_left &&
+          (!selected_left || detections[detection_index].score >= score)) {
+        merged.push_back(detections[detection_index++]);
+      } else {
+        merged.push_back({box_index, col, score});
+        selected_index++;
+      }
     }
-    size_of_sorted_indices = num_indices_to_sort;
+    detections.swap(merged);
   }
 
   // Allocate output tensors
+  const int size_of_sorted_indices = detections.size();
   for (int output_box_index = 0; output_box_index < max_detections;
        output_box_index++) {
     if (output_box_index < size_of_sorted_indices) {
-      const int anchor_index = floor(
-          box_indices_after_regular_non_max_suppression[output_box_index] /
-          num_classes_with_background);
-      const int class_index =
-          box_indices_after_regular_non_max_suppression[output_box_index] -
-          anchor_index * num_classes_with_background - label_offset;
-      const float selected_score =
-          scores_after_regular_non_max_suppression[output_box_index];
+      const Detection& detection = detections[output_box_index];
       // detection_boxes
       ReInterpretTensor<BoxCornerEncoding*>(detection_boxes)[output_box_index] =
-          ReInterpretTensor<const BoxCornerEncoding*>(
-              decoded_boxes)[anchor_index];
+          args.decoded_boxes[detection.box_index];
       // detection_classes
-      GetTensorData<float>(detection_classes)[output_box_index] = class_index;
+      GetTensorData<float>(detection_classes)[output_box_index] =
+          detection.class_index;
       // detection_scores
-      GetTensorData<float>(detection_scores)[output_box_index] = selected_score;
+      GetTensorData<float>(detection_scores)[output_box_index] =
+          detection.score;
     } else {
       ReInterpretTensor<BoxCornerEncoding*>(
           detection_boxes)[output_box_index] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -611,8 +680,6 @@ TfLiteStatus NonMaxSuppressionMultiClassRegularHelper(TfLiteContext* context,
     }
   }
   GetTensorData<float>(num_detections)[0] = size_of_sorted_indices;
-  box_indices_after_regular_non_max_suppression.clear();
-  scores_after_regular_non_max_suppression.clear();
   return kTfLiteOk;
 }
 
@@ -623,6 +690,8 @@ TfLiteStatus NonMaxSuppressionMultiClassRegularHelper(TfLiteContext* context,
 // 3) Compared to standard NMS, the worst runtime of this version is O(N^2)
 // instead of O(KN^2) where N is the number of anchors and K the number of
 // classes.
+// Only the highest class score of each anchor is needed for the NMS, so the
+// top-k classes are sorted for the selected anchors only.
 TfLiteStatus NonMaxSuppressionMultiClassFastHelper(TfLiteContext* context,
                                                    TfLiteNode* node,
                                                    OpData* op_data,
@@ -663,31 +732,35 @@ TfLiteStatus NonMaxSuppressionMultiClassFastHelper(TfLiteContext* context,
   // The row index offset is 1 if background class is included and 0 otherwise.
   int label_offset = num_classes_with_background - num_classes;
   TF_LITE_ENSURE(context, (max_categories_per_anchor > 0));
+  TF_LITE_ENSURE(context, (num_classes > 0));
+  // Maximum detections should be positive.
+  TF_LITE_ENSURE(context, (op_data->max_detections >= 0));
   const int num_categories_per_anchor =
       std::min(max_categories_per_anchor, num_classes);
-  std::vector<float> max_scores;
+  std::vector<float>& max_scores = op_data->max_scores;
   max_scores.resize(num_boxes);
-  std::vector<int> sorted_class_indices;
-  sorted_class_indices.resize(num_boxes * num_classes);
   for (int row = 0; row < num_boxes; row++) {
     const float* box_scores =
         scores + row * num_classes_with_background + label_offset;
-    int* class_indices = sorted_class_indices.data() + row * num_classes;
-    DecreasingPartialArgSort(box_scores, num_classes, num_categories_per_anchor,
-                             class_indices);
-    max_scores[row] = box_scores[class_indices[0]];
+    max_scores[row] = *std::max_element(box_scores, box_scores + num_classes);
   }
   // Perform non-maximal suppression on max scores
-  std::vector<int> selected;
-  TF_LITE_ENSURE_STATUS(NonMaxSuppressionSingleClassHelper(
-      context, node, op_data, max_scores, &selected, op_data->max_detections));
+  op_data->scratch.resize(1);
+  NonMaxSuppressionSingleClass(
+      ReInterpretTensor<const BoxCornerEncoding*>(decoded_boxes), num_boxes,
+      max_scores.data(), 1, op_data->non_max_suppression_score_threshold,
+      op_data->intersection_over_union_threshold, op_data->max_detections,
+      &op_data->scratch[0]);
+  const std::vector<int>& selected = op_data->scratch[0].selected;
   // Allocate output tensors
+  std::vector<int>& class_indices = op_data->class_indices;
+  class_indices.resize(num_classes);
   int output_box_index = 0;
   for (const auto& selected_index : selected) {
     const float* box_scores =
         scores + selected_index * num_classes_with_background + label_offset;
-    const int* class_indices =
-        sorted_class_indices.data() + selected_index * num_classes;
+    DecreasingPartialArgSort(box_scores, num_classes, num_categories_per_anchor,
+                             class_indices.data());
 
     for (int col = 0; col < num_categories_per_anchor; ++col) {
       int box_offset = num_categories_per_anchor * output_box_index + col;
@@ -742,6 +815,15 @@ TfLiteStatus NonMaxSuppressionMultiClass(TfLiteContext* context,
 
   TF_LITE_ENSURE(context, (num_classes_with_background - num_classes <= 1));
   TF_LITE_ENSURE(context, (num_classes_with_background >= num_classes));
+  // intersection_over_union_threshold should be positive
+  // and should be less than 1.
+  TF_LITE_ENSURE(context,
+                 (op_data->intersection_over_union_threshold > 0.0f) &&
+                     (op_data->intersection_over_union_threshold <= 1.0f));
+  // Validate boxes
+  TF_LITE_ENSURE(context,
+                 ValidateBoxes(&context->tensors[op_data->decoded_boxes_index],
+                               num_boxes));
 
   const TfLiteTensor* scores;
   switch (input_class_predictions->type) {
@@ -21,6 +21,7 @@ limitations under the License.
 #endif
 #endif
 
+#include <algorithm>
 #include <functional>
 
 #include "fixedpoint/fixedpoint.h"
@@ -138,6 +139,22 @@ inline void BiasAndClamp(float clamp_min, float clamp_max, int bias_size,
 #endif
 }
 
+// Output stage activation of a float conv (see FloatEpilogue), for kernels
+// that finish one output value at a time.
+inline float ApplyFloatEpilogue(FloatEpilogue epilogue, float alpha, float x) {
+  switch (epilogue) {
+    case FloatEpilogue::kNone:
+      return x;
+    case FloatEpilogue::kLeakyRelu:
+      return x > 0.0f ? x : x * alpha;
+    case FloatEpilogue::kLogistic:
+      return 1.0f / (1.0f + std::exp(-x));
+    case FloatEpilogue::kHardSwish:
+      return x * std::min(6.0f, std::max(0.0f, x + 3.0f)) / 6.0f;
+  }
+  return x;
+}
+
 inline int32_t MultiplyByQuantizedMultiplierSmallerThanOneExp(
     int32_t x, int32_t quantized_multiplier, int left_shift) {
   using gemmlowp::RoundingDivideByPOT;
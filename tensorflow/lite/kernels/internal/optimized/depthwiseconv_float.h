@@ -17,6 +17,7 @@ limitations under the License.
 
 #include "ruy/profiler/instrumentation.h"  // from @ruy
 #include "tensorflow/lite/kernels/internal/optimized/cpu_check.h"
+#include "tensorflow/lite/kernels/internal/optimized/float_epilogue.h"
 #include "tensorflow/lite/kernels/internal/types.h"
 
 namespace tflite {
@@ -1102,6 +1103,13 @@ inline void DepthwiseConvImpl(
 
           *output_ptr++ = acc;
         }
+        // The values just stored are still in L1.
+        if (params.float_epilogue != FloatEpilogue::kNone) {
+          ApplyFloatEpilogue(params.float_epilogue,
+                             params.float_epilogue_alpha,
+                             output_ptr - num_output_values,
+                             num_output_values);
+        }
       }
     }
     output_ptr += batch_step;
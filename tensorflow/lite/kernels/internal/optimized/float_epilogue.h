@@ -0,0 +1,52 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_FLOAT_EPILOGUE_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_FLOAT_EPILOGUE_H_
+
+#include "third_party/eigen3/Eigen/Core"
+#include "tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Output values per block a conv finishes before applying its FloatEpilogue,
+// so the block is still in cache when the epilogue reads it back.
+constexpr int kFloatEpilogueBlockSize = 16 * 1024;
+
+// Applies 'epilogue' in place to 'size' output values the caller just stored.
+inline void ApplyFloatEpilogue(FloatEpilogue epilogue, float alpha,
+                               float* data, int size) {
+  Eigen::Map<Eigen::ArrayXf> values(data, size);
+  switch (epilogue) {
+    case FloatEpilogue::kNone:
+      break;
+    case FloatEpilogue::kLeakyRelu:
+      // Alpha might be > 1 or < 0, so select instead of max(x, alpha * x).
+      values = (values > 0.0f).select(values, values * alpha);
+      break;
+    case FloatEpilogue::kLogistic:
+      values = values.unaryExpr(Eigen::internal::scalar_logistic_op<float>());
+      break;
+    case FloatEpilogue::kHardSwish:
+      values = values * (values + 3.0f).cwiseMax(0.0f).cwiseMin(6.0f) *
+               (1.0f / 6.0f);
+      break;
+  }
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_FLOAT_EPILOGUE_H_
@@ -173,9 +173,25 @@ inline void Conv(const Eigen::ThreadPoolDevice& device,
                output_depth, stride_height, stride_width, pad_height, pad_width,
                padding, output_data, output_height, output_width);
 
-  optimized_ops::AddBiasAndEvalActivationFunction(
-      output_activation_min, output_activation_max, bias_shape, bias_data,
-      output_shape, output_data);
+  if (params.float_epilogue == FloatEpilogue::kNone) {
+    optimized_ops::AddBiasAndEvalActivationFunction(
+        output_activation_min, output_activation_max, bias_shape, bias_data,
+        output_shape, output_data);
+    return;
+  }
+  // Fold the epilogue into the bias pass, one cache sized block at a time.
+  const int block_size =
+      std::max(1, optimized_ops::kFloatEpilogueBlockSize / output_depth) *
+      output_depth;
+  const int flat_size = output_shape.FlatSize();
+  for (int start = 0; start < flat_size; start += block_size) {
+    const int size = std::min(block_size, flat_size - start);
+    BiasAndClamp(output_activation_min, output_activation_max, output_depth,
+                 bias_data, size, output_data + start);
+    optimized_ops::ApplyFloatEpilogue(params.float_epilogue,
+                                      params.float_epilogue_alpha,
+                                      output_data + start, size);
+  }
 }
 
 }  // namespace multithreaded_ops
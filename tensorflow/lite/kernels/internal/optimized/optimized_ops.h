@@ -48,6 +48,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/cpu_backend_threadpool.h"
 #include "tensorflow/lite/kernels/internal/cppmath.h"
 #include "tensorflow/lite/kernels/internal/optimized/cpu_check.h"
+#include "tensorflow/lite/kernels/internal/optimized/float_epilogue.h"
 #include "tensorflow/lite/kernels/internal/optimized/im2col_utils.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
@@ -92,7 +93,6 @@ using reference_ops::Greater;
 using reference_ops::GreaterEqual;
 using reference_ops::GreaterEqualWithScaling;
 using reference_ops::GreaterWithScaling;
-using reference_ops::LeakyRelu;
 using reference_ops::Less;
 using reference_ops::LessEqual;
 using reference_ops::LessEqualWithScaling;
@@ -1332,6 +1332,22 @@ inline void Conv(const ConvParams& params, const RuntimeShape& input_shape,
   int m = FlatSizeSkipDim(*gemm_input_shape, gemm_input_dims - 1);
   int n = output_shape.Dims(3);
   int k = gemm_input_shape->Dims(gemm_input_dims - 1);
+  // Distance between output pixels; wider than n when the output is a channel
+  // slice of a larger tensor (see ConvParams::output_row_stride).
+  const int output_stride = params.output_row_stride ? params.output_row_stride
+                                                     : n;
+  // Applies the epilogue to 'pixels' output pixels starting at 'block'.
+  auto apply_epilogue = [&](float* block, int pixels) {
+    if (output_stride == n) {
+      ApplyFloatEpilogue(params.float_epilogue, params.float_epilogue_alpha,
+                         block, pixels * n);
+      return;
+    }
+    for (int pixel = 0; pixel < pixels; ++pixel) {
+      ApplyFloatEpilogue(params.float_epilogue, params.float_epilogue_alpha,
+                         block + pixel * output_stride, n);
+    }
+  };
 
 #if defined(TF_LITE_USE_CBLAS) && defined(__APPLE__)
   // The following code computes matrix multiplication c = a * transponse(b)
@@ -1346,13 +1362,36 @@ inline void Conv(const ConvParams& params, const RuntimeShape& input_shape,
   // The stride of matrix a, b and c respectively.
   int stride_a = k;
   int stride_b = k;
-  int stride_c = n;
-
-  cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, m, n, k, 1.0f, a,
-              stride_a, b, stride_b, 0.0f, c, stride_c);
-  optimized_ops::AddBiasAndEvalActivationFunction(
-      output_activation_min, output_activation_max, bias_shape, bias_data,
-      output_shape, output_data);
+  int stride_c = output_stride;
+
+  if (params.float_epilogue == FloatEpilogue::kNone && output_stride == n) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, m, n, k, 1.0f, a,
+                stride_a, b, stride_b, 0.0f, c, stride_c);
+    optimized_ops::AddBiasAndEvalActivationFunction(
+        output_activation_min, output_activation_max, bias_shape, bias_data,
+        output_shape, output_data);
+    return;
+  }
+  // With an epilogue, finish the output in blocks of pixels so the epilogue
+  // reads each block back from cache instead of making a second pass.
+  const int rows_per_block = std::max(1, kFloatEpilogueBlockSize / n);
+  for (int row = 0; row < m; row += rows_per_block) {
+    const int rows = std::min(rows_per_block, m - row);
+    float* block = c + row * stride_c;
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, rows, n, k, 1.0f,
+                a + row * stride_a, stride_a, b, stride_b, 0.0f, block,
+                stride_c);
+    if (output_stride == n) {
+      BiasAndClamp(output_activation_min, output_activation_max, n, bias_data,
+                   rows * n, block);
+    } else {
+      for (int pixel = 0; pixel < rows; ++pixel) {
+        BiasAndClamp(output_activation_min, output_activation_max, n,
+                     bias_data, n, block + pixel * stride_c);
+      }
+    }
+    apply_epilogue(block, rows);
+  }
 #else
   // When an optimized CBLAS implementation is not available, fall back
   // to using cpu_backend_gemm.
@@ -1368,13 +1407,31 @@ inline void Conv(const ConvParams& params, const RuntimeShape& input_shape,
   dst_params.order = cpu_backend_gemm::Order::kColMajor;
   dst_params.rows = n;
   dst_params.cols = m;
+  dst_params.stride = params.output_row_stride;
   cpu_backend_gemm::GemmParams<float, float> gemm_params;
   gemm_params.bias = bias_data;
   gemm_params.clamp_min = output_activation_min;
   gemm_params.clamp_max = output_activation_max;
-  cpu_backend_gemm::Gemm(lhs_params, filter_data, rhs_params, gemm_input_data,
-                         dst_params, output_data, gemm_params,
-                         cpu_backend_context);
+  if (params.float_epilogue == FloatEpilogue::kNone) {
+    cpu_backend_gemm::Gemm(lhs_params, filter_data, rhs_params,
+                           gemm_input_data, dst_params, output_data,
+                           gemm_params, cpu_backend_context);
+    return;
+  }
+  // With an epilogue, run the GEMM over blocks of output pixels (dst columns)
+  // and apply the epilogue to each block while it is still in cache, instead
+  // of making a second pass over the whole output.
+  const int cols_per_block = std::max(1, kFloatEpilogueBlockSize / n);
+  for (int col = 0; col < m; col += cols_per_block) {
+    const int cols = std::min(cols_per_block, m - col);
+    rhs_params.cols = cols;
+    dst_params.cols = cols;
+    float* block = output_data + col * output_stride;
+    cpu_backend_gemm::Gemm(lhs_params, filter_data, rhs_params,
+                           gemm_input_data + col * k, dst_params, block,
+                           gemm_params, cpu_backend_context);
+    apply_epilogue(block, cols);
+  }
 #endif  //  defined(TF_LITE_USE_CBLAS) && defined(__APPLE__)
 }
 
@@ -4383,6 +4440,18 @@ inline void Logistic(const RuntimeShape& input_shape, const float* input_data,
       input_map.array().unaryExpr(Eigen::internal::scalar_logistic_op<float>());
 }
 
+inline void LeakyRelu(const tflite::LeakyReluParams& params,
+                      const RuntimeShape& input_shape, const float* input_data,
+                      const RuntimeShape& output_shape, float* output_data) {
+  ruy::profiler::ScopeLabel label("LeakyRelu");
+  auto input_map = MapAsVector(input_data, input_shape);
+  auto output_map = MapAsVector(output_data, output_shape);
+  // Alpha might be > 1 or < 0, so select instead of max(x, alpha * x).
+  output_map.array() = (input_map.array() > 0.0f)
+                           .select(input_map.array(),
+                                   input_map.array() * params.alpha);
+}
+
 // Convenience version that allows, for example, generated-code calls to be
 // uniform between data types.
 inline void Logistic(const LogisticParams&, const RuntimeShape& input_shape,
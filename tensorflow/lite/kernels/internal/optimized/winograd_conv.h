@@ -0,0 +1,360 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_WINOGRAD_CONV_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_WINOGRAD_CONV_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "ruy/profiler/instrumentation.h"  // from @ruy
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_gemm.h"
+#include "tensorflow/lite/kernels/cpu_backend_gemm_params.h"
+#include "tensorflow/lite/kernels/cpu_backend_threadpool.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "tensorflow/lite/kernels/internal/optimized/float_epilogue.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Winograd F(2x2, 3x3) float convolution for 3x3 filters with stride 1 and no
+// dilation. Every 2x2 output tile is computed from a 4x4 input tile as
+//   Y = A^T [ (G g G^T) . (B^T d B) ] A
+// which needs 16 multiplies per tile and channel pair instead of 36. The
+// element-wise products over all tiles are batched into 16 GEMMs
+// ([output_depth x input_depth] x [input_depth x tiles]).
+//
+// Layouts:
+//   transformed filter : [16][output_depth][input_depth]
+//   scratch            : [16][tiles][input_depth] + [16][tiles][output_depth]
+constexpr int kWinogradTileSize = 2;
+constexpr int kWinogradInputTileSize = 4;
+constexpr int kWinogradTileElements = 16;
+
+inline bool IsWinogradConvSupported(int filter_height, int filter_width,
+                                    int stride_height, int stride_width,
+                                    int dilation_height, int dilation_width) {
+  return filter_height == 3 && filter_width == 3 && stride_height == 1 &&
+         stride_width == 1 && dilation_height == 1 && dilation_width == 1;
+}
+
+inline int WinogradTileCount(int output_height, int output_width) {
+  return ((output_height + kWinogradTileSize - 1) / kWinogradTileSize) *
+         ((output_width + kWinogradTileSize - 1) / kWinogradTileSize);
+}
+
+// Number of floats the per-batch scratch buffer needs.
+inline int WinogradScratchSize(int output_height, int output_width,
+                               int input_depth, int output_depth) {
+  return kWinogradTileElements * WinogradTileCount(output_height, output_width) *
+         (input_depth + output_depth);
+}
+
+// U = G g G^T for every (output channel, input channel) pair of an OHWI
+// filter.
+inline void WinogradTransformFilter(const RuntimeShape& filter_shape,
+                                    const float* filter_data,
+                                    float* transformed_filter_data) {
+  ruy::profiler::ScopeLabel label("WinogradTransformFilter");
+  const int output_depth = filter_shape.Dims(0);
+  const int input_depth = filter_shape.Dims(3);
+  TFLITE_DCHECK_EQ(filter_shape.Dims(1), 3);
+  TFLITE_DCHECK_EQ(filter_shape.Dims(2), 3);
+  const int plane_size = output_depth * input_depth;
+  for (int oc = 0; oc < output_depth; ++oc) {
+    for (int ic = 0; ic < input_depth; ++ic) {
+      float g[3][3];
+      for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 3; ++x) {
+          g[y][x] = filter_data[Offset(filter_shape, oc, y, x, ic)];
+        }
+      }
+      // t = G g (4x3)
+      float t[4][3];
+      for (int x = 0; x < 3; ++x) {
+        t[0][x] = g[0][x];
+        t[1][x] = 0.5f * (g[0][x] + g[1][x] + g[2][x]);
+        t[2][x] = 0.5f * (g[0][x] - g[1][x] + g[2][x]);
+        t[3][x] = g[2][x];
+      }
+      // u = t G^T (4x4)
+      float* u = transformed_filter_data + oc * input_depth + ic;
+      for (int y = 0; y < 4; ++y) {
+        u[(y * 4 + 0) * plane_size] = t[y][0];
+        u[(y * 4 + 1) * plane_size] = 0.5f * (t[y][0] + t[y][1] + t[y][2]);
+        u[(y * 4 + 2) * plane_size] = 0.5f * (t[y][0] - t[y][1] + t[y][2]);
+        u[(y * 4 + 3) * plane_size] = t[y][2];
+      }
+    }
+  }
+}
+
+struct WinogradTileParams {
+  const ConvParams* params;
+  const RuntimeShape* input_shape;
+  const float* input_data;  // Start of the current batch.
+  const float* bias_data;
+  const RuntimeShape* output_shape;
+  float* output_data;  // Start of the current batch.
+  float* transformed_input;
+  float* transformed_output;
+  int tiles_x;
+  int tile_count;
+  int input_depth;
+  int output_depth;
+  int output_pixel_stride;  // output_depth unless the output is strided.
+};
+
+// V = B^T d B for tiles [tile_start, tile_end).
+inline void WinogradTransformInput(const WinogradTileParams& p, int tile_start,
+                                   int tile_end) {
+  const int input_height = p.input_shape->Dims(1);
+  const int input_width = p.input_shape->Dims(2);
+  const int depth = p.input_depth;
+  const int pad_height = p.params->padding_values.height;
+  const int pad_width = p.params->padding_values.width;
+  const int plane_size = p.tile_count * depth;
+  for (int tile = tile_start; tile < tile_end; ++tile) {
+    const int in_y0 = (tile / p.tiles_x) * kWinogradTileSize - pad_height;
+    const int in_x0 = (tile % p.tiles_x) * kWinogradTileSize - pad_width;
+    // Rows/columns outside the input read as zero (padding).
+    const float* rows[4][4];
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        const int in_y = in_y0 + y;
+        const int in_x = in_x0 + x;
+        rows[y][x] = (in_y >= 0 && in_y < input_height && in_x >= 0 &&
+                      in_x < input_width)
+                         ? p.input_data + (in_y * input_width + in_x) * depth
+                         : nullptr;
+      }
+    }
+    float* v = p.transformed_input + tile * depth;
+    for (int ic = 0; ic < depth; ++ic) {
+      float d[4][4];
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          d[y][x] = rows[y][x] ? rows[y][x][ic] : 0.0f;
+        }
+      }
+      // t = B^T d
+      float t[4][4];
+      for (int x = 0; x < 4; ++x) {
+        t[0][x] = d[0][x] - d[2][x];
+        t[1][x] = d[1][x] + d[2][x];
+        t[2][x] = d[2][x] - d[1][x];
+        t[3][x] = d[1][x] - d[3][x];
+      }
+      // v = t B
+      for (int y = 0; y < 4; ++y) {
+        v[(y * 4 + 0) * plane_size + ic] = t[y][0] - t[y][2];
+        v[(y * 4 + 1) * plane_size + ic] = t[y][1] + t[y][2];
+        v[(y * 4 + 2) * plane_size + ic] = t[y][2] - t[y][1];
+        v[(y * 4 + 3) * plane_size + ic] = t[y][1] - t[y][3];
+      }
+    }
+  }
+}
+
+// Y = A^T M A, plus bias and activation, for tiles [tile_start, tile_end).
+inline void WinogradTransformOutput(const WinogradTileParams& p,
+                                    int tile_start, int tile_end) {
+  const int output_height = p.output_shape->Dims(1);
+  const int output_width = p.output_shape->Dims(2);
+  const int depth = p.output_depth;
+  const int pixel_stride = p.output_pixel_stride;
+  const float activation_min = p.params->float_activation_min;
+  const float activation_max = p.params->float_activation_max;
+  const int plane_size = p.tile_count * depth;
+  for (int tile = tile_start; tile < tile_end; ++tile) {
+    const int out_y0 = (tile / p.tiles_x) * kWinogradTileSize;
+    const int out_x0 = (tile % p.tiles_x) * kWinogradTileSize;
+    const bool has_y1 = out_y0 + 1 < output_height;
+    const bool has_x1 = out_x0 + 1 < output_width;
+    float* out00 =
+        p.output_data + (out_y0 * output_width + out_x0) * pixel_stride;
+    float* out01 = out00 + pixel_stride;
+    float* out10 = out00 + output_width * pixel_stride;
+    float* out11 = out10 + pixel_stride;
+    const float* m = p.transformed_output + tile * depth;
+    for (int oc = 0; oc < depth; ++oc) {
+      float s[4][4];
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          s[y][x] = m[(y * 4 + x) * plane_size + oc];
+        }
+      }
+      // t = A^T s (2x4)
+      float t[2][4];
+      for (int x = 0; x < 4; ++x) {
+        t[0][x] = s[0][x] + s[1][x] + s[2][x];
+        t[1][x] = s[1][x] - s[2][x] - s[3][x];
+      }
+      const float bias = p.bias_data ? p.bias_data[oc] : 0.0f;
+      auto finish = [&](float value) {
+        return ActivationFunctionWithMinMax(value + bias, activation_min,
+                                            activation_max);
+      };
+      out00[oc] = finish(t[0][0] + t[0][1] + t[0][2]);
+      if (has_x1) out01[oc] = finish(t[0][1] - t[0][2] - t[0][3]);
+      if (has_y1) {
+        out10[oc] = finish(t[1][0] + t[1][1] + t[1][2]);
+        if (has_x1) out11[oc] = finish(t[1][1] - t[1][2] - t[1][3]);
+      }
+    }
+    // Output stage activation over the tile's pixels, still in L1.
+    const FloatEpilogue epilogue = p.params->float_epilogue;
+    if (epilogue != FloatEpilogue::kNone) {
+      const float alpha = p.params->float_epilogue_alpha;
+      ApplyFloatEpilogue(epilogue, alpha, out00, depth);
+      if (has_x1) ApplyFloatEpilogue(epilogue, alpha, out01, depth);
+      if (has_y1) {
+        ApplyFloatEpilogue(epilogue, alpha, out10, depth);
+        if (has_x1) ApplyFloatEpilogue(epilogue, alpha, out11, depth);
+      }
+    }
+  }
+}
+
+struct WinogradTransformTask : cpu_backend_threadpool::Task {
+  WinogradTransformTask(const WinogradTileParams& params, bool is_input,
+                        int tile_start, int tile_end)
+      : params_(params),
+        is_input_(is_input),
+        tile_start_(tile_start),
+        tile_end_(tile_end) {}
+
+  void Run() override {
+    if (is_input_) {
+      WinogradTransformInput(params_, tile_start_, tile_end_);
+    } else {
+      WinogradTransformOutput(params_, tile_start_, tile_end_);
+    }
+  }
+
+ private:
+  const WinogradTileParams& params_;
+  bool is_input_;
+  int tile_start_;
+  int tile_end_;
+};
+
+inline void WinogradTransformTiles(const WinogradTileParams& params,
+                                   bool is_input,
+                                   CpuBackendContext* cpu_backend_context) {
+  const int thread_count =
+      std::max(1, std::min(params.tile_count,
+                           cpu_backend_context->max_num_threads()));
+  if (thread_count == 1) {
+    WinogradTransformTask(params, is_input, 0, params.tile_count).Run();
+    return;
+  }
+  std::vector<WinogradTransformTask> tasks;
+  tasks.reserve(thread_count);
+  int tile_start = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    int tile_end =
+        tile_start + (params.tile_count - tile_start) / (thread_count - i);
+    tasks.emplace_back(params, is_input, tile_start, tile_end);
+    tile_start = tile_end;
+  }
+  cpu_backend_threadpool::Execute(tasks.size(), tasks.data(),
+                                  cpu_backend_context);
+}
+
+inline void WinogradConv(const ConvParams& params,
+                         const RuntimeShape& input_shape,
+                         const float* input_data,
+                         const RuntimeShape& transformed_filter_shape,
+                         const float* transformed_filter_data,
+                         const RuntimeShape& bias_shape, const float* bias_data,
+                         const RuntimeShape& output_shape, float* output_data,
+                         float* scratch_data, bool filter_is_constant,
+                         CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("WinogradConv");
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(transformed_filter_shape.Dims(0), kWinogradTileElements);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int input_depth = input_shape.Dims(3);
+  const int output_depth = output_shape.Dims(3);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int tiles_x = (output_width + kWinogradTileSize - 1) / kWinogradTileSize;
+  const int tile_count = WinogradTileCount(output_height, output_width);
+  if (bias_data) {
+    TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
+  }
+
+  WinogradTileParams tile_params;
+  tile_params.params = &params;
+  tile_params.input_shape = &input_shape;
+  tile_params.bias_data = bias_data;
+  tile_params.output_shape = &output_shape;
+  tile_params.transformed_input = scratch_data;
+  tile_params.transformed_output =
+      scratch_data + kWinogradTileElements * tile_count * input_depth;
+  tile_params.tiles_x = tiles_x;
+  tile_params.tile_count = tile_count;
+  tile_params.input_depth = input_depth;
+  tile_params.output_depth = output_depth;
+  tile_params.output_pixel_stride =
+      params.output_row_stride ? params.output_row_stride : output_depth;
+
+  cpu_backend_gemm::MatrixParams<float> lhs_params;
+  lhs_params.order = cpu_backend_gemm::Order::kRowMajor;
+  lhs_params.rows = output_depth;
+  lhs_params.cols = input_depth;
+  // A non-constant filter is transformed again into the same buffer on every
+  // call, so a cached packing of it would go stale.
+  lhs_params.cache_policy =
+      cpu_backend_gemm::DefaultCachePolicy(filter_is_constant);
+  cpu_backend_gemm::MatrixParams<float> rhs_params;
+  rhs_params.order = cpu_backend_gemm::Order::kColMajor;
+  rhs_params.rows = input_depth;
+  rhs_params.cols = tile_count;
+  cpu_backend_gemm::MatrixParams<float> dst_params;
+  dst_params.order = cpu_backend_gemm::Order::kColMajor;
+  dst_params.rows = output_depth;
+  dst_params.cols = tile_count;
+  cpu_backend_gemm::GemmParams<float, float> gemm_params;
+
+  for (int b = 0; b < batches; ++b) {
+    tile_params.input_data = input_data + b * input_shape.Dims(1) *
+                                              input_shape.Dims(2) * input_depth;
+    tile_params.output_data =
+        output_data +
+        b * output_height * output_width * tile_params.output_pixel_stride;
+
+    WinogradTransformTiles(tile_params, /*is_input=*/true, cpu_backend_context);
+    for (int e = 0; e < kWinogradTileElements; ++e) {
+      cpu_backend_gemm::Gemm(
+          lhs_params, transformed_filter_data + e * output_depth * input_depth,
+          rhs_params, tile_params.transformed_input + e * tile_count * input_depth,
+          dst_params,
+          tile_params.transformed_output + e * tile_count * output_depth,
+          gemm_params, cpu_backend_context);
+    }
+    WinogradTransformTiles(tile_params, /*is_input=*/false,
+                           cpu_backend_context);
+  }
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_WINOGRAD_CONV_H_
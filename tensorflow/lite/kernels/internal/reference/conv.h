@@ -58,6 +58,8 @@ inline void Conv(const ConvParams& params, const RuntimeShape& input_shape,
   const int filter_width = filter_shape.Dims(2);
   const int output_height = output_shape.Dims(1);
   const int output_width = output_shape.Dims(2);
+  const int output_pixel_stride =
+      params.output_row_stride ? params.output_row_stride : output_depth;
   for (int batch = 0; batch < batches; ++batch) {
     for (int out_y = 0; out_y < output_height; ++out_y) {
       const int in_y_origin = (out_y * stride_height) - pad_height;
@@ -92,10 +94,15 @@ inline void Conv(const ConvParams& params, const RuntimeShape& input_shape,
           if (bias_data) {
             bias_value = bias_data[out_channel];
           }
-          output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] =
-              ActivationFunctionWithMinMax(total + bias_value,
-                                           output_activation_min,
-                                           output_activation_max);
+          output_data[((batch * output_height + out_y) * output_width +
+                       out_x) *
+                          output_pixel_stride +
+                      out_channel] =
+              ApplyFloatEpilogue(
+                  params.float_epilogue, params.float_epilogue_alpha,
+                  ActivationFunctionWithMinMax(total + bias_value,
+                                               output_activation_min,
+                                               output_activation_max));
         }
       }
     }
@@ -84,9 +84,11 @@ inline void DepthwiseConv(
               bias_value = bias_data[oc];
             }
             output_data[Offset(output_shape, b, out_y, out_x, oc)] =
-                ActivationFunctionWithMinMax(total + bias_value,
-                                             output_activation_min,
-                                             output_activation_max);
+                ApplyFloatEpilogue(
+                    params.float_epilogue, params.float_epilogue_alpha,
+                    ActivationFunctionWithMinMax(total + bias_value,
+                                                 output_activation_min,
+                                                 output_activation_max));
           }
         }
       }
@@ -590,6 +590,11 @@ inline void ApplyActivationToVector(const float* __restrict__ vector,
       return ApplySignbitToVector(vector, v_size, result);
     case kTfLiteActSigmoid:
       return ApplySigmoidToVector(vector, v_size, result);
+    case kTfLiteActLeakyRelu:
+    case kTfLiteActHardSwish:
+      // Only set on convs the interpreter builder folded an activation op
+      // into, never on the ops using this helper.
+      return;
   }
 }
 
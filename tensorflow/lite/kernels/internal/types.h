@@ -817,6 +817,11 @@ struct ComparisonParams {
   bool is_broadcast;
 };
 
+// Float activations a conv applies in its output stage, after bias and clamp,
+// that no clamp range can express. Only set when the interpreter builder
+// folded the activation op following the conv into it.
+enum class FloatEpilogue : uint8_t { kNone, kLeakyRelu, kLogistic, kHardSwish };
+
 struct ConvParams {
   PaddingType padding_type;
   PaddingValues padding_values;
@@ -838,6 +843,12 @@ struct ConvParams {
   // float activation params.
   float float_activation_min;
   float float_activation_max;
+  // float output stage activation, applied after the clamp.
+  FloatEpilogue float_epilogue = FloatEpilogue::kNone;
+  float float_epilogue_alpha = 0.0f;  // kLeakyRelu only.
+  // Float only: elements between the starts of consecutive output pixels when
+  // the output is a channel slice of a wider tensor. 0 for a dense output.
+  int32_t output_row_stride = 0;
 };
 
 struct DepthToSpaceParams {
@@ -867,6 +878,9 @@ struct DepthwiseParams {
   float float_activation_max;
   const int32_t* output_multiplier_per_channel;
   const int32_t* output_shift_per_channel;
+  // float output stage activation, applied after the clamp.
+  FloatEpilogue float_epilogue = FloatEpilogue::kNone;
+  float float_epilogue_alpha = 0.0f;  // kLeakyRelu only.
 };
 
 struct DequantizationParams {
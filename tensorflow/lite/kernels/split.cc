@@ -103,6 +103,20 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   }
 }
 
+// True if the arena planner already placed the outputs back to back inside
+// the input (see ArenaPlanner), in which case there is nothing to copy.
+bool OutputsAreInputSlices(TfLiteContext* context, TfLiteNode* node,
+                           const TfLiteTensor* input) {
+  const char* slice = input->data.raw;
+  if (slice == nullptr) return false;
+  for (int i = 0; i < NumOutputs(node); ++i) {
+    const TfLiteTensor* output = GetOutput(context, node, i);
+    if (output == nullptr || output->data.raw != slice) return false;
+    slice += output->bytes;
+  }
+  return true;
+}
+
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   OpContext op_context(context, node);
 
@@ -122,6 +136,7 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
   TF_LITE_ENSURE(context, axis_value >= 0);
   TF_LITE_ENSURE(context, axis_value < NumDimensions(op_context.input));
+  if (OutputsAreInputSlices(context, node, op_context.input)) return kTfLiteOk;
 
   // TODO(ahentz): Our usage of VectorOfTensors could be optimized by
   // calculating it in Prepare, unless we defer shape calculation.
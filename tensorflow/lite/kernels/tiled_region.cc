@@ -0,0 +1,524 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/kernels/tiled_region.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/internal/optimized/depthwiseconv_multithread.h"
+#include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/kernels/padding.h"
+
+namespace tflite {
+namespace tiled {
+namespace {
+
+constexpr size_t kFallbackCacheBytes = 512 * 1024;
+
+#if defined(__linux__)
+// Reads the L2 size from sysfs ("512K", "2M"). glibc's sysconf reports 0 on
+// most ARM cores.
+size_t ReadSysfsL2CacheBytes() {
+  for (int index = 0; index < 8; ++index) {
+    const std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" +
+                            std::to_string(index) + "/";
+    std::ifstream level_file(dir + "level");
+    int level = 0;
+    if (!(level_file >> level)) break;
+    if (level != 2) continue;
+    std::ifstream size_file(dir + "size");
+    size_t size = 0;
+    char unit = 0;
+    if (!(size_file >> size)) return 0;
+    size_file >> unit;
+    if (unit == 'K') size *= 1024;
+    if (unit == 'M') size *= 1024 * 1024;
+    return size;
+  }
+  return 0;
+}
+#endif
+
+// Activations that can not be expressed as the clamp of the optimized kernels.
+bool NeedsActivationEpilogue(TfLiteFusedActivation activation) {
+  return activation == kTfLiteActLeakyRelu || activation == kTfLiteActSigmoid ||
+         activation == kTfLiteActHardSwish;
+}
+
+// Writes activation(input) to output. `input` and `output` may alias.
+void ApplyActivation(TfLiteFusedActivation activation, float alpha,
+                     const RuntimeShape& shape, const float* input,
+                     float* output) {
+  switch (activation) {
+    case kTfLiteActLeakyRelu: {
+      LeakyReluParams op_params;
+      op_params.alpha = alpha;
+      optimized_ops::LeakyRelu(op_params, shape, input, shape, output);
+      return;
+    }
+    case kTfLiteActSigmoid:
+      optimized_ops::Logistic(shape, input, shape, output);
+      return;
+    case kTfLiteActHardSwish:
+      optimized_ops::HardSwish(shape, input, shape, output);
+      return;
+    default:
+      break;
+  }
+  float activation_min, activation_max;
+  CalculateActivationRange(activation, &activation_min, &activation_max);
+  const int flat_size = shape.FlatSize();
+  for (int i = 0; i < flat_size; ++i) {
+    output[i] = std::min(std::max(input[i], activation_min), activation_max);
+  }
+}
+
+// Activation an elementwise builtin op computes.
+TfLiteFusedActivation UnaryActivation(int builtin_code) {
+  switch (builtin_code) {
+    case kTfLiteBuiltinRelu:
+      return kTfLiteActRelu;
+    case kTfLiteBuiltinRelu6:
+      return kTfLiteActRelu6;
+    case kTfLiteBuiltinReluN1To1:
+      return kTfLiteActReluN1To1;
+    case kTfLiteBuiltinLeakyRelu:
+      return kTfLiteActLeakyRelu;
+    case kTfLiteBuiltinLogistic:
+      return kTfLiteActSigmoid;
+    case kTfLiteBuiltinHardSwish:
+      return kTfLiteActHardSwish;
+    default:
+      return kTfLiteActNone;
+  }
+}
+
+const TfLiteTensor* OptionalTensor(TfLiteContext* context, int index) {
+  return index < 0 ? nullptr : &context->tensors[index];
+}
+
+}  // namespace
+
+size_t DefaultCacheBytes() {
+  static const size_t cache_bytes = [] {
+#if defined(__linux__)
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+    const long sysconf_bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (sysconf_bytes > 0) return static_cast<size_t>(sysconf_bytes);
+#endif
+    const size_t sysfs_bytes = ReadSysfsL2CacheBytes();
+    if (sysfs_bytes > 0) return sysfs_bytes;
+#endif
+    return kFallbackCacheBytes;
+  }();
+  return cache_bytes;
+}
+
+bool IsTileableOp(const TfLiteRegistration& registration) {
+  switch (registration.builtin_code) {
+    case kTfLiteBuiltinConv2d:
+    case kTfLiteBuiltinDepthwiseConv2d:
+    case kTfLiteBuiltinMaxPool2d:
+    case kTfLiteBuiltinAveragePool2d:
+      return true;
+    default:
+      return UnaryActivation(registration.builtin_code) != kTfLiteActNone;
+  }
+}
+
+TfLiteStatus TiledRegion::AddOp(TfLiteContext* context, const Node& node,
+                                Op* op) {
+  const int builtin_code = node.registration->builtin_code;
+  TF_LITE_ENSURE_MSG(context, IsTileableOp(*node.registration),
+                     "Tiled region contains an op that is not spatially local");
+  TF_LITE_ENSURE(context, node.node->inputs->size >= 1);
+  TF_LITE_ENSURE_EQ(context, node.node->outputs->size, 1);
+
+  const TfLiteTensor* input = &context->tensors[node.node->inputs->data[0]];
+  const TfLiteTensor* output = &context->tensors[node.node->outputs->data[0]];
+  TF_LITE_ENSURE_TYPES_EQ(context, input->type, kTfLiteFloat32);
+  TF_LITE_ENSURE_TYPES_EQ(context, output->type, kTfLiteFloat32);
+  TF_LITE_ENSURE_EQ(context, NumDimensions(input), 4);
+  TF_LITE_ENSURE_EQ(context, NumDimensions(output), 4);
+  TF_LITE_ENSURE_EQ(context, SizeOfDimension(input, 0), 1);
+  TF_LITE_ENSURE_EQ(context, SizeOfDimension(output, 0), 1);
+
+  op->builtin_code = builtin_code;
+  op->input = node.node->inputs->data[0];
+  op->output = node.node->outputs->data[0];
+  op->in_height = SizeOfDimension(input, 1);
+  op->in_width = SizeOfDimension(input, 2);
+  op->in_channels = SizeOfDimension(input, 3);
+  op->out_height = SizeOfDimension(output, 1);
+  op->out_width = SizeOfDimension(output, 2);
+  op->out_channels = SizeOfDimension(output, 3);
+
+  TfLitePadding padding = kTfLitePaddingValid;
+  switch (builtin_code) {
+    case kTfLiteBuiltinConv2d:
+    case kTfLiteBuiltinDepthwiseConv2d: {
+      TF_LITE_ENSURE(context, node.node->inputs->size >= 2);
+      const TfLiteTensor* filter =
+          &context->tensors[node.node->inputs->data[1]];
+      TF_LITE_ENSURE_TYPES_EQ(context, filter->type, kTfLiteFloat32);
+      TF_LITE_ENSURE_EQ(context, NumDimensions(filter), 4);
+      op->filter = node.node->inputs->data[1];
+      op->kernel_height = SizeOfDimension(filter, 1);
+      op->kernel_width = SizeOfDimension(filter, 2);
+      op->weight_bytes = filter->bytes;
+      if (node.node->inputs->size > 2 &&
+          node.node->inputs->data[2] != kTfLiteOptionalTensor) {
+        op->bias = node.node->inputs->data[2];
+        const TfLiteTensor* bias = &context->tensors[op->bias];
+        TF_LITE_ENSURE_TYPES_EQ(context, bias->type, kTfLiteFloat32);
+        op->weight_bytes += bias->bytes;
+      }
+      if (builtin_code == kTfLiteBuiltinConv2d) {
+        const auto* params =
+            reinterpret_cast<const TfLiteConvParams*>(node.node->builtin_data);
+        op->kind = OpKind::kConv;
+        op->stride_height = params->stride_height;
+        op->stride_width = params->stride_width;
+        op->dilation_height = params->dilation_height_factor;
+        op->dilation_width = params->dilation_width_factor;
+        op->activation = params->activation;
+        op->alpha = params->leaky_relu_alpha;
+        padding = params->padding;
+        TF_LITE_ENSURE_EQ(context, SizeOfDimension(filter, 3),
+                          op->in_channels);
+        TF_LITE_ENSURE_EQ(context, SizeOfDimension(filter, 0),
+                          op->out_channels);
+        op->need_im2col = op->stride_height != 1 || op->stride_width != 1 ||
+                          op->dilation_height != 1 ||
+                          op->dilation_width != 1 || op->kernel_height != 1 ||
+                          op->kernel_width != 1;
+      } else {
+        const auto* params = reinterpret_cast<const TfLiteDepthwiseConvParams*>(
+            node.node->builtin_data);
+        op->kind = OpKind::kDepthwiseConv;
+        op->stride_height = params->stride_height;
+        op->stride_width = params->stride_width;
+        op->dilation_height = params->dilation_height_factor;
+        op->dilation_width = params->dilation_width_factor;
+        op->activation = params->activation;
+        op->alpha = params->leaky_relu_alpha;
+        padding = params->padding;
+        // The optimized float kernel always reads the bias.
+        TF_LITE_ENSURE(context, op->bias >= 0);
+        TF_LITE_ENSURE_EQ(context, SizeOfDimension(filter, 3),
+                          op->out_channels);
+        TF_LITE_ENSURE_EQ(context, op->out_channels % op->in_channels, 0);
+        op->depth_multiplier = op->out_channels / op->in_channels;
+      }
+      break;
+    }
+    case kTfLiteBuiltinMaxPool2d:
+    case kTfLiteBuiltinAveragePool2d: {
+      const auto* params =
+          reinterpret_cast<const TfLitePoolParams*>(node.node->builtin_data);
+      op->kind = builtin_code == kTfLiteBuiltinMaxPool2d ? OpKind::kMaxPool
+                                                         : OpKind::kAveragePool;
+      op->kernel_height = params->filter_height;
+      op->kernel_width = params->filter_width;
+      op->stride_height = params->stride_height;
+      op->stride_width = params->stride_width;
+      op->activation = params->activation;
+      padding = params->padding;
+      TF_LITE_ENSURE_EQ(context, op->in_channels, op->out_channels);
+      break;
+    }
+    default: {
+      op->kind = OpKind::kUnary;
+      op->activation = UnaryActivation(builtin_code);
+      if (builtin_code == kTfLiteBuiltinLeakyRelu) {
+        op->alpha = reinterpret_cast<const TfLiteLeakyReluParams*>(
+                        node.node->builtin_data)
+                        ->alpha;
+      }
+      TF_LITE_ENSURE(context, HaveSameShapes(input, output));
+      return kTfLiteOk;
+    }
+  }
+
+  int out_height, out_width;
+  const TfLitePaddingValues padding_values = ComputePaddingHeightWidth(
+      op->stride_height, op->stride_width, op->dilation_height,
+      op->dilation_width, op->in_height, op->in_width, op->kernel_height,
+      op->kernel_width, padding, &out_height, &out_width);
+  TF_LITE_ENSURE_EQ(context, out_height, op->out_height);
+  TF_LITE_ENSURE_EQ(context, out_width, op->out_width);
+  op->pad_height = padding_values.height;
+  op->pad_width = padding_values.width;
+  return kTfLiteOk;
+}
+
+TfLiteStatus TiledRegion::Plan(TfLiteContext* context,
+                               const std::vector<Node>& nodes,
+                               size_t cache_bytes,
+                               std::unique_ptr<TiledRegion>* region) {
+  TF_LITE_ENSURE(context, !nodes.empty());
+  std::unique_ptr<TiledRegion> result(new TiledRegion);
+  for (const Node& node : nodes) {
+    Op op;
+    TF_LITE_ENSURE_STATUS(AddOp(context, node, &op));
+    TF_LITE_ENSURE_MSG(
+        context, result->ops_.empty() || op.input == result->ops_.back().output,
+        "Tiled region nodes must consume the output of the previous node");
+    result->ops_.push_back(op);
+  }
+
+  if (cache_bytes == 0) cache_bytes = DefaultCacheBytes();
+  const int height = result->ops_.back().out_height;
+  int rows = height;
+  while (rows > 1 && result->BandFootprint(rows) > cache_bytes) --rows;
+  // Even out the bands so the last one is not a sliver of halo.
+  const int num_bands = (height + rows - 1) / rows;
+  result->PlanBands((height + num_bands - 1) / num_bands);
+
+  *region = std::move(result);
+  return kTfLiteOk;
+}
+
+size_t TiledRegion::BandFootprint(int rows) const {
+  size_t floats = 0;
+  size_t im2col_floats = 0;
+  size_t weight_bytes = 0;
+  int out_rows = rows;
+  for (int i = static_cast<int>(ops_.size()) - 1; i >= 0; --i) {
+    const Op& op = ops_[i];
+    out_rows = std::min(out_rows, op.out_height);
+    const int in_rows =
+        std::min(op.in_height, (out_rows - 1) * op.stride_height +
+                                   (op.kernel_height - 1) * op.dilation_height +
+                                   1);
+    if (i == static_cast<int>(ops_.size()) - 1) {
+      floats += static_cast<size_t>(out_rows) * op.out_width * op.out_channels;
+    }
+    floats += static_cast<size_t>(in_rows) * op.in_width * op.in_channels;
+    if (op.need_im2col) {
+      im2col_floats =
+          std::max(im2col_floats, static_cast<size_t>(out_rows) * op.out_width *
+                                      op.kernel_height * op.kernel_width *
+                                      op.in_channels);
+    }
+    weight_bytes += op.weight_bytes;
+    out_rows = in_rows;
+  }
+  return (floats + im2col_floats) * sizeof(float) + weight_bytes;
+}
+
+void TiledRegion::PlanBands(int rows) {
+  const int num_ops = ops_.size();
+  const int height = ops_.back().out_height;
+  band_rows_ = rows;
+  num_bands_ = (height + rows - 1) / rows;
+  stages_.assign(static_cast<size_t>(num_bands_) * num_ops, Stage());
+
+  std::vector<size_t> scratch_floats(num_ops - 1, 0);
+  size_t im2col_floats = 0;
+  for (int band = 0; band < num_bands_; ++band) {
+    int out_begin = band * rows;
+    int out_end = std::min(height, out_begin + rows);
+    for (int i = num_ops - 1; i >= 0; --i) {
+      const Op& op = ops_[i];
+      Stage& stage = stages_[band * num_ops + i];
+      // Input rows the band reads, before clamping to the tensor.
+      const int first = out_begin * op.stride_height - op.pad_height;
+      const int last = (out_end - 1) * op.stride_height - op.pad_height +
+                       (op.kernel_height - 1) * op.dilation_height + 1;
+      stage.out_row = out_begin;
+      stage.out_rows = out_end - out_begin;
+      stage.in_row = std::max(0, first);
+      stage.in_rows = std::min(op.in_height, last) - stage.in_row;
+      stage.pad_top = stage.in_row - first;
+
+      if (i < num_ops - 1) {
+        scratch_floats[i] =
+            std::max(scratch_floats[i], static_cast<size_t>(stage.out_rows) *
+                                            op.out_width * op.out_channels);
+      }
+      if (op.need_im2col) {
+        im2col_floats = std::max(
+            im2col_floats, static_cast<size_t>(stage.out_rows) * op.out_width *
+                               op.kernel_height * op.kernel_width *
+                               op.in_channels);
+      }
+      // The previous op produces exactly the rows this one reads.
+      out_begin = stage.in_row;
+      out_end = stage.in_row + stage.in_rows;
+    }
+  }
+
+  scratch_.resize(num_ops - 1);
+  for (int i = 0; i < num_ops - 1; ++i) scratch_[i].resize(scratch_floats[i]);
+  im2col_.resize(im2col_floats);
+}
+
+size_t TiledRegion::scratch_bytes() const {
+  size_t floats = im2col_.size();
+  for (const auto& buffer : scratch_) floats += buffer.size();
+  return floats * sizeof(float);
+}
+
+void TiledRegion::RunStage(const Op& op, const Stage& stage,
+                           const float* input, float* output,
+                           TfLiteContext* context) {
+  const RuntimeShape input_shape(
+      {1, stage.in_rows, op.in_width, op.in_channels});
+  const RuntimeShape output_shape(
+      {1, stage.out_rows, op.out_width, op.out_channels});
+  float activation_min, activation_max;
+  CalculateActivationRange(op.activation, &activation_min, &activation_max);
+
+  switch (op.kind) {
+    case OpKind::kConv: {
+      const TfLiteTensor* filter = &context->tensors[op.filter];
+      const TfLiteTensor* bias = OptionalTensor(context, op.bias);
+      ConvParams op_params;
+      op_params.padding_type = PaddingType::kSame;
+      op_params.padding_values.height = stage.pad_top;
+      op_params.padding_values.width = op.pad_width;
+      op_params.stride_height = op.stride_height;
+      op_params.stride_width = op.stride_width;
+      op_params.dilation_height_factor = op.dilation_height;
+      op_params.dilation_width_factor = op.dilation_width;
+      op_params.float_activation_min = activation_min;
+      op_params.float_activation_max = activation_max;
+      const RuntimeShape im2col_shape(
+          {1, stage.out_rows, op.out_width,
+           op.kernel_height * op.kernel_width * op.in_channels});
+      optimized_ops::Conv(op_params, input_shape, input, GetTensorShape(filter),
+                          GetTensorData<float>(filter), GetTensorShape(bias),
+                          GetTensorData<float>(bias), output_shape, output,
+                          im2col_shape,
+                          op.need_im2col ? im2col_.data() : nullptr,
+                          CpuBackendContext::GetFromContext(context));
+      break;
+    }
+    case OpKind::kDepthwiseConv: {
+      const TfLiteTensor* filter = &context->tensors[op.filter];
+      const TfLiteTensor* bias = &context->tensors[op.bias];
+      DepthwiseParams op_params;
+      op_params.padding_type = PaddingType::kSame;
+      op_params.padding_values.height = stage.pad_top;
+      op_params.padding_values.width = op.pad_width;
+      op_params.stride_height = op.stride_height;
+      op_params.stride_width = op.stride_width;
+      op_params.dilation_height_factor = op.dilation_height;
+      op_params.dilation_width_factor = op.dilation_width;
+      op_params.depth_multiplier = op.depth_multiplier;
+      op_params.float_activation_min = activation_min;
+      op_params.float_activation_max = activation_max;
+      optimized_ops::DepthwiseConv<float, float>(
+          op_params, input_shape, input, GetTensorShape(filter),
+          GetTensorData<float>(filter), GetTensorShape(bias),
+          GetTensorData<float>(bias), output_shape, output,
+          CpuBackendContext::GetFromContext(context));
+      break;
+    }
+    case OpKind::kMaxPool:
+    case OpKind::kAveragePool: {
+      PoolParams op_params;
+      op_params.padding_type = PaddingType::kSame;
+      op_params.padding_values.height = stage.pad_top;
+      op_params.padding_values.width = op.pad_width;
+      op_params.stride_height = op.stride_height;
+      op_params.stride_width = op.stride_width;
+      op_params.filter_height = op.kernel_height;
+      op_params.filter_width = op.kernel_width;
+      op_params.float_activation_min = activation_min;
+      op_params.float_activation_max = activation_max;
+      if (op.kind == OpKind::kMaxPool) {
+        optimized_ops::MaxPool(op_params, input_shape, input, output_shape,
+                               output);
+      } else {
+        optimized_ops::AveragePool(op_params, input_shape, input, output_shape,
+                                   output);
+      }
+      break;
+    }
+    case OpKind::kUnary:
+      ApplyActivation(op.activation, op.alpha, input_shape, input, output);
+      return;
+  }
+  if (NeedsActivationEpilogue(op.activation)) {
+    ApplyActivation(op.activation, op.alpha, output_shape, output, output);
+  }
+}
+
+TfLiteStatus TiledRegion::Invoke(TfLiteContext* context) {
+  const int num_ops = ops_.size();
+  const float* input = context->tensors[ops_.front().input].data.f;
+  float* output = context->tensors[ops_.back().output].data.f;
+  TF_LITE_ENSURE(context, input != nullptr);
+  TF_LITE_ENSURE(context, output != nullptr);
+
+  for (int band = 0; band < num_bands_; ++band) {
+    for (int i = 0; i < num_ops; ++i) {
+      const Op& op = ops_[i];
+      const Stage& stage = stages_[band * num_ops + i];
+      const float* op_input =
+          i == 0 ? input + static_cast<size_t>(stage.in_row) * op.in_width *
+                               op.in_channels
+                 : scratch_[i - 1].data();
+      float* op_output =
+          i == num_ops - 1 ? output + static_cast<size_t>(stage.out_row) *
+                                          op.out_width * op.out_channels
+                           : scratch_[i].data();
+      RunStage(op, stage, op_input, op_output, context);
+    }
+  }
+  return kTfLiteOk;
+}
+
+namespace {
+
+class TiledRegionPlanner : public TiledExecutionPlanner {
+ public:
+  bool IsTileableOp(const TfLiteRegistration& registration) const override {
+    return tiled::IsTileableOp(registration);
+  }
+
+  TfLiteStatus Plan(TfLiteContext* context, const std::vector<Node>& nodes,
+                    size_t cache_bytes,
+                    std::unique_ptr<TiledExecution>* plan) const override {
+    std::unique_ptr<TiledRegion> region;
+    TF_LITE_ENSURE_STATUS(
+        TiledRegion::Plan(context, nodes, cache_bytes, &region));
+    *plan = std::move(region);
+    return kTfLiteOk;
+  }
+};
+
+}  // namespace
+
+void RegisterTiledExecutionPlanner() {
+  static const TiledRegionPlanner* planner = new TiledRegionPlanner;
+  SetTiledExecutionPlanner(planner);
+}
+
+}  // namespace tiled
+}  // namespace tflite
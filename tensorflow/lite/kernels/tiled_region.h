@@ -0,0 +1,142 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_TILED_REGION_H_
+#define TENSORFLOW_LITE_KERNELS_TILED_REGION_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/tiled_execution.h"
+
+namespace tflite {
+namespace tiled {
+
+// Cache budget used when a region does not specify one: the L2 size reported
+// by the OS, or 512KB if it can not be determined.
+size_t DefaultCacheBytes();
+
+// True if `registration` is a spatially local op a tiled region can run:
+// CONV_2D, DEPTHWISE_CONV_2D, MAX_POOL_2D, AVERAGE_POOL_2D and the elementwise
+// activations RELU, RELU6, RELU_N1_TO_1, LEAKY_RELU, LOGISTIC and HARD_SWISH.
+bool IsTileableOp(const TfLiteRegistration& registration);
+
+// Installs TiledRegion as the framework's TiledExecutionPlanner. Called by the
+// BuiltinOpResolver constructor; idempotent.
+void RegisterTiledExecutionPlanner();
+
+// A chain of spatially local ops executed depth first, one band of output rows
+// at a time.
+//
+// The region is a sequence of nodes where each node consumes the single output
+// of the previous one. For every band of rows of the last output, the rows each
+// op needs from its input (the band plus the halo of its kernel) are computed
+// backwards through the chain, then the ops run front to back on those rows
+// only. The first op reads its rows straight out of the region input and the
+// last op writes straight into the region output; everything in between lives
+// in small scratch buffers owned by the region, so with a band sized to the
+// cache the intermediate activations never leave it. Halo rows shared by two
+// neighbouring bands are recomputed.
+//
+// Only float32, batch 1, NHWC tensors are supported. The ops are run with the
+// optimized kernels directly (the registrations' invoke functions are never
+// called), so the intermediate tensors do not need any storage of their own.
+class TiledRegion : public TiledExecution {
+ public:
+  using Node = TiledExecutionPlanner::Node;
+
+  // Plans a region over `nodes`, given in execution order. Tensor shapes must
+  // be final, i.e. all nodes have been prepared. The band height is the
+  // largest one whose working set (input, intermediate and output rows,
+  // im2col and weights) fits in `cache_bytes`; 0 uses DefaultCacheBytes().
+  // Returns kTfLiteError (and reports why) if the nodes can not be tiled.
+  static TfLiteStatus Plan(TfLiteContext* context,
+                           const std::vector<Node>& nodes, size_t cache_bytes,
+                           std::unique_ptr<TiledRegion>* region);
+
+  // Runs every band of the region. Reads the region input and writes the
+  // region output through `context`.
+  TfLiteStatus Invoke(TfLiteContext* context) override;
+
+  // Rows of the last output computed per band.
+  int band_rows() const override { return band_rows_; }
+  int num_bands() const override { return num_bands_; }
+
+  // Bytes of scratch memory held by the region.
+  size_t scratch_bytes() const override;
+
+ private:
+  enum class OpKind { kConv, kDepthwiseConv, kMaxPool, kAveragePool, kUnary };
+
+  struct Op {
+    OpKind kind;
+    int builtin_code;
+    int input;
+    int output;
+    int filter = -1;
+    int bias = -1;
+    int in_height, in_width, in_channels;
+    int out_height, out_width, out_channels;
+    int kernel_height = 1, kernel_width = 1;
+    int stride_height = 1, stride_width = 1;
+    int dilation_height = 1, dilation_width = 1;
+    int pad_height = 0, pad_width = 0;
+    int depth_multiplier = 1;
+    bool need_im2col = false;
+    TfLiteFusedActivation activation = kTfLiteActNone;
+    float alpha = 0.f;
+    size_t weight_bytes = 0;
+  };
+
+  // Rows one op touches in one band.
+  struct Stage {
+    int in_row;
+    int in_rows;
+    int out_row;
+    int out_rows;
+    // Padding rows above in_row (only non zero at the top of the tensor).
+    int pad_top;
+  };
+
+  TiledRegion() = default;
+
+  static TfLiteStatus AddOp(TfLiteContext* context, const Node& node,
+                            Op* op);
+
+  // Working set in bytes of one band computing `rows` rows of the last output.
+  size_t BandFootprint(int rows) const;
+
+  // Fills stages_ for bands of `rows` rows and sizes the scratch buffers.
+  void PlanBands(int rows);
+
+  void RunStage(const Op& op, const Stage& stage, const float* input,
+                float* output, TfLiteContext* context);
+
+  std::vector<Op> ops_;
+  int band_rows_ = 0;
+  int num_bands_ = 0;
+  // num_bands_ x ops_.size() stages, band major.
+  std::vector<Stage> stages_;
+  // Output rows of op i (i < ops_.size() - 1) for the current band.
+  std::vector<std::vector<float>> scratch_;
+  std::vector<float> im2col_;
+};
+
+}  // namespace tiled
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_TILED_REGION_H_
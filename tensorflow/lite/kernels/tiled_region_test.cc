@@ -0,0 +1,212 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/kernels/tiled_region.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/kernels/test_util.h"
+
+namespace tflite {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+template <typename T>
+T* NewParams() {
+  T* params = static_cast<T*>(calloc(1, sizeof(T)));
+  return params;
+}
+
+// conv 3x3/2 (relu) -> depthwise 3x3/1 -> max pool 3x3/2 -> leaky relu, on an
+// odd sized input so every op pads asymmetrically.
+class TiledRegionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i < conv_filter_.size(); ++i) {
+      conv_filter_[i] = std::sin(0.37f * i);
+    }
+    for (int i = 0; i < dw_filter_.size(); ++i) {
+      dw_filter_[i] = std::cos(0.21f * i);
+    }
+    for (int i = 0; i < 4; ++i) {
+      conv_bias_[i] = 0.1f * i - 0.15f;
+      dw_bias_[i] = 0.05f * i;
+    }
+  }
+
+  void Build(Interpreter* interpreter, const std::vector<int>& outputs) {
+    ASSERT_EQ(interpreter->AddTensors(9), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetInputs({0}), kTfLiteOk);
+    ASSERT_EQ(interpreter->SetOutputs(outputs), kTfLiteOk);
+    TfLiteQuantization quant = {kTfLiteNoQuantization, nullptr};
+    interpreter->SetTensorParametersReadWrite(0, kTfLiteFloat32, "input",
+                                              {1, 13, 11, 3}, quant);
+    interpreter->SetTensorParametersReadOnly(
+        1, kTfLiteFloat32, "conv_filter", {4, 3, 3, 3}, quant,
+        reinterpret_cast<const char*>(conv_filter_.data()),
+        conv_filter_.size() * sizeof(float));
+    interpreter->SetTensorParametersReadOnly(
+        2, kTfLiteFloat32, "conv_bias", {4}, quant,
+        reinterpret_cast<const char*>(conv_bias_.data()),
+        conv_bias_.size() * sizeof(float));
+    interpreter->SetTensorParametersReadWrite(3, kTfLiteFloat32, "conv",
+                                              {1, 7, 6, 4}, quant);
+    interpreter->SetTensorParametersReadOnly(
+        4, kTfLiteFloat32, "dw_filter", {1, 3, 3, 4}, quant,
+        reinterpret_cast<const char*>(dw_filter_.data()),
+        dw_filter_.size() * sizeof(float));
+    interpreter->SetTensorParametersReadOnly(
+        5, kTfLiteFloat32, "dw_bias", {4}, quant,
+        reinterpret_cast<const char*>(dw_bias_.data()),
+        dw_bias_.size() * sizeof(float));
+    interpreter->SetTensorParametersReadWrite(6, kTfLiteFloat32, "dw",
+                                              {1, 7, 6, 4}, quant);
+    interpreter->SetTensorParametersReadWrite(7, kTfLiteFloat32, "pool",
+                                              {1, 4, 3, 4}, quant);
+    interpreter->SetTensorParametersReadWrite(8, kTfLiteFloat32, "output",
+                                              {1, 4, 3, 4}, quant);
+
+    auto* conv_params = NewParams<TfLiteConvParams>();
+    conv_params->padding = kTfLitePaddingSame;
+    conv_params->stride_height = 2;
+    conv_params->stride_width = 2;
+    conv_params->dilation_height_factor = 1;
+    conv_params->dilation_width_factor = 1;
+    conv_params->activation = kTfLiteActRelu;
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {0, 1, 2}, {3}, nullptr, 0, conv_params,
+                  resolver_.FindOp(BuiltinOperator_CONV_2D, 1)),
+              kTfLiteOk);
+
+    auto* dw_params = NewParams<TfLiteDepthwiseConvParams>();
+    dw_params->padding = kTfLitePaddingSame;
+    dw_params->stride_height = 1;
+    dw_params->stride_width = 1;
+    dw_params->dilation_height_factor = 1;
+    dw_params->dilation_width_factor = 1;
+    dw_params->depth_multiplier = 1;
+    dw_params->activation = kTfLiteActNone;
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {3, 4, 5}, {6}, nullptr, 0, dw_params,
+                  resolver_.FindOp(BuiltinOperator_DEPTHWISE_CONV_2D, 1)),
+              kTfLiteOk);
+
+    auto* pool_params = NewParams<TfLitePoolParams>();
+    pool_params->padding = kTfLitePaddingSame;
+    pool_params->stride_height = 2;
+    pool_params->stride_width = 2;
+    pool_params->filter_height = 3;
+    pool_params->filter_width = 3;
+    pool_params->activation = kTfLiteActNone;
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {6}, {7}, nullptr, 0, pool_params,
+                  resolver_.FindOp(BuiltinOperator_MAX_POOL_2D, 1)),
+              kTfLiteOk);
+
+    auto* leaky_params = NewParams<TfLiteLeakyReluParams>();
+    leaky_params->alpha = 0.1f;
+    ASSERT_EQ(interpreter->AddNodeWithParameters(
+                  {7}, {8}, nullptr, 0, leaky_params,
+                  resolver_.FindOp(BuiltinOperator_LEAKY_RELU, 1)),
+              kTfLiteOk);
+  }
+
+  std::vector<float> Run(Interpreter* interpreter) {
+    EXPECT_EQ(interpreter->AllocateTensors(), kTfLiteOk);
+    TfLiteTensor* input = interpreter->tensor(0);
+    for (int i = 0; i < NumElements(input); ++i) {
+      input->data.f[i] = std::cos(0.11f * i);
+    }
+    EXPECT_EQ(interpreter->Invoke(), kTfLiteOk);
+    const TfLiteTensor* output = interpreter->tensor(8);
+    return std::vector<float>(output->data.f,
+                              output->data.f + NumElements(output));
+  }
+
+  std::vector<float> Reference() {
+    Interpreter interpreter;
+    Build(&interpreter, {8});
+    return Run(&interpreter);
+  }
+
+  ops::builtin::BuiltinOpResolver resolver_;
+  std::vector<float> conv_filter_ = std::vector<float>(4 * 3 * 3 * 3);
+  std::vector<float> conv_bias_ = std::vector<float>(4);
+  std::vector<float> dw_filter_ = std::vector<float>(3 * 3 * 4);
+  std::vector<float> dw_bias_ = std::vector<float>(4);
+};
+
+TEST_F(TiledRegionTest, OneRowBandsMatchNodeByNode) {
+  const std::vector<float> expected = Reference();
+
+  Interpreter interpreter;
+  Build(&interpreter, {8});
+  // Nothing fits in one byte, so every band is a single output row.
+  ASSERT_EQ(interpreter.EnableTiledRegion(0, 3, /*cache_bytes=*/1), kTfLiteOk);
+  EXPECT_THAT(Run(&interpreter), ElementsAreArray(ArrayFloatNear(expected)));
+  EXPECT_EQ(interpreter.subgraph(0)->TiledRegionBandRows(0), 1);
+  // The intermediates never got arena memory.
+  EXPECT_EQ(interpreter.tensor(3)->data.raw, nullptr);
+  EXPECT_EQ(interpreter.tensor(6)->data.raw, nullptr);
+  EXPECT_EQ(interpreter.tensor(7)->data.raw, nullptr);
+
+  // Invoking again reuses the plan.
+  EXPECT_THAT(Run(&interpreter), ElementsAreArray(ArrayFloatNear(expected)));
+}
+
+TEST_F(TiledRegionTest, LargeCacheRunsOneBand) {
+  const std::vector<float> expected = Reference();
+
+  Interpreter interpreter;
+  Build(&interpreter, {8});
+  ASSERT_EQ(interpreter.EnableTiledRegion(0, 3, /*cache_bytes=*/1 << 20),
+            kTfLiteOk);
+  EXPECT_THAT(Run(&interpreter), ElementsAreArray(ArrayFloatNear(expected)));
+  EXPECT_EQ(interpreter.subgraph(0)->TiledRegionBandRows(0), 4);
+}
+
+TEST_F(TiledRegionTest, PartialRegion) {
+  const std::vector<float> expected = Reference();
+
+  Interpreter interpreter;
+  Build(&interpreter, {8});
+  ASSERT_EQ(interpreter.EnableTiledRegion(1, 2, /*cache_bytes=*/1), kTfLiteOk);
+  EXPECT_THAT(Run(&interpreter), ElementsAreArray(ArrayFloatNear(expected)));
+  EXPECT_NE(interpreter.tensor(3)->data.raw, nullptr);
+  EXPECT_EQ(interpreter.tensor(6)->data.raw, nullptr);
+}
+
+TEST_F(TiledRegionTest, RejectsIntermediateReadOutsideRegion) {
+  Interpreter interpreter;
+  Build(&interpreter, {8, 6});
+  EXPECT_EQ(interpreter.EnableTiledRegion(0, 3), kTfLiteError);
+  EXPECT_EQ(interpreter.EnableTiledRegion(0, 1), kTfLiteOk);
+  // Overlaps the region above.
+  EXPECT_EQ(interpreter.EnableTiledRegion(1, 2), kTfLiteError);
+  EXPECT_EQ(interpreter.EnableTiledRegion(2, 4), kTfLiteError);
+}
+
+TEST(TiledRegion, DefaultCacheBytes) { EXPECT_GT(tiled::DefaultCacheBytes(), 0); }
+
+}  // namespace
+}  // namespace tflite
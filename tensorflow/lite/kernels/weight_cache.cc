@@ -0,0 +1,270 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/kernels/weight_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace tflite {
+namespace {
+
+constexpr char kFileMagic[8] = {'T', 'F', 'L', 'W', 'C', 'A', 'C', 'H'};
+// Bump when a packing changes its output layout.
+constexpr uint32_t kFileVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_entries;
+};
+
+struct FileEntryHeader {
+  uint64_t fingerprint;
+  uint64_t source_bytes;
+  int32_t packing;
+  uint32_t reserved;
+  uint64_t bytes;
+};
+
+uint64_t Mix(uint64_t hash, uint64_t value) {
+  hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  return hash * 0xff51afd7ed558ccdull;
+}
+
+uint64_t HashBytes(const char* data, size_t bytes, uint64_t hash) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = Mix(hash, word);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, bytes - i);
+  return Mix(hash, tail ^ bytes);
+}
+
+}  // namespace
+
+SharedWeightCache& SharedWeightCache::GetInstance() {
+  // Never destroyed: interpreters released at exit may still call Release().
+  static SharedWeightCache* instance = new SharedWeightCache;
+  return *instance;
+}
+
+WeightCacheKey SharedWeightCache::KeyFor(const TfLiteTensor* source,
+                                         WeightPacking packing) {
+  uint64_t hash = Mix(0, source->type);
+  if (source->dims != nullptr) {
+    for (int i = 0; i < source->dims->size; ++i) {
+      hash = Mix(hash, source->dims->data[i]);
+    }
+  }
+  WeightCacheKey key;
+  key.fingerprint = HashBytes(source->data.raw_const, source->bytes, hash);
+  key.source_bytes = source->bytes;
+  key.packing = static_cast<int32_t>(packing);
+  return key;
+}
+
+const void* SharedWeightCache::Acquire(
+    const WeightCacheKey& key, size_t packed_bytes,
+    const std::function<void(void*)>& pack) {
+  // Packing happens under the lock so two interpreters preparing the same
+  // weights at once do not both pack them.
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    if (it->second.bytes != packed_bytes) return nullptr;
+    ++it->second.references;
+    ++hits_;
+    return it->second.data.get();
+  }
+  Entry& entry = entries_[key];
+  entry.data.reset(new char[packed_bytes]);
+  entry.bytes = packed_bytes;
+  entry.references = 1;
+  pack(entry.data.get());
+  bytes_ += packed_bytes;
+  ++misses_;
+  return entry.data.get();
+}
+
+void SharedWeightCache::Release(const WeightCacheKey& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end() || it->second.references <= 0) return;
+  if (--it->second.references == 0) {
+    bytes_ -= it->second.bytes;
+    entries_.erase(it);
+  }
+}
+
+void SharedWeightCache::SetEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = enabled;
+}
+
+bool SharedWeightCache::enabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return enabled_;
+}
+
+TfLiteStatus SharedWeightCache::Save(const std::string& path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Written next to the target and renamed, so a crash never leaves a
+  // truncated cache behind.
+  const std::string tmp_path = path + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) return kTfLiteError;
+
+  FileHeader header;
+  memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+  header.version = kFileVersion;
+  header.reserved = 0;
+  header.num_entries = entries_.size();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const auto& key_and_entry : entries_) {
+    if (!ok) break;
+    FileEntryHeader entry_header;
+    entry_header.fingerprint = key_and_entry.first.fingerprint;
+    entry_header.source_bytes = key_and_entry.first.source_bytes;
+    entry_header.packing = key_and_entry.first.packing;
+    entry_header.reserved = 0;
+    entry_header.bytes = key_and_entry.second.bytes;
+    ok = fwrite(&entry_header, sizeof(entry_header), 1, file) == 1 &&
+         fwrite(key_and_entry.second.data.get(), 1, entry_header.bytes,
+                file) == entry_header.bytes;
+  }
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+    return kTfLiteError;
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus SharedWeightCache::Load(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return kTfLiteError;
+
+  fseek(file, 0, SEEK_END);
+  const long file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  // Read everything first, a corrupt file must not add half of its entries.
+  std::vector<std::pair<WeightCacheKey, Entry>> loaded;
+  FileHeader header;
+  bool ok = file_size > 0 && fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) == 0 &&
+            header.version == kFileVersion;
+  for (uint64_t i = 0; ok && i < header.num_entries; ++i) {
+    FileEntryHeader entry_header;
+    if (fread(&entry_header, sizeof(entry_header), 1, file) != 1 ||
+        entry_header.bytes > static_cast<uint64_t>(file_size - ftell(file))) {
+      ok = false;
+      break;
+    }
+    WeightCacheKey key;
+    key.fingerprint = entry_header.fingerprint;
+    key.source_bytes = entry_header.source_bytes;
+    key.packing = entry_header.packing;
+    Entry entry;
+    entry.bytes = entry_header.bytes;
+    entry.data.reset(new char[entry.bytes]);
+    ok = key.valid() &&
+         fread(entry.data.get(), 1, entry.bytes, file) == entry.bytes;
+    loaded.emplace_back(key, std::move(entry));
+  }
+  fclose(file);
+  if (!ok) return kTfLiteError;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& key_and_entry : loaded) {
+    if (entries_.count(key_and_entry.first)) continue;
+    bytes_ += key_and_entry.second.bytes;
+    entries_.emplace(key_and_entry.first, std::move(key_and_entry.second));
+  }
+  return kTfLiteOk;
+}
+
+void SharedWeightCache::Trim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (it->second.references == 0) {
+      bytes_ -= it->second.bytes;
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t SharedWeightCache::num_entries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+size_t SharedWeightCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+int64_t SharedWeightCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+int64_t SharedWeightCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+bool AcquireSharedPackedWeights(
+    const TfLiteTensor* source, WeightPacking packing, TfLiteTensor* packed,
+    WeightCacheKey* key,
+    const std::function<void(const TfLiteTensor*, TfLiteTensor*)>& pack) {
+  SharedWeightCache& cache = SharedWeightCache::GetInstance();
+  if (source->allocation_type != kTfLiteMmapRo ||
+      source->data.raw == nullptr || !cache.enabled()) {
+    ReleaseSharedPackedWeights(key);
+    return false;
+  }
+  const WeightCacheKey new_key = SharedWeightCache::KeyFor(source, packing);
+  const void* data =
+      cache.Acquire(new_key, packed->bytes, [source, packed, &pack](void* out) {
+        TfLiteTensor view = *packed;
+        view.data.raw = static_cast<char*>(out);
+        pack(source, &view);
+      });
+  // Released after acquiring, so preparing the same weights again does not
+  // drop and repack the entry.
+  ReleaseSharedPackedWeights(key);
+  if (data == nullptr) return false;
+  *key = new_key;
+  packed->allocation_type = kTfLiteCustom;
+  packed->data.raw = const_cast<char*>(static_cast<const char*>(data));
+  return true;
+}
+
+void ReleaseSharedPackedWeights(WeightCacheKey* key) {
+  if (!key->valid()) return;
+  SharedWeightCache::GetInstance().Release(*key);
+  *key = WeightCacheKey();
+}
+
+}  // namespace tflite
@@ -0,0 +1,138 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_WEIGHT_CACHE_H_
+#define TENSORFLOW_LITE_KERNELS_WEIGHT_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <tuple>
+
+#include "tensorflow/lite/c/common.h"
+
+namespace tflite {
+
+// The packed forms kernels derive from constant weights.
+enum class WeightPacking : int32_t {
+  // Conv filter transposed to [filter_height * filter_width * input_depth,
+  // output_depth] for the Eigen (multithreaded) conv.
+  kHwcnTranspose = 1,
+  // Conv filter transformed for Winograd F(2x2, 3x3).
+  kWinogradFilter = 2,
+};
+
+// Identifies one packed form of a constant tensor by its content, so the same
+// weights loaded by different interpreters (or different processes, see
+// SharedWeightCache::Save) map to the same entry.
+struct WeightCacheKey {
+  // Hash of the source tensor's bytes and shape.
+  uint64_t fingerprint = 0;
+  uint64_t source_bytes = 0;
+  int32_t packing = 0;
+
+  bool valid() const { return packing != 0; }
+  bool operator<(const WeightCacheKey& other) const {
+    return std::tie(fingerprint, source_bytes, packing) <
+           std::tie(other.fingerprint, other.source_bytes, other.packing);
+  }
+};
+
+// Process wide, reference counted store of packed constant weights.
+//
+// Kernels that repack a constant filter in Prepare (and would otherwise keep a
+// private persistent copy per interpreter) acquire the packed copy here
+// instead. Every interpreter of the process built from the same weights then
+// shares one copy, packed once. An entry lives as long as some node holds it.
+//
+// The cache can be written to disk and read back, so a restarted process
+// finds its weights already packed. Entries loaded from disk are kept until
+// they are used and released, or until Trim().
+//
+// All methods are thread safe.
+class SharedWeightCache {
+ public:
+  static SharedWeightCache& GetInstance();
+
+  // Key of `source` packed with `packing`. Hashes the whole tensor.
+  static WeightCacheKey KeyFor(const TfLiteTensor* source,
+                               WeightPacking packing);
+
+  // Returns the `packed_bytes` long buffer for `key`, calling `pack` to fill
+  // it if the entry does not exist yet. Every successful Acquire must be
+  // paired with a Release. Returns nullptr if an entry of a different size is
+  // stored under the key (the caller then has to pack privately).
+  const void* Acquire(const WeightCacheKey& key, size_t packed_bytes,
+                      const std::function<void(void*)>& pack);
+  void Release(const WeightCacheKey& key);
+
+  // Kernels only use the cache while it is enabled (the default). Disabling
+  // it does not affect buffers already acquired.
+  void SetEnabled(bool enabled);
+  bool enabled() const;
+
+  // Writes every entry to `path`.
+  TfLiteStatus Save(const std::string& path) const;
+  // Adds the entries stored in `path`. Entries already present are kept.
+  TfLiteStatus Load(const std::string& path);
+
+  // Drops the entries no node holds.
+  void Trim();
+
+  size_t num_entries() const;
+  // Bytes of packed data held.
+  size_t bytes() const;
+  // Number of Acquire calls that found their entry / had to pack it.
+  int64_t hits() const;
+  int64_t misses() const;
+
+ private:
+  struct Entry {
+    std::unique_ptr<char[]> data;
+    size_t bytes = 0;
+    int references = 0;
+  };
+
+  SharedWeightCache() = default;
+  SharedWeightCache(const SharedWeightCache&) = delete;
+  SharedWeightCache& operator=(const SharedWeightCache&) = delete;
+
+  mutable std::mutex mutex_;
+  std::map<WeightCacheKey, Entry> entries_;
+  size_t bytes_ = 0;
+  int64_t hits_ = 0;
+  int64_t misses_ = 0;
+  bool enabled_ = true;
+};
+
+// Points `packed` at the shared copy of `source` packed with `packing`, calling
+// `pack(source, packed)` on a miss. `packed` must already have its final type
+// and shape; it becomes a kTfLiteCustom tensor so it takes no arena memory.
+// A key held from a previous call is released. Returns false, leaving `packed`
+// untouched, if `source` is not constant or the cache is disabled.
+bool AcquireSharedPackedWeights(
+    const TfLiteTensor* source, WeightPacking packing, TfLiteTensor* packed,
+    WeightCacheKey* key,
+    const std::function<void(const TfLiteTensor*, TfLiteTensor*)>& pack);
+
+// Releases `key` if it is held and resets it.
+void ReleaseSharedPackedWeights(WeightCacheKey* key);
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_WEIGHT_CACHE_H_
@@ -0,0 +1,246 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/kernels/weight_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "tensorflow/lite/c/common.h"
+
+namespace tflite {
+namespace {
+
+class WeightCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    cache_.Trim();
+    cache_.SetEnabled(true);
+    path_ = ::testing::TempDir() + "/weight_cache_test.bin";
+    remove(path_.c_str());
+  }
+
+  void TearDown() override {
+    cache_.Trim();
+    remove(path_.c_str());
+  }
+
+  // A read only float tensor over `values`.
+  TfLiteTensor ConstTensor(std::vector<float>* values) {
+    TfLiteTensor tensor;
+    memset(&tensor, 0, sizeof(tensor));
+    tensor.type = kTfLiteFloat32;
+    tensor.allocation_type = kTfLiteMmapRo;
+    tensor.data.f = values->data();
+    tensor.bytes = values->size() * sizeof(float);
+    tensor.dims = TfLiteIntArrayCreate(1);
+    tensor.dims->data[0] = values->size();
+    return tensor;
+  }
+
+  SharedWeightCache& cache_ = SharedWeightCache::GetInstance();
+  std::string path_;
+};
+
+void Negate(const TfLiteTensor* source, TfLiteTensor* packed) {
+  const int size = source->bytes / sizeof(float);
+  for (int i = 0; i < size; ++i) packed->data.f[i] = -source->data.f[i];
+}
+
+TEST_F(WeightCacheTest, KeyDependsOnContentAndPacking) {
+  std::vector<float> a = {1, 2, 3, 4};
+  std::vector<float> b = {1, 2, 3, 5};
+  TfLiteTensor ta = ConstTensor(&a);
+  TfLiteTensor tb = ConstTensor(&b);
+  const WeightCacheKey ka =
+      SharedWeightCache::KeyFor(&ta, WeightPacking::kHwcnTranspose);
+  const WeightCacheKey kb =
+      SharedWeightCache::KeyFor(&tb, WeightPacking::kHwcnTranspose);
+  const WeightCacheKey kw =
+      SharedWeightCache::KeyFor(&ta, WeightPacking::kWinogradFilter);
+  EXPECT_TRUE(ka.valid());
+  EXPECT_TRUE(ka < kb || kb < ka);
+  EXPECT_TRUE(ka < kw || kw < ka);
+  EXPECT_FALSE(
+      ka < SharedWeightCache::KeyFor(&ta, WeightPacking::kHwcnTranspose));
+  TfLiteIntArrayFree(ta.dims);
+  TfLiteIntArrayFree(tb.dims);
+}
+
+TEST_F(WeightCacheTest, AcquirePacksOnceAndReleaseFrees) {
+  std::vector<float> values = {1, 2, 3, 4};
+  TfLiteTensor source = ConstTensor(&values);
+  const WeightCacheKey key =
+      SharedWeightCache::KeyFor(&source, WeightPacking::kHwcnTranspose);
+  int packs = 0;
+  auto pack = [&packs](void* out) {
+    ++packs;
+    memset(out, 0x7f, 16);
+  };
+  const int64_t hits = cache_.hits();
+  const void* first = cache_.Acquire(key, 16, pack);
+  const void* second = cache_.Acquire(key, 16, pack);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(packs, 1);
+  EXPECT_EQ(cache_.hits(), hits + 1);
+  EXPECT_EQ(cache_.num_entries(), 1);
+  EXPECT_EQ(cache_.bytes(), 16);
+
+  // A different packed size under the same key is refused.
+  EXPECT_EQ(cache_.Acquire(key, 8, pack), nullptr);
+
+  cache_.Release(key);
+  EXPECT_EQ(cache_.num_entries(), 1);
+  cache_.Release(key);
+  EXPECT_EQ(cache_.num_entries(), 0);
+  EXPECT_EQ(cache_.bytes(), 0);
+  TfLiteIntArrayFree(source.dims);
+}
+
+TEST_F(WeightCacheTest, SharedPackedWeightsAcrossTensors) {
+  std::vector<float> values = {1, -2, 3, -4};
+  // Two interpreters loading the same model map the same bytes.
+  std::vector<float> copy = values;
+  TfLiteTensor source_a = ConstTensor(&values);
+  TfLiteTensor source_b = ConstTensor(&copy);
+  TfLiteTensor packed_a, packed_b;
+  memset(&packed_a, 0, sizeof(packed_a));
+  memset(&packed_b, 0, sizeof(packed_b));
+  packed_a.allocation_type = packed_b.allocation_type =
+      kTfLiteArenaRwPersistent;
+  packed_a.bytes = packed_b.bytes = values.size() * sizeof(float);
+
+  WeightCacheKey key_a, key_b;
+  ASSERT_TRUE(AcquireSharedPackedWeights(
+      &source_a, WeightPacking::kHwcnTranspose, &packed_a, &key_a, Negate));
+  ASSERT_TRUE(AcquireSharedPackedWeights(
+      &source_b, WeightPacking::kHwcnTranspose, &packed_b, &key_b, Negate));
+  EXPECT_EQ(packed_a.allocation_type, kTfLiteCustom);
+  EXPECT_EQ(packed_a.data.raw, packed_b.data.raw);
+  EXPECT_EQ(packed_a.data.f[1], 2);
+  EXPECT_EQ(cache_.num_entries(), 1);
+
+  // Preparing again keeps the entry.
+  ASSERT_TRUE(AcquireSharedPackedWeights(
+      &source_a, WeightPacking::kHwcnTranspose, &packed_a, &key_a, Negate));
+  EXPECT_EQ(packed_a.data.raw, packed_b.data.raw);
+
+  ReleaseSharedPackedWeights(&key_a);
+  EXPECT_FALSE(key_a.valid());
+  EXPECT_EQ(cache_.num_entries(), 1);
+  ReleaseSharedPackedWeights(&key_b);
+  EXPECT_EQ(cache_.num_entries(), 0);
+  TfLiteIntArrayFree(source_a.dims);
+  TfLiteIntArrayFree(source_b.dims);
+}
+
+TEST_F(WeightCacheTest, SkipsNonConstantSourcesAndDisabledCache) {
+  std::vector<float> values = {1, 2};
+  TfLiteTensor source = ConstTensor(&values);
+  TfLiteTensor packed;
+  memset(&packed, 0, sizeof(packed));
+  packed.allocation_type = kTfLiteArenaRwPersistent;
+  packed.bytes = values.size() * sizeof(float);
+  WeightCacheKey key;
+
+  source.allocation_type = kTfLiteArenaRw;
+  EXPECT_FALSE(AcquireSharedPackedWeights(
+      &source, WeightPacking::kHwcnTranspose, &packed, &key, Negate));
+  EXPECT_EQ(packed.allocation_type, kTfLiteArenaRwPersistent);
+
+  source.allocation_type = kTfLiteMmapRo;
+  cache_.SetEnabled(false);
+  EXPECT_FALSE(AcquireSharedPackedWeights(
+      &source, WeightPacking::kHwcnTranspose, &packed, &key, Negate));
+  EXPECT_FALSE(key.valid());
+  EXPECT_EQ(cache_.num_entries(), 0);
+  TfLiteIntArrayFree(source.dims);
+}
+
+TEST_F(WeightCacheTest, SaveAndLoad) {
+  std::vector<float> values = {5, 6, 7};
+  TfLiteTensor source = ConstTensor(&values);
+  TfLiteTensor packed;
+  memset(&packed, 0, sizeof(packed));
+  packed.bytes = values.size() * sizeof(float);
+  WeightCacheKey key;
+  ASSERT_TRUE(AcquireSharedPackedWeights(
+      &source, WeightPacking::kWinogradFilter, &packed, &key, Negate));
+  ASSERT_EQ(cache_.Save(path_), kTfLiteOk);
+  ReleaseSharedPackedWeights(&key);
+  ASSERT_EQ(cache_.num_entries(), 0);
+
+  // A restarted process finds the weights already packed.
+  ASSERT_EQ(cache_.Load(path_), kTfLiteOk);
+  EXPECT_EQ(cache_.num_entries(), 1);
+  const int64_t misses = cache_.misses();
+  auto never_called = [](const TfLiteTensor*, TfLiteTensor*) {
+    ADD_FAILURE() << "loaded entry was packed again";
+  };
+  ASSERT_TRUE(AcquireSharedPackedWeights(
+      &source, WeightPacking::kWinogradFilter, &packed, &key, never_called));
+  EXPECT_EQ(cache_.misses(), misses);
+  EXPECT_EQ(packed.data.f[2], -7);
+
+  // Loaded entries nobody holds go away with Trim.
+  ReleaseSharedPackedWeights(&key);
+  ASSERT_EQ(cache_.Load(path_), kTfLiteOk);
+  EXPECT_EQ(cache_.num_entries(), 1);
+  cache_.Trim();
+  EXPECT_EQ(cache_.num_entries(), 0);
+  TfLiteIntArrayFree(source.dims);
+}
+
+TEST_F(WeightCacheTest, LoadRejectsCorruptFiles) {
+  EXPECT_EQ(cache_.Load(path_), kTfLiteError);
+
+  std::vector<float> values = {1, 2, 3, 4, 5, 6, 7, 8};
+  TfLiteTensor source = ConstTensor(&values);
+  TfLiteTensor packed;
+  memset(&packed, 0, sizeof(packed));
+  packed.bytes = values.size() * sizeof(float);
+  WeightCacheKey key;
+  ASSERT_TRUE(AcquireSharedPackedWeights(
+      &source, WeightPacking::kHwcnTranspose, &packed, &key, Negate));
+  ASSERT_EQ(cache_.Save(path_), kTfLiteOk);
+  ReleaseSharedPackedWeights(&key);
+
+  // Truncate the entry data.
+  FILE* file = fopen(path_.c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  std::vector<char> contents(4096);
+  contents.resize(fread(contents.data(), 1, contents.size(), file));
+  fclose(file);
+  file = fopen(path_.c_str(), "wb");
+  fwrite(contents.data(), 1, contents.size() - 4, file);
+  fclose(file);
+  EXPECT_EQ(cache_.Load(path_), kTfLiteError);
+  EXPECT_EQ(cache_.num_entries(), 0);
+
+  // Wrong magic.
+  contents[0] = 'X';
+  file = fopen(path_.c_str(), "wb");
+  fwrite(contents.data(), 1, contents.size(), file);
+  fclose(file);
+  EXPECT_EQ(cache_.Load(path_), kTfLiteError);
+  EXPECT_EQ(cache_.num_entries(), 0);
+  TfLiteIntArrayFree(source.dims);
+}
+
+}  // namespace
+}  // namespace tflite
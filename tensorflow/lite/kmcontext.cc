@@ -7,8 +7,6 @@
 #include "tensorflow/lite/schema/schema_generated.h"
 using namespace std;
 
-KmContext kmcontext;
-
 void KmContext::channelPartitioning(vector<pair<int, float>>& layer) {
 	vector<int> partitioning_plan;
 	vector<float> ratios;
@@ -205,7 +203,7 @@ void KmContext::printNodeDims() {
 	string output_shape_[1] = {"output_shape : " };
 
   for (int execution_plan_index = 0;
-		 execution_plan_index < kmcontext.execution_plan_->size(); execution_plan_index++) {
+		 execution_plan_index < execution_plan_->size(); execution_plan_index++) {
 		int node_index = (*execution_plan_)[execution_plan_index];
 		TfLiteNode& node = (*nodes_and_registration_)[node_index].first;
 		const TfLiteRegistration& registration = (*nodes_and_registration_)[node_index].second;
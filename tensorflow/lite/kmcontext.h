@@ -1,8 +1,21 @@
+#pragma once
 #include <vector>
 #include <string>
 #include "tensorflow/lite/c/common.h"
 
-#define KMCONTEXT() kmcontext.setContext(&context_, &execution_plan_, &nodes_and_registration_)
+/*
+KmContext : channel-wise partitioning context of one subgraph
+
+    Every tflite::Subgraph owns its KmContext, pointing at the subgraph's own
+    context_, execution_plan_ and nodes_and_registration_. Partitioning one
+    interpreter never touches another one, so several channel-partitioned
+    interpreters (one per stream) can be set up and run in one process.
+
+    Usage
+        interpreter->AllocateTensors();
+        interpreter->ChannelPartitioning("CONV_2D", 0.5);
+        interpreter->kmcontext()->printNodeDims();
+*/
 
 class KmContext {
   public:
@@ -13,9 +26,9 @@ class KmContext {
     void channelPartitioning(std::string op_name, float ratio);
     void channelPartitioning(std::vector<int>& partitioning_plan, std::vector<float>& ratios);
 
-    TfLiteContext* context_;
-    std::vector<int>* execution_plan_;
-    std::vector<std::pair<TfLiteNode, TfLiteRegistration>>* nodes_and_registration_;
+    TfLiteContext* context_ = nullptr;
+    std::vector<int>* execution_plan_ = nullptr;
+    std::vector<std::pair<TfLiteNode, TfLiteRegistration>>* nodes_and_registration_ = nullptr;
 
 	std::vector<int> partitioning_plan_;
 	std::vector<float> ratios_;
@@ -25,5 +38,3 @@ class KmContext {
 };
 
 const char* GetOpName(const TfLiteRegistration& op_reg);
-
-extern KmContext kmcontext;
\ No newline at end of file
@@ -59,6 +59,10 @@ class MemoryPlanner {
 
   // Returns true if the non-persistent memory is available.
   virtual bool HasNonPersistentMemory() = 0;
+
+  // Returns the size in bytes of the memory currently held for non-persistent
+  // tensors, 0 if it has been released.
+  virtual size_t GetNonPersistentMemorySize() = 0;
 };
 
 }  // namespace tflite
@@ -45,6 +45,10 @@ inline float ActivationValFloat(TfLiteFusedActivation act, float a) {
       return std::signbit(a);
     case kTfLiteActSigmoid:
       return 1.0f / (1.0f + std::exp(-a));
+    case kTfLiteActLeakyRelu:
+    case kTfLiteActHardSwish:
+      // Only folded into float convs by the TFLite interpreter builder.
+      break;
   }
   return 0.0f;  // To indicate an unsupported activation (i.e. when a new fused
                 // activation is added to the enum and not handled here).
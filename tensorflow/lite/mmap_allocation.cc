@@ -26,6 +26,11 @@ namespace tflite {
 
 MMAPAllocation::MMAPAllocation(const char* filename,
                                ErrorReporter* error_reporter)
+    : MMAPAllocation(filename, MMAPOptions(), error_reporter) {}
+
+MMAPAllocation::MMAPAllocation(const char* filename,
+                               const MMAPOptions& options,
+                               ErrorReporter* error_reporter)
     : Allocation(error_reporter, Allocation::Type::kMMap),
       mmapped_buffer_(MAP_FAILED) {
   mmap_fd_ = open(filename, O_RDONLY);
@@ -36,12 +41,23 @@ MMAPAllocation::MMAPAllocation(const char* filename,
   struct stat sb;
   fstat(mmap_fd_, &sb);
   buffer_size_bytes_ = sb.st_size;
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (options.populate) flags |= MAP_POPULATE;
+#endif
   mmapped_buffer_ =
-      mmap(nullptr, buffer_size_bytes_, PROT_READ, MAP_SHARED, mmap_fd_, 0);
+      mmap(nullptr, buffer_size_bytes_, PROT_READ, flags, mmap_fd_, 0);
   if (mmapped_buffer_ == MAP_FAILED) {
     error_reporter_->Report("Mmap of '%s' failed.", filename);
     return;
   }
+#ifdef MADV_HUGEPAGE
+  // Best effort: fails where huge pages are not supported for this file.
+  if (options.huge_pages) {
+    madvise(const_cast<void*>(mmapped_buffer_), buffer_size_bytes_,
+            MADV_HUGEPAGE);
+  }
+#endif
 }
 
 MMAPAllocation::~MMAPAllocation() {
@@ -27,6 +27,15 @@ MMAPAllocation::MMAPAllocation(const char* filename,
   assert(false);
 }
 
+MMAPAllocation::MMAPAllocation(const char* filename,
+                               const MMAPOptions& options,
+                               ErrorReporter* error_reporter)
+    : Allocation(error_reporter, Allocation::Type::kMMap),
+      mmapped_buffer_(nullptr) {
+  // The disabled variant should never be created.
+  assert(false);
+}
+
 MMAPAllocation::~MMAPAllocation() {}
 
 const void* MMAPAllocation::base() const { return nullptr; }
@@ -43,13 +43,12 @@ ErrorReporter* ValidateErrorReporter(ErrorReporter* e) {
 #ifndef TFLITE_MCU
 // Loads a model from `filename`. If `mmap_file` is true then use mmap,
 // otherwise make a copy of the model in a buffer.
-std::unique_ptr<Allocation> GetAllocationFromFile(const char* filename,
-                                                  bool mmap_file,
-                                                  ErrorReporter* error_reporter,
-                                                  bool use_nnapi) {
+std::unique_ptr<Allocation> GetAllocationFromFile(
+    const char* filename, bool mmap_file, ErrorReporter* error_reporter,
+    bool use_nnapi, const MMAPOptions& mmap_options = MMAPOptions()) {
   std::unique_ptr<Allocation> allocation;
   if (mmap_file && MMAPAllocation::IsSupported()) {
-    allocation.reset(new MMAPAllocation(filename, error_reporter));
+    allocation.reset(new MMAPAllocation(filename, mmap_options, error_reporter));
   } else {
     allocation.reset(new FileCopyAllocation(filename, error_reporter));
   }
@@ -68,6 +67,20 @@ std::unique_ptr<FlatBufferModel> FlatBufferModel::BuildFromFile(
   return model;
 }
 
+std::unique_ptr<FlatBufferModel> FlatBufferModel::BuildFromFile(
+    const char* filename, const MMAPOptions& mmap_options,
+    ErrorReporter* error_reporter) {
+  error_reporter = ValidateErrorReporter(error_reporter);
+
+  std::unique_ptr<FlatBufferModel> model;
+  auto allocation =
+      GetAllocationFromFile(filename, /*mmap_file=*/true, error_reporter,
+                            /*use_nnapi=*/true, mmap_options);
+  model.reset(new FlatBufferModel(std::move(allocation), error_reporter));
+  if (!model->initialized()) model.reset();
+  return model;
+}
+
 std::unique_ptr<FlatBufferModel> FlatBufferModel::VerifyAndBuildFromFile(
     const char* filename, TfLiteVerifier* extra_verifier,
     ErrorReporter* error_reporter) {
@@ -66,6 +66,12 @@ class FlatBufferModel {
       const char* filename,
       ErrorReporter* error_reporter = DefaultErrorReporter());
 
+  /// Same as above, mapping the file as described by `mmap_options` (e.g.
+  /// populated up front and on huge pages) where mmap is supported.
+  static std::unique_ptr<FlatBufferModel> BuildFromFile(
+      const char* filename, const MMAPOptions& mmap_options,
+      ErrorReporter* error_reporter = DefaultErrorReporter());
+
   /// Verifies whether the content of the file is legit, then builds a model
   /// based on the file.
   /// The extra_verifier argument is an additional optional verifier for the
@@ -18,13 +18,19 @@ limitations under the License.
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include <gtest/gtest.h>
+#include "flatbuffers/flatbuffers.h"  // from @flatbuffers
 #include "tensorflow/lite/core/api/error_reporter.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/schema/schema_generated.h"
 #include "tensorflow/lite/testing/util.h"
+#include "tensorflow/lite/version.h"
 
 // Comparison for TfLiteRegistration. Since TfLiteRegistration is a C object,
 // we must declare this in global namespace, so argument-dependent operator
@@ -482,6 +488,118 @@ TEST(BasicFlatBufferModel, TestHandleMalformedModelInvalidBuffer) {
   ASSERT_NE(interpreter->Invoke(), kTfLiteOk);
 }
 
+// CONV_2D (1x1, 2 -> 3 channels, no fused activation) followed by
+// 'activation'. 64x128 output pixels, so the folded conv finishes its output
+// in more than one block.
+std::vector<char> CreateConvActivationModel(BuiltinOperator activation) {
+  flatbuffers::FlatBufferBuilder builder;
+  const std::vector<flatbuffers::Offset<OperatorCode>> operator_codes{
+      CreateOperatorCode(builder, BuiltinOperator_CONV_2D),
+      CreateOperatorCode(builder, activation)};
+
+  const std::vector<float> filter{0.5f, -1.0f, 2.0f, 0.25f, -0.75f, 1.5f};
+  const std::vector<float> bias{0.1f, -0.2f, 0.3f};
+  const std::vector<flatbuffers::Offset<Buffer>> buffers{
+      CreateBuffer(builder, builder.CreateVector({})),
+      CreateBuffer(builder, builder.CreateVector(
+                                reinterpret_cast<const uint8_t*>(filter.data()),
+                                sizeof(float) * filter.size())),
+      CreateBuffer(builder, builder.CreateVector(
+                                reinterpret_cast<const uint8_t*>(bias.data()),
+                                sizeof(float) * bias.size())),
+  };
+
+  const std::vector<int32_t> input_shape{1, 64, 128, 2};
+  const std::vector<int32_t> filter_shape{3, 1, 1, 2};
+  const std::vector<int32_t> bias_shape{3};
+  const std::vector<int32_t> output_shape{1, 64, 128, 3};
+  const std::vector<flatbuffers::Offset<Tensor>> tensors{
+      CreateTensor(builder, builder.CreateVector(input_shape),
+                   TensorType_FLOAT32),
+      CreateTensor(builder, builder.CreateVector(filter_shape),
+                   TensorType_FLOAT32, /*buffer=*/1),
+      CreateTensor(builder, builder.CreateVector(bias_shape),
+                   TensorType_FLOAT32, /*buffer=*/2),
+      CreateTensor(builder, builder.CreateVector(output_shape),
+                   TensorType_FLOAT32),
+      CreateTensor(builder, builder.CreateVector(output_shape),
+                   TensorType_FLOAT32),
+  };
+
+  flatbuffers::Offset<void> activation_options = 0;
+  BuiltinOptions activation_options_type = BuiltinOptions_NONE;
+  if (activation == BuiltinOperator_LEAKY_RELU) {
+    activation_options = CreateLeakyReluOptions(builder, 0.2f).Union();
+    activation_options_type = BuiltinOptions_LeakyReluOptions;
+  }
+  const std::vector<flatbuffers::Offset<Operator>> operators{
+      CreateOperator(builder, /*opcode_index=*/0,
+                     builder.CreateVector<int32_t>({0, 1, 2}),
+                     builder.CreateVector<int32_t>({3}),
+                     BuiltinOptions_Conv2DOptions,
+                     CreateConv2DOptions(builder, Padding_VALID, 1, 1).Union()),
+      CreateOperator(builder, /*opcode_index=*/1,
+                     builder.CreateVector<int32_t>({3}),
+                     builder.CreateVector<int32_t>({4}),
+                     activation_options_type, activation_options),
+  };
+
+  const flatbuffers::Offset<SubGraph> subgraph = CreateSubGraph(
+      builder, builder.CreateVector(tensors),
+      builder.CreateVector<int32_t>({0}), builder.CreateVector<int32_t>({4}),
+      builder.CreateVector(operators));
+  builder.Finish(CreateModel(
+      builder, TFLITE_SCHEMA_VERSION, builder.CreateVector(operator_codes),
+      builder.CreateVector(&subgraph, 1),
+      builder.CreateString("Activation fusion test"),
+      builder.CreateVector(buffers)));
+  return std::vector<char>(builder.GetBufferPointer(),
+                           builder.GetBufferPointer() + builder.GetSize());
+}
+
+// Builds the model with and without activation fusion and checks that the
+// folded conv replaces both nodes and computes the same output.
+void ExpectActivationFolded(BuiltinOperator activation) {
+  const std::vector<char> buffer = CreateConvActivationModel(activation);
+  ops::builtin::BuiltinOpResolver resolver;
+  std::vector<float> outputs[2];
+  for (bool fuse : {false, true}) {
+    InterpreterBuilder builder(GetModel(buffer.data()), resolver);
+    builder.SetActivationFusion(fuse);
+    std::unique_ptr<Interpreter> interpreter;
+    ASSERT_EQ(builder(&interpreter), kTfLiteOk);
+    ASSERT_NE(interpreter, nullptr);
+    EXPECT_EQ(interpreter->nodes_size(), fuse ? 1 : 2);
+    ASSERT_EQ(interpreter->AllocateTensors(), kTfLiteOk);
+
+    TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[0]);
+    const int input_size = NumElements(input);
+    for (int i = 0; i < input_size; ++i) {
+      input->data.f[i] = 4.0f * std::sin(0.37f * i);
+    }
+    ASSERT_EQ(interpreter->Invoke(), kTfLiteOk);
+    const TfLiteTensor* output =
+        interpreter->tensor(interpreter->outputs()[0]);
+    outputs[fuse].assign(output->data.f, output->data.f + NumElements(output));
+  }
+  ASSERT_EQ(outputs[0].size(), outputs[1].size());
+  for (size_t i = 0; i < outputs[0].size(); ++i) {
+    EXPECT_NEAR(outputs[1][i], outputs[0][i], 1e-5f) << "at " << i;
+  }
+}
+
+TEST(ActivationFusion, FoldsLeakyReluIntoConv) {
+  ExpectActivationFolded(BuiltinOperator_LEAKY_RELU);
+}
+
+TEST(ActivationFusion, FoldsLogisticIntoConv) {
+  ExpectActivationFolded(BuiltinOperator_LOGISTIC);
+}
+
+TEST(ActivationFusion, FoldsHardSwishIntoConv) {
+  ExpectActivationFolded(BuiltinOperator_HARD_SWISH);
+}
+
 // TODO(aselle): Add tests for serialization of builtin op data types.
 // These tests will occur with the evaluation tests of individual operators,
 // not here.
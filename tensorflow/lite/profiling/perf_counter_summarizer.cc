@@ -0,0 +1,246 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/profiling/perf_counter_summarizer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/c/builtin_op_data.h"
+
+namespace tflite {
+namespace profiling {
+namespace {
+
+int64_t NumElements(const TfLiteTensor* tensor) {
+  if (tensor == nullptr || tensor->dims == nullptr) return 0;
+  int64_t count = 1;
+  for (int i = 0; i < tensor->dims->size; ++i) count *= tensor->dims->data[i];
+  return count;
+}
+
+int Dim(const TfLiteTensor* tensor, int i) {
+  if (tensor == nullptr || tensor->dims == nullptr ||
+      i >= tensor->dims->size) {
+    return 0;
+  }
+  return tensor->dims->data[i];
+}
+
+int64_t EstimateFlops(const Subgraph& subgraph, const TfLiteNode& node,
+                      const TfLiteRegistration& registration) {
+  if (node.outputs->size == 0) return 0;
+  auto input = [&](int i) -> const TfLiteTensor* {
+    if (i >= node.inputs->size || node.inputs->data[i] < 0) return nullptr;
+    return subgraph.tensor(node.inputs->data[i]);
+  };
+  const int64_t output_elements =
+      NumElements(subgraph.tensor(node.outputs->data[0]));
+  switch (registration.builtin_code) {
+    case kTfLiteBuiltinConv2d: {
+      // Filter is [output depth, height, width, input depth].
+      const TfLiteTensor* filter = input(1);
+      return 2 * output_elements * Dim(filter, 1) * Dim(filter, 2) *
+             Dim(filter, 3);
+    }
+    case kTfLiteBuiltinDepthwiseConv2d: {
+      // Filter is [1, height, width, output depth].
+      const TfLiteTensor* filter = input(1);
+      return 2 * output_elements * Dim(filter, 1) * Dim(filter, 2);
+    }
+    case kTfLiteBuiltinFullyConnected: {
+      // Weights are [units, input depth].
+      return 2 * output_elements * Dim(input(1), 1);
+    }
+    case kTfLiteBuiltinTransposeConv: {
+      // Every input element is scattered through the whole filter, which is
+      // [output depth, height, width, input depth].
+      const TfLiteTensor* filter = input(1);
+      return 2 * NumElements(input(2)) * Dim(filter, 0) * Dim(filter, 1) *
+             Dim(filter, 2);
+    }
+    case kTfLiteBuiltinAveragePool2d:
+    case kTfLiteBuiltinMaxPool2d:
+    case kTfLiteBuiltinL2Pool2d: {
+      const auto* params =
+          reinterpret_cast<const TfLitePoolParams*>(node.builtin_data);
+      if (params == nullptr) return output_elements;
+      return output_elements * params->filter_height * params->filter_width;
+    }
+    default:
+      return output_elements;
+  }
+}
+
+void Accumulate(int64_t duration_us, const PerfCounterValues& counters,
+                int64_t flops, PerfCounterSummarizer::Stats* stats) {
+  ++stats->count;
+  stats->total_us += duration_us;
+  stats->flops += flops;
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    if (counters.values[i] == kPerfCounterNotAvailable) continue;
+    if (stats->counters[i] < 0) stats->counters[i] = 0;
+    stats->counters[i] += counters.values[i];
+  }
+}
+
+}  // namespace
+
+double PerfCounterSummarizer::Stats::InstructionsPerCycle() const {
+  const int64_t cycles = counters[static_cast<int>(PerfCounter::kCycles)];
+  const int64_t instructions =
+      counters[static_cast<int>(PerfCounter::kInstructions)];
+  if (cycles <= 0 || instructions < 0) return 0;
+  return static_cast<double>(instructions) / cycles;
+}
+
+int64_t PerfCounterSummarizer::Stats::MemoryBytes(int cache_line_bytes) const {
+  const int64_t loads = counters[static_cast<int>(PerfCounter::kLlcLoadMisses)];
+  const int64_t stores =
+      counters[static_cast<int>(PerfCounter::kLlcStoreMisses)];
+  if (loads < 0 && stores < 0) return 0;
+  return (std::max<int64_t>(loads, 0) + std::max<int64_t>(stores, 0)) *
+         cache_line_bytes;
+}
+
+double PerfCounterSummarizer::Stats::BytesPerFlop(int cache_line_bytes) const {
+  if (flops <= 0) return 0;
+  return static_cast<double>(MemoryBytes(cache_line_bytes)) / flops;
+}
+
+void PerfCounterSummarizer::ProcessProfiles(
+    const std::vector<PerfEventRecord>& records,
+    const tflite::Interpreter& interpreter) {
+  auto& mutable_interpreter = const_cast<tflite::Interpreter&>(interpreter);
+  for (const PerfEventRecord& record : records) {
+    const ProfileEvent& event = record.event;
+    if (event.event_type != Profiler::EventType::OPERATOR_INVOKE_EVENT ||
+        event.end_timestamp_us < event.begin_timestamp_us) {
+      continue;
+    }
+    // See TFLITE_SCOPED_TAGGED_OPERATOR_PROFILE: the node index, and the
+    // subgraph index added by the SubgraphAwareProfiler.
+    const int subgraph_index = event.extra_event_metadata;
+    const Subgraph* subgraph = mutable_interpreter.subgraph(subgraph_index);
+    if (subgraph == nullptr) continue;
+    const auto* node_and_registration =
+        subgraph->node_and_registration(event.event_metadata);
+    if (node_and_registration == nullptr) continue;
+    AddOpStats(event.tag, subgraph_index,
+               event.end_timestamp_us - event.begin_timestamp_us,
+               record.counters,
+               EstimateFlops(*subgraph, node_and_registration->first,
+                             node_and_registration->second));
+  }
+}
+
+void PerfCounterSummarizer::AddOpStats(const std::string& op_type,
+                                       int subgraph_index, int64_t duration_us,
+                                       const PerfCounterValues& counters,
+                                       int64_t flops) {
+  Accumulate(duration_us, counters, flops, &op_type_stats_[op_type]);
+  Accumulate(duration_us, counters, flops, &subgraph_stats_[subgraph_index]);
+}
+
+bool PerfCounterSummarizer::IsMemoryBound(const std::string& op_type) const {
+  auto it = op_type_stats_.find(op_type);
+  return it != op_type_stats_.end() && IsMemoryBound(it->second);
+}
+
+bool PerfCounterSummarizer::IsMemoryBound(const Stats& stats) const {
+  return stats.flops > 0 && stats.MemoryBytes(cache_line_bytes_) > 0 &&
+         stats.BytesPerFlop(cache_line_bytes_) > machine_balance_;
+}
+
+std::string PerfCounterSummarizer::GetOutputString() const {
+  std::vector<std::pair<std::string, Stats>> op_type_rows(
+      op_type_stats_.begin(), op_type_stats_.end());
+  // Most expensive first.
+  std::stable_sort(op_type_rows.begin(), op_type_rows.end(),
+                   [](const std::pair<std::string, Stats>& a,
+                      const std::pair<std::string, Stats>& b) {
+                     return a.second.total_us > b.second.total_us;
+                   });
+  std::vector<std::pair<std::string, Stats>> subgraph_rows;
+  for (const auto& subgraph_and_stats : subgraph_stats_) {
+    subgraph_rows.emplace_back(
+        "subgraph " + std::to_string(subgraph_and_stats.first),
+        subgraph_and_stats.second);
+  }
+  std::string output;
+  AppendTable("Hardware counters by op type", op_type_rows, &output);
+  AppendTable("Hardware counters by subgraph", subgraph_rows, &output);
+  return output;
+}
+
+void PerfCounterSummarizer::AppendTable(
+    const std::string& title,
+    const std::vector<std::pair<std::string, Stats>>& rows,
+    std::string* output) const {
+  std::stringstream stream;
+  stream << "============================== " << title
+         << " ==============================\n";
+  stream << std::left << std::setw(28) << "[name]" << std::right
+         << std::setw(8) << "[count]" << std::setw(12) << "[avg ms]"
+         << std::setw(16) << "[cycles]" << std::setw(8) << "[IPC]"
+         << std::setw(16) << "[LLC misses]" << std::setw(12) << "[mem MB]"
+         << std::setw(12) << "[MFLOPs]" << std::setw(12) << "[B/FLOP]"
+         << "  [bound]\n";
+  stream << std::fixed;
+  for (const auto& name_and_stats : rows) {
+    const Stats& stats = name_and_stats.second;
+    const int64_t cycles =
+        stats.counters[static_cast<int>(PerfCounter::kCycles)];
+    const int64_t loads =
+        stats.counters[static_cast<int>(PerfCounter::kLlcLoadMisses)];
+    const int64_t stores =
+        stats.counters[static_cast<int>(PerfCounter::kLlcStoreMisses)];
+    const bool has_memory = loads >= 0 || stores >= 0;
+    stream << std::left << std::setw(28) << name_and_stats.first << std::right
+           << std::setw(8) << stats.count << std::setw(12)
+           << std::setprecision(3)
+           << (stats.count ? stats.total_us / 1000.0 / stats.count : 0.0)
+           << std::setw(16);
+    if (cycles >= 0) {
+      stream << cycles;
+    } else {
+      stream << "n/a";
+    }
+    stream << std::setw(8) << std::setprecision(2)
+           << stats.InstructionsPerCycle() << std::setw(16);
+    if (has_memory) {
+      stream << std::max<int64_t>(loads, 0) + std::max<int64_t>(stores, 0);
+    } else {
+      stream << "n/a";
+    }
+    stream << std::setw(12) << std::setprecision(2)
+           << stats.MemoryBytes(cache_line_bytes_) / 1e6 << std::setw(12)
+           << stats.flops / 1e6 << std::setw(12) << std::setprecision(3)
+           << stats.BytesPerFlop(cache_line_bytes_) << "  ";
+    if (!has_memory || stats.flops <= 0) {
+      stream << "n/a";
+    } else {
+      stream << (IsMemoryBound(stats) ? "memory" : "compute");
+    }
+    stream << "\n";
+  }
+  stream << "\n";
+  output->append(stream.str());
+}
+
+}  // namespace profiling
+}  // namespace tflite
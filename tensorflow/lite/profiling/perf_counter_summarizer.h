@@ -0,0 +1,102 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_PROFILING_PERF_COUNTER_SUMMARIZER_H_
+#define TENSORFLOW_LITE_PROFILING_PERF_COUNTER_SUMMARIZER_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/profiling/perf_event_profiler.h"
+
+namespace tflite {
+namespace profiling {
+
+// Accumulates the hardware counters recorded by a PerfEventProfiler per op
+// type and per subgraph (i.e. per partition), and derives instructions per
+// cycle and memory traffic per FLOP from them.
+//
+// Memory traffic is estimated as (LLC load + store misses) * cache line size.
+// FLOPs are estimated from the node shapes: 2 * MACs for convolutions and
+// fully connected layers, window size per output for pooling and one per
+// output element for everything else.
+//
+// An op moving more bytes per FLOP than the machine balance (peak memory
+// bandwidth / peak FLOP rate) is reported as memory bound.
+class PerfCounterSummarizer {
+ public:
+  struct Stats {
+    int64_t count = 0;
+    int64_t total_us = 0;
+    int64_t flops = 0;
+    // Sums over the invocations the counter was available for, -1 if it never
+    // was.
+    int64_t counters[kNumPerfCounters] = {-1, -1, -1, -1};
+
+    // 0 when the needed counters are not available.
+    double InstructionsPerCycle() const;
+    int64_t MemoryBytes(int cache_line_bytes) const;
+    double BytesPerFlop(int cache_line_bytes) const;
+  };
+
+  explicit PerfCounterSummarizer(double machine_balance_bytes_per_flop = 0.1,
+                                 int cache_line_bytes = 64)
+      : machine_balance_(machine_balance_bytes_per_flop),
+        cache_line_bytes_(cache_line_bytes) {}
+
+  // Adds the op invocations in `records`, looking the nodes up in
+  // `interpreter` for their FLOPs.
+  void ProcessProfiles(const std::vector<PerfEventRecord>& records,
+                       const tflite::Interpreter& interpreter);
+
+  // Adds one invocation of an op of `op_type` in subgraph `subgraph_index`.
+  void AddOpStats(const std::string& op_type, int subgraph_index,
+                  int64_t duration_us, const PerfCounterValues& counters,
+                  int64_t flops);
+
+  const std::map<std::string, Stats>& op_type_stats() const {
+    return op_type_stats_;
+  }
+  const std::map<int, Stats>& subgraph_stats() const {
+    return subgraph_stats_;
+  }
+
+  // Whether the stats of `op_type` point to a memory bound op. False if the
+  // counters are not available.
+  bool IsMemoryBound(const std::string& op_type) const;
+
+  // One table per op type and one per subgraph.
+  std::string GetOutputString() const;
+
+  bool HasProfiles() const { return !op_type_stats_.empty(); }
+
+ private:
+  bool IsMemoryBound(const Stats& stats) const;
+  void AppendTable(const std::string& title,
+                   const std::vector<std::pair<std::string, Stats>>& rows,
+                   std::string* output) const;
+
+  const double machine_balance_;
+  const int cache_line_bytes_;
+  std::map<std::string, Stats> op_type_stats_;
+  std::map<int, Stats> subgraph_stats_;
+};
+
+}  // namespace profiling
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_PROFILING_PERF_COUNTER_SUMMARIZER_H_
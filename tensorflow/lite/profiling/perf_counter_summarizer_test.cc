@@ -0,0 +1,131 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/profiling/perf_counter_summarizer.h"
+
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+
+namespace tflite {
+namespace profiling {
+namespace {
+
+using ::testing::HasSubstr;
+
+PerfCounterValues Counters(int64_t cycles, int64_t instructions,
+                           int64_t load_misses, int64_t store_misses) {
+  PerfCounterValues values;
+  values.values[static_cast<int>(PerfCounter::kCycles)] = cycles;
+  values.values[static_cast<int>(PerfCounter::kInstructions)] = instructions;
+  values.values[static_cast<int>(PerfCounter::kLlcLoadMisses)] = load_misses;
+  values.values[static_cast<int>(PerfCounter::kLlcStoreMisses)] = store_misses;
+  return values;
+}
+
+TEST(PerfCounterSummarizerTest, AccumulatesPerOpTypeAndSubgraph) {
+  PerfCounterSummarizer summarizer(/*machine_balance_bytes_per_flop=*/0.1,
+                                   /*cache_line_bytes=*/64);
+  // 2 MFLOPs moving 6.4 KB: compute bound.
+  summarizer.AddOpStats("CONV_2D", 0, 100, Counters(1000, 3000, 50, 50),
+                        2000000);
+  summarizer.AddOpStats("CONV_2D", 1, 100, Counters(1000, 1000, 0, 0),
+                        2000000);
+  // 1000 FLOPs moving 64 KB: memory bound.
+  summarizer.AddOpStats("ADD", 1, 10, Counters(500, 250, 600, 400), 1000);
+
+  const auto& conv = summarizer.op_type_stats().at("CONV_2D");
+  EXPECT_EQ(conv.count, 2);
+  EXPECT_EQ(conv.total_us, 200);
+  EXPECT_EQ(conv.flops, 4000000);
+  EXPECT_DOUBLE_EQ(conv.InstructionsPerCycle(), 2.0);
+  EXPECT_EQ(conv.MemoryBytes(64), 6400);
+  EXPECT_FALSE(summarizer.IsMemoryBound("CONV_2D"));
+
+  const auto& add = summarizer.op_type_stats().at("ADD");
+  EXPECT_DOUBLE_EQ(add.InstructionsPerCycle(), 0.5);
+  EXPECT_DOUBLE_EQ(add.BytesPerFlop(64), 64.0);
+  EXPECT_TRUE(summarizer.IsMemoryBound("ADD"));
+
+  ASSERT_EQ(summarizer.subgraph_stats().size(), 2);
+  EXPECT_EQ(summarizer.subgraph_stats().at(1).count, 2);
+  EXPECT_EQ(summarizer.subgraph_stats().at(1).flops, 2001000);
+
+  const std::string output = summarizer.GetOutputString();
+  EXPECT_THAT(output, HasSubstr("CONV_2D"));
+  EXPECT_THAT(output, HasSubstr("subgraph 1"));
+  EXPECT_THAT(output, HasSubstr("memory"));
+  EXPECT_THAT(output, HasSubstr("compute"));
+}
+
+TEST(PerfCounterSummarizerTest, MissingCounters) {
+  PerfCounterSummarizer summarizer;
+  summarizer.AddOpStats("ADD", 0, 10, PerfCounterValues(), 1000);
+  const auto& add = summarizer.op_type_stats().at("ADD");
+  EXPECT_EQ(add.counters[static_cast<int>(PerfCounter::kCycles)], -1);
+  EXPECT_DOUBLE_EQ(add.InstructionsPerCycle(), 0);
+  EXPECT_EQ(add.MemoryBytes(64), 0);
+  EXPECT_FALSE(summarizer.IsMemoryBound("ADD"));
+  EXPECT_THAT(summarizer.GetOutputString(), HasSubstr("n/a"));
+}
+
+TEST(PerfCounterSummarizerTest, ProcessProfilesEstimatesFlops) {
+  // A single 3x3 conv, 1x8x8x2 -> 1x8x8x4.
+  Interpreter interpreter;
+  ASSERT_EQ(interpreter.AddTensors(4), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetInputs({0}), kTfLiteOk);
+  ASSERT_EQ(interpreter.SetOutputs({3}), kTfLiteOk);
+  TfLiteQuantization quant = {kTfLiteNoQuantization, nullptr};
+  interpreter.SetTensorParametersReadWrite(0, kTfLiteFloat32, "input",
+                                           {1, 8, 8, 2}, quant);
+  interpreter.SetTensorParametersReadWrite(1, kTfLiteFloat32, "filter",
+                                           {4, 3, 3, 2}, quant);
+  interpreter.SetTensorParametersReadWrite(2, kTfLiteFloat32, "bias", {4},
+                                           quant);
+  interpreter.SetTensorParametersReadWrite(3, kTfLiteFloat32, "output",
+                                           {1, 8, 8, 4}, quant);
+  auto* params =
+      static_cast<TfLiteConvParams*>(calloc(1, sizeof(TfLiteConvParams)));
+  params->padding = kTfLitePaddingSame;
+  params->stride_width = params->stride_height = 1;
+  params->dilation_width_factor = params->dilation_height_factor = 1;
+  ops::builtin::BuiltinOpResolver resolver;
+  ASSERT_EQ(interpreter.AddNodeWithParameters(
+                {0, 1, 2}, {3}, nullptr, 0, params,
+                resolver.FindOp(BuiltinOperator_CONV_2D, 1)),
+            kTfLiteOk);
+
+  PerfEventRecord record;
+  record.event.tag = "CONV_2D";
+  record.event.event_type = Profiler::EventType::OPERATOR_INVOKE_EVENT;
+  record.event.event_metadata = 0;
+  record.event.extra_event_metadata = 0;
+  record.event.begin_timestamp_us = 10;
+  record.event.end_timestamp_us = 30;
+  record.counters = Counters(100, 200, 1, 1);
+
+  PerfCounterSummarizer summarizer;
+  summarizer.ProcessProfiles({record}, interpreter);
+  const auto& conv = summarizer.op_type_stats().at("CONV_2D");
+  EXPECT_EQ(conv.total_us, 20);
+  EXPECT_EQ(conv.flops, 2 * (8 * 8 * 4) * (3 * 3 * 2));
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace tflite
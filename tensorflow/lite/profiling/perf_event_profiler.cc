@@ -0,0 +1,267 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/profiling/perf_event_profiler.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "tensorflow/lite/profiling/time.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TFLITE_PERF_EVENT_PROFILER_SUPPORTED
+#endif
+
+namespace tflite {
+namespace profiling {
+namespace {
+
+#ifdef TFLITE_PERF_EVENT_PROFILER_SUPPORTED
+constexpr uint64_t LlcConfig(uint64_t op) {
+  return PERF_COUNT_HW_CACHE_LL | (op << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// perf_event type and config of each PerfCounter.
+constexpr struct {
+  uint32_t type;
+  uint64_t config;
+} kCounterConfigs[kNumPerfCounters] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, LlcConfig(PERF_COUNT_HW_CACHE_OP_READ)},
+    {PERF_TYPE_HW_CACHE, LlcConfig(PERF_COUNT_HW_CACHE_OP_WRITE)},
+};
+
+int OpenCounter(int index, int group_fd) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = kCounterConfigs[index].type;
+  attr.config = kCounterConfigs[index].config;
+  attr.disabled = group_fd == -1 ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // This thread, any CPU.
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif  // TFLITE_PERF_EVENT_PROFILER_SUPPORTED
+
+}  // namespace
+
+const char* PerfCounterName(PerfCounter counter) {
+  switch (counter) {
+    case PerfCounter::kCycles:
+      return "cycles";
+    case PerfCounter::kInstructions:
+      return "instructions";
+    case PerfCounter::kLlcLoadMisses:
+      return "LLC load misses";
+    case PerfCounter::kLlcStoreMisses:
+      return "LLC store misses";
+  }
+  return "unknown";
+}
+
+PerfEventProfiler::PerfEventProfiler(uint32_t max_num_entries)
+    : max_num_entries_(max_num_entries) {
+  // Reserved up front so the records handed out stay put.
+  records_.reserve(max_num_entries);
+  begin_counters_.reserve(max_num_entries);
+}
+
+PerfEventProfiler::~PerfEventProfiler() {
+#ifdef TFLITE_PERF_EVENT_PROFILER_SUPPORTED
+  for (auto& thread_and_group : counter_groups_) {
+    for (int fd : thread_and_group.second->fds) close(fd);
+  }
+#endif
+}
+
+PerfEventProfiler::CounterGroup* PerfEventProfiler::GetCounterGroup() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<CounterGroup>& group =
+      counter_groups_[std::this_thread::get_id()];
+  if (!group) {
+    group.reset(new CounterGroup);
+    OpenCounters(group.get());
+  }
+  return group.get();
+}
+
+void PerfEventProfiler::OpenCounters(CounterGroup* group) {
+  for (int i = 0; i < kNumPerfCounters; ++i) group->position[i] = -1;
+#ifdef TFLITE_PERF_EVENT_PROFILER_SUPPORTED
+  // One group, so all counters are scheduled together and their ratios (IPC)
+  // are consistent. Counters the PMU does not have are left out.
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    const int fd = OpenCounter(i, group->leader_fd);
+    if (fd == -1) continue;
+    if (group->leader_fd == -1) group->leader_fd = fd;
+    group->position[i] = group->fds.size();
+    group->fds.push_back(fd);
+  }
+  if (group->leader_fd != -1) {
+    ioctl(group->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+void PerfEventProfiler::ReadCounters(const CounterGroup& group,
+                                     PerfCounterValues* values) {
+#ifdef TFLITE_PERF_EVENT_PROFILER_SUPPORTED
+  if (group.leader_fd == -1) return;
+  // nr, time_enabled, time_running, then one value per counter.
+  uint64_t data[3 + kNumPerfCounters];
+  const ssize_t bytes = read(group.leader_fd, data, sizeof(data));
+  if (bytes < static_cast<ssize_t>(3 * sizeof(uint64_t)) ||
+      data[0] != group.fds.size()) {
+    return;
+  }
+  const uint64_t time_enabled = data[1];
+  const uint64_t time_running = data[2];
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    if (group.position[i] < 0) continue;
+    double value = data[3 + group.position[i]];
+    // Scale up when the group had to share the PMU with other groups.
+    if (time_running > 0 && time_running < time_enabled) {
+      value *= static_cast<double>(time_enabled) / time_running;
+    }
+    values->values[i] = static_cast<int64_t>(value);
+  }
+#endif
+}
+
+uint32_t PerfEventProfiler::BeginEvent(const char* tag, EventType event_type,
+                                       int64_t event_metadata1,
+                                       int64_t event_metadata2) {
+  CounterGroup* group = GetCounterGroup();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!enabled_) return kInvalidEventHandle;
+  if (records_.size() >= max_num_entries_) {
+    fprintf(stderr, "Warning: Dropping PerfEventProfiler event.\n");
+    return kInvalidEventHandle;
+  }
+  const uint32_t handle = records_.size();
+  records_.emplace_back();
+  begin_counters_.emplace_back();
+  ProfileEvent& event = records_.back().event;
+  event.tag = tag;
+  event.event_type = event_type;
+  event.event_metadata = event_metadata1;
+  event.extra_event_metadata = event_metadata2;
+  event.begin_timestamp_us = time::NowMicros();
+  event.end_timestamp_us = 0;
+  // Read last, so the bookkeeping above is not counted.
+  ReadCounters(*group, &begin_counters_.back());
+  return handle;
+}
+
+void PerfEventProfiler::EndEvent(uint32_t event_handle) {
+  EndEvent(event_handle, nullptr, nullptr);
+}
+
+void PerfEventProfiler::EndEvent(uint32_t event_handle,
+                                 int64_t event_metadata1,
+                                 int64_t event_metadata2) {
+  EndEvent(event_handle, &event_metadata1, &event_metadata2);
+}
+
+void PerfEventProfiler::EndEvent(uint32_t event_handle,
+                                 const int64_t* event_metadata1,
+                                 const int64_t* event_metadata2) {
+  if (event_handle == kInvalidEventHandle) return;
+  // Read first, for the same reason as in BeginEvent.
+  PerfCounterValues end_counters;
+  ReadCounters(*GetCounterGroup(), &end_counters);
+  const uint64_t end_timestamp_us = time::NowMicros();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!enabled_ || event_handle >= records_.size()) return;
+  PerfEventRecord& record = records_[event_handle];
+  record.event.end_timestamp_us = end_timestamp_us;
+  if (event_metadata1) record.event.event_metadata = *event_metadata1;
+  if (event_metadata2) record.event.extra_event_metadata = *event_metadata2;
+  const PerfCounterValues& begin_counters = begin_counters_[event_handle];
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    if (begin_counters.values[i] == kPerfCounterNotAvailable ||
+        end_counters.values[i] == kPerfCounterNotAvailable) {
+      continue;
+    }
+    record.counters.values[i] =
+        end_counters.values[i] - begin_counters.values[i];
+  }
+}
+
+void PerfEventProfiler::AddEvent(const char* tag, EventType event_type,
+                                 uint64_t start, uint64_t end,
+                                 int64_t event_metadata1,
+                                 int64_t event_metadata2) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!enabled_ || records_.size() >= max_num_entries_) return;
+  records_.emplace_back();
+  begin_counters_.emplace_back();
+  ProfileEvent& event = records_.back().event;
+  event.tag = tag;
+  event.event_type = event_type;
+  event.event_metadata = event_metadata1;
+  event.extra_event_metadata = event_metadata2;
+  event.begin_timestamp_us = start;
+  event.end_timestamp_us = end;
+}
+
+void PerfEventProfiler::StartProfiling() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = true;
+}
+
+void PerfEventProfiler::StopProfiling() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = false;
+}
+
+void PerfEventProfiler::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = false;
+  records_.clear();
+  begin_counters_.clear();
+}
+
+bool PerfEventProfiler::IsCounterAvailable(PerfCounter counter) {
+  return GetCounterGroup()->position[static_cast<int>(counter)] >= 0;
+}
+
+std::vector<PerfEventRecord> PerfEventProfiler::GetRecords() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return records_;
+}
+
+std::vector<const ProfileEvent*> PerfEventProfiler::GetProfileEvents() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<const ProfileEvent*> events;
+  events.reserve(records_.size());
+  for (const PerfEventRecord& record : records_) {
+    events.push_back(&record.event);
+  }
+  return events;
+}
+
+}  // namespace profiling
+}  // namespace tflite
@@ -0,0 +1,144 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_PROFILING_PERF_EVENT_PROFILER_H_
+#define TENSORFLOW_LITE_PROFILING_PERF_EVENT_PROFILER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "tensorflow/lite/core/api/profiler.h"
+#include "tensorflow/lite/profiling/profile_buffer.h"
+
+namespace tflite {
+namespace profiling {
+
+// Hardware counters a PerfEventProfiler samples around every event.
+enum class PerfCounter : int {
+  kCycles = 0,
+  kInstructions = 1,
+  // Last level cache read and write misses. Each one moves a cache line from
+  // or to memory, so together they approximate the memory traffic.
+  kLlcLoadMisses = 2,
+  kLlcStoreMisses = 3,
+};
+constexpr int kNumPerfCounters = 4;
+
+const char* PerfCounterName(PerfCounter counter);
+
+// Counter values of one event, kPerfCounterNotAvailable for the counters the
+// system does not provide.
+constexpr int64_t kPerfCounterNotAvailable = -1;
+struct PerfCounterValues {
+  int64_t values[kNumPerfCounters] = {
+      kPerfCounterNotAvailable, kPerfCounterNotAvailable,
+      kPerfCounterNotAvailable, kPerfCounterNotAvailable};
+
+  bool Has(PerfCounter counter) const {
+    return values[static_cast<int>(counter)] != kPerfCounterNotAvailable;
+  }
+  int64_t Get(PerfCounter counter) const {
+    return values[static_cast<int>(counter)];
+  }
+};
+
+// A profile event with the counts of the hardware counters between its begin
+// and end.
+struct PerfEventRecord {
+  ProfileEvent event;
+  PerfCounterValues counters;
+};
+
+// Profiler attaching Linux perf_event hardware counters (cycles, instructions,
+// last level cache misses) to every op and runtime event, so compute bound
+// ops can be told apart from memory bound ones. See PerfCounterSummarizer for
+// the per op type summary.
+//
+// Counters are per thread and only count user space: an event counts the work
+// of the thread that begins and ends it, opened lazily on the first event of
+// each thread. Ops that fan out to a thread pool (num_threads > 1) are
+// therefore under-counted; profile with one thread per interpreter.
+//
+// Counters the kernel refuses (non Linux, perf_event_paranoid > 2, containers
+// without PMU access, virtual machines) are reported as
+// kPerfCounterNotAvailable, the events are recorded with their timestamps
+// anyway.
+//
+// Unlike BufferedProfiler this class is thread safe, so it can be shared by
+// the interpreters of the units running in parallel.
+class PerfEventProfiler : public tflite::Profiler {
+ public:
+  explicit PerfEventProfiler(uint32_t max_num_entries);
+  ~PerfEventProfiler() override;
+
+  uint32_t BeginEvent(const char* tag, EventType event_type,
+                      int64_t event_metadata1,
+                      int64_t event_metadata2) override;
+  void EndEvent(uint32_t event_handle) override;
+  void EndEvent(uint32_t event_handle, int64_t event_metadata1,
+                int64_t event_metadata2) override;
+  // Events added after the fact carry no counters.
+  void AddEvent(const char* tag, EventType event_type, uint64_t start,
+                uint64_t end, int64_t event_metadata1,
+                int64_t event_metadata2) override;
+
+  void StartProfiling();
+  void StopProfiling();
+  void Reset();
+
+  // Whether `counter` can be read on the calling thread.
+  bool IsCounterAvailable(PerfCounter counter);
+
+  // Copies of the events recorded since the last Reset(), with their
+  // counters. Safe to call while other threads are still recording; events
+  // that have not ended yet have end_timestamp_us == 0.
+  std::vector<PerfEventRecord> GetRecords() const;
+  // The same events for ProfileSummarizer. These point into the profiler:
+  // read them only once recording stopped (StopProfiling() and the events in
+  // flight ended), they are valid until the next Reset().
+  std::vector<const ProfileEvent*> GetProfileEvents() const;
+
+ private:
+  // perf_event group of one thread.
+  struct CounterGroup {
+    int leader_fd = -1;
+    std::vector<int> fds;
+    // Position of each counter in a group read, -1 if it is not open.
+    int position[kNumPerfCounters];
+  };
+
+  CounterGroup* GetCounterGroup();
+  static void OpenCounters(CounterGroup* group);
+  static void ReadCounters(const CounterGroup& group,
+                           PerfCounterValues* values);
+  void EndEvent(uint32_t event_handle, const int64_t* event_metadata1,
+                const int64_t* event_metadata2);
+
+  mutable std::mutex mutex_;
+  bool enabled_ = false;
+  const uint32_t max_num_entries_;
+  std::vector<PerfEventRecord> records_;
+  // Counter values when the event of the same index began.
+  std::vector<PerfCounterValues> begin_counters_;
+  std::map<std::thread::id, std::unique_ptr<CounterGroup>> counter_groups_;
+};
+
+}  // namespace profiling
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_PROFILING_PERF_EVENT_PROFILER_H_
@@ -0,0 +1,135 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/profiling/perf_event_profiler.h"
+
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace tflite {
+namespace profiling {
+namespace {
+
+// Something for the counters to count.
+float Work(int iterations) {
+  volatile float sum = 0;
+  for (int i = 0; i < iterations; ++i) sum = sum + i * 0.5f;
+  return sum;
+}
+
+TEST(PerfEventProfilerTest, NoEventsWhenDisabled) {
+  PerfEventProfiler profiler(16);
+  {
+    ScopedProfile profile(&profiler, "Work");
+    Work(10);
+  }
+  EXPECT_TRUE(profiler.GetRecords().empty());
+}
+
+TEST(PerfEventProfilerTest, RecordsNestedEvents) {
+  PerfEventProfiler profiler(16);
+  profiler.StartProfiling();
+  {
+    ScopedProfile outer(&profiler, "Outer");
+    {
+      ScopedOperatorProfile inner(&profiler, "Inner", /*node_index=*/3);
+      Work(100000);
+    }
+    Work(100000);
+  }
+  profiler.StopProfiling();
+
+  const std::vector<PerfEventRecord> records = profiler.GetRecords();
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_EQ(records[0].event.tag, "Outer");
+  EXPECT_EQ(records[1].event.tag, "Inner");
+  EXPECT_EQ(records[1].event.event_type,
+            Profiler::EventType::OPERATOR_INVOKE_EVENT);
+  EXPECT_EQ(records[1].event.event_metadata, 3);
+  for (const PerfEventRecord& record : records) {
+    EXPECT_GE(record.event.end_timestamp_us,
+              record.event.begin_timestamp_us);
+  }
+  EXPECT_EQ(profiler.GetProfileEvents().size(), 2);
+
+  // Where the counters exist, the outer event counts at least what the inner
+  // one does.
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    const PerfCounter counter = static_cast<PerfCounter>(i);
+    if (!profiler.IsCounterAvailable(counter)) {
+      EXPECT_FALSE(records[1].counters.Has(counter))
+          << PerfCounterName(counter);
+      continue;
+    }
+    ASSERT_TRUE(records[0].counters.Has(counter)) << PerfCounterName(counter);
+    ASSERT_TRUE(records[1].counters.Has(counter)) << PerfCounterName(counter);
+    EXPECT_GE(records[0].counters.Get(counter),
+              records[1].counters.Get(counter));
+  }
+  if (profiler.IsCounterAvailable(PerfCounter::kInstructions)) {
+    EXPECT_GT(records[1].counters.Get(PerfCounter::kInstructions), 100000);
+  }
+
+  profiler.Reset();
+  EXPECT_TRUE(profiler.GetRecords().empty());
+}
+
+TEST(PerfEventProfilerTest, DropsEventsBeyondCapacity) {
+  PerfEventProfiler profiler(2);
+  profiler.StartProfiling();
+  for (int i = 0; i < 4; ++i) {
+    ScopedProfile profile(&profiler, "Work");
+  }
+  EXPECT_EQ(profiler.GetRecords().size(), 2);
+}
+
+TEST(PerfEventProfilerTest, AddedEventsHaveNoCounters) {
+  PerfEventProfiler profiler(4);
+  profiler.StartProfiling();
+  tflite::Profiler* p = &profiler;
+  p->AddEvent("Added", Profiler::EventType::DEFAULT, /*start*/ 10,
+              /*end*/ 20, /*event_metadata*/ 1);
+  const std::vector<PerfEventRecord> records = profiler.GetRecords();
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_EQ(records[0].event.begin_timestamp_us, 10);
+  EXPECT_EQ(records[0].event.end_timestamp_us, 20);
+  EXPECT_FALSE(records[0].counters.Has(PerfCounter::kCycles));
+}
+
+TEST(PerfEventProfilerTest, EventsFromSeveralThreads) {
+  PerfEventProfiler profiler(64);
+  profiler.StartProfiling();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&profiler] {
+      for (int i = 0; i < 8; ++i) {
+        ScopedOperatorProfile profile(&profiler, "Work", i);
+        Work(1000);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  const std::vector<PerfEventRecord> records = profiler.GetRecords();
+  ASSERT_EQ(records.size(), 32);
+  for (const PerfEventRecord& record : records) {
+    EXPECT_GT(record.event.end_timestamp_us, 0);
+  }
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace tflite
@@ -30,9 +30,138 @@ T AlignTo(size_t alignment, T offset) {
                                  : offset + (alignment - offset % alignment);
 }
 
+// Removes one occurrence of `value` from `values`, not preserving the order.
+void EraseUnordered(std::vector<int>* values, int value) {
+  auto it = std::find(values->begin(), values->end(), value);
+  if (it != values->end()) {
+    *it = values->back();
+    values->pop_back();
+  }
+}
+
 }  // namespace
 
 namespace tflite {
+
+void ArenaAllocIndex::Insert(const ArenaAllocWithUsageInterval& alloc) {
+  int slot;
+  if (free_slots_.empty()) {
+    slot = slots_.size();
+    slots_.push_back(alloc);
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    slots_[slot] = alloc;
+  }
+  slot_of_tensor_.emplace(alloc.tensor, slot);
+  if (!IsIndexed(alloc)) {
+    unindexed_slots_.push_back(slot);
+    return;
+  }
+  Reserve(alloc.last_node);
+  AddCover(slot);
+  slots_by_first_node_.emplace(alloc.first_node, slot);
+}
+
+int ArenaAllocIndex::Remove(int32_t tensor) {
+  auto range = slot_of_tensor_.equal_range(tensor);
+  int removed = 0;
+  for (auto it = range.first; it != range.second; ++it, ++removed) {
+    const int slot = it->second;
+    const ArenaAllocWithUsageInterval& alloc = slots_[slot];
+    if (IsIndexed(alloc)) {
+      RemoveCover(slot);
+      auto starting = slots_by_first_node_.equal_range(alloc.first_node);
+      for (auto by_first = starting.first; by_first != starting.second;
+           ++by_first) {
+        if (by_first->second == slot) {
+          slots_by_first_node_.erase(by_first);
+          break;
+        }
+      }
+    } else {
+      EraseUnordered(&unindexed_slots_, slot);
+    }
+    slots_[slot].reset();
+    free_slots_.push_back(slot);
+  }
+  slot_of_tensor_.erase(range.first, range.second);
+  return removed;
+}
+
+void ArenaAllocIndex::FindOverlapping(
+    int32_t first_node, int32_t last_node,
+    std::vector<const ArenaAllocWithUsageInterval*>* overlapping) const {
+  auto overlaps = [first_node, last_node](
+                      const ArenaAllocWithUsageInterval& alloc) {
+    return !(alloc.last_node < first_node || alloc.first_node > last_node);
+  };
+  if (first_node > last_node) {
+    // Not an interval, the index can not answer this.
+    for (const auto& tensor_and_slot : slot_of_tensor_) {
+      const ArenaAllocWithUsageInterval& alloc = slots_[tensor_and_slot.second];
+      if (overlaps(alloc)) overlapping->push_back(&alloc);
+    }
+    return;
+  }
+  for (int slot : unindexed_slots_) {
+    if (overlaps(slots_[slot])) overlapping->push_back(&slots_[slot]);
+  }
+  // An interval intersects [first_node, last_node] iff it either contains
+  // first_node or starts in (first_node, last_node]; the two sets are
+  // disjoint.
+  if (first_node >= 0 && first_node < num_leaves_) {
+    for (int i = first_node + num_leaves_; i >= 1; i >>= 1) {
+      for (int slot : cover_[i]) overlapping->push_back(&slots_[slot]);
+    }
+  }
+  for (auto it = slots_by_first_node_.upper_bound(first_node);
+       it != slots_by_first_node_.end() && it->first <= last_node; ++it) {
+    overlapping->push_back(&slots_[it->second]);
+  }
+}
+
+void ArenaAllocIndex::Clear() {
+  slots_.clear();
+  free_slots_.clear();
+  slot_of_tensor_.clear();
+  num_leaves_ = 0;
+  cover_.clear();
+  slots_by_first_node_.clear();
+  unindexed_slots_.clear();
+}
+
+void ArenaAllocIndex::Reserve(int32_t node) {
+  if (node < num_leaves_) return;
+  int32_t num_leaves = std::max<int32_t>(num_leaves_, 16);
+  while (num_leaves <= node) num_leaves *= 2;
+  num_leaves_ = num_leaves;
+  cover_.assign(2 * num_leaves_, std::vector<int>());
+  for (const auto& first_and_slot : slots_by_first_node_) {
+    AddCover(first_and_slot.second);
+  }
+}
+
+void ArenaAllocIndex::AddCover(int slot) {
+  const ArenaAllocWithUsageInterval& alloc = slots_[slot];
+  for (int lo = alloc.first_node + num_leaves_,
+           hi = alloc.last_node + num_leaves_ + 1;
+       lo < hi; lo >>= 1, hi >>= 1) {
+    if (lo & 1) cover_[lo++].push_back(slot);
+    if (hi & 1) cover_[--hi].push_back(slot);
+  }
+}
+
+void ArenaAllocIndex::RemoveCover(int slot) {
+  const ArenaAllocWithUsageInterval& alloc = slots_[slot];
+  for (int lo = alloc.first_node + num_leaves_,
+           hi = alloc.last_node + num_leaves_ + 1;
+       lo < hi; lo >>= 1, hi >>= 1) {
+    if (lo & 1) EraseUnordered(&cover_[lo++], slot);
+    if (hi & 1) EraseUnordered(&cover_[--hi], slot);
+  }
+}
+
 TfLiteStatus SimpleMemoryArena::Allocate(
     TfLiteContext* context, size_t alignment, size_t size, int32_t tensor,
     int32_t first_node, int32_t last_node,
@@ -56,23 +185,25 @@ TfLiteStatus SimpleMemoryArena::Allocate(
   size_t best_offset = kOffsetNotAssigned;
   size_t best_offset_fit = kOffsetNotAssigned;
 
-  // Go through the sorted allocs and look at the gaps between them.
+  // Only allocs whose usage interval intersects with the current tensor's
+  // usage interval matter. Go through them sorted by offset and look at the
+  // gaps between them.
+  overlapping_.clear();
+  live_allocs_.FindOverlapping(first_node, last_node, &overlapping_);
+  std::sort(overlapping_.begin(), overlapping_.end(),
+            [](const ArenaAllocWithUsageInterval* a,
+               const ArenaAllocWithUsageInterval* b) { return *a < *b; });
   size_t current_offset = 0;
-  for (const auto& alloc : ordered_allocs_) {
-    if (alloc.last_node < first_node || alloc.first_node > last_node) {
-      // Usage interval of alloc doesn't intersect with current tensor's usage
-      // interval, so we skip it.
-      continue;
-    }
+  for (const ArenaAllocWithUsageInterval* alloc : overlapping_) {
     size_t aligned_current_offset = AlignTo(alignment, current_offset);
     // If we found a gap larger than required size, and smaller than previous
     // best fit, take it.
-    if (aligned_current_offset + size <= alloc.offset &&
-        alloc.offset - aligned_current_offset < best_offset_fit) {
+    if (aligned_current_offset + size <= alloc->offset &&
+        alloc->offset - aligned_current_offset < best_offset_fit) {
       best_offset = aligned_current_offset;
-      best_offset_fit = alloc.offset - current_offset;
+      best_offset_fit = alloc->offset - current_offset;
     }
-    current_offset = std::max(current_offset, alloc.offset + alloc.size);
+    current_offset = std::max(current_offset, alloc->offset + alloc->size);
   }
   if (best_offset == kOffsetNotAssigned) {
     best_offset = AlignTo(alignment, current_offset);
@@ -82,11 +213,7 @@ TfLiteStatus SimpleMemoryArena::Allocate(
   high_water_mark_ = std::max(high_water_mark_, best_offset + size);
   new_alloc->offset = best_offset;
 
-  auto insertion_it = ordered_allocs_.begin();
-  while (insertion_it != ordered_allocs_.end() && *insertion_it < *new_alloc) {
-    ++insertion_it;
-  }
-  ordered_allocs_.insert(insertion_it, *new_alloc);
+  live_allocs_.Insert(*new_alloc);
   return kTfLiteOk;
 }
 
@@ -96,24 +223,30 @@ TfLiteStatus SimpleMemoryArena::Deallocate(
     return kTfLiteOk;
   }
 
-  int erased_allocs_count = 0;
-  auto it = ordered_allocs_.begin();
-  while (it != ordered_allocs_.end()) {
-    if (it->tensor == alloc.tensor) {
-      erased_allocs_count++;
-      it = ordered_allocs_.erase(it);
-    } else {
-      ++it;
-    }
-  }
+  int erased_allocs_count = live_allocs_.Remove(alloc.tensor);
   TF_LITE_ENSURE(context, erased_allocs_count <= 1);
   return kTfLiteOk;
 }
 
+TfLiteStatus SimpleMemoryArena::RestoreAlloc(
+    TfLiteContext* context, const ArenaAllocWithUsageInterval& alloc) {
+  if (alloc.size == 0) {
+    return kTfLiteOk;
+  }
+  high_water_mark_ = std::max(high_water_mark_, alloc.offset + alloc.size);
+  live_allocs_.Insert(alloc);
+  return kTfLiteOk;
+}
+
 TfLiteStatus SimpleMemoryArena::Commit(TfLiteContext* context) {
   size_t required_size = RequiredBufferSize();
   if (required_size > underlying_buffer_size_) {
-    char* new_alloc = new char[required_size];
+    char* new_alloc = static_cast<char*>(allocator_->Allocate(required_size));
+    if (new_alloc == nullptr) {
+      TF_LITE_KERNEL_LOG(context, "Failed to allocate %zu bytes for the arena.",
+                         required_size);
+      return kTfLiteError;
+    }
     char* new_underlying_buffer_aligned_ptr = reinterpret_cast<char*>(
         AlignTo(arena_alignment_, reinterpret_cast<intptr_t>(new_alloc)));
 
@@ -122,14 +255,16 @@ TfLiteStatus SimpleMemoryArena::Commit(TfLiteContext* context) {
     // memory block.
     if (high_water_mark_ > 0 && underlying_buffer_size_ > 0) {
       size_t copy_amount = std::min(
-          underlying_buffer_.get() + underlying_buffer_size_ -
+          underlying_buffer_ + underlying_buffer_size_ -
               underlying_buffer_aligned_ptr_,
           new_alloc + required_size - new_underlying_buffer_aligned_ptr);
       memcpy(new_underlying_buffer_aligned_ptr, underlying_buffer_aligned_ptr_,
              copy_amount);
     }
 
-    underlying_buffer_.reset(new_alloc);
+    FreeBuffer();
+    underlying_buffer_ = new_alloc;
+    buffer_allocator_ = allocator_;
     underlying_buffer_size_ = required_size;
     underlying_buffer_aligned_ptr_ = new_underlying_buffer_aligned_ptr;
   }
@@ -155,16 +290,24 @@ TfLiteStatus SimpleMemoryArena::ResolveAlloc(
 TfLiteStatus SimpleMemoryArena::ClearPlan() {
   committed_ = false;
   high_water_mark_ = 0;
-  ordered_allocs_.clear();
+  live_allocs_.Clear();
   return kTfLiteOk;
 }
 
 TfLiteStatus SimpleMemoryArena::ReleaseBuffer() {
   committed_ = false;
+  FreeBuffer();
   underlying_buffer_size_ = 0;
   underlying_buffer_aligned_ptr_ = nullptr;
-  underlying_buffer_.reset();
   return kTfLiteOk;
 }
 
+void SimpleMemoryArena::FreeBuffer() {
+  if (underlying_buffer_ != nullptr) {
+    buffer_allocator_->Deallocate(underlying_buffer_, underlying_buffer_size_);
+  }
+  underlying_buffer_ = nullptr;
+  buffer_allocator_ = nullptr;
+}
+
 }  // namespace tflite
@@ -16,9 +16,12 @@ limitations under the License.
 #define TENSORFLOW_LITE_SIMPLE_MEMORY_ARENA_H_
 
 #include <cstdint>
+#include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include "tensorflow/lite/arena_allocator.h"
 #include "tensorflow/lite/c/common.h"
 
 namespace tflite {
@@ -52,19 +55,91 @@ struct ArenaAllocWithUsageInterval {
   }
 };
 
+// The live allocations of an arena, indexed by their usage interval so that
+// the ones overlapping a new allocation are found without visiting all of
+// them.
+//
+// Intervals ending before kMaxIndexedNode are kept in a segment tree over
+// node indices (to find those containing a node) and in a map keyed by
+// first_node (to find those starting inside a range). The rest, in practice
+// tensors living until the end of the graph, are few and kept in a plain list.
+class ArenaAllocIndex {
+ public:
+  void Insert(const ArenaAllocWithUsageInterval& alloc);
+
+  // Removes every allocation of `tensor`, returns how many there were.
+  int Remove(int32_t tensor);
+
+  // Appends to `overlapping` the allocations whose usage interval intersects
+  // [first_node, last_node].
+  void FindOverlapping(int32_t first_node, int32_t last_node,
+                       std::vector<const ArenaAllocWithUsageInterval*>*
+                           overlapping) const;
+
+  void Clear();
+
+  size_t size() const { return slot_of_tensor_.size(); }
+
+ private:
+  static constexpr int32_t kMaxIndexedNode = 1 << 20;
+
+  bool IsIndexed(const ArenaAllocWithUsageInterval& alloc) const {
+    return alloc.first_node >= 0 && alloc.first_node <= alloc.last_node &&
+           alloc.last_node < kMaxIndexedNode;
+  }
+  // Grows the segment tree so it covers node `node`.
+  void Reserve(int32_t node);
+  void AddCover(int slot);
+  void RemoveCover(int slot);
+
+  std::vector<ArenaAllocWithUsageInterval> slots_;
+  std::vector<int> free_slots_;
+  std::unordered_multimap<int32_t, int> slot_of_tensor_;
+
+  // Number of leaves of cover_, a power of two.
+  int32_t num_leaves_ = 0;
+  // Heap ordered segment tree, cover_[i] lists the slots whose interval
+  // covers the range of tree node i but not that of its parent.
+  std::vector<std::vector<int>> cover_;
+  std::multimap<int32_t, int> slots_by_first_node_;
+  std::vector<int> unindexed_slots_;
+};
+
 // This small class is responsible for allocating, deallocating and reusing
 // dynamic memory from a common underlying buffer. The arena can be used in
 // scenarios when the pattern of memory allocations and deallocations is
 // repetitive, e.g. running NN inference in multiple iterations. Note that
 // zero-sized allocations are explicitly allowed, and will resolve to null.
+//
+// Allocate() places a tensor in the smallest gap left by the allocations whose
+// usage interval overlaps its own. Those are looked up in an interval index,
+// so planning a graph costs O(n log n + n k log k) for n tensors of which at
+// most k are alive at once, instead of O(n^2).
+//
+// The underlying buffer comes from an ArenaAllocator, DefaultArenaAllocator()
+// unless SetAllocator() says otherwise.
 class SimpleMemoryArena {
  public:
   explicit SimpleMemoryArena(size_t arena_alignment)
       : committed_(false),
         arena_alignment_(arena_alignment),
         high_water_mark_(0),
+        underlying_buffer_(nullptr),
         underlying_buffer_size_(0),
-        ordered_allocs_() {}
+        underlying_buffer_aligned_ptr_(nullptr),
+        allocator_(DefaultArenaAllocator()),
+        buffer_allocator_(nullptr),
+        live_allocs_() {}
+  ~SimpleMemoryArena() { FreeBuffer(); }
+  SimpleMemoryArena(const SimpleMemoryArena&) = delete;
+  SimpleMemoryArena& operator=(const SimpleMemoryArena&) = delete;
+
+  // Allocator of the buffers committed from now on (nullptr for the default
+  // one). Ownership is not taken, it must outlive the arena. A buffer already
+  // committed stays with the allocator it came from.
+  void SetAllocator(ArenaAllocator* allocator) {
+    allocator_ = allocator != nullptr ? allocator : DefaultArenaAllocator();
+  }
 
   // Schedule memory allocation for a tensor with a given size, assuming that it
   // needs to be allocated before the execution of first_node, and deallocated
@@ -76,6 +151,11 @@ class SimpleMemoryArena {
   TfLiteStatus Deallocate(TfLiteContext* context,
                           const ArenaAllocWithUsageInterval& alloc);
 
+  // Adds an allocation whose offset was computed earlier (e.g. by an
+  // identical plan), as if Allocate() had placed it there.
+  TfLiteStatus RestoreAlloc(TfLiteContext* context,
+                            const ArenaAllocWithUsageInterval& alloc);
+
   inline size_t RequiredBufferSize() {
     // Add in a small amount of padding to reduce the chance of resize events
     // for small allocations.
@@ -109,10 +189,18 @@ class SimpleMemoryArena {
   bool committed_;
   size_t arena_alignment_;
   size_t high_water_mark_;
-  std::unique_ptr<char[]> underlying_buffer_;
+  // Returns the underlying buffer to the allocator it came from.
+  void FreeBuffer();
+
+  char* underlying_buffer_;
   size_t underlying_buffer_size_;
   char* underlying_buffer_aligned_ptr_;
-  std::vector<ArenaAllocWithUsageInterval> ordered_allocs_;
+  ArenaAllocator* allocator_;
+  // Allocator underlying_buffer_ came from.
+  ArenaAllocator* buffer_allocator_;
+  ArenaAllocIndex live_allocs_;
+  // Scratch space of Allocate(), kept to avoid reallocating it per tensor.
+  std::vector<const ArenaAllocWithUsageInterval*> overlapping_;
 };
 
 }  // namespace tflite
@@ -14,6 +14,12 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/lite/simple_memory_arena.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "tensorflow/core/platform/logging.h"
@@ -157,6 +163,157 @@ TEST(SimpleMemoryArenaTest, TestClearBuffer) {
   EXPECT_NE(resolved_ptr, nullptr);
 }
 
+// The placement the arena made before it indexed allocations by interval:
+// scan every live alloc in offset order.
+size_t LinearScanOffset(const std::vector<ArenaAllocWithUsageInterval>& live,
+                        size_t alignment, size_t size, int32_t first_node,
+                        int32_t last_node) {
+  std::vector<ArenaAllocWithUsageInterval> ordered = live;
+  std::stable_sort(ordered.begin(), ordered.end());
+  const size_t kNotAssigned = std::numeric_limits<size_t>::max();
+  size_t best_offset = kNotAssigned;
+  size_t best_offset_fit = kNotAssigned;
+  size_t current_offset = 0;
+  for (const auto& alloc : ordered) {
+    if (alloc.last_node < first_node || alloc.first_node > last_node) continue;
+    const size_t aligned = (current_offset + alignment - 1) / alignment *
+                           alignment;
+    if (aligned + size <= alloc.offset &&
+        alloc.offset - aligned < best_offset_fit) {
+      best_offset = aligned;
+      best_offset_fit = alloc.offset - current_offset;
+    }
+    current_offset = std::max(current_offset, alloc.offset + alloc.size);
+  }
+  if (best_offset == kNotAssigned) {
+    best_offset = (current_offset + alignment - 1) / alignment * alignment;
+  }
+  return best_offset;
+}
+
+TEST(SimpleMemoryArenaTest, IndexedPlacementMatchesLinearScan) {
+  TfLiteContext context;
+  context.ReportError = ReportError;
+  SimpleMemoryArena arena(64);
+  std::vector<ArenaAllocWithUsageInterval> live;
+  std::mt19937 random(1234);
+  const int kNumNodes = 300;
+  int32_t next_tensor = 0;
+  for (int step = 0; step < 2000; ++step) {
+    // Mostly allocations, some deallocations so gaps open up again.
+    if (!live.empty() && random() % 4 == 0) {
+      const int victim = random() % live.size();
+      ASSERT_EQ(arena.Deallocate(&context, live[victim]), kTfLiteOk);
+      live.erase(live.begin() + victim);
+      continue;
+    }
+    const int32_t first_node = random() % kNumNodes;
+    int32_t last_node = first_node + random() % 8;
+    // Some tensors live until the end, like graph outputs.
+    if (random() % 16 == 0) last_node = std::numeric_limits<int32_t>::max();
+    const size_t size = 1 + random() % 4096;
+    const size_t expected =
+        LinearScanOffset(live, 32, size, first_node, last_node);
+    ArenaAllocWithUsageInterval alloc;
+    ASSERT_EQ(arena.Allocate(&context, 32, size, next_tensor++, first_node,
+                             last_node, &alloc),
+              kTfLiteOk);
+    ASSERT_EQ(alloc.offset, expected) << "step " << step;
+    live.push_back(alloc);
+  }
+}
+
+TEST(SimpleMemoryArenaTest, RestoreAlloc) {
+  TfLiteContext context;
+  context.ReportError = ReportError;
+  SimpleMemoryArena arena(64);
+  ArenaAllocWithUsageInterval allocs[4];
+  arena.Allocate(&context, 32, 2047, 0, 0, 2, &allocs[0]);
+  arena.Allocate(&context, 32, 2047, 1, 1, 2, &allocs[1]);
+  const size_t required_size = arena.RequiredBufferSize();
+
+  ASSERT_EQ(arena.ClearPlan(), kTfLiteOk);
+  ASSERT_EQ(arena.RestoreAlloc(&context, allocs[0]), kTfLiteOk);
+  ASSERT_EQ(arena.RestoreAlloc(&context, allocs[1]), kTfLiteOk);
+  EXPECT_EQ(arena.RequiredBufferSize(), required_size);
+
+  // Restored allocs are taken into account by later allocations.
+  arena.Allocate(&context, 32, 2047, 2, 2, 3, &allocs[2]);
+  EXPECT_EQ(allocs[2].offset, 4096);
+  ASSERT_EQ(arena.Deallocate(&context, allocs[1]), kTfLiteOk);
+  arena.Allocate(&context, 32, 2047, 3, 2, 3, &allocs[3]);
+  EXPECT_EQ(allocs[3].offset, 2048);
+}
+
+// Counts the buffers it hands out.
+class CountingArenaAllocator : public ArenaAllocator {
+ public:
+  void* Allocate(size_t bytes) override {
+    ++live_buffers;
+    allocated_bytes += bytes;
+    return DefaultArenaAllocator()->Allocate(bytes);
+  }
+  void Deallocate(void* buffer, size_t bytes) override {
+    --live_buffers;
+    DefaultArenaAllocator()->Deallocate(buffer, bytes);
+  }
+
+  int live_buffers = 0;
+  size_t allocated_bytes = 0;
+};
+
+TEST(SimpleMemoryArenaTest, CustomAllocator) {
+  TfLiteContext context;
+  context.ReportError = ReportError;
+  CountingArenaAllocator allocator;
+  {
+    SimpleMemoryArena arena(64);
+    arena.SetAllocator(&allocator);
+    ArenaAllocWithUsageInterval allocs[2];
+    arena.Allocate(&context, 32, 2047, 0, 0, 1, &allocs[0]);
+    ASSERT_EQ(arena.Commit(&context), kTfLiteOk);
+    EXPECT_EQ(allocator.live_buffers, 1);
+    EXPECT_GE(allocator.allocated_bytes, 2047);
+
+    // Growing the arena returns the old buffer.
+    arena.Allocate(&context, 32, 4095, 1, 0, 1, &allocs[1]);
+    ASSERT_EQ(arena.Commit(&context), kTfLiteOk);
+    EXPECT_EQ(allocator.live_buffers, 1);
+
+    ASSERT_EQ(arena.ReleaseBuffer(), kTfLiteOk);
+    EXPECT_EQ(allocator.live_buffers, 0);
+    ASSERT_EQ(arena.Commit(&context), kTfLiteOk);
+    EXPECT_EQ(allocator.live_buffers, 1);
+  }
+  // The destructor too.
+  EXPECT_EQ(allocator.live_buffers, 0);
+}
+
+TEST(SimpleMemoryArenaTest, PageArenaAllocator) {
+  TfLiteContext context;
+  context.ReportError = ReportError;
+  PageArenaAllocatorOptions options;
+  options.huge_pages = PageArenaAllocatorOptions::HugePages::kTransparent;
+  options.numa_node = 0;
+  options.prefault = true;
+  PageArenaAllocator allocator(options);
+
+  SimpleMemoryArena arena(64);
+  arena.SetAllocator(&allocator);
+  ArenaAllocWithUsageInterval allocs[2];
+  arena.Allocate(&context, 64, 100000, 0, 0, 1, &allocs[0]);
+  arena.Allocate(&context, 64, 100000, 1, 0, 1, &allocs[1]);
+  ASSERT_EQ(arena.Commit(&context), kTfLiteOk);
+
+  char* ptrs[2];
+  ASSERT_EQ(arena.ResolveAlloc(&context, allocs[0], &ptrs[0]), kTfLiteOk);
+  ASSERT_EQ(arena.ResolveAlloc(&context, allocs[1], &ptrs[1]), kTfLiteOk);
+  memset(ptrs[0], 1, 100000);
+  memset(ptrs[1], 2, 100000);
+  EXPECT_EQ(ptrs[0][99999], 1);
+  EXPECT_EQ(ptrs[1][0], 2);
+}
+
 // Test parameterized by whether ClearBuffer() is called before ClearPlan(), or
 // vice versa.
 class BufferAndPlanClearingTest : public ::testing::Test,
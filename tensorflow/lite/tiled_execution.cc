@@ -0,0 +1,34 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/tiled_execution.h"
+
+#include <atomic>
+
+namespace tflite {
+namespace {
+
+std::atomic<const TiledExecutionPlanner*> tiled_execution_planner{nullptr};
+
+}  // namespace
+
+void SetTiledExecutionPlanner(const TiledExecutionPlanner* planner) {
+  tiled_execution_planner = planner;
+}
+
+const TiledExecutionPlanner* GetTiledExecutionPlanner() {
+  return tiled_execution_planner;
+}
+
+}  // namespace tflite
@@ -0,0 +1,75 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_TILED_EXECUTION_H_
+#define TENSORFLOW_LITE_TILED_EXECUTION_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/lite/c/common.h"
+
+namespace tflite {
+
+// A planned chain of nodes the subgraph runs as a whole, band by band (see
+// Subgraph::EnableTiledRegion). The implementation lives with the kernels
+// (kernels/tiled_region.h); the framework only sees this interface.
+class TiledExecution {
+ public:
+  virtual ~TiledExecution() {}
+
+  // Runs every band, reading the chain's input and writing its output
+  // through `context`.
+  virtual TfLiteStatus Invoke(TfLiteContext* context) = 0;
+
+  // Rows of the last output computed per band.
+  virtual int band_rows() const = 0;
+  virtual int num_bands() const = 0;
+
+  // Bytes of scratch memory held by the plan.
+  virtual size_t scratch_bytes() const = 0;
+};
+
+// Decides which nodes can run tiled and plans them into a TiledExecution.
+class TiledExecutionPlanner {
+ public:
+  struct Node {
+    const TfLiteNode* node;
+    const TfLiteRegistration* registration;
+  };
+
+  virtual ~TiledExecutionPlanner() {}
+
+  // True if `registration` is an op the planner can run band by band.
+  virtual bool IsTileableOp(const TfLiteRegistration& registration) const = 0;
+
+  // Plans `nodes`, given in execution order with final tensor shapes, for a
+  // working set of `cache_bytes` (0: planner default). Returns kTfLiteError
+  // if the nodes can not be tiled.
+  virtual TfLiteStatus Plan(TfLiteContext* context,
+                            const std::vector<Node>& nodes, size_t cache_bytes,
+                            std::unique_ptr<TiledExecution>* plan) const = 0;
+};
+
+// Installs the planner used by every subgraph. The builtin kernels register
+// theirs when a BuiltinOpResolver is created. `planner` must outlive its use.
+void SetTiledExecutionPlanner(const TiledExecutionPlanner* planner);
+
+// The installed planner, or nullptr if none was registered.
+const TiledExecutionPlanner* GetTiledExecutionPlanner();
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_TILED_EXECUTION_H_
@@ -0,0 +1,377 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/tools/benchmark/op_shape_benchmark.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+#include "tensorflow/lite/core/api/flatbuffer_conversions.h"
+#include "tensorflow/lite/profiling/time.h"
+#include "tensorflow/lite/schema/schema_utils.h"
+
+namespace tflite {
+namespace benchmark {
+namespace {
+
+class MallocDataAllocator : public BuiltinDataAllocator {
+ public:
+  void* Allocate(size_t size, size_t alignment_hint) override {
+    return malloc(size);
+  }
+  void Deallocate(void* data) override { free(data); }
+};
+
+bool IsConstant(const Model* model, const Tensor* tensor) {
+  const auto* buffers = model->buffers();
+  if (buffers == nullptr || tensor->buffer() >= buffers->size()) return false;
+  const auto* buffer = buffers->Get(tensor->buffer());
+  return buffer != nullptr && buffer->data() != nullptr &&
+         buffer->data()->size() > 0;
+}
+
+std::vector<int> Shape(const Tensor* tensor) {
+  std::vector<int> shape;
+  if (tensor->shape() != nullptr) {
+    shape.assign(tensor->shape()->begin(), tensor->shape()->end());
+  }
+  return shape;
+}
+
+// "FLOAT32[1,8,8,3]", with a trailing 'c' for constants and 'q' for
+// quantized tensors.
+std::string TensorSignature(const Model* model, const Tensor* tensor) {
+  std::stringstream signature;
+  signature << EnumNameTensorType(tensor->type()) << "[";
+  const std::vector<int> shape = Shape(tensor);
+  for (size_t i = 0; i < shape.size(); ++i) {
+    signature << (i ? "," : "") << shape[i];
+  }
+  signature << "]";
+  if (IsConstant(model, tensor)) signature << "c";
+  const auto* quantization = tensor->quantization();
+  if (quantization != nullptr && quantization->scale() != nullptr &&
+      quantization->scale()->size() > 0) {
+    signature << "q" << quantization->scale()->size();
+  }
+  return signature.str();
+}
+
+// Serialized builtin options, equal for ops configured the same way.
+std::string OptionsKey(const Operator* op) {
+  if (op->builtin_options_type() == BuiltinOptions_NONE) return "";
+  std::unique_ptr<OperatorT> unpacked(op->UnPack());
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(unpacked->builtin_options.Pack(builder));
+  return std::to_string(op->builtin_options_type()) + ":" +
+         std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+TfLiteStatus ConvertQuantization(const QuantizationParameters* source,
+                                 TfLiteQuantization* quantization) {
+  quantization->type = kTfLiteNoQuantization;
+  quantization->params = nullptr;
+  if (source == nullptr || source->scale() == nullptr ||
+      source->scale()->size() == 0) {
+    return kTfLiteOk;
+  }
+  if (source->zero_point() == nullptr ||
+      source->zero_point()->size() != source->scale()->size()) {
+    return kTfLiteError;
+  }
+  const int num_scales = source->scale()->size();
+  auto* affine = static_cast<TfLiteAffineQuantization*>(
+      malloc(sizeof(TfLiteAffineQuantization)));
+  affine->scale = TfLiteFloatArrayCreate(num_scales);
+  affine->zero_point = TfLiteIntArrayCreate(num_scales);
+  for (int i = 0; i < num_scales; ++i) {
+    affine->scale->data[i] = source->scale()->Get(i);
+    affine->zero_point->data[i] = source->zero_point()->Get(i);
+  }
+  affine->quantized_dimension = source->quantized_dimension();
+  quantization->type = kTfLiteAffineQuantization;
+  quantization->params = affine;
+  return kTfLiteOk;
+}
+
+void FillRandom(TfLiteTensor* tensor, std::mt19937* generator) {
+  const size_t bytes = tensor->bytes;
+  switch (tensor->type) {
+    case kTfLiteFloat32: {
+      std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+      for (size_t i = 0; i < bytes / sizeof(float); ++i) {
+        tensor->data.f[i] = distribution(*generator);
+      }
+      break;
+    }
+    case kTfLiteInt8:
+    case kTfLiteUInt8: {
+      std::uniform_int_distribution<int> distribution(0, 255);
+      for (size_t i = 0; i < bytes; ++i) {
+        tensor->data.uint8[i] = distribution(*generator);
+      }
+      break;
+    }
+    default:
+      // Integer inputs often are indices or sizes, zero is always valid.
+      memset(tensor->data.raw, 0, bytes);
+      break;
+  }
+}
+
+}  // namespace
+
+std::vector<OpShapeCase> ExtractOpShapeCases(const FlatBufferModel& model) {
+  std::vector<OpShapeCase> cases;
+  std::unordered_map<std::string, int> case_index_by_key;
+  const Model* fb_model = model.GetModel();
+  if (fb_model == nullptr || fb_model->subgraphs() == nullptr ||
+      fb_model->operator_codes() == nullptr) {
+    return cases;
+  }
+  for (int s = 0; s < fb_model->subgraphs()->size(); ++s) {
+    const SubGraph* subgraph = fb_model->subgraphs()->Get(s);
+    if (subgraph->operators() == nullptr || subgraph->tensors() == nullptr) {
+      continue;
+    }
+    const auto* tensors = subgraph->tensors();
+    for (int o = 0; o < subgraph->operators()->size(); ++o) {
+      const Operator* op = subgraph->operators()->Get(o);
+      if (op->opcode_index() >= fb_model->operator_codes()->size()) continue;
+      const OperatorCode* opcode =
+          fb_model->operator_codes()->Get(op->opcode_index());
+      const BuiltinOperator builtin = GetBuiltinCode(opcode);
+      if (builtin == BuiltinOperator_CUSTOM) continue;
+
+      std::stringstream signature;
+      bool supported = true;
+      auto append_tensors = [&](const flatbuffers::Vector<int32_t>* indices) {
+        if (indices == nullptr) return;
+        for (int32_t index : *indices) {
+          if (index < 0) {
+            signature << " -";
+            continue;
+          }
+          if (index >= tensors->size()) {
+            supported = false;
+            return;
+          }
+          const Tensor* tensor = tensors->Get(index);
+          if (tensor->sparsity() != nullptr) supported = false;
+          signature << " " << TensorSignature(fb_model, tensor);
+        }
+      };
+      signature << EnumNameBuiltinOperator(builtin) << " v"
+                << opcode->version();
+      append_tensors(op->inputs());
+      signature << " ->";
+      append_tensors(op->outputs());
+      if (!supported) continue;
+
+      const std::string key = signature.str() + "|" + OptionsKey(op);
+      auto it = case_index_by_key.find(key);
+      if (it != case_index_by_key.end()) {
+        ++cases[it->second].occurrences;
+        continue;
+      }
+      OpShapeCase op_case;
+      op_case.op = builtin;
+      op_case.version = opcode->version();
+      op_case.subgraph_index = s;
+      op_case.operator_index = o;
+      op_case.occurrences = 1;
+      op_case.description = signature.str();
+      op_case.key = key;
+      case_index_by_key[key] = cases.size();
+      cases.push_back(op_case);
+    }
+  }
+  return cases;
+}
+
+TfLiteStatus BuildOpInterpreter(const FlatBufferModel& model,
+                                const OpShapeCase& op_case,
+                                const OpResolver& resolver, int num_threads,
+                                std::unique_ptr<Interpreter>* interpreter) {
+  const Model* fb_model = model.GetModel();
+  const SubGraph* subgraph = fb_model->subgraphs()->Get(op_case.subgraph_index);
+  const Operator* op = subgraph->operators()->Get(op_case.operator_index);
+  const TfLiteRegistration* registration =
+      resolver.FindOp(op_case.op, op_case.version);
+  if (registration == nullptr) return kTfLiteError;
+
+  // The op's tensors, renumbered from 0.
+  std::map<int, int> local_index;
+  auto map_tensors = [&](const flatbuffers::Vector<int32_t>* indices) {
+    std::vector<int> mapped;
+    if (indices == nullptr) return mapped;
+    for (int32_t index : *indices) {
+      if (index < 0) {
+        mapped.push_back(kTfLiteOptionalTensor);
+        continue;
+      }
+      auto it = local_index.emplace(index, local_index.size()).first;
+      mapped.push_back(it->second);
+    }
+    return mapped;
+  };
+  const std::vector<int> inputs = map_tensors(op->inputs());
+  const std::vector<int> outputs = map_tensors(op->outputs());
+  const std::vector<int> intermediates = map_tensors(op->intermediates());
+
+  interpreter->reset(new Interpreter);
+  Interpreter* op_interpreter = interpreter->get();
+  TF_LITE_ENSURE_STATUS(op_interpreter->AddTensors(local_index.size()));
+  std::vector<int> graph_inputs;
+  for (const auto& model_and_local : local_index) {
+    const Tensor* tensor = subgraph->tensors()->Get(model_and_local.first);
+    TfLiteType type;
+    TF_LITE_ENSURE_STATUS(ConvertTensorType(
+        tensor->type(), &type, op_interpreter->error_reporter()));
+    TfLiteQuantization quantization;
+    TF_LITE_ENSURE_STATUS(
+        ConvertQuantization(tensor->quantization(), &quantization));
+    const char* name = tensor->name() ? tensor->name()->c_str() : "";
+    if (IsConstant(fb_model, tensor)) {
+      const auto* data = fb_model->buffers()->Get(tensor->buffer())->data();
+      TF_LITE_ENSURE_STATUS(op_interpreter->SetTensorParametersReadOnly(
+          model_and_local.second, type, name, Shape(tensor), quantization,
+          reinterpret_cast<const char*>(data->data()), data->size()));
+    } else {
+      TF_LITE_ENSURE_STATUS(op_interpreter->SetTensorParametersReadWrite(
+          model_and_local.second, type, name, Shape(tensor), quantization,
+          tensor->is_variable()));
+      if (std::find(inputs.begin(), inputs.end(), model_and_local.second) !=
+          inputs.end()) {
+        graph_inputs.push_back(model_and_local.second);
+      }
+    }
+  }
+  TF_LITE_ENSURE_STATUS(op_interpreter->SetInputs(graph_inputs));
+  TF_LITE_ENSURE_STATUS(op_interpreter->SetOutputs(outputs));
+
+  void* builtin_data = nullptr;
+  MallocDataAllocator allocator;
+  TF_LITE_ENSURE_STATUS(ParseOpData(op, op_case.op,
+                                    op_interpreter->error_reporter(),
+                                    &allocator, &builtin_data));
+  // Through the subgraph, the interpreter does not take intermediates.
+  Subgraph& op_subgraph = op_interpreter->primary_subgraph();
+  TF_LITE_ENSURE_STATUS(op_subgraph.AddNodeWithParameters(
+      inputs, outputs, intermediates, nullptr, 0, builtin_data, registration));
+  TF_LITE_ENSURE_STATUS(op_interpreter->SetNumThreads(num_threads));
+  TF_LITE_ENSURE_STATUS(op_interpreter->AllocateTensors());
+
+  std::mt19937 generator(op_case.operator_index);
+  for (int input : graph_inputs) {
+    FillRandom(op_interpreter->tensor(input), &generator);
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus RunOpBenchmark(Interpreter* interpreter,
+                            const OpBenchmarkOptions& options,
+                            OpBenchmarkStats* stats) {
+  for (int i = 0; i < options.warmup_runs; ++i) {
+    TF_LITE_ENSURE_STATUS(interpreter->Invoke());
+  }
+  std::vector<double> run_us;
+  const uint64_t start_us = profiling::time::NowMicros();
+  while (true) {
+    const uint64_t run_start_us = profiling::time::NowMicros();
+    TF_LITE_ENSURE_STATUS(interpreter->Invoke());
+    const uint64_t now_us = profiling::time::NowMicros();
+    run_us.push_back(now_us - run_start_us);
+    const double elapsed_secs = (now_us - start_us) / 1e6;
+    if (elapsed_secs >= options.max_secs) break;
+    if (run_us.size() >= static_cast<size_t>(options.min_runs) &&
+        elapsed_secs >= options.min_secs) {
+      break;
+    }
+  }
+  double total_us = 0;
+  for (double us : run_us) total_us += us;
+  stats->runs = run_us.size();
+  stats->avg_us = total_us / run_us.size();
+  std::sort(run_us.begin(), run_us.end());
+  stats->min_us = run_us.front();
+  stats->median_us = run_us[run_us.size() / 2];
+  return kTfLiteOk;
+}
+
+std::string FormatOpBenchmarkTable(const std::vector<OpBenchmarkRow>& rows) {
+  std::stringstream table;
+  table << std::left << std::setw(20) << "[op]" << std::setw(12) << "[kernel]"
+        << std::right << std::setw(9) << "[threads]" << std::setw(7)
+        << "[count]" << std::setw(12) << "[avg us]" << std::setw(12)
+        << "[median us]" << std::setw(12) << "[min us]" << "  [signature]\n";
+  table << std::fixed << std::setprecision(1);
+  // Model total per (kernel, threads).
+  std::map<std::pair<std::string, int>, double> total_us;
+  for (const OpBenchmarkRow& row : rows) {
+    table << std::left << std::setw(20)
+          << EnumNameBuiltinOperator(row.op_case->op) << std::setw(12)
+          << row.kernel << std::right << std::setw(9) << row.num_threads
+          << std::setw(7) << row.op_case->occurrences;
+    if (row.ok) {
+      table << std::setw(12) << row.stats.avg_us << std::setw(12)
+            << row.stats.median_us << std::setw(12) << row.stats.min_us;
+      total_us[{row.kernel, row.num_threads}] +=
+          row.stats.avg_us * row.op_case->occurrences;
+    } else {
+      table << std::setw(36) << "unsupported";
+    }
+    table << "  " << row.op_case->description << "\n";
+  }
+  table << "\nModel total (avg * count, unsupported cases excluded):\n";
+  for (const auto& kernel_and_total : total_us) {
+    table << "  " << kernel_and_total.first.first << ", "
+          << kernel_and_total.first.second
+          << " thread(s): " << kernel_and_total.second / 1000.0 << " ms\n";
+  }
+  return table.str();
+}
+
+std::string FormatOpBenchmarkCsv(const std::vector<OpBenchmarkRow>& rows) {
+  std::stringstream csv;
+  csv << "op,version,subgraph,operator,kernel,threads,count,runs,avg_us,"
+         "median_us,min_us,signature\n";
+  csv << std::fixed << std::setprecision(2);
+  for (const OpBenchmarkRow& row : rows) {
+    const OpShapeCase& op_case = *row.op_case;
+    csv << EnumNameBuiltinOperator(op_case.op) << "," << op_case.version << ","
+        << op_case.subgraph_index << "," << op_case.operator_index << ","
+        << row.kernel << "," << row.num_threads << "," << op_case.occurrences
+        << ",";
+    if (row.ok) {
+      csv << row.stats.runs << "," << row.stats.avg_us << ","
+          << row.stats.median_us << "," << row.stats.min_us;
+    } else {
+      csv << ",,,";
+    }
+    csv << ",\"" << op_case.description << "\"\n";
+  }
+  return csv.str();
+}
+
+}  // namespace benchmark
+}  // namespace tflite
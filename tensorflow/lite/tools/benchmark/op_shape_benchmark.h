@@ -0,0 +1,105 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_TOOLS_BENCHMARK_OP_SHAPE_BENCHMARK_H_
+#define TENSORFLOW_LITE_TOOLS_BENCHMARK_OP_SHAPE_BENCHMARK_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/core/api/op_resolver.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+namespace benchmark {
+
+// A distinct builtin op of a model: same operator, version, options and
+// tensor signature (types, shapes, quantization kind and which inputs are
+// constant). Ops repeated through the model with the same signature (e.g. the
+// residual blocks of a backbone) form a single case.
+struct OpShapeCase {
+  BuiltinOperator op = BuiltinOperator_ADD;
+  int version = 1;
+  // First occurrence in the model.
+  int subgraph_index = 0;
+  int operator_index = 0;
+  int occurrences = 0;
+  // Human readable signature, e.g.
+  // "CONV_2D v1 FLOAT32[1,16,16,8] FLOAT32[16,3,3,8]c FLOAT32[16]c ->
+  // FLOAT32[1,16,16,16]". Constant tensors are marked with 'c'.
+  std::string description;
+  // What makes the case distinct, compared when extracting.
+  std::string key;
+};
+
+// Walks the operators of every subgraph of `model` and returns the distinct
+// cases, in order of first occurrence. Custom ops and ops reading sparse
+// tensors are skipped. Shapes are the ones stored in the model.
+std::vector<OpShapeCase> ExtractOpShapeCases(const FlatBufferModel& model);
+
+// Builds an interpreter running the first occurrence of `op_case` alone, with
+// the kernel `resolver` registers for it and `num_threads` threads. Constant
+// inputs keep the model's data (so `model` must outlive the interpreter), the
+// other inputs are filled with random data.
+TfLiteStatus BuildOpInterpreter(const FlatBufferModel& model,
+                                const OpShapeCase& op_case,
+                                const OpResolver& resolver, int num_threads,
+                                std::unique_ptr<Interpreter>* interpreter);
+
+struct OpBenchmarkOptions {
+  int warmup_runs = 2;
+  // Runs at least `min_runs` times and for `min_secs`, but stops after
+  // `max_secs`.
+  int min_runs = 10;
+  double min_secs = 0.1;
+  double max_secs = 2.0;
+};
+
+struct OpBenchmarkStats {
+  int runs = 0;
+  double avg_us = 0;
+  double min_us = 0;
+  double median_us = 0;
+};
+
+// Times Invoke() of an interpreter built by BuildOpInterpreter.
+TfLiteStatus RunOpBenchmark(Interpreter* interpreter,
+                            const OpBenchmarkOptions& options,
+                            OpBenchmarkStats* stats);
+
+// One measured (case, kernel, thread count) combination.
+struct OpBenchmarkRow {
+  const OpShapeCase* op_case = nullptr;
+  std::string kernel;
+  int num_threads = 1;
+  // False if the kernel does not support the case (stats are then unset).
+  bool ok = false;
+  OpBenchmarkStats stats;
+};
+
+// Latency table, one line per row, followed by the model total per kernel and
+// thread count (sum of avg latency * occurrences).
+std::string FormatOpBenchmarkTable(const std::vector<OpBenchmarkRow>& rows);
+
+// Same rows as CSV, for regression tracking and as measured op costs for the
+// partitioner.
+std::string FormatOpBenchmarkCsv(const std::vector<OpBenchmarkRow>& rows);
+
+}  // namespace benchmark
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_TOOLS_BENCHMARK_OP_SHAPE_BENCHMARK_H_
@@ -0,0 +1,146 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+// Benchmarks every distinct op of a model in isolation:
+//
+//   op_shape_benchmark --graph=model.tflite --kernels=optimized,reference \
+//     --num_threads=1,4 --output_csv=ops.csv
+//
+// Each distinct (op, version, options, tensor shapes and types) found in the
+// model runs alone with each requested kernel set and thread count. The
+// latency table goes to stdout, the CSV (if requested) can be kept for
+// regression tracking or fed to the partitioner as measured op costs.
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/kernels/register_ref.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/tools/benchmark/benchmark_utils.h"
+#include "tensorflow/lite/tools/benchmark/op_shape_benchmark.h"
+#include "tensorflow/lite/tools/command_line_flags.h"
+#include "tensorflow/lite/tools/logging.h"
+
+namespace tflite {
+namespace benchmark {
+
+int Main(int argc, char** argv) {
+  std::string graph;
+  std::string kernels = "optimized";
+  std::string num_threads_list = "1";
+  std::string ops;
+  std::string output_csv;
+  OpBenchmarkOptions options;
+  std::vector<Flag> flags = {
+      Flag::CreateFlag("graph", &graph, "Path to the .tflite model."),
+      Flag::CreateFlag("kernels", &kernels,
+                       "Comma separated kernel sets to run: optimized "
+                       "(builtin kernels), reference."),
+      Flag::CreateFlag("num_threads", &num_threads_list,
+                       "Comma separated thread counts to run with."),
+      Flag::CreateFlag("ops", &ops,
+                       "Comma separated op names (e.g. CONV_2D) to limit the "
+                       "run to. Empty runs all of them."),
+      Flag::CreateFlag("warmup_runs", &options.warmup_runs,
+                       "Untimed runs of each case."),
+      Flag::CreateFlag("min_runs", &options.min_runs,
+                       "Minimum timed runs of each case."),
+      Flag::CreateFlag("min_secs", &options.min_secs,
+                       "Minimum time spent timing each case."),
+      Flag::CreateFlag("max_secs", &options.max_secs,
+                       "Maximum time spent timing each case."),
+      Flag::CreateFlag("output_csv", &output_csv,
+                       "File to write the results to as CSV."),
+  };
+  if (!Flags::Parse(&argc, const_cast<const char**>(argv), flags) ||
+      graph.empty()) {
+    TFLITE_LOG(ERROR) << Flags::Usage(argv[0], flags);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> kernel_sets;
+  std::vector<int> thread_counts;
+  std::vector<std::string> op_filter;
+  if (!util::SplitAndParse(kernels, ',', &kernel_sets) ||
+      !util::SplitAndParse(num_threads_list, ',', &thread_counts) ||
+      !util::SplitAndParse(ops, ',', &op_filter)) {
+    TFLITE_LOG(ERROR) << Flags::Usage(argv[0], flags);
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<FlatBufferModel> model =
+      FlatBufferModel::BuildFromFile(graph.c_str());
+  if (!model) {
+    TFLITE_LOG(ERROR) << "Failed to load " << graph;
+    return EXIT_FAILURE;
+  }
+  const std::vector<OpShapeCase> cases = ExtractOpShapeCases(*model);
+  TFLITE_LOG(INFO) << cases.size() << " distinct ops in " << graph;
+
+  std::vector<OpBenchmarkRow> rows;
+  for (const std::string& kernel : kernel_sets) {
+    std::unique_ptr<OpResolver> resolver;
+    if (kernel == "optimized") {
+      resolver.reset(new ops::builtin::BuiltinOpResolver);
+    } else if (kernel == "reference") {
+      resolver.reset(new ops::builtin::BuiltinRefOpResolver);
+    } else {
+      TFLITE_LOG(ERROR) << "Unknown kernel set " << kernel;
+      return EXIT_FAILURE;
+    }
+    for (int num_threads : thread_counts) {
+      for (const OpShapeCase& op_case : cases) {
+        const std::string op_name = EnumNameBuiltinOperator(op_case.op);
+        if (!op_filter.empty() &&
+            std::find(op_filter.begin(), op_filter.end(), op_name) ==
+                op_filter.end()) {
+          continue;
+        }
+        OpBenchmarkRow row;
+        row.op_case = &op_case;
+        row.kernel = kernel;
+        row.num_threads = num_threads;
+        std::unique_ptr<Interpreter> interpreter;
+        row.ok = BuildOpInterpreter(*model, op_case, *resolver, num_threads,
+                                    &interpreter) == kTfLiteOk &&
+                 RunOpBenchmark(interpreter.get(), options, &row.stats) ==
+                     kTfLiteOk;
+        rows.push_back(row);
+      }
+    }
+  }
+
+  std::cout << FormatOpBenchmarkTable(rows);
+  if (!output_csv.empty()) {
+    std::ofstream csv(output_csv);
+    csv << FormatOpBenchmarkCsv(rows);
+    if (!csv.good()) {
+      TFLITE_LOG(ERROR) << "Failed to write " << output_csv;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace benchmark
+}  // namespace tflite
+
+int main(int argc, char** argv) { return tflite::benchmark::Main(argc, argv); }
@@ -0,0 +1,102 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/tools/benchmark/op_shape_benchmark.h"
+
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/mutable_op_resolver.h"
+#include "tensorflow/lite/testing/util.h"
+
+namespace tflite {
+namespace benchmark {
+namespace {
+
+constexpr char kMultiAddModel[] = "tensorflow/lite/testdata/multi_add.bin";
+
+TEST(OpShapeBenchmarkTest, ExtractsDistinctCases) {
+  auto model = FlatBufferModel::BuildFromFile(kMultiAddModel);
+  ASSERT_TRUE(model);
+  const std::vector<OpShapeCase> cases = ExtractOpShapeCases(*model);
+  // The three ADDs of the model share op, options and shapes.
+  ASSERT_EQ(cases.size(), 1);
+  EXPECT_EQ(cases[0].op, BuiltinOperator_ADD);
+  EXPECT_EQ(cases[0].occurrences, 3);
+  EXPECT_EQ(cases[0].subgraph_index, 0);
+  EXPECT_EQ(cases[0].operator_index, 0);
+  EXPECT_THAT(cases[0].description, ::testing::StartsWith("ADD v1 "));
+}
+
+TEST(OpShapeBenchmarkTest, RunsCaseAlone) {
+  auto model = FlatBufferModel::BuildFromFile(kMultiAddModel);
+  ASSERT_TRUE(model);
+  const std::vector<OpShapeCase> cases = ExtractOpShapeCases(*model);
+  ASSERT_FALSE(cases.empty());
+
+  ops::builtin::BuiltinOpResolver resolver;
+  std::unique_ptr<Interpreter> interpreter;
+  ASSERT_EQ(BuildOpInterpreter(*model, cases[0], resolver, /*num_threads=*/1,
+                               &interpreter),
+            kTfLiteOk);
+  ASSERT_TRUE(interpreter);
+  EXPECT_EQ(interpreter->nodes_size(), 1);
+  EXPECT_EQ(interpreter->inputs().size(), 2);
+  EXPECT_EQ(interpreter->outputs().size(), 1);
+
+  OpBenchmarkOptions options;
+  options.warmup_runs = 1;
+  options.min_runs = 3;
+  options.min_secs = 0;
+  OpBenchmarkStats stats;
+  ASSERT_EQ(RunOpBenchmark(interpreter.get(), options, &stats), kTfLiteOk);
+  EXPECT_GE(stats.runs, 3);
+  EXPECT_LE(stats.min_us, stats.median_us);
+
+  OpBenchmarkRow row;
+  row.op_case = &cases[0];
+  row.kernel = "optimized";
+  row.ok = true;
+  row.stats = stats;
+  EXPECT_THAT(FormatOpBenchmarkTable({row}), ::testing::HasSubstr("ADD"));
+  EXPECT_THAT(FormatOpBenchmarkCsv({row}), ::testing::HasSubstr("optimized"));
+}
+
+TEST(OpShapeBenchmarkTest, UnsupportedCaseFails) {
+  auto model = FlatBufferModel::BuildFromFile(kMultiAddModel);
+  ASSERT_TRUE(model);
+  const std::vector<OpShapeCase> cases = ExtractOpShapeCases(*model);
+  ASSERT_FALSE(cases.empty());
+
+  // No kernel registered for ADD.
+  MutableOpResolver resolver;
+  std::unique_ptr<Interpreter> interpreter;
+  EXPECT_EQ(BuildOpInterpreter(*model, cases[0], resolver, /*num_threads=*/1,
+                               &interpreter),
+            kTfLiteError);
+}
+
+}  // namespace
+}  // namespace benchmark
+}  // namespace tflite
+
+int main(int argc, char** argv) {
+  ::tflite::LogToStderr();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -25,43 +25,53 @@ namespace benchmark {
 ProfilingListener::ProfilingListener(
     Interpreter* interpreter, uint32_t max_num_entries,
     const std::string& csv_file_path,
-    std::shared_ptr<profiling::ProfileSummaryFormatter> summarizer_formatter)
+    std::shared_ptr<profiling::ProfileSummaryFormatter> summarizer_formatter,
+    bool perf_counters)
     : run_summarizer_(summarizer_formatter),
       init_summarizer_(summarizer_formatter),
       csv_file_path_(csv_file_path),
       interpreter_(interpreter),
       profiler_(max_num_entries) {
   TFLITE_TOOLS_CHECK(interpreter);
-  interpreter_->SetProfiler(&profiler_);
+  if (perf_counters) {
+    perf_profiler_.reset(new profiling::PerfEventProfiler(max_num_entries));
+    interpreter_->SetProfiler(perf_profiler_.get());
+  } else {
+    interpreter_->SetProfiler(&profiler_);
+  }
 
   // We start profiling here in order to catch events that are recorded during
   // the benchmark run preparation stage where TFLite interpreter is
   // initialized and model graph is prepared.
-  profiler_.Reset();
-  profiler_.StartProfiling();
+  ResetProfiler();
+  StartProfiling();
 }
 
 void ProfilingListener::OnBenchmarkStart(const BenchmarkParams& params) {
   // At this point, we have completed the preparation for benchmark runs
   // including TFLite interpreter initialization etc. So we are going to process
   // profiling events recorded during this stage.
-  profiler_.StopProfiling();
-  auto profile_events = profiler_.GetProfileEvents();
+  StopProfiling();
+  auto profile_events = GetProfileEvents();
   init_summarizer_.ProcessProfiles(profile_events, *interpreter_);
-  profiler_.Reset();
+  ResetProfiler();
 }
 
 void ProfilingListener::OnSingleRunStart(RunType run_type) {
   if (run_type == REGULAR) {
-    profiler_.Reset();
-    profiler_.StartProfiling();
+    ResetProfiler();
+    StartProfiling();
   }
 }
 
 void ProfilingListener::OnSingleRunEnd() {
-  profiler_.StopProfiling();
-  auto profile_events = profiler_.GetProfileEvents();
+  StopProfiling();
+  auto profile_events = GetProfileEvents();
   run_summarizer_.ProcessProfiles(profile_events, *interpreter_);
+  if (perf_profiler_) {
+    perf_counter_summarizer_.ProcessProfiles(perf_profiler_->GetRecords(),
+                                             *interpreter_);
+  }
 }
 
 void ProfilingListener::OnBenchmarkEnd(const BenchmarkResults& results) {
@@ -80,6 +90,41 @@ void ProfilingListener::OnBenchmarkEnd(const BenchmarkResults& results) {
                 run_summarizer_.GetOutputString(),
                 output_stream == nullptr ? &TFLITE_LOG(INFO) : output_stream);
   }
+  if (perf_counter_summarizer_.HasProfiles()) {
+    WriteOutput("Hardware Counters for Regular Benchmark Runs:",
+                perf_counter_summarizer_.GetOutputString(),
+                output_stream == nullptr ? &TFLITE_LOG(INFO) : output_stream);
+  }
+}
+
+void ProfilingListener::StartProfiling() {
+  if (perf_profiler_) {
+    perf_profiler_->StartProfiling();
+  } else {
+    profiler_.StartProfiling();
+  }
+}
+
+void ProfilingListener::StopProfiling() {
+  if (perf_profiler_) {
+    perf_profiler_->StopProfiling();
+  } else {
+    profiler_.StopProfiling();
+  }
+}
+
+void ProfilingListener::ResetProfiler() {
+  if (perf_profiler_) {
+    perf_profiler_->Reset();
+  } else {
+    profiler_.Reset();
+  }
+}
+
+std::vector<const profiling::ProfileEvent*>
+ProfilingListener::GetProfileEvents() {
+  if (perf_profiler_) return perf_profiler_->GetProfileEvents();
+  return profiler_.GetProfileEvents();
 }
 
 void ProfilingListener::WriteOutput(const std::string& header,
@@ -19,6 +19,8 @@ limitations under the License.
 #include <memory>
 
 #include "tensorflow/lite/profiling/buffered_profiler.h"
+#include "tensorflow/lite/profiling/perf_counter_summarizer.h"
+#include "tensorflow/lite/profiling/perf_event_profiler.h"
 #include "tensorflow/lite/profiling/profile_summarizer.h"
 #include "tensorflow/lite/profiling/profile_summary_formatter.h"
 #include "tensorflow/lite/tools/benchmark/benchmark_model.h"
@@ -26,14 +28,17 @@ limitations under the License.
 namespace tflite {
 namespace benchmark {
 
-// Dumps profiling events if profiling is enabled.
+// Dumps profiling events if profiling is enabled. With `perf_counters`, the
+// op events also carry hardware counters (see PerfEventProfiler) and their
+// summary per op type and subgraph is dumped after the op profile.
 class ProfilingListener : public BenchmarkListener {
  public:
   ProfilingListener(
       Interpreter* interpreter, uint32_t max_num_entries,
       const std::string& csv_file_path = "",
       std::shared_ptr<profiling::ProfileSummaryFormatter> summarizer_formatter =
-          std::make_shared<profiling::ProfileSummaryDefaultFormatter>());
+          std::make_shared<profiling::ProfileSummaryDefaultFormatter>(),
+      bool perf_counters = false);
 
   void OnBenchmarkStart(const BenchmarkParams& params) override;
 
@@ -46,13 +51,21 @@ class ProfilingListener : public BenchmarkListener {
  protected:
   profiling::ProfileSummarizer run_summarizer_;
   profiling::ProfileSummarizer init_summarizer_;
+  profiling::PerfCounterSummarizer perf_counter_summarizer_;
   std::string csv_file_path_;
 
  private:
   void WriteOutput(const std::string& header, const string& data,
                    std::ostream* stream);
+  void StartProfiling();
+  void StopProfiling();
+  void ResetProfiler();
+  std::vector<const profiling::ProfileEvent*> GetProfileEvents();
+
   Interpreter* interpreter_;
   profiling::BufferedProfiler profiler_;
+  // Used instead of profiler_ when hardware counters are requested.
+  std::unique_ptr<profiling::PerfEventProfiler> perf_profiler_;
 };
 
 }  // namespace benchmark
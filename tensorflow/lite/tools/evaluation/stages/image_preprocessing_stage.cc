@@ -27,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/lib/jpeg/jpeg_handle.h"
 #include "tensorflow/core/lib/jpeg/jpeg_mem.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
 #include "tensorflow/lite/kernels/internal/types.h"
 #include "tensorflow/lite/profiling/time.h"
@@ -47,38 +48,39 @@ inline int ImageArrayOffset(int height, int width, int h, int w, int c) {
   return (h * width + w) * kNumChannels + c;
 }
 
-// Stores data and size information of an image.
+// Stores data and size information of an image. T is float, or uint8_t when
+// the whole pipeline can stay in uint8 (see ImagePreprocessingStage::Init).
+template <typename T>
 struct ImageData {
   uint32_t width;
   uint32_t height;
-  std::unique_ptr<std::vector<float>> data;
+  std::vector<T> data;
 
   // GetData performs no checks.
-  float GetData(int h, int w, int c) {
-    return data->at(ImageArrayOffset(height, width, h, w, c));
+  T GetData(int h, int w, int c) const {
+    return data[ImageArrayOffset(height, width, h, w, c)];
   }
 };
 
+// Reads the whole file.
+inline std::string ReadFile(const std::string& filename) {
+  std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(stream)),
+                     std::istreambuf_iterator<char>());
+}
+
 // Loads the raw image.
-inline void LoadImageRaw(std::string* filename, ImageData* image_data) {
-  std::ifstream stream(filename->c_str(), std::ios::in | std::ios::binary);
-  std::vector<uint8_t> raw_data((std::istreambuf_iterator<char>(stream)),
-                                std::istreambuf_iterator<char>());
-  std::vector<float>* orig_image = new std::vector<float>();
-  orig_image->reserve(raw_data.size());
-  for (int i = 0; i < raw_data.size(); ++i) {
-    orig_image->push_back(static_cast<float>(raw_data[i]));
-  }
-  image_data->data.reset(orig_image);
+template <typename T>
+inline void LoadImageRaw(const std::string& image_str,
+                         ImageData<T>* image_data) {
+  auto raw_data = absl::bit_cast<const uint8_t*>(image_str.data());
+  image_data->data.assign(raw_data, raw_data + image_str.size());
 }
 
-// Loads the jpeg image.
-inline void LoadImageJpeg(std::string* filename, ImageData* image_data) {
-  // Reads image.
-  std::ifstream t(*filename);
-  std::string image_str((std::istreambuf_iterator<char>(t)),
-                        std::istreambuf_iterator<char>());
-  const int fsize = image_str.size();
+// Loads the jpeg image, scaled down by 1/ratio in the DCT domain.
+template <typename T>
+inline bool LoadImageJpeg(const std::string& image_str, int ratio,
+                          ImageData<T>* image_data) {
   auto temp = absl::bit_cast<const uint8_t*>(image_str.data());
   std::unique_ptr<uint8_t[]> original_image;
   int original_width, original_height, original_channels;
@@ -89,58 +91,86 @@ inline void LoadImageJpeg(std::string* filename, ImageData* image_data) {
   flags.dct_method = JDCT_ISLOW;
   // We necessarily require a 3-channel image as the output.
   flags.components = kNumChannels;
-  original_image.reset(Uncompress(temp, fsize, flags, &original_width,
-                                  &original_height, &original_channels,
-                                  nullptr));
+  flags.ratio = ratio;
+  original_image.reset(Uncompress(temp, image_str.size(), flags,
+                                  &original_width, &original_height,
+                                  &original_channels, nullptr));
+  if (!original_image) return false;
   // Copies the image data.
   image_data->width = original_width;
   image_data->height = original_height;
   int original_size = original_height * original_width * original_channels;
-  std::vector<float>* float_image = new std::vector<float>();
-  float_image->reserve(original_size);
-  for (int i = 0; i < original_size; ++i) {
-    float_image->push_back(static_cast<float>(original_image[i]));
-  }
-  image_data->data.reset(float_image);
+  image_data->data.assign(original_image.get(),
+                          original_image.get() + original_size);
+  return true;
 }
 
-// Central-cropping.
-inline void Crop(ImageData* image_data, const CroppingParams& crop_params) {
-  int crop_height, crop_width;
-  int input_width = image_data->width;
-  int input_height = image_data->height;
+// Size of the central crop of a width x height image.
+inline void CropSize(int input_width, int input_height,
+                     const CroppingParams& crop_params, int* crop_width,
+                     int* crop_height) {
   if (crop_params.has_cropping_fraction()) {
-    crop_height =
+    *crop_height =
         static_cast<int>(round(crop_params.cropping_fraction() * input_height));
-    crop_width =
+    *crop_width =
         static_cast<int>(round(crop_params.cropping_fraction() * input_width));
   } else if (crop_params.has_target_size()) {
-    crop_height = crop_params.target_size().height();
-    crop_width = crop_params.target_size().width();
+    *crop_height = crop_params.target_size().height();
+    *crop_width = crop_params.target_size().width();
   }
   if (crop_params.has_cropping_fraction() && crop_params.square_cropping()) {
-    crop_height = std::min(crop_height, crop_width);
-    crop_width = crop_height;
+    *crop_height = std::min(*crop_height, *crop_width);
+    *crop_width = *crop_height;
   }
+}
+
+// Central-cropping.
+template <typename T>
+inline void Crop(ImageData<T>* image_data, const CroppingParams& crop_params) {
+  int crop_height, crop_width;
+  int input_width = image_data->width;
+  int input_height = image_data->height;
+  CropSize(input_width, input_height, crop_params, &crop_width, &crop_height);
   int start_w = static_cast<int>(round((input_width - crop_width) / 2.0));
   int start_h = static_cast<int>(round((input_height - crop_height) / 2.0));
-  std::vector<float>* cropped_image = new std::vector<float>();
-  cropped_image->reserve(crop_height * crop_width * kNumChannels);
+  std::vector<T> cropped_image(crop_height * crop_width * kNumChannels);
+  T* output = cropped_image.data();
   for (int in_h = start_h; in_h < start_h + crop_height; ++in_h) {
-    for (int in_w = start_w; in_w < start_w + crop_width; ++in_w) {
-      for (int c = 0; c < kNumChannels; ++c) {
-        cropped_image->push_back(image_data->GetData(in_h, in_w, c));
-      }
-    }
+    const T* row = &image_data->data[ImageArrayOffset(
+        input_height, input_width, in_h, start_w, 0)];
+    output = std::copy(row, row + crop_width * kNumChannels, output);
   }
   image_data->height = crop_height;
   image_data->width = crop_width;
-  image_data->data.reset(cropped_image);
+  image_data->data.swap(cropped_image);
+}
+
+// Output size of the resizing step for a width x height image.
+inline void ResizeOutputSize(int input_width, int input_height,
+                             const ResizingParams& params, int* output_width,
+                             int* output_height) {
+  if (params.aspect_preserving()) {
+    float ratio_w =
+        params.target_size().width() / static_cast<float>(input_width);
+    float ratio_h =
+        params.target_size().height() / static_cast<float>(input_height);
+    if (ratio_w >= ratio_h) {
+      *output_width = params.target_size().width();
+      *output_height = static_cast<int>(round(input_height * ratio_w));
+    } else {
+      *output_width = static_cast<int>(round(input_width * ratio_h));
+      *output_height = params.target_size().height();
+    }
+  } else {
+    *output_height = params.target_size().height();
+    *output_width = params.target_size().width();
+  }
 }
 
 // Performs billinear interpolation for 3-channel RGB image.
 // See: https://en.wikipedia.org/wiki/Bilinear_interpolation
-inline void ResizeBilinear(ImageData* image_data,
+template <typename T>
+inline void ResizeBilinear(ImageData<T>* image_data,
                            const ResizingParams& params) {
   tflite::ResizeBilinearParams resize_params;
   resize_params.align_corners = false;
@@ -151,38 +181,25 @@ inline void ResizeBilinear(ImageData* image_data,
                                     kNumChannels});
   // Calculates output size.
   int output_height, output_width;
-  if (params.aspect_preserving()) {
-    float ratio_w =
-        params.target_size().width() / static_cast<float>(image_data->width);
-    float ratio_h =
-        params.target_size().height() / static_cast<float>(image_data->height);
-    if (ratio_w >= ratio_h) {
-      output_width = params.target_size().width();
-      output_height = static_cast<int>(round(image_data->height * ratio_w));
-    } else {
-      output_width = static_cast<int>(round(image_data->width * ratio_h));
-      output_height = params.target_size().height();
-    }
-  } else {
-    output_height = params.target_size().height();
-    output_width = params.target_size().width();
-  }
+  ResizeOutputSize(image_data->width, image_data->height, params,
+                   &output_width, &output_height);
   tflite::RuntimeShape output_size_dims({1, 1, 1, 2});
   std::vector<int32_t> output_size_data = {output_height, output_width};
   tflite::RuntimeShape output_shape(
       {1, output_height, output_width, kNumChannels});
   int output_size = output_width * output_height * kNumChannels;
-  std::vector<float>* output_data = new std::vector<float>(output_size, 0);
-  tflite::reference_ops::ResizeBilinear(
-      resize_params, input_shape, image_data->data->data(), output_size_dims,
-      output_size_data.data(), output_shape, output_data->data());
+  std::vector<T> output_data(output_size);
+  tflite::optimized_ops::ResizeBilinear(
+      resize_params, input_shape, image_data->data.data(), output_size_dims,
+      output_size_data.data(), output_shape, output_data.data());
   image_data->height = output_height;
   image_data->width = output_width;
-  image_data->data.reset(output_data);
+  image_data->data.swap(output_data);
 }
 
 // Pads the image to a pre-defined size.
-inline void Pad(ImageData* image_data, const PaddingParams& params) {
+template <typename T>
+inline void Pad(ImageData<T>* image_data, const PaddingParams& params) {
   int output_width = params.target_size().width();
   int output_height = params.target_size().height();
   int pad_value = params.padding_value();
@@ -205,29 +222,63 @@ inline void Pad(ImageData* image_data, const PaddingParams& params) {
   tflite::RuntimeShape output_shape(
       {1, output_height, output_width, kNumChannels});
   int output_size = output_width * output_height * kNumChannels;
-  std::vector<float>* output_data = new std::vector<float>(output_size, 0);
-  tflite::reference_ops::Pad(pad_params, input_shape, image_data->data->data(),
-                             &pad_value, output_shape, output_data->data());
+  std::vector<T> output_data(output_size, 0);
+  tflite::reference_ops::Pad(pad_params, input_shape, image_data->data.data(),
+                             &pad_value, output_shape, output_data.data());
   image_data->height = output_height;
   image_data->width = output_width;
-  image_data->data.reset(output_data);
+  image_data->data.swap(output_data);
+}
+
+// Largest JPEG decode ratio (1, 2, 4 or 8) for which the first resizing step
+// still upscales the decoded (and cropped) image by at most max_upscale.
+// Returns 1 when the size the resize sees does not follow the decoded size.
+int JpegDecodeRatio(int width, int height,
+                    const ImagePreprocessingParams& params, float max_upscale) {
+  int best_ratio = 1;
+  for (int ratio = 2; ratio <= 8; ratio *= 2) {
+    // libjpeg rounds scaled dimensions up.
+    int scaled_width = (width + ratio - 1) / ratio;
+    int scaled_height = (height + ratio - 1) / ratio;
+    bool fits = false;
+    for (const ImagePreprocessingStepParams& param : params.steps()) {
+      if (param.has_cropping_params()) {
+        const CroppingParams& crop_params = param.cropping_params();
+        if (!crop_params.has_cropping_fraction()) return best_ratio;
+        CropSize(scaled_width, scaled_height, crop_params, &scaled_width,
+                 &scaled_height);
+      } else if (param.has_padding_params()) {
+        return best_ratio;
+      } else if (param.has_resizing_params()) {
+        int output_width, output_height;
+        ResizeOutputSize(scaled_width, scaled_height, param.resizing_params(),
+                         &output_width, &output_height);
+        fits = output_width <= scaled_width * max_upscale &&
+               output_height <= scaled_height * max_upscale;
+        break;
+      }
+    }
+    if (!fits) break;
+    best_ratio = ratio;
+  }
+  return best_ratio;
 }
 
 // Normalizes the image data to a specific range with mean and scale.
-inline void Normalize(ImageData* image_data,
+inline void Normalize(ImageData<float>* image_data,
                       const NormalizationParams& params) {
   float scale = params.scale();
-  float* data_end = image_data->data->data() + image_data->data->size();
+  float* data_end = image_data->data.data() + image_data->data.size();
   if (params.has_channelwise_mean()) {
     float mean = params.channelwise_mean();
-    for (float* data = image_data->data->data(); data < data_end; ++data) {
+    for (float* data = image_data->data.data(); data < data_end; ++data) {
       *data = (*data - mean) * scale;
     }
   } else {
     float r_mean = params.means().r_mean();
     float g_mean = params.means().g_mean();
     float b_mean = params.means().b_mean();
-    for (float* data = image_data->data->data(); data < data_end;) {
+    for (float* data = image_data->data.data(); data < data_end;) {
       *data = (*data - r_mean) * scale;
       ++data;
       *data = (*data - g_mean) * scale;
@@ -237,6 +288,70 @@ inline void Normalize(ImageData* image_data,
     }
   }
 }
+
+// Normalization needs float data. Init() rejects the uint8 pipeline for
+// steps with a normalization.
+inline void Normalize(ImageData<uint8_t>* image_data,
+                      const NormalizationParams& params) {}
+
+// Loads the image and applies every preprocessing step.
+template <typename T>
+TfLiteStatus LoadAndPreprocess(const std::string& image_path,
+                               const ImagePreprocessingParams& params,
+                               ImageData<T>* image_data) {
+  // Loads the image from file.
+  string image_ext = image_path.substr(image_path.find_last_of("."));
+  absl::AsciiStrToLower(&image_ext);
+  bool is_raw_image = (image_ext == ".rgb8");
+  if (image_ext == ".rgb8") {
+    LoadImageRaw(ReadFile(image_path), image_data);
+  } else if (image_ext == ".jpg" || image_ext == ".jpeg") {
+    const std::string image_str = ReadFile(image_path);
+    int ratio = 1;
+    int width, height;
+    if (params.has_jpeg_decode_max_upscale() &&
+        tensorflow::jpeg::GetImageInfo(image_str.data(), image_str.size(),
+                                       &width, &height, nullptr)) {
+      ratio = JpegDecodeRatio(width, height, params,
+                              params.jpeg_decode_max_upscale());
+    }
+    if (!LoadImageJpeg(image_str, ratio, image_data)) {
+      LOG(ERROR) << "Could not decode " << image_path;
+      return kTfLiteError;
+    }
+  } else {
+    LOG(ERROR) << "Extension " << image_ext << " is not supported";
+    return kTfLiteError;
+  }
+
+  // Cropping, padding and resizing are not supported with raw images since raw
+  // images do not contain image size information. Those steps are assumed to
+  // be done before raw images are generated.
+  for (const ImagePreprocessingStepParams& param : params.steps()) {
+    if (param.has_cropping_params()) {
+      if (is_raw_image) {
+        LOG(WARNING) << "Image cropping will not be performed on raw images";
+        continue;
+      }
+      Crop(image_data, param.cropping_params());
+    } else if (param.has_resizing_params()) {
+      if (is_raw_image) {
+        LOG(WARNING) << "Image resizing will not be performed on raw images";
+        continue;
+      }
+      ResizeBilinear(image_data, param.resizing_params());
+    } else if (param.has_padding_params()) {
+      if (is_raw_image) {
+        LOG(WARNING) << "Image padding will not be performed on raw images";
+        continue;
+      }
+      Pad(image_data, param.padding_params());
+    } else if (param.has_normalization_params()) {
+      Normalize(image_data, param.normalization_params());
+    }
+  }
+  return kTfLiteOk;
+}
 }  // namespace
 
 TfLiteStatus ImagePreprocessingStage::Init() {
@@ -259,7 +374,23 @@ TfLiteStatus ImagePreprocessingStage::Init() {
       }
     }
   }
+  if (params.has_jpeg_decode_max_upscale() &&
+      params.jpeg_decode_max_upscale() < 1.0) {
+    LOG(ERROR) << "Invalid JPEG decode max upscale";
+    return kTfLiteError;
+  }
   output_type_ = static_cast<TfLiteType>(params.output_type());
+  uint8_pipeline_ = params.uint8_pipeline();
+  if (uint8_pipeline_) {
+    bool has_normalization = false;
+    for (const ImagePreprocessingStepParams& param : params.steps()) {
+      if (param.has_normalization_params()) has_normalization = true;
+    }
+    if (output_type_ != kTfLiteUInt8 || has_normalization) {
+      LOG(ERROR) << "uint8 pipeline needs a uint8 output without normalization";
+      return kTfLiteError;
+    }
+  }
   return kTfLiteOk;
 }
 
@@ -269,67 +400,30 @@ TfLiteStatus ImagePreprocessingStage::Run() {
     return kTfLiteError;
   }
 
-  ImageData image_data;
   const ImagePreprocessingParams& params =
       config_.specification().image_preprocessing_params();
   int64_t start_us = profiling::time::NowMicros();
-  // Loads the image from file.
-  string image_ext = image_path_->substr(image_path_->find_last_of("."));
-  absl::AsciiStrToLower(&image_ext);
-  bool is_raw_image = (image_ext == ".rgb8");
-  if (image_ext == ".rgb8") {
-    LoadImageRaw(image_path_, &image_data);
-  } else if (image_ext == ".jpg" || image_ext == ".jpeg") {
-    LoadImageJpeg(image_path_, &image_data);
-  } else {
-    LOG(ERROR) << "Extension " << image_ext << " is not supported";
-    return kTfLiteError;
+  if (uint8_pipeline_) {
+    ImageData<uint8_t> image_data;
+    TF_LITE_ENSURE_STATUS(
+        LoadAndPreprocess(*image_path_, params, &image_data));
+    uint8_preprocessed_image_.swap(image_data.data);
+    latency_stats_.UpdateStat(profiling::time::NowMicros() - start_us);
+    return kTfLiteOk;
   }
 
-  // Cropping, padding and resizing are not supported with raw images since raw
-  // images do not contain image size information. Those steps are assumed to
-  // be done before raw images are generated.
-  for (const ImagePreprocessingStepParams& param : params.steps()) {
-    if (param.has_cropping_params()) {
-      if (is_raw_image) {
-        LOG(WARNING) << "Image cropping will not be performed on raw images";
-        continue;
-      }
-      Crop(&image_data, param.cropping_params());
-    } else if (param.has_resizing_params()) {
-      if (is_raw_image) {
-        LOG(WARNING) << "Image resizing will not be performed on raw images";
-        continue;
-      }
-      ResizeBilinear(&image_data, param.resizing_params());
-    } else if (param.has_padding_params()) {
-      if (is_raw_image) {
-        LOG(WARNING) << "Image padding will not be performed on raw images";
-        continue;
-      }
-      Pad(&image_data, param.padding_params());
-    } else if (param.has_normalization_params()) {
-      Normalize(&image_data, param.normalization_params());
-    }
-  }
+  ImageData<float> image_data;
+  TF_LITE_ENSURE_STATUS(LoadAndPreprocess(*image_path_, params, &image_data));
 
   // Converts data to output type.
   if (output_type_ == kTfLiteUInt8) {
-    uint8_preprocessed_image_.clear();
-    uint8_preprocessed_image_.reserve(image_data.data->size());
-    for (int i = 0; i < image_data.data->size(); ++i) {
-      uint8_preprocessed_image_.push_back(
-          static_cast<uint8_t>(image_data.data->at(i)));
-    }
+    uint8_preprocessed_image_.assign(image_data.data.begin(),
+                                     image_data.data.end());
   } else if (output_type_ == kTfLiteInt8) {
-    int8_preprocessed_image_.clear();
-    int8_preprocessed_image_.reserve(image_data.data->size());
-    for (int i = 0; i < image_data.data->size(); ++i) {
-      int8_preprocessed_image_.push_back(
-          static_cast<int8_t>(image_data.data->at(i)));
-    }
+    int8_preprocessed_image_.assign(image_data.data.begin(),
+                                    image_data.data.end());
   } else if (output_type_ == kTfLiteFloat32) {
-    float_preprocessed_image_ = *image_data.data;
+    float_preprocessed_image_.swap(image_data.data);
   }
 
   latency_stats_.UpdateStat(profiling::time::NowMicros() - start_us);
@@ -53,6 +53,9 @@ class ImagePreprocessingStage : public EvaluationStage {
  private:
   std::string* image_path_ = nullptr;
   TfLiteType output_type_;
+  // Crop, resize and pad directly on uint8 pixels (see
+  // ImagePreprocessingParams.uint8_pipeline).
+  bool uint8_pipeline_ = false;
   tensorflow::Stat<int64_t> latency_stats_;
 
   // One of the following 3 vectors will be populated based on output_type_.
@@ -158,6 +161,22 @@ class ImagePreprocessingConfigBuilder {
         ->Add(std::move(params));
   }
 
+  // Lets JPEGs be decoded at 1/2, 1/4 or 1/8 of their size as long as the
+  // resizing step then upscales by at most `max_upscale`.
+  void SetJpegDecodeMaxUpscale(float max_upscale) {
+    config_.mutable_specification()
+        ->mutable_image_preprocessing_params()
+        ->set_jpeg_decode_max_upscale(max_upscale);
+  }
+
+  // Opts in to preprocessing on uint8 pixels, for uint8 outputs without a
+  // normalization step.
+  void SetUint8Pipeline(bool uint8_pipeline) {
+    config_.mutable_specification()
+        ->mutable_image_preprocessing_params()
+        ->set_uint8_pipeline(uint8_pipeline);
+  }
+
   // Adds a normalization step with default value.
   void AddDefaultNormalizationStep() {
     switch (
@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/lite/tools/evaluation/stages/image_preprocessing_stage.h"
 
+#include <cstdlib>
 #include <memory>
 #include <string>
 
@@ -48,6 +49,24 @@ TEST(ImagePreprocessingStage, InvalidCroppingFraction) {
   EXPECT_EQ(stage.Init(), kTfLiteError);
 }
 
+TEST(ImagePreprocessingStage, InvalidJpegDecodeMaxUpscale) {
+  ImagePreprocessingConfigBuilder builder(kImagePreprocessingStageName,
+                                          kTfLiteFloat32);
+  builder.AddResizingStep(224, 224, false);
+  builder.SetJpegDecodeMaxUpscale(0.5);
+  ImagePreprocessingStage stage = ImagePreprocessingStage(builder.build());
+  EXPECT_EQ(stage.Init(), kTfLiteError);
+}
+
+TEST(ImagePreprocessingStage, InvalidUint8Pipeline) {
+  ImagePreprocessingConfigBuilder builder(kImagePreprocessingStageName,
+                                          kTfLiteFloat32);
+  builder.AddResizingStep(224, 224, false);
+  builder.SetUint8Pipeline(true);
+  ImagePreprocessingStage stage = ImagePreprocessingStage(builder.build());
+  EXPECT_EQ(stage.Init(), kTfLiteError);
+}
+
 TEST(ImagePreprocessingStage, ImagePathNotSet) {
   ImagePreprocessingConfigBuilder builder(kImagePreprocessingStageName,
                                           kTfLiteFloat32);
@@ -306,6 +325,83 @@ TEST(ImagePreprocessingStage, TestImagePreprocessingSubtractMean) {
   EXPECT_EQ(metrics.process_metrics().total_latency().avg_us(), last_latency);
 }
 
+TEST(ImagePreprocessingStage, TestImagePreprocessingDownscaledJpegDecode) {
+  std::string image_path = kTestImage;
+
+  ImagePreprocessingConfigBuilder full_builder(kImagePreprocessingStageName,
+                                               kTfLiteUInt8);
+  full_builder.AddResizingStep(224, 224, false);
+  ImagePreprocessingStage full_stage =
+      ImagePreprocessingStage(full_builder.build());
+  EXPECT_EQ(full_stage.Init(), kTfLiteOk);
+  full_stage.SetImagePath(&image_path);
+  EXPECT_EQ(full_stage.Run(), kTfLiteOk);
+
+  // The 517x606 test image is decoded at 1/2, still larger than 224x224.
+  ImagePreprocessingConfigBuilder builder(kImagePreprocessingStageName,
+                                          kTfLiteUInt8);
+  builder.AddResizingStep(224, 224, false);
+  builder.SetJpegDecodeMaxUpscale(1.0);
+  ImagePreprocessingStage stage = ImagePreprocessingStage(builder.build());
+  EXPECT_EQ(stage.Init(), kTfLiteOk);
+  stage.SetImagePath(&image_path);
+  EXPECT_EQ(stage.Run(), kTfLiteOk);
+
+  uint8_t* full_image_ptr =
+      static_cast<uint8_t*>(full_stage.GetPreprocessedImageData());
+  uint8_t* preprocessed_image_ptr =
+      static_cast<uint8_t*>(stage.GetPreprocessedImageData());
+  ASSERT_NE(full_image_ptr, nullptr);
+  ASSERT_NE(preprocessed_image_ptr, nullptr);
+  // Same output size and close to the fully decoded image.
+  const int image_size = kImageDim * kImageDim * 3;
+  double total_difference = 0;
+  for (int i = 0; i < image_size; ++i) {
+    total_difference += std::abs(static_cast<int>(preprocessed_image_ptr[i]) -
+                                 static_cast<int>(full_image_ptr[i]));
+  }
+  EXPECT_LT(total_difference / image_size, 8.0);
+}
+
+TEST(ImagePreprocessingStage, TestImagePreprocessingUint8Pipeline) {
+  std::string image_path = kTestImage;
+
+  ImagePreprocessingConfigBuilder float_builder(kImagePreprocessingStageName,
+                                                kTfLiteUInt8);
+  float_builder.AddCroppingStep(0.875);
+  float_builder.AddResizingStep(224, 224, false);
+  ImagePreprocessingStage float_stage =
+      ImagePreprocessingStage(float_builder.build());
+  EXPECT_EQ(float_stage.Init(), kTfLiteOk);
+  float_stage.SetImagePath(&image_path);
+  EXPECT_EQ(float_stage.Run(), kTfLiteOk);
+
+  ImagePreprocessingConfigBuilder builder(kImagePreprocessingStageName,
+                                          kTfLiteUInt8);
+  builder.AddCroppingStep(0.875);
+  builder.AddResizingStep(224, 224, false);
+  builder.SetUint8Pipeline(true);
+  ImagePreprocessingStage stage = ImagePreprocessingStage(builder.build());
+  EXPECT_EQ(stage.Init(), kTfLiteOk);
+  stage.SetImagePath(&image_path);
+  EXPECT_EQ(stage.Run(), kTfLiteOk);
+
+  uint8_t* float_image_ptr =
+      static_cast<uint8_t*>(float_stage.GetPreprocessedImageData());
+  uint8_t* preprocessed_image_ptr =
+      static_cast<uint8_t*>(stage.GetPreprocessedImageData());
+  ASSERT_NE(float_image_ptr, nullptr);
+  ASSERT_NE(preprocessed_image_ptr, nullptr);
+  // Only rounding differs from the float pipeline.
+  const int image_size = kImageDim * kImageDim * 3;
+  double total_difference = 0;
+  for (int i = 0; i < image_size; ++i) {
+    total_difference += std::abs(static_cast<int>(preprocessed_image_ptr[i]) -
+                                 static_cast<int>(float_image_ptr[i]));
+  }
+  EXPECT_LT(total_difference / image_size, 1.0);
+}
+
 }  // namespace
 }  // namespace evaluation
 }  // namespace tflite
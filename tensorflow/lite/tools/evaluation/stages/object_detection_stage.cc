@@ -73,6 +73,9 @@ TfLiteStatus ObjectDetectionStage::Init(
       "image_preprocessing", input_type);
   builder.AddResizingStep(input_shape->data[2], input_shape->data[1], false);
   builder.AddDefaultNormalizationStep();
+  if (params.has_jpeg_decode_max_upscale()) {
+    builder.SetJpegDecodeMaxUpscale(params.jpeg_decode_max_upscale());
+  }
   preprocessing_stage_.reset(new ImagePreprocessingStage(builder.build()));
   TF_LITE_ENSURE_STATUS(preprocessing_stage_->Init());
 
@@ -41,6 +41,7 @@ constexpr char kGroundTruthProtoFileFlag[] = "ground_truth_proto";
 constexpr char kInterpreterThreadsFlag[] = "num_interpreter_threads";
 constexpr char kDebugModeFlag[] = "debug_mode";
 constexpr char kDelegateFlag[] = "delegate";
+constexpr char kJpegDecodeMaxUpscaleFlag[] = "jpeg_decode_max_upscale";
 
 std::string GetNameFromPath(const std::string& str) {
   int pos = str.find_last_of("/\\");
@@ -50,7 +51,10 @@ std::string GetNameFromPath(const std::string& str) {
 
 class CocoObjectDetection : public TaskExecutor {
  public:
-  CocoObjectDetection() : debug_mode_(false), num_interpreter_threads_(1) {}
+  CocoObjectDetection()
+      : debug_mode_(false),
+        num_interpreter_threads_(1),
+        jpeg_decode_max_upscale_(0) {}
   ~CocoObjectDetection() override {}
 
  protected:
@@ -69,6 +73,7 @@ class CocoObjectDetection : public TaskExecutor {
   bool debug_mode_;
   std::string delegate_;
   int num_interpreter_threads_;
+  float jpeg_decode_max_upscale_;
 };
 
 std::vector<Flag> CocoObjectDetection::GetFlags() {
@@ -106,6 +111,11 @@ std::vector<Flag> CocoObjectDetection::GetFlags() {
           kDelegateFlag, &delegate_,
           "Delegate to use for inference, if available. "
           "Must be one of {'nnapi', 'gpu', 'xnnpack', 'hexagon'}"),
+      tflite::Flag::CreateFlag(
+          kJpegDecodeMaxUpscaleFlag, &jpeg_decode_max_upscale_,
+          "If >= 1, JPEGs are decoded at 1/2, 1/4 or 1/8 of their size when "
+          "the model input is then upscaled by at most this factor. 0 decodes "
+          "at full size."),
   };
   return flag_list;
 }
@@ -133,6 +143,9 @@ absl::optional<EvaluationStageMetrics> CocoObjectDetection::RunImpl() {
   inference_params->set_model_file_path(model_file_path_);
   inference_params->set_num_threads(num_interpreter_threads_);
   inference_params->set_delegate(ParseStringToDelegateType(delegate_));
+  if (jpeg_decode_max_upscale_ > 0) {
+    detection_params->set_jpeg_decode_max_upscale(jpeg_decode_max_upscale_);
+  }
 
   // Get ground truth data.
   absl::flat_hash_map<std::string, ObjectDetectionResult> ground_truth_map;
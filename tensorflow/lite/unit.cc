@@ -1,5 +1,7 @@
 #include "unit.h"
 #include "algorithm"
+#include "cmath"
+#include "cstring"
 // #define GPUONLY
 #define CPUONLY
 //#define MULTITHREAD
@@ -26,6 +28,233 @@ std::mutex mtx_lock;
 namespace tflite
 {
 
+TfLiteStatus CopyFrameToInputTensor(TfLiteTensor* input, int slot,
+                                    const cv::Mat& frame){
+    if(input->dims->size != 4){
+        std::cout << "CopyFrameToInputTensor : input tensor is not NHWC \n";
+        return kTfLiteError;
+    }
+    const int height = input->dims->data[1];
+    const int width = input->dims->data[2];
+    const int channel = input->dims->data[3];
+    const int slot_size = height * width * channel;
+    if(frame.empty()){
+        size_t slot_bytes = input->bytes / input->dims->data[0];
+        memset(input->data.raw + slot * slot_bytes, 0, slot_bytes);
+        return kTfLiteOk;
+    }
+    cv::Mat resized = frame;
+    if(frame.rows != height || frame.cols != width)
+        cv::resize(frame, resized, cv::Size(width, height));
+    if(resized.channels() != channel || resized.depth() != CV_8U){
+        std::cout << "CopyFrameToInputTensor : frame format does not match input tensor \n";
+        return kTfLiteError;
+    }
+    if(!resized.isContinuous())
+        resized = resized.clone();
+    const uint8_t* pixel = resized.ptr<uint8_t>(0);
+    switch(input->type){
+        case kTfLiteFloat32:{
+            float* dst = input->data.f + slot * slot_size;
+            for(int i=0; i<slot_size; ++i)
+                dst[i] = ((float)pixel[i])/255.0;
+            break;
+        }
+        case kTfLiteUInt8:
+        case kTfLiteInt8:{
+            // Quantize the normalized pixel with the tensor's own parameters.
+            float scale = input->params.scale > 0 ? input->params.scale : 1.0/255.0;
+            int zero_point = input->params.zero_point;
+            int q_min = input->type == kTfLiteUInt8 ? 0 : -128;
+            int q_max = input->type == kTfLiteUInt8 ? 255 : 127;
+            for(int i=0; i<slot_size; ++i){
+                int q = (int)std::round(((float)pixel[i])/255.0/scale) + zero_point;
+                q = std::min(q_max, std::max(q_min, q));
+                if(input->type == kTfLiteUInt8)
+                    input->data.uint8[slot * slot_size + i] = (uint8_t)q;
+                else
+                    input->data.int8[slot * slot_size + i] = (int8_t)q;
+            }
+            break;
+        }
+        default:
+            std::cout << "CopyFrameToInputTensor : unsupported input tensor type \n";
+            return kTfLiteError;
+    }
+    return kTfLiteOk;
+}
+
+// Unit (async worker)
+TfLiteStatus Unit::StartAsync(int max_pending){
+    std::unique_lock<std::mutex> lock(mtx_async);
+    if(async_started)
+        return kTfLiteOk;
+    if(GetInterpreter() == nullptr){
+        std::cout << "Unit : no interpreter for async invoke \n";
+        return kTfLiteError;
+    }
+    async_max_pending = max_pending < 1 ? 1 : max_pending;
+    async_stop = false;
+    asyncThread = std::thread(&Unit::AsyncWorker, this);
+    async_started = true;
+    return kTfLiteOk;
+}
+
+void Unit::StopAsync(){
+    {
+        std::unique_lock<std::mutex> lock(mtx_async);
+        if(!async_started)
+            return;
+        async_stop = true;
+    }
+    Acontroller.notify_all();
+    asyncThread.join();
+    async_started = false;
+}
+
+std::future<TfLiteStatus> Unit::InvokeAsync(std::vector<cv::Mat> inputs,
+                                            InvokeCallback callback){
+    AsyncJob* job = new AsyncJob;
+    job->inputs = inputs;
+    job->callback = callback;
+    std::future<TfLiteStatus> future = job->done.get_future();
+    {
+        std::unique_lock<std::mutex> lock(mtx_async);
+        if(!async_started || async_stop){
+            lock.unlock();
+            job->done.set_value(kTfLiteError);
+            delete job;
+            return future;
+        }
+        // Back pressure : do not let the caller run too far ahead.
+        Acontroller.wait(lock, [this]{
+            return async_stop || qAsyncJob.size() < (size_t)async_max_pending;
+        });
+        qAsyncJob.push_back(job);
+    }
+    Acontroller.notify_all();
+    return future;
+}
+
+void Unit::AsyncWorker(){
+    while(true){
+        AsyncJob* job;
+        {
+            std::unique_lock<std::mutex> lock(mtx_async);
+            Acontroller.wait(lock, [this]{ return async_stop || !qAsyncJob.empty(); });
+            if(qAsyncJob.empty())
+                return;
+            job = qAsyncJob.front();
+            qAsyncJob.pop_front();
+        }
+        Acontroller.notify_all(); // wake a blocked InvokeAsync()
+        // The callback reads the outputs of the interpreter that ran.
+        Interpreter* interpreter = PinInterpreter();
+        TfLiteStatus status = InvokeOn(interpreter, job->inputs);
+        if(job->callback)
+            job->callback(status, interpreter);
+        UnpinInterpreter(interpreter);
+        job->done.set_value(status);
+        delete job;
+    }
+}
+
+TfLiteStatus Unit::InvokeOnce(std::vector<cv::Mat> inputs){
+    Interpreter* interpreter = PinInterpreter();
+    TfLiteStatus status = InvokeOn(interpreter, inputs);
+    UnpinInterpreter(interpreter);
+    return status;
+}
+
+Interpreter* Unit::PinInterpreter(){
+    std::unique_lock<std::mutex> lock(mtx_swap);
+    Interpreter* interpreter = GetInterpreter();
+    pins[interpreter]++;
+    // Pinned until the outputs have been read, the idle releaser skips it.
+    if(interpreter != nullptr)
+        interpreter->PinNonPersistentMemory();
+    return interpreter;
+}
+
+void Unit::UnpinInterpreter(Interpreter* interpreter){
+    {
+        std::unique_lock<std::mutex> lock(mtx_swap);
+        auto pin = pins.find(interpreter);
+        if(pin == pins.end())
+            return;
+        if(interpreter != nullptr)
+            interpreter->UnpinNonPersistentMemory();
+        if(--pin->second > 0)
+            return;
+        pins.erase(pin);
+    }
+    Scontroller.notify_all();
+}
+
+TfLiteStatus Unit::SwapInterpreter(std::unique_ptr<tflite::Interpreter>* next){
+    if(next == nullptr || next->get() == nullptr){
+        std::cout << "Unit : no interpreter to swap in \n";
+        return kTfLiteError;
+    }
+    std::unique_ptr<tflite::Interpreter>* old;
+    {
+        std::unique_lock<std::mutex> lock(mtx_swap);
+        old = ExchangeInterpreter(next);
+        generation++;
+        // Invokes started before the swap finish on the old interpreter.
+        Interpreter* retiring = old ? old->get() : nullptr;
+        Scontroller.wait(lock, [this, retiring]{ return pins.count(retiring) == 0; });
+    }
+    delete old;
+    return kTfLiteOk;
+}
+
+uint64_t Unit::GetGeneration(){
+    std::unique_lock<std::mutex> lock(mtx_swap);
+    return generation;
+}
+
+void Unit::SetRecorder(WorkloadRecorder* recorder_){
+    recorder = recorder_;
+}
+
+void Unit::SetExternalInput(){
+    external_input = true;
+}
+
+bool Unit::HasExternalInput(){
+    return external_input;
+}
+
+TfLiteStatus Unit::InvokeOn(Interpreter* interpreter, std::vector<cv::Mat> inputs){
+    auto arrival = std::chrono::steady_clock::now();
+    if(!inputs.empty() && external_input){
+        std::cout << "Unit : input is bound to a frame ring \n";
+        return kTfLiteError;
+    }
+    // Inputs live in the arena, which may have been released while idle.
+    if(interpreter->AcquireNonPersistentMemory() != kTfLiteOk)
+        return kTfLiteError;
+    // Empty inputs means the caller filled the input tensors itself.
+    for(size_t i=0; i<inputs.size() && i<interpreter->inputs().size(); ++i){
+        TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[i]);
+        if(CopyFrameToInputTensor(input, 0, inputs[i]) != kTfLiteOk)
+            return kTfLiteError;
+    }
+    UnitType type = GetUnitType();
+    TfLiteStatus status;
+    if(type == UnitType::CPU0 || type == UnitType::GPU0){
+        status = interpreter->Invoke(type, mtx_invoke, mtx_invoke_,
+                                     mtx_invoke_debug, Icontroller, &qInvokeShared);
+    }else{
+        status = interpreter->Invoke();
+    }
+    WorkloadRecorder* recording = recorder;
+    if(recording != nullptr && status == kTfLiteOk)
+        recording->Record(interpreter, arrival);
+    return status;
+}
+
 // UnitCPU
 UnitCPU::UnitCPU() : name("NONE"), interpreterCPU(nullptr){}
 
@@ -41,19 +270,25 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
                             std::condition_variable& Outcontroller,
                             std::queue<SharedContext*>* qSharedData,
                             int* C_Counter, int* G_Counter) { 
+    if(HasExternalInput()){
+        std::cout << "Unit : input is bound to a frame ring \n";
+        return kTfLiteError;
+    }
+    // Pinned for the whole run, a SwapModel meanwhile waits for it.
+    Interpreter* interpreter = PinInterpreter();
     for(int o_loop=0; o_loop<OUT_SEQ; o_loop++){
         for(int k=0; k<SEQ; k++){
             //std::cout << "CPU " << *C_Counter << "\n";
             #ifdef catdog
             for (int i=0; i < 300; ++i) {
                 for(int j=0; j < 300; j++){
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*300 + j*3] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[0])/255.0;    
 
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[1])/255.0;
 
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[2])/255.0;
                 }
             }
@@ -62,15 +297,16 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef mnist
             for (int i=0; i<Image_x; i++){
                 for (int j=0; j<Image_y; j++){
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*28 + j] = \
+                    interpreter->typed_input_tensor<float>(0)[i*28 + j] = \
                      ((float)input[k].at<uchar>(i, j)/255.0);          
                 }
             } 
             #endif 
             // Run inference
-            if(interpreterCPU->get()->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
+            if(interpreter->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
                                                 Ucontroller, qSharedData) 
                                             != kTfLiteOk){
+                UnpinInterpreter(interpreter);
                 return kTfLiteError;
             }
             mtx_lock_timing.lock();
@@ -83,6 +319,7 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
         }
     }
     std::cout << "\n" << "CPU All Jobs Done" << "\n";
+    UnpinInterpreter(interpreter);
     return kTfLiteOk;
 }
 #endif
@@ -98,6 +335,12 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
                             std::condition_variable& Outcontroller,
                             std::queue<SharedContext*>* qSharedData,
                             int* C_Counter, int* G_Counter ) { 
+    if(HasExternalInput()){
+        std::cout << "Unit : input is bound to a frame ring \n";
+        return kTfLiteError;
+    }
+    // Pinned for the whole run, a SwapModel meanwhile waits for it.
+    Interpreter* interpreter = PinInterpreter();
     double time = 0;
     struct timespec begin, end;
     for(int o_loop=0; o_loop<OUT_SEQ; o_loop++){
@@ -106,7 +349,7 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef yolo
 
             // RGB linear [SUCCESSED]
-            auto input_pointer = (float *)interpreterCPU->get()->subgraph(0)->tensor(0)->data.data;
+            auto input_pointer = (float *)interpreter->subgraph(0)->tensor(0)->data.data;
             for (int i=0; i<416; i++){
                 for (int j=0; j<416; j++){   
                         cv::Vec3b pixel = input[0].at<cv::Vec3b>(i, j);
@@ -117,7 +360,7 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             }
 
             // pixel-wise linear [FAILED] 
-            // auto input_pointer = (float *)interpreterCPU->get()->subgraph(0)->tensor(0)->data.data;
+            // auto input_pointer = (float *)interpreter->subgraph(0)->tensor(0)->data.data;
             // for (int c=0;c<3;c++)
             // {
             //     for (int i=0; i<416; i++){
@@ -132,13 +375,13 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef catdog
             for (int i=0; i < 300; ++i) {
                 for(int j=0; j< 300; j++){
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*300 + j*3] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[0])/255.0;    
 
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[1])/255.0;
 
-                    interpreterCPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[2])/255.0;
                 }
             }
@@ -147,7 +390,7 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
                 #ifdef quantize
                 for (int i=0; i<Image_x; i++){
                     for (int j=0; j<Image_y; j++){
-                        interpreterCPU->get()->typed_input_tensor<int8_t>(0)[i*28 + j] = 100;
+                        interpreter->typed_input_tensor<int8_t>(0)[i*28 + j] = 100;
                         //static_cast<int8_t>((float)input[k].at<uchar>(i, j)/255.0);          
                     }
                 } 
@@ -156,7 +399,7 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
                 #ifndef quantize
                 for (int i=0; i<Image_x; i++){
                     for (int j=0; j<Image_y; j++){
-                        interpreterCPU->get()->typed_input_tensor<float>(0)[i*28 + j] = \
+                        interpreter->typed_input_tensor<float>(0)[i*28 + j] = \
                         ((float)input[k].at<uchar>(i, j)/255.0);          
                     }
                 } 
@@ -164,9 +407,10 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #endif
             // Run inference
             clock_gettime(CLOCK_MONOTONIC, &begin);
-            if(interpreterCPU->get()->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
+            if(interpreter->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
                                                 Ucontroller, qSharedData) 
                                             != kTfLiteOk){
+                UnpinInterpreter(interpreter);
                 return kTfLiteError;
             }
             clock_gettime(CLOCK_MONOTONIC, &end);
@@ -175,16 +419,16 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             //printf("time : %.6fs \n", temp_time);
             time += temp_time;
             #ifdef yolo
-                // interpreterCPU->get()->PrintOutputTensor(eType);            
-                // interpreterCPU->get()->PrintInputTensor(eType);
+                // interpreter->PrintOutputTensor(eType);            
+                // interpreter->PrintInputTensor(eType);
             #endif
             #ifdef MONITORING
             // for (int i =0; i<1001; i++){
-            //     float value = interpreterCPU->get()->typed_output_tensor<float>(1)[i];
+            //     float value = interpreter->typed_output_tensor<float>(1)[i];
             //     if(value > 0.5)
             //         printf("label : %d, pre : %0.5f \n", i, value);
             // }
-            // PrintInterpreterState(interpreterCPU->get());
+            // PrintInterpreterState(interpreter);
             std::cout << "\n";
             #endif
             if(!(*C_Counter % 1000))
@@ -194,13 +438,23 @@ TfLiteStatus UnitCPU::Invoke(UnitType eType, std::mutex& mtx_lock,
     time = time / (SEQ * OUT_SEQ);
     printf("Average elepsed time : %.6fs \n", time);
     std::cout << "\n" << "CPU All Jobs Done" << "\n";
-    interpreterCPU->get()->~Interpreter(); // Interpreter clear !!!!
+    // Frees the arenas, the interpreter itself is retired by its owner
+    // (destroying it here left a dangling unique_ptr).
+    interpreter->ReleaseNonPersistentMemory();
+    UnpinInterpreter(interpreter);
     return kTfLiteOk;
 }
 #endif
 
 Interpreter* UnitCPU::GetInterpreter(){return interpreterCPU->get();}
 
+std::unique_ptr<tflite::Interpreter>* UnitCPU::ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next){
+    std::unique_ptr<tflite::Interpreter>* old = interpreterCPU;
+    interpreterCPU = next;
+    return old;
+}
+
 void UnitCPU::SetInput(std::vector<cv::Mat> input_){
     input = input_;
 }
@@ -224,6 +478,12 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
                             std::condition_variable& Outcontroller,
                             std::queue<SharedContext*>* qSharedData,
                             int* C_Counter, int* G_Counter) {
+    if(HasExternalInput()){
+        std::cout << "Unit : input is bound to a frame ring \n";
+        return kTfLiteError;
+    }
+    // Pinned for the whole run, a SwapModel meanwhile waits for it.
+    Interpreter* interpreter = PinInterpreter();
     std::cout << "Starting GPU Job" << "\n";
     struct timespec begin, end;
     double time = 0;
@@ -234,13 +494,13 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef catdog
             for (int i=0; i < 300; ++i) {
                 for(int j=0; j< 300; j++){
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*300 + j*3] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[0])/255.0;    
 
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[1])/255.0;
 
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[2])/255.0;
                 }
             }
@@ -249,16 +509,17 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef mnist
             for (int i=0; i<Image_x; i++){
                 for (int j=0; j<Image_y; j++){
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*28 + j] = \
+                    interpreter->typed_input_tensor<float>(0)[i*28 + j] = \
                      ((float)input[k].at<uchar>(i, j)/255.0);          
                 }
             } 
             #endif
             // Run inference
             clock_gettime(CLOCK_MONOTONIC, &begin);
-            if(interpreterGPU->get()->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
+            if(interpreter->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
                                                 Ucontroller, qSharedData) 
                                             != kTfLiteOk){
+                UnpinInterpreter(interpreter);
                 return kTfLiteError;
             }
             clock_gettime(CLOCK_MONOTONIC, &end);
@@ -275,7 +536,7 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             //printf("time : %.6fs \n", temp_time);
             #ifdef MONITORING
             for (int i =0; i<10; i++){
-                printf("%0.5f", interpreterGPU->get()->typed_output_tensor<float>(0)[i] );
+                printf("%0.5f", interpreter->typed_output_tensor<float>(0)[i] );
                 std:: cout << " ";
             }
             std::cout << "\n";
@@ -290,6 +551,7 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
     printf("Average elepsed time : %.6fs \n", time);
     std::cout << "\n";
     std::cout << "GPU All Jobs done" << "\n";
+    UnpinInterpreter(interpreter);
     return kTfLiteOk;
 }
 #endif
@@ -311,6 +573,12 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
                             std::condition_variable& Outcontroller,
                             std::queue<SharedContext*>* qSharedData,
                             int* C_Counter, int* G_Counter) {
+    if(HasExternalInput()){
+        std::cout << "Unit : input is bound to a frame ring \n";
+        return kTfLiteError;
+    }
+    // Pinned for the whole run, a SwapModel meanwhile waits for it.
+    Interpreter* interpreter = PinInterpreter();
     std::cout << "Starting GPU Job" << "\n";
     double time = 0;
     struct timespec begin, end;
@@ -320,40 +588,40 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             //std::cout << "GPU " << *G_Counter << "\n";
             // for (int i=0; i<SSD_size; i++){
             //     for (int j=0; j<SSD_size; j++){
-            //             interpreterGPU->get()->typed_input_tensor<float>(0)[i*SSD_size + j*3] = \
+            //             interpreter->typed_input_tensor<float>(0)[i*SSD_size + j*3] = \
             //             ((float)input[0].at<cv::Vec3b>(i, j)[0])/255.0;
-            //             interpreterGPU->get()->typed_input_tensor<float>(0)[i*SSD_size + j*3+1] = \
+            //             interpreter->typed_input_tensor<float>(0)[i*SSD_size + j*3+1] = \
             //             ((float)input[0].at<cv::Vec3b>(i, j)[1])/255.0;
-            //             interpreterGPU->get()->typed_input_tensor<float>(0)[i*SSD_size + j*3+2] = \
+            //             interpreter->typed_input_tensor<float>(0)[i*SSD_size + j*3+2] = \
             //             ((float)input[0].at<cv::Vec3b>(i, j)[2])/255.0;
             //     }
             // } 
             #ifdef yolo  // same code as catdog //HOON
             for (int i=0; i<416; i++){
                 for (int j=0; j<416; j++){
-                        interpreterGPU->get()->typed_input_tensor<float>(0)[i*416 + j*3] = \
+                        interpreter->typed_input_tensor<float>(0)[i*416 + j*3] = \
                         ((float)input[0].at<cv::Vec3b>(i, j)[0])/255.0;
-                        interpreterGPU->get()->typed_input_tensor<float>(0)[i*416 + j*3+1] = \
+                        interpreter->typed_input_tensor<float>(0)[i*416 + j*3+1] = \
                         ((float)input[0].at<cv::Vec3b>(i, j)[1])/255.0;
-                        interpreterGPU->get()->typed_input_tensor<float>(0)[i*416 + j*3+2] = \
+                        interpreter->typed_input_tensor<float>(0)[i*416 + j*3+2] = \
                         ((float)input[0].at<cv::Vec3b>(i, j)[2])/255.0;
                         
                 }
             } 
-            // auto *input_pointer = interpreterGPU->get()->typed_input_tensor<float>(0);
+            // auto *input_pointer = interpreter->typed_input_tensor<float>(0);
             // memcpy(input_pointer, input[0].data, input[0].total() * input[0].elemSize());
             #endif
 
             #ifdef catdog
             for (int i=0; i < 300; ++i) {
                 for(int j=0; j < 300; j++){
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*300 + j*3] = \   //image size : 300*300
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3] = \   //image size : 300*300
                      ((float)input[0].at<cv::Vec3b>(i, j)[0])/255.0;    
 
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \  // cause of RGB
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 1] = \  // cause of RGB
                      ((float)input[0].at<cv::Vec3b>(i, j)[1])/255.0;
 
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
+                    interpreter->typed_input_tensor<float>(0)[i*300 + j*3 + 2] = \
                      ((float)input[0].at<cv::Vec3b>(i, j)[2])/255.0;
                 }
             }
@@ -362,7 +630,7 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef mnist
             for (int i=0; i<Image_x; i++){
                 for (int j=0; j<Image_y; j++){
-                    interpreterGPU->get()->typed_input_tensor<float>(0)[i*28 + j] = \
+                    interpreter->typed_input_tensor<float>(0)[i*28 + j] = \
                      ((float)input[k].at<uchar>(i, j)/255.0);          // HOON input[0]
                 }
             } 
@@ -371,9 +639,10 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             // Run inference
             clock_gettime(CLOCK_MONOTONIC, &begin);
             // HOON : add extra parameter to test delegation optimizing? TODO
-            if(interpreterGPU->get()->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
+            if(interpreter->Invoke(eType, mtx_lock, mtx_lock_, mtx_lock_debug,
                                                 Ucontroller, qSharedData) 
                                             != kTfLiteOk){
+                UnpinInterpreter(interpreter);
                 return kTfLiteError;
             }
             clock_gettime(CLOCK_MONOTONIC, &end);
@@ -385,23 +654,23 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             #ifdef MONITORING
             #ifdef yolo
                 for (int i =0; i<1000; i++){
-                    float value = interpreterGPU->get()->typed_output_tensor<float>(0)[i];
+                    float value = interpreter->typed_output_tensor<float>(0)[i];
                     printf("label : %d, pre : %0.5f \n", i, value);
                     //if(value > 0.5)
                     //    printf("label : %d, pre : %0.5f \n", i, value);
                 }
-                //interpreterGPU->get()->PrintOutputTensor(eType);
+                //interpreter->PrintOutputTensor(eType);
             #endif
             #ifdef mnist
                 // for (int i =0; i<10; i++){
-                //     float value = interpreterGPU->get()->typed_output_tensor_final<float>(0)[i];
+                //     float value = interpreter->typed_output_tensor_final<float>(0)[i];
                 //     printf("label : %d, pre : %0.5f \n", i, value);
                 //     if(value > 0.5)
                 //         printf("label : %d, pre : %0.5f \n", i, value);
                 // }
-                interpreterGPU->get()->PrintOutputTensor(eType);
+                interpreter->PrintOutputTensor(eType);
             #endif
-            //PrintInterpreterState(interpreterGPU->get());
+            //PrintInterpreterState(interpreter);
             std::cout << "\n";
             #endif
             //std::cout << *G_Counter << "\n";
@@ -412,7 +681,7 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
             // <<<<<<<<<<<<<<<<<<<<<<<<<< HOON : TODO >>>>>>>>>>>>>>>>>>>>>>>>>>>>
             float max  = 0;
             for (int i =0; i<10; i++){
-                float value = interpreterGPU->get()->typed_output_tensor_final<float>(0)[i];
+                float value = interpreter->typed_output_tensor_final<float>(0)[i];
                 if (value > max){
                     max = value;
                 }
@@ -436,7 +705,10 @@ TfLiteStatus UnitGPU::Invoke(UnitType eType, std::mutex& mtx_lock,
     //
     if(print_flag) PrintTest(b_delegation_optimizer);
     //interpreterGPU memory delete
-    interpreterGPU->get()->~Interpreter(); // interpreter clear
+    // Frees the arenas, the interpreter itself is retired by its owner
+    // (destroying it here left a dangling unique_ptr).
+    interpreter->ReleaseNonPersistentMemory();
+    UnpinInterpreter(interpreter);
     return kTfLiteOk;
 }
 #endif
@@ -461,6 +733,13 @@ void UnitGPU::PrintTest(std::vector<double> b_delegation_optimizer){
 
 Interpreter* UnitGPU::GetInterpreter(){return interpreterGPU->get();}
 
+std::unique_ptr<tflite::Interpreter>* UnitGPU::ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next){
+    std::unique_ptr<tflite::Interpreter>* old = interpreterGPU;
+    interpreterGPU = next;
+    return old;
+}
+
 void UnitGPU::SetInput(std::vector<cv::Mat> input_){
     input = input_;
 }
@@ -14,9 +14,13 @@
 #include "tensorflow/lite/optional_debug_tools.h"
 #include "tensorflow/lite/delegates/gpu/delegate.h"
 #include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/unit_workload.h"
 #include "mutex"
 #include "thread"
 #include "future"
+#include <deque>
+#include <map>
+#include <atomic>
 
 
 #define Image_x 28
@@ -54,9 +58,72 @@ namespace tflite{
 
 class UnitHandler; //Forward declare of UnitHandler since UnitHander Uses Unit
 
+/// Called on the unit's worker thread right after an async invoke finished.
+/// Output tensors of the interpreter stay valid until the callback returns.
+typedef std::function<void(TfLiteStatus, Interpreter*)> InvokeCallback;
+
+/// Converts a CV_8U frame to the layout of an NHWC input tensor and writes
+/// it to batch slot 'slot' (resize if needed, float /255 or quantized with
+/// the tensor's params). An empty frame zero fills the slot.
+TfLiteStatus CopyFrameToInputTensor(TfLiteTensor* input, int slot,
+                                    const cv::Mat& frame);
+
 class Unit 
 {   
     public:
+        /*
+        Asynchronous invoke
+            InvokeAsync() only queues the job and returns, so the caller can
+            preprocess frame N+1 while the unit's worker thread runs frame N
+            and the callback of frame N-1 does its postprocessing.
+            The worker owns the mutex/condvar/queue Interpreter::Invoke needs,
+            so the caller does not have to keep them alive.
+            At most max_pending jobs are queued, InvokeAsync() blocks beyond.
+        */
+        TfLiteStatus StartAsync(int max_pending = 2);
+        void StopAsync();
+        std::future<TfLiteStatus> InvokeAsync(std::vector<cv::Mat> inputs,
+                                              InvokeCallback callback = nullptr);
+
+        /// Fills the inputs and runs one invoke on the calling thread with the
+        /// unit's own sync objects. Do not mix with pending async jobs.
+        TfLiteStatus InvokeOnce(std::vector<cv::Mat> inputs);
+
+        /*
+        Hot swap
+            Invokes pin the interpreter serving when they start and run on
+            it to the end (fill, invoke, reading outputs). SwapInterpreter()
+            makes the new interpreter serve every invoke starting after it,
+            waits until the pins on the old one drained and retires it.
+            The legacy Invoke() loops pin once for their whole run.
+            Raw GetInterpreter() pointers are not pinned, they are only
+            valid until the next swap.
+        */
+        Interpreter* PinInterpreter();
+        void UnpinInterpreter(Interpreter* interpreter);
+
+        /// InvokeOnce() on an interpreter the caller pinned.
+        TfLiteStatus InvokeOn(Interpreter* interpreter, std::vector<cv::Mat> inputs);
+
+        /// Input tensors bound to shm frame slots (UnitHandler::
+        /// InvokeFromFrameRing). For good : frame inputs (InvokeOnce(),
+        /// InvokeAsync(), legacy Invoke(), UnitPool) are refused from then on,
+        /// they would be written into the producer's ring.
+        void SetExternalInput();
+        bool HasExternalInput();
+
+        /// Takes ownership of 'next' (built, allocated and warmed). Blocks
+        /// until the old interpreter is retired.
+        TfLiteStatus SwapInterpreter(std::unique_ptr<tflite::Interpreter>* next);
+
+        /// Swaps done on this unit
+        uint64_t GetGeneration();
+
+        /// Records every invoke of the unit from now on (see
+        /// WorkloadRecorder), nullptr stops. The recorder must outlive the
+        /// invokes running meanwhile.
+        void SetRecorder(WorkloadRecorder* recorder_);
+
         virtual Interpreter* GetInterpreter() = 0;
         virtual TfLiteStatus Invoke(UnitType eType, std::mutex& mtx_lock,
                                     std::mutex& mtx_lock_,
@@ -75,6 +142,42 @@ class Unit
         std::unique_ptr<tflite::Interpreter> interpreter;
         std::string name;
         int partition;
+
+    protected:
+        /// Installs 'next' as the unit's interpreter, returns the old one.
+        virtual std::unique_ptr<tflite::Interpreter>* ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next) = 0;
+
+        /// Pinned invokes per interpreter (hot swap)
+        std::map<Interpreter*, int> pins;
+        std::mutex mtx_swap;
+        std::condition_variable Scontroller;
+        uint64_t generation = 0;
+
+        std::atomic<WorkloadRecorder*> recorder{nullptr};
+        std::atomic<bool> external_input{false};
+
+        struct AsyncJob{
+            std::vector<cv::Mat> inputs;
+            InvokeCallback callback;
+            std::promise<TfLiteStatus> done;
+        };
+        void AsyncWorker();
+
+        std::deque<AsyncJob*> qAsyncJob;
+        std::mutex mtx_async;
+        std::condition_variable Acontroller;
+        std::thread asyncThread;
+        bool async_stop = false;
+        bool async_started = false;
+        int async_max_pending = 2;
+
+        /// Sync objects handed to Interpreter::Invoke by the async worker
+        std::mutex mtx_invoke;
+        std::mutex mtx_invoke_;
+        std::mutex mtx_invoke_debug;
+        std::condition_variable Icontroller;
+        std::queue<SharedContext*> qInvokeShared;
 };
 
 //Unit Class for CPU
@@ -83,7 +186,7 @@ class UnitCPU : public Unit
     public:
         UnitCPU();
         UnitCPU(UnitType eType_, std::unique_ptr<tflite::Interpreter>* interpreter);
-        ~UnitCPU() {};
+        ~UnitCPU() { StopAsync(); };
         TfLiteStatus Invoke(UnitType eType, std::mutex& mtx_lock,
                                     std::mutex& mtx_lock_,
                                     std::mutex& mtx_lock_timing,
@@ -102,6 +205,10 @@ class UnitCPU : public Unit
         std::unique_ptr<tflite::Interpreter>* interpreterCPU;
         std::string name;
         int partition;
+
+    protected:
+        std::unique_ptr<tflite::Interpreter>* ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next);
 };
 
 //Unit Class for GPU
@@ -110,7 +217,7 @@ class UnitGPU : public Unit
     public:
         UnitGPU();
         UnitGPU(UnitType eType_, std::unique_ptr<tflite::Interpreter>* interpreter);
-        ~UnitGPU() {};
+        ~UnitGPU() { StopAsync(); };
         TfLiteStatus Invoke(UnitType eType, std::mutex& mtx_lock,
                                     std::mutex& mtx_lock_,
                                     std::mutex& mtx_lock_timing,
@@ -129,6 +236,10 @@ class UnitGPU : public Unit
         std::unique_ptr<tflite::Interpreter>* interpreterGPU;
         std::string name;
         int partition;
+
+    protected:
+        std::unique_ptr<tflite::Interpreter>* ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next);
 };
 
 } // End of namespace tflite
\ No newline at end of file
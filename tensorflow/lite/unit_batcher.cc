@@ -0,0 +1,242 @@
+#include "unit_batcher.h"
+#include "algorithm"
+#include <stdexcept>
+#include "tensorflow/lite/kernels/kernel_util.h"
+
+namespace tflite
+{
+
+UnitBatcher::UnitBatcher(tflite::InterpreterBuilder* builder, int max_batch_,
+                         int max_delay_us_, int num_threads_)
+                        : builder_(builder), max_batch(max_batch_),
+                          max_delay_us(max_delay_us_), num_threads(num_threads_)
+{
+    if(max_batch < 1)
+        max_batch = 1;
+    if(max_delay_us < 0)
+        max_delay_us = 0;
+}
+
+UnitBatcher::~UnitBatcher(){
+    Stop();
+}
+
+TfLiteStatus UnitBatcher::Start(){
+    if(started)
+        return kTfLiteOk;
+    if(builder_ == nullptr){
+        PrintMsg("InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    // The builder is not thread safe, so every bucket is built here and
+    // the worker only looks them up.
+    if(WarmUp() != kTfLiteOk){
+        PrintMsg("Bucket Interpreter build ERROR");
+        return kTfLiteError;
+    }
+    stop_flag = false;
+    worker = std::thread(&UnitBatcher::Worker, this);
+    started = true;
+    PrintMsg("Batching Worker Started");
+    return kTfLiteOk;
+}
+
+void UnitBatcher::Stop(){
+    if(!started)
+        return;
+    {
+        std::unique_lock<std::mutex> lock(mtx_queue);
+        stop_flag = true;
+    }
+    Bcontroller.notify_all();
+    worker.join();
+    started = false;
+    std::cout << "UnitBatcher : " << frame_count << " frames in "
+              << invoke_count << " invokes \n";
+}
+
+TfLiteStatus UnitBatcher::WarmUp(){
+    if(started)
+        return kTfLiteOk;
+    // Batch 1 first, it tells us the model's input shape.
+    for(int bucket = 1; bucket <= GetBucket(max_batch); bucket *= 2){
+        if(GetInterpreter(bucket) == nullptr)
+            return kTfLiteError;
+    }
+    return kTfLiteOk;
+}
+
+std::future<BatchOutput> UnitBatcher::Submit(cv::Mat frame){
+    BatchRequest* request = new BatchRequest;
+    request->frame = frame;
+    request->enqueued = std::chrono::steady_clock::now();
+    std::future<BatchOutput> future = request->result.get_future();
+    {
+        std::unique_lock<std::mutex> lock(mtx_queue);
+        qRequest.push_back(request);
+    }
+    Bcontroller.notify_one();
+    return future;
+}
+
+int UnitBatcher::GetBucket(int batch_size){
+    int bucket = 1;
+    while(bucket < batch_size)
+        bucket *= 2;
+    return bucket;
+}
+
+Interpreter* UnitBatcher::GetInterpreter(int batch_size){
+    auto cached = interpreters.find(batch_size);
+    if(cached != interpreters.end())
+        return cached->second.get();
+
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    if((*builder_)(&interpreter, num_threads) != kTfLiteOk || interpreter == nullptr){
+        PrintMsg("Interpreter build ERROR");
+        return nullptr;
+    }
+    int input_idx = interpreter->inputs()[0];
+    if(input_dims.empty()){
+        TfLiteIntArray* dims = interpreter->tensor(input_idx)->dims;
+        input_dims.assign(dims->data, dims->data + dims->size);
+    }
+    std::vector<int> batch_dims = input_dims;
+    batch_dims[0] = batch_size;
+    if(interpreter->ResizeInputTensor(input_idx, batch_dims) != kTfLiteOk){
+        PrintMsg("ResizeInputTensor ERROR");
+        return nullptr;
+    }
+    if(interpreter->AllocateTensors() != kTfLiteOk){
+        PrintMsg("AllocateTensors ERROR");
+        return nullptr;
+    }
+    std::cout << "UnitBatcher : Interpreter for batch " << batch_size << " ready \n";
+    Interpreter* raw = interpreter.get();
+    interpreters[batch_size] = std::move(interpreter);
+    return raw;
+}
+
+void UnitBatcher::Worker(){
+    std::vector<BatchRequest*> batch;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mtx_queue);
+            Bcontroller.wait(lock, [this]{ return stop_flag || !qRequest.empty(); });
+            if(qRequest.empty() && stop_flag)
+                return;
+            // Oldest frame decides how long the batch may wait. It may have
+            // been queued while the previous batch ran, so count from then.
+            auto deadline = qRequest.front()->enqueued +
+                            std::chrono::microseconds(max_delay_us);
+            Bcontroller.wait_until(lock, deadline, [this]{
+                return stop_flag || qRequest.size() >= (size_t)max_batch;
+            });
+            int batch_size = std::min((int)qRequest.size(), max_batch);
+            for(int i=0; i<batch_size; ++i){
+                batch.push_back(qRequest.front());
+                qRequest.pop_front();
+            }
+        }
+        RunBatch(batch);
+        for(size_t i=0; i<batch.size(); ++i)
+            delete batch[i];
+        batch.clear();
+    }
+}
+
+void UnitBatcher::RunBatch(std::vector<BatchRequest*>& batch){
+    int bucket = GetBucket(batch.size());
+    // Lookup only, Start() built every bucket.
+    auto cached = interpreters.find(bucket);
+    Interpreter* interpreter = cached != interpreters.end() ?
+                               cached->second.get() : nullptr;
+    auto fail = [&](const char* msg){
+        PrintMsg(msg);
+        for(size_t i=0; i<batch.size(); ++i){
+            batch[i]->result.set_exception(std::make_exception_ptr(
+                                            std::runtime_error(msg)));
+        }
+    };
+    if(interpreter == nullptr){
+        fail("No Interpreter for batch");
+        return;
+    }
+    if(interpreter->AcquireNonPersistentMemory() != kTfLiteOk){
+        fail("Acquire memory ERROR");
+        return;
+    }
+    for(size_t slot=0; slot<(size_t)bucket; ++slot){
+        cv::Mat empty;
+        cv::Mat& frame = slot < batch.size() ? batch[slot]->frame : empty;
+        if(FillInput(interpreter, (int)slot, frame) != kTfLiteOk){
+            fail("Input fill ERROR");
+            return;
+        }
+    }
+    if(interpreter->Invoke() != kTfLiteOk){
+        fail("Batched Invoke ERROR");
+        return;
+    }
+    if(ScatterOutputs(interpreter, bucket, batch) != kTfLiteOk){
+        fail("Output not batched");
+        return;
+    }
+    invoke_count++;
+    frame_count += batch.size();
+}
+
+TfLiteStatus UnitBatcher::FillInput(Interpreter* interpreter, int slot,
+                                    cv::Mat& frame){
+    TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[0]);
+    return CopyFrameToInputTensor(input, slot, frame);
+}
+
+TfLiteStatus UnitBatcher::ScatterOutputs(Interpreter* interpreter, int bucket,
+                                         std::vector<BatchRequest*>& batch){
+    std::vector<BatchOutput> outputs(batch.size());
+    for(int output_idx : interpreter->outputs()){
+        TfLiteTensor* output = interpreter->tensor(output_idx);
+        // An output reduced over the batch (or not carrying it) can not be
+        // split back into per frame results.
+        if(output->dims->size < 1 || output->dims->data[0] != bucket){
+            std::cout << "UnitBatcher : output " << output_idx
+                      << " is not batched by " << bucket << "\n";
+            return kTfLiteError;
+        }
+        const int per_slot = NumElements(output) / output->dims->data[0];
+        float scale = output->params.scale;
+        int zero_point = output->params.zero_point;
+        for(size_t slot=0; slot<batch.size(); ++slot){
+            std::vector<float> values(per_slot);
+            const int offset = slot * per_slot;
+            for(int i=0; i<per_slot; ++i){
+                switch(output->type){
+                    case kTfLiteFloat32:
+                        values[i] = output->data.f[offset + i];
+                        break;
+                    case kTfLiteUInt8:
+                        values[i] = scale * ((int)output->data.uint8[offset + i] - zero_point);
+                        break;
+                    case kTfLiteInt8:
+                        values[i] = scale * ((int)output->data.int8[offset + i] - zero_point);
+                        break;
+                    default:
+                        values[i] = 0;
+                        break;
+                }
+            }
+            outputs[slot].push_back(std::move(values));
+        }
+    }
+    for(size_t slot=0; slot<batch.size(); ++slot)
+        batch[slot]->result.set_value(std::move(outputs[slot]));
+    return kTfLiteOk;
+}
+
+void UnitBatcher::PrintMsg(const char* msg){
+    std::cout << "UnitBatcher : \"" << msg << "\"\n";
+    return;
+}
+
+} // End of namespace tflite
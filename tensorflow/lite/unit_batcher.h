@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include "condition_variable"
+#include "mutex"
+#include "thread"
+#include "future"
+#include "opencv2/opencv.hpp"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/interpreter_builder.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/unit.h"
+
+/*
+UnitBatcher : Dynamic request batching front-end for the CPU unit
+
+    Frames are submitted one by one with Submit() and collected by a worker
+    thread until either max_batch frames are queued or max_delay_us has
+    passed since the oldest queued frame arrived.
+    The collected frames are run as ONE Invoke on an interpreter whose input
+    tensor has been resized to the batch size, and every output is scattered
+    back to the future of the request it belongs to.
+
+    Batch sizes are rounded up to a power of two (1, 2, 4, .. max_batch) and
+    every bucket owns its own, already allocated interpreter, all built by
+    Start(). So switching batch size never touches ResizeInputTensor/
+    AllocateTensors again (no arena realloc churn).
+    Padded slots in a bucket are zero filled and their outputs are dropped.
+
+    Usage
+        UnitBatcher batcher(builder, 8, 3000);
+        batcher.Start();
+        std::future<BatchOutput> out = batcher.Submit(frame);
+        out.get()[0] -> first output tensor of this frame (float)
+*/
+
+namespace tflite{
+
+/// Outputs of a single request. One float vector per model output tensor.
+typedef std::vector<std::vector<float>> BatchOutput;
+
+class UnitBatcher
+{
+    public:
+        UnitBatcher(tflite::InterpreterBuilder* builder, int max_batch,
+                    int max_delay_us, int num_threads = -1);
+        ~UnitBatcher();
+
+        /// Builds every bucket's interpreter (see WarmUp()) and launches the
+        /// worker thread. The builder is only used from here on this thread.
+        TfLiteStatus Start();
+
+        /// Drains the queue and joins the worker thread.
+        void Stop();
+
+        /// Queue a frame. The future is fulfilled after the batch containing
+        /// this frame has been invoked (or broken if the invoke failed).
+        std::future<BatchOutput> Submit(cv::Mat frame);
+
+        /// Builds and allocates every batch bucket up front so the first
+        /// large batch does not pay for the interpreter creation. Done by
+        /// Start() anyway, a no-op once started.
+        TfLiteStatus WarmUp();
+
+        int GetMaxBatch() { return max_batch; }
+        int GetInvokeCount() { return invoke_count; }
+        int GetFrameCount() { return frame_count; }
+
+    private:
+        struct BatchRequest{
+            cv::Mat frame;
+            std::promise<BatchOutput> result;
+            /// Submit() time, the oldest one bounds the batching delay
+            std::chrono::steady_clock::time_point enqueued;
+        };
+
+        void Worker();
+
+        /// Runs one batch. Every request's promise is fulfilled here.
+        void RunBatch(std::vector<BatchRequest*>& batch);
+
+        /// Returns the (cached) interpreter for the given bucket size. Builds
+        /// it, so only called before the worker runs.
+        Interpreter* GetInterpreter(int batch_size);
+
+        /// Smallest power-of-two bucket which holds batch_size frames.
+        int GetBucket(int batch_size);
+
+        TfLiteStatus FillInput(Interpreter* interpreter, int slot, cv::Mat& frame);
+        /// kTfLiteError (no promise touched) if an output's batch dim is not
+        /// the bucket.
+        TfLiteStatus ScatterOutputs(Interpreter* interpreter, int bucket,
+                            std::vector<BatchRequest*>& batch);
+
+        void PrintMsg(const char* msg);
+
+        tflite::InterpreterBuilder* builder_;
+
+        /// Interpreters already resized & allocated, keyed by bucket size
+        std::map<int, std::unique_ptr<tflite::Interpreter>> interpreters;
+
+        /// Original input shape of the model (batch dim included)
+        std::vector<int> input_dims;
+
+        std::deque<BatchRequest*> qRequest;
+        std::mutex mtx_queue;
+        std::condition_variable Bcontroller;
+        std::thread worker;
+        bool stop_flag = false;
+        bool started = false;
+
+        int max_batch;
+        int max_delay_us;
+        int num_threads;
+
+        int invoke_count = 0;
+        int frame_count = 0;
+};
+
+} // End of namespace tflite
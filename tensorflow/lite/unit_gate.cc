@@ -0,0 +1,166 @@
+#include "unit_gate.h"
+#include "algorithm"
+#include "cmath"
+
+namespace tflite
+{
+
+ChangeGate::ChangeGate(ChangeGateOptions options_) : options(options_) {
+    options.diff_width = std::max(1, options.diff_width);
+    options.diff_height = std::max(1, options.diff_height);
+    options.cell_size = std::max(1, options.cell_size);
+}
+
+void ChangeGate::Reset(){
+    std::unique_lock<std::mutex> lock(mtx_gate);
+    reference.release();
+    last_detections.clear();
+    frames_since_full = 0;
+}
+
+GateDecision ChangeGate::Compare(const cv::Mat& frame, cv::Mat* small,
+                                 std::vector<cv::Rect>* regions,
+                                 std::vector<cv::Rect>* small_regions){
+    // Shrink first, the color conversion is then almost free.
+    cv::Mat resized;
+    cv::resize(frame, resized, cv::Size(options.diff_width, options.diff_height),
+               0, 0, cv::INTER_AREA);
+    if(resized.channels() == 3)
+        cv::cvtColor(resized, *small, cv::COLOR_BGR2GRAY);
+    else if(resized.channels() == 4)
+        cv::cvtColor(resized, *small, cv::COLOR_BGRA2GRAY);
+    else
+        *small = resized;
+
+    if(reference.empty())
+        return GateDecision::FULL;
+    if(options.refresh_interval > 0 && frames_since_full + 1 >= options.refresh_interval)
+        return GateDecision::FULL;
+
+    cv::Mat diff, mask;
+    cv::absdiff(*small, reference, diff);
+    cv::threshold(diff, mask, options.pixel_threshold, 255, cv::THRESH_BINARY);
+    const float changed = (float)cv::countNonZero(mask) / mask.total();
+    if(changed <= options.reuse_below)
+        return GateDecision::REUSE;
+    if(changed > options.full_above)
+        return GateDecision::FULL;
+
+    // Any changed pixel marks its cell, neighbouring cells join the region.
+    const int cell = options.cell_size;
+    cv::Mat cells;
+    cv::resize(mask, cells,
+               cv::Size((mask.cols + cell - 1) / cell, (mask.rows + cell - 1) / cell),
+               0, 0, cv::INTER_AREA);
+    cv::threshold(cells, cells, 0, 255, cv::THRESH_BINARY);
+    cv::dilate(cells, cells, cv::Mat());
+    cv::Mat labels, stats, centroids;
+    int count = cv::connectedComponentsWithStats(cells, labels, stats, centroids, 8);
+    const float scale_x = (float)frame.cols / mask.cols;
+    const float scale_y = (float)frame.rows / mask.rows;
+    const cv::Rect small_rect(0, 0, mask.cols, mask.rows);
+    for(int label=1; label<count; ++label){ // 0 is the background
+        cv::Rect in_small(stats.at<int>(label, cv::CC_STAT_LEFT) * cell,
+                          stats.at<int>(label, cv::CC_STAT_TOP) * cell,
+                          stats.at<int>(label, cv::CC_STAT_WIDTH) * cell,
+                          stats.at<int>(label, cv::CC_STAT_HEIGHT) * cell);
+        in_small &= small_rect;
+        small_regions->push_back(in_small);
+        regions->push_back(cv::Rect((int)std::floor(in_small.x * scale_x),
+                                    (int)std::floor(in_small.y * scale_y),
+                                    (int)std::ceil(in_small.width * scale_x),
+                                    (int)std::ceil(in_small.height * scale_y)));
+    }
+    return regions->empty() ? GateDecision::REUSE : GateDecision::REGIONS;
+}
+
+void ChangeGate::FitRegions(UnitTiler* tiler, cv::Size frame_size,
+                            std::vector<cv::Rect>* regions){
+    const cv::Size tile = tiler->GetTileSize();
+    const cv::Rect frame_rect(0, 0, frame_size.width, frame_size.height);
+    std::vector<cv::Rect> fitted;
+    for(size_t i=0; i<regions->size(); ++i){
+        const cv::Rect& region = (*regions)[i];
+        int width = std::min(frame_size.width, std::max(region.width, tile.width));
+        int height = std::min(frame_size.height, std::max(region.height, tile.height));
+        int x = region.x + region.width / 2 - width / 2;
+        int y = region.y + region.height / 2 - height / 2;
+        x = std::max(0, std::min(x, frame_size.width - width));
+        y = std::max(0, std::min(y, frame_size.height - height));
+        const cv::Rect grown = cv::Rect(x, y, width, height) & frame_rect;
+        if(grown.width <= tile.width && grown.height <= tile.height){
+            fitted.push_back(grown);
+            continue;
+        }
+        // Larger than a tile : one crop would be shrunk to the input size.
+        std::vector<cv::Rect> tiles = tiler->MakeTiles(grown.size());
+        for(size_t t=0; t<tiles.size(); ++t){
+            // Skip the optional whole area tile, that is the crop avoided here.
+            if(tiles.size() > 1 && tiles[t].size() == grown.size())
+                continue;
+            fitted.push_back(tiles[t] + grown.tl());
+        }
+    }
+    regions->swap(fitted);
+}
+
+TfLiteStatus ChangeGate::Detect(UnitTiler* tiler, const cv::Mat& frame,
+                                std::vector<TileDetection>* detections,
+                                GateDecision* decision){
+    std::unique_lock<std::mutex> lock(mtx_gate);
+    cv::Mat small;
+    std::vector<cv::Rect> regions, small_regions;
+    GateDecision gate = Compare(frame, &small, &regions, &small_regions);
+    if(decision != nullptr)
+        *decision = gate;
+
+    switch(gate){
+        case GateDecision::REUSE:
+            *detections = last_detections;
+            frames_since_full++;
+            reuse_count++;
+            return kTfLiteOk;
+
+        case GateDecision::FULL:
+            if(tiler->Detect(frame, detections) != kTfLiteOk)
+                return kTfLiteError;
+            reference = small;
+            last_detections = *detections;
+            frames_since_full = 0;
+            full_count++;
+            return kTfLiteOk;
+
+        case GateDecision::REGIONS:{
+            FitRegions(tiler, frame.size(), &regions);
+            std::vector<TileDetection> fresh;
+            if(tiler->DetectRegions(frame, regions, &fresh) != kTfLiteOk)
+                return kTfLiteError;
+            // Old detections centered in a changed region are replaced.
+            std::vector<TileDetection> merged;
+            for(size_t i=0; i<last_detections.size(); ++i){
+                const TileDetection& old = last_detections[i];
+                cv::Point center((int)((old.xmin + old.xmax) / 2),
+                                 (int)((old.ymin + old.ymax) / 2));
+                bool changed = false;
+                for(size_t r=0; r<regions.size() && !changed; ++r)
+                    changed = regions[r].contains(center);
+                if(!changed)
+                    merged.push_back(old);
+            }
+            merged.insert(merged.end(), fresh.begin(), fresh.end());
+            MergeTileDetections(&merged, options.iou_threshold, true);
+            // Only the regions that ran move the reference, so slow changes
+            // elsewhere still add up against the old one.
+            for(size_t r=0; r<small_regions.size(); ++r)
+                small(small_regions[r]).copyTo(reference(small_regions[r]));
+            last_detections = merged;
+            *detections = merged;
+            frames_since_full++;
+            region_count++;
+            return kTfLiteOk;
+        }
+    }
+    return kTfLiteError;
+}
+
+} // End of namespace tflite
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include "mutex"
+#include "opencv2/opencv.hpp"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/unit_tiler.h"
+
+/*
+ChangeGate : Change gated inference for (mostly) static cameras
+
+    Every frame is downsampled to a small grayscale image and diffed against
+    the image of the last frame inference ran on (cv::absdiff, vectorized by
+    OpenCV). Depending on how much of it changed, the gate
+
+        REUSE   : returns the last detections without any invoke
+        REGIONS : runs only the changed regions through the tiler, keeps the
+                  last detections everywhere else
+        FULL    : runs the whole frame through the tiler
+
+    A FULL run is forced every refresh_interval frames so detections can not
+    drift away from the scene for ever.
+    One gate per stream (thresholds are per stream), a gate is thread safe.
+
+    Usage
+        ChangeGateOptions options;
+        options.refresh_interval = 50;
+        ChangeGate gate(options);
+        gate.Detect(tiler, frame, &detections);
+*/
+
+namespace tflite{
+
+enum class GateDecision{
+    REUSE,
+    REGIONS,
+    FULL
+};
+
+struct ChangeGateOptions{
+    /// Frames are compared at this size, in grayscale
+    int diff_width = 160;
+    int diff_height = 90;
+    /// A downsampled pixel changed if it moved by more than this
+    int pixel_threshold = 25;
+    /// Fraction of changed pixels up to which the last detections are reused
+    float reuse_below = 0.002;
+    /// Fraction of changed pixels above which the whole frame is run
+    float full_above = 0.3;
+    /// A FULL run at least every this many frames (0 : never forced)
+    int refresh_interval = 30;
+    /// Changed pixels are grouped into regions by cells of this many
+    /// downsampled pixels
+    int cell_size = 8;
+    /// Merging fresh region detections with the kept ones
+    float iou_threshold = 0.5;
+};
+
+class ChangeGate
+{
+    public:
+        ChangeGate(ChangeGateOptions options = ChangeGateOptions());
+
+        /// Detections of 'frame' in frame pixel coordinates, from the tiler
+        /// or reused as the gate decides. 'decision' (optional) receives how.
+        TfLiteStatus Detect(UnitTiler* tiler, const cv::Mat& frame,
+                            std::vector<TileDetection>* detections,
+                            GateDecision* decision = nullptr);
+
+        /// Forgets the reference frame, the next frame runs FULL.
+        void Reset();
+
+        int GetReuseCount() { return reuse_count; }
+        int GetRegionCount() { return region_count; }
+        int GetFullCount() { return full_count; }
+
+    private:
+        /// Downsamples 'frame', compares it with the reference and fills the
+        /// changed regions (frame coordinates) for REGIONS.
+        GateDecision Compare(const cv::Mat& frame, cv::Mat* small,
+                             std::vector<cv::Rect>* regions,
+                             std::vector<cv::Rect>* small_regions);
+
+        /// Grows every region to at least the tile size around its center,
+        /// so crops are not upscaled, and keeps it inside the frame. A region
+        /// still larger than a tile is cut into the tiler's overlapping tiles
+        /// (MakeTiles over the region), so crops are not downscaled either.
+        void FitRegions(UnitTiler* tiler, cv::Size frame_size,
+                        std::vector<cv::Rect>* regions);
+
+        ChangeGateOptions options;
+
+        std::mutex mtx_gate;
+
+        /// Downsampled frame the current detections belong to
+        cv::Mat reference;
+        std::vector<TileDetection> last_detections;
+        int frames_since_full = 0;
+
+        int reuse_count = 0;
+        int region_count = 0;
+        int full_count = 0;
+};
+
+} // End of namespace tflite
@@ -1,6 +1,6 @@
 #include "unit_handler.h"
-#include "kmcontext.h"
 #include <typeinfo>
+#include <stdexcept>
 //#define MULTITHREAD
 // #define GPUONLY
 #define CPUONLY
@@ -93,39 +93,30 @@ UnitHandler::UnitHandler(const char* OriginalModel, const char* QuanizedModel)
     qSharedData = new std::queue<SharedContext*>;
 }
 
-TfLiteStatus UnitHandler::CreateUnitCPU(UnitType eType,
-                                         std::vector<cv::Mat> input, int partitioning){
-    std::unique_ptr<tflite::Interpreter>* interpreter;
-    if(bUseTwoModel){
-        if(CPUBuilder_ ==nullptr){
-            PrintMsg("CPU InterpreterBuilder nullptr ERROR");
-            return kTfLiteError;
-        }
-        interpreter = new std::unique_ptr<tflite::Interpreter>;
-        (*CPUBuilder_)(interpreter, 4);
-    }
-    else{
-        if(builder_ == nullptr){
-            PrintMsg("InterpreterBuilder nullptr ERROR");
-            return kTfLiteError;
-        }
-        interpreter = new std::unique_ptr<tflite::Interpreter>;
-        (*builder_)(interpreter, 4);
+TfLiteStatus UnitHandler::BuildCPUInterpreter(UnitType eType,
+                                    tflite::InterpreterBuilder* builder,
+                                    std::unique_ptr<tflite::Interpreter>* interpreter){
+    if((*builder)(interpreter, 4) != kTfLiteOk || interpreter->get() == nullptr){
+        PrintMsg("CPU Interpreter build ERROR");
+        return kTfLiteError;
     }
     #ifdef MULTITHREAD
     // Below code targetting to "subgraph partitioning"
-    TFLITE_MINIMAL_CHECK(interpreter->get()->SetPartitioning(5, eType) == kTfLiteOk);  
+    if(interpreter->get()->SetPartitioning(5, eType) != kTfLiteOk){
+        PrintMsg("SetPartitioning ERROR");
+        return kTfLiteError;
+    }
     #endif 
-    TFLITE_MINIMAL_CHECK(interpreter != nullptr);
-    TFLITE_MINIMAL_CHECK(interpreter->get()->AllocateTensors() == kTfLiteOk);  // memory allocation
-    UnitCPU* temp;
-    temp = new UnitCPU(eType, std::move(interpreter));
-    temp->SetInput(input);
-    vUnitContainer.push_back(temp);
-    iUnitCount++;    
-    PrintMsg("Build CPU Interpreter");
+    if(interpreter->get()->AllocateTensors() != kTfLiteOk){  // memory allocation
+        PrintMsg("AllocateTensors ERROR");
+        return kTfLiteError;
+    }
     #ifdef MULTITHREAD
-    kmcontext.channelPartitioning("CONV_2D", 0.5); // MAIN : CPU channel-wise partitioning
+    // MAIN : CPU channel-wise partitioning, on this interpreter only
+    if(interpreter->get()->ChannelPartitioning("CONV_2D", 0.5) != kTfLiteOk){
+        PrintMsg("ChannelPartitioning ERROR");
+        return kTfLiteError;
+    }
     #endif
     #ifdef QUANTIZE
     if(interpreter->get()->QuantizeSubgraph() != kTfLiteOk){
@@ -133,6 +124,37 @@ TfLiteStatus UnitHandler::CreateUnitCPU(UnitType eType,
         return kTfLiteError;  
     }
     #endif
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::CreateUnitCPU(UnitType eType,
+                                         std::vector<cv::Mat> input, int partitioning){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    tflite::InterpreterBuilder* builder = bUseTwoModel ? CPUBuilder_ : builder_;
+    if(builder == nullptr){
+        PrintMsg(bUseTwoModel ? "CPU InterpreterBuilder nullptr ERROR"
+                              : "InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    std::unique_ptr<tflite::Interpreter>* interpreter =
+                                    new std::unique_ptr<tflite::Interpreter>;
+    if(BuildCPUInterpreter(eType, builder, interpreter) != kTfLiteOk){
+        delete interpreter;
+        return kTfLiteError;
+    }
+    UnitCPU* temp;
+    temp = new UnitCPU(eType, std::move(interpreter));
+    temp->SetInput(input);
+    vUnitContainer.push_back(temp);
+    UnitRecipe recipe;
+    recipe.kind = UnitRecipe::CPU;
+    recipe.eType = eType;
+    recipes_[temp] = recipe;
+    // Keeps a swapped model alive while the unit runs it.
+    unit_models_[temp] = cpu_builder_model_;
+    iUnitCount++;    
+    PrintMsg("Build CPU Interpreter");
+    PersistWeightCache();
     // std::cout << "[CPU INTERETER STATE] \n";
     // tflite::PrintInterpreterState(interpreter->get()); //
     return kTfLiteOk;
@@ -159,38 +181,32 @@ TfLiteStatus UnitHandler::CreateAndInvokeCPU(UnitType eType,
     return kTfLiteOk;
 }
 
-TfLiteStatus UnitHandler::CreateUnitGPU(UnitType eType,
-                                         std::vector<cv::Mat> input, int partitioning, int loop_num, int max_delegated_partition_num){
-    std::unique_ptr<tflite::Interpreter>* interpreter;
+TfLiteStatus UnitHandler::BuildGPUInterpreter(UnitType eType,
+                                    tflite::InterpreterBuilder* builder,
+                                    int loop_num, int max_delegated_partition_num,
+                                    std::unique_ptr<tflite::Interpreter>* interpreter){
+    TfLiteStatus built;
     if(bUseTwoModel){
-        if(GPUBuilder_ ==nullptr){
-            PrintMsg("GPU InterpreterBuilder nullptr ERROR");
-            return kTfLiteError;
-        }
-        interpreter = new std::unique_ptr<tflite::Interpreter>;
         // An experimental task to devide a model to multiple subgrpahs
         //interpreter->get()->SetMultipleSubgraphs(true);
-        (*GPUBuilder_)(interpreter, eType);
+        built = (*builder)(interpreter, eType);
     }
     else{
-        if(builder_ == nullptr){
-            PrintMsg("InterpreterBuilder nullptr ERROR");
-            return kTfLiteError;
-        }
-        interpreter = new std::unique_ptr<tflite::Interpreter>;
         //////////////////////////////////////////////////////////////////
         // An experimental task to devide a model to multiple subgrpahs //
         //////////////////////////////////////////////////////////////////
         //(*builder_)(interpreter, eType);  //HOON : later
 
         // No multiple subgraph modifying
-        (*builder_)(interpreter);
+        built = (*builder)(interpreter);
+    }
+    if(built != kTfLiteOk || interpreter->get() == nullptr){
+        PrintMsg("GPU Interpreter build ERROR");
+        return kTfLiteError;
     }
     std::cout << "#####################################" << "\n";
     std::cout << "# Base interpreter has been created #" << "\n";
     std::cout << "#####################################" << "\n";
-    TFLITE_MINIMAL_CHECK(interpreter != nullptr);
-    TfLiteDelegate *MyDelegate = NULL;
     const TfLiteGpuDelegateOptionsV2 options = {
         .is_precision_loss_allowed = 0, 
         .inference_preference = TFLITE_GPU_INFERENCE_PREFERENCE_FAST_SINGLE_ANSWER,
@@ -201,29 +217,67 @@ TfLiteStatus UnitHandler::CreateUnitGPU(UnitType eType,
         .experimental_flags = 1,
         .max_delegated_partitions = max_delegated_partition_num, // default is "1"
     };
-    TFLITE_MINIMAL_CHECK(interpreter->get()->AllocateTensorsofAllSubgraphsAndFixShape() == kTfLiteOk)
+    if(interpreter->get()->AllocateTensorsofAllSubgraphsAndFixShape() != kTfLiteOk){
+        PrintMsg("AllocateTensorsofAllSubgraphsAndFixShape ERROR");
+        return kTfLiteError;
+    }
     #ifdef MULTITHREAD
     
     //Set Partitioning Value : GPU Side Filters
     // HOON : in GPU, setpartitioning code is on both partitioning tool
-    TFLITE_MINIMAL_CHECK(interpreter->get()->SetPartitioning(5, eType) == kTfLiteOk); 
+    if(interpreter->get()->SetPartitioning(5, eType) != kTfLiteOk){
+        PrintMsg("SetPartitioning ERROR");
+        return kTfLiteError;
+    }
     //TFLITE_MINIMAL_CHECK(interpreter->get()->PrepareTensorsSharing(eType) == kTfLiteOk); 
     #endif
     // HOON ==> real tflitedelegate create. with delegate options  in this code, N's gpu delegate created
-    MyDelegate = TfLiteGpuDelegateV2Create(&options); 
-    if(interpreter->get()->ModifyGraphWithDelegate(MyDelegate) != kTfLiteOk) {
+    // The interpreter owns the delegate, so it goes when the unit retires it.
+    Interpreter::TfLiteDelegatePtr delegate(TfLiteGpuDelegateV2Create(&options),
+                                            TfLiteGpuDelegateV2Delete);
+    if(interpreter->get()->ModifyGraphWithDelegate(std::move(delegate)) != kTfLiteOk) {
         PrintMsg("Unable to Use GPU Delegate");
         return kTfLiteError;
     }
-    TFLITE_MINIMAL_CHECK(interpreter->get()->AllocateTensorsofAllSubgraphs() == kTfLiteOk);
+    if(interpreter->get()->AllocateTensorsofAllSubgraphs() != kTfLiteOk){
+        PrintMsg("AllocateTensorsofAllSubgraphs ERROR");
+        return kTfLiteError;
+    }
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::CreateUnitGPU(UnitType eType,
+                                         std::vector<cv::Mat> input, int partitioning, int loop_num, int max_delegated_partition_num){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    tflite::InterpreterBuilder* builder = bUseTwoModel ? GPUBuilder_ : builder_;
+    if(builder == nullptr){
+        PrintMsg(bUseTwoModel ? "GPU InterpreterBuilder nullptr ERROR"
+                              : "InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    std::unique_ptr<tflite::Interpreter>* interpreter =
+                                    new std::unique_ptr<tflite::Interpreter>;
+    if(BuildGPUInterpreter(eType, builder, loop_num, max_delegated_partition_num,
+                           interpreter) != kTfLiteOk){
+        delete interpreter;
+        return kTfLiteError;
+    }
     UnitGPU* temp;
     // tflite::PrintInterpreterStateV2(interpreter->get());
     temp = new UnitGPU(eType, std::move(interpreter));
     temp->SetInput(input);
     //Set ContextHandler Pointer
     vUnitContainer.push_back(temp);
+    UnitRecipe recipe;
+    recipe.kind = UnitRecipe::GPU;
+    recipe.eType = eType;
+    recipe.loop_num = loop_num;
+    recipe.max_delegated_partition_num = max_delegated_partition_num;
+    recipes_[temp] = recipe;
+    unit_models_[temp] = gpu_builder_model_;
     iUnitCount++;
     PrintMsg("Build GPU Interpreter");
+    PersistWeightCache();
     PrintMsg("GPU Interpreter Pre Invoke State");
     if (loop_num ==0)
     {
@@ -232,6 +286,357 @@ TfLiteStatus UnitHandler::CreateUnitGPU(UnitType eType,
     return kTfLiteOk;
 }
 
+TfLiteStatus UnitHandler::BuildPartitionedInterpreter(tflite::InterpreterBuilder* builder,
+                                    const std::vector<PartitionExecSpec>& specs,
+                                    std::unique_ptr<tflite::Interpreter>* interpreter){
+    // GPU0 splits the model into one subgraph per partition
+    if((*builder)(interpreter, UnitType::GPU0) != kTfLiteOk ||
+                                    interpreter->get() == nullptr){
+        PrintMsg("Partitioned Interpreter build ERROR");
+        return kTfLiteError;
+    }
+    Interpreter* partitioned = interpreter->get();
+    if(specs.size() != partitioned->subgraphs_size()){
+        std::cout << "UnitHandler : \"" << specs.size() << " exec specs for "
+                  << partitioned->subgraphs_size() << " partitions\"\n";
+        return kTfLiteError;
+    }
+    if(partitioned->AllocateTensorsofAllSubgraphsAndFixShape() != kTfLiteOk){
+        PrintMsg("AllocateTensorsofAllSubgraphsAndFixShape ERROR");
+        return kTfLiteError;
+    }
+    for(int i=0; i<specs.size(); ++i){
+        if(ApplyPartitionExecSpec(partitioned, i, specs[i]) != kTfLiteOk){
+            std::cout << "UnitHandler : \"Exec spec of partition " << i
+                      << " ERROR\"\n";
+            return kTfLiteError;
+        }
+    }
+    if(partitioned->AllocateTensorsofAllSubgraphs() != kTfLiteOk){
+        PrintMsg("AllocateTensorsofAllSubgraphs ERROR");
+        return kTfLiteError;
+    }
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::CreateUnitPartitioned(std::vector<cv::Mat> input,
+                                    std::vector<PartitionExecSpec> specs){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    tflite::InterpreterBuilder* builder = bUseTwoModel ? GPUBuilder_ : builder_;
+    if(builder == nullptr){
+        PrintMsg("InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    std::unique_ptr<tflite::Interpreter>* interpreter =
+                                    new std::unique_ptr<tflite::Interpreter>;
+    if(BuildPartitionedInterpreter(builder, specs, interpreter) != kTfLiteOk){
+        delete interpreter;
+        return kTfLiteError;
+    }
+    UnitGPU* temp = new UnitGPU(UnitType::GPU0, std::move(interpreter));
+    temp->SetInput(input);
+    vUnitContainer.push_back(temp);
+    UnitRecipe recipe;
+    recipe.kind = UnitRecipe::PARTITIONED;
+    recipe.eType = UnitType::GPU0;
+    recipe.specs = specs;
+    recipes_[temp] = recipe;
+    unit_models_[temp] = gpu_builder_model_;
+    iUnitCount++;
+    PrintMsg("Build Partitioned Interpreter");
+    PersistWeightCache();
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::BuildSimInterpreter(UnitType eType,
+                                    tflite::InterpreterBuilder* builder, int num_threads,
+                                    std::unique_ptr<tflite::Interpreter>* interpreter){
+    // GPU0 splits the model into one subgraph per partition
+    TfLiteStatus built = eType == UnitType::GPU0 ? (*builder)(interpreter, eType)
+                                                 : (*builder)(interpreter, num_threads);
+    if(built != kTfLiteOk || interpreter->get() == nullptr){
+        PrintMsg("SIM Interpreter build ERROR");
+        return kTfLiteError;
+    }
+    if(eType != UnitType::GPU0){
+        if(interpreter->get()->AllocateTensors() != kTfLiteOk){
+            PrintMsg("AllocateTensors ERROR");
+            return kTfLiteError;
+        }
+        return kTfLiteOk;
+    }
+    Interpreter* partitioned = interpreter->get();
+    if(partitioned->AllocateTensorsofAllSubgraphsAndFixShape() != kTfLiteOk){
+        PrintMsg("AllocateTensorsofAllSubgraphsAndFixShape ERROR");
+        return kTfLiteError;
+    }
+    // Every partition on the builtin CPU kernels, no delegate
+    for(int i=0; i<partitioned->subgraphs_size(); ++i){
+        if(partitioned->SetPartitionNumThreads(i, num_threads) != kTfLiteOk)
+            return kTfLiteError;
+    }
+    if(partitioned->AllocateTensorsofAllSubgraphs() != kTfLiteOk){
+        PrintMsg("AllocateTensorsofAllSubgraphs ERROR");
+        return kTfLiteError;
+    }
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::CreateUnitSim(UnitType eType, std::vector<cv::Mat> input,
+                                        SimLatencyModel model, int num_threads){
+    // Same model the real unit of this type would run
+    std::unique_lock<std::mutex> lock(mtx_units);
+    tflite::InterpreterBuilder* builder = builder_;
+    if(bUseTwoModel)
+        builder = eType >= UnitType::GPU0 ? GPUBuilder_ : CPUBuilder_;
+    if(builder == nullptr){
+        PrintMsg("InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    std::unique_ptr<tflite::Interpreter>* interpreter =
+                                    new std::unique_ptr<tflite::Interpreter>;
+    if(BuildSimInterpreter(eType, builder, num_threads, interpreter) != kTfLiteOk){
+        delete interpreter;
+        return kTfLiteError;
+    }
+    UnitSim* temp = new UnitSim(eType, interpreter, model);
+    temp->SetInput(input);
+    vUnitContainer.push_back(temp);
+    UnitRecipe recipe;
+    recipe.kind = UnitRecipe::SIM;
+    recipe.eType = eType;
+    recipe.num_threads = num_threads;
+    recipes_[temp] = recipe;
+    unit_models_[temp] = eType >= UnitType::GPU0 ? gpu_builder_model_ : cpu_builder_model_;
+    iUnitCount++;
+    PrintMsg("Build SIM Interpreter");
+    PersistWeightCache();
+    return kTfLiteOk;
+}
+
+std::future<TfLiteStatus> UnitHandler::SwapModel(UnitType eType, const char* model_path){
+    if(model_path == nullptr){
+        PrintMsg("Model path nullptr ERROR");
+        std::promise<TfLiteStatus> failed;
+        failed.set_value(kTfLiteError);
+        return failed.get_future();
+    }
+    return std::async(std::launch::async, &UnitHandler::SwapUnitModel, this,
+                      eType, std::string(model_path));
+}
+
+TfLiteStatus UnitHandler::SwapUnitModel(UnitType eType, std::string model_path){
+    std::unique_lock<std::mutex> swap_lock(mtx_swap_model);
+    Unit* unit = nullptr;
+    size_t unit_index = 0;
+    UnitRecipe recipe;
+    {
+        std::unique_lock<std::mutex> lock(mtx_units);
+        for(size_t i=0; i<vUnitContainer.size() && unit == nullptr; ++i){
+            if(vUnitContainer[i]->GetUnitType() == eType){
+                unit = vUnitContainer[i];
+                unit_index = i;
+            }
+        }
+        if(unit == nullptr || recipes_.count(unit) == 0){
+            PrintMsg("No Unit to swap");
+            return kTfLiteError;
+        }
+        if(units_pooled_){
+            PrintMsg("Units of the pool can not be swapped");
+            return kTfLiteError;
+        }
+        recipe = recipes_[unit];
+    }
+
+    std::shared_ptr<SwappedModel> next_model(new SwappedModel);
+    next_model->model = tflite::FlatBufferModel::BuildFromFile(model_path.c_str());
+    if(next_model->model == nullptr){
+        PrintMsg("Model load ERROR");
+        return kTfLiteError;
+    }
+    next_model->resolver.reset(new tflite::ops::builtin::BuiltinOpResolver);
+    next_model->builder.reset(new tflite::InterpreterBuilder(*next_model->model,
+                                                             *next_model->resolver));
+
+    // Built & warmed while the old interpreter keeps serving.
+    std::unique_ptr<tflite::Interpreter>* interpreter =
+                                    new std::unique_ptr<tflite::Interpreter>;
+    TfLiteStatus status = kTfLiteError;
+    switch(recipe.kind){
+        case UnitRecipe::CPU:
+            status = BuildCPUInterpreter(recipe.eType, next_model->builder.get(),
+                                         interpreter);
+            break;
+        case UnitRecipe::GPU:
+            status = BuildGPUInterpreter(recipe.eType, next_model->builder.get(),
+                                         recipe.loop_num,
+                                         recipe.max_delegated_partition_num,
+                                         interpreter);
+            break;
+        case UnitRecipe::PARTITIONED:
+            status = BuildPartitionedInterpreter(next_model->builder.get(),
+                                                 recipe.specs, interpreter);
+            break;
+        case UnitRecipe::SIM:
+            status = BuildSimInterpreter(recipe.eType, next_model->builder.get(),
+                                         recipe.num_threads, interpreter);
+            break;
+    }
+    if(status != kTfLiteOk){
+        PrintMsg("Swap build ERROR, keeping the old model");
+        delete interpreter;
+        return kTfLiteError;
+    }
+    Interpreter* next = interpreter->get();
+    Interpreter* old = unit->PinInterpreter();
+    bool same_inputs = old->inputs().size() == next->inputs().size();
+    for(size_t i=0; i<next->inputs().size() && same_inputs; ++i){
+        const TfLiteTensor* a = old->tensor(old->inputs()[i]);
+        const TfLiteTensor* b = next->tensor(next->inputs()[i]);
+        same_inputs = a->type == b->type && TfLiteIntArrayEqual(a->dims, b->dims);
+    }
+    unit->UnpinInterpreter(old);
+    if(!same_inputs){
+        PrintMsg("New model has another input layout, keeping the old model");
+        delete interpreter;
+        return kTfLiteError;
+    }
+    if(WarmUp(next, unit->GetUnitType()) != kTfLiteOk){
+        PrintMsg("Swap warm up ERROR, keeping the old model");
+        delete interpreter;
+        return kTfLiteError;
+    }
+    PersistWeightCache();
+
+    std::unique_lock<std::mutex> lock(mtx_units);
+    // The units may have gone to the pool while the new model was built.
+    if(units_pooled_){
+        PrintMsg("Units of the pool can not be swapped");
+        delete interpreter;
+        return kTfLiteError;
+    }
+    if(releaser_ != nullptr)
+        releaser_->Unregister(old);
+    if(unit->SwapInterpreter(interpreter) != kTfLiteOk)
+        return kTfLiteError;
+    // The old interpreter is gone, its model may go with it.
+    unit_models_[unit] = next_model;
+    if(releaser_ != nullptr)
+        releaser_->Register("Unit" + std::to_string(unit_index), next, release_idle_us_);
+
+    // Units created from now on use the new model.
+    if(!bUseTwoModel){
+        builder_ = next_model->builder.get();
+        cpu_builder_model_ = next_model;
+        gpu_builder_model_ = next_model;
+    }else if(recipe.kind == UnitRecipe::CPU ||
+             (recipe.kind == UnitRecipe::SIM && recipe.eType < UnitType::GPU0)){
+        CPUBuilder_ = next_model->builder.get();
+        cpu_builder_model_ = next_model;
+    }else{
+        GPUBuilder_ = next_model->builder.get();
+        gpu_builder_model_ = next_model;
+    }
+    std::cout << "UnitHandler : \"Swapped to " << model_path << " (generation "
+              << unit->GetGeneration() << ")\"\n";
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::WarmUp(Interpreter* interpreter, UnitType eType){
+    for(size_t i=0; i<interpreter->inputs().size(); ++i){
+        TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[i]);
+        // Zero fills the slot, other input layouts are left as allocated.
+        CopyFrameToInputTensor(input, 0, cv::Mat());
+    }
+    if(eType == UnitType::CPU0 || eType == UnitType::GPU0){
+        std::mutex mtx_warm, mtx_warm_, mtx_warm_debug;
+        std::condition_variable Wcontroller;
+        std::queue<SharedContext*> qWarmShared;
+        return interpreter->Invoke(eType, mtx_warm, mtx_warm_, mtx_warm_debug,
+                                   Wcontroller, &qWarmShared);
+    }
+    return interpreter->Invoke();
+}
+
+Unit* UnitHandler::FindUnit(UnitType eType){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    for(size_t i=0; i<vUnitContainer.size(); ++i){
+        if(vUnitContainer[i]->GetUnitType() == eType)
+            return vUnitContainer[i];
+    }
+    return nullptr;
+}
+
+TfLiteStatus UnitHandler::UseWeightCacheFile(const char* path){
+    if(path == nullptr){
+        PrintMsg("Weight cache path nullptr ERROR");
+        return kTfLiteError;
+    }
+    weight_cache_path_ = path;
+    SharedWeightCache& cache = SharedWeightCache::GetInstance();
+    weight_cache_saved_misses_ = cache.misses();
+    std::ifstream exists(weight_cache_path_);
+    if(!exists.good()){
+        PrintMsg("No weight cache file yet, created after the first unit");
+        return kTfLiteOk;
+    }
+    if(cache.Load(weight_cache_path_) != kTfLiteOk){
+        std::cout << "UnitHandler : \"Weight cache " << weight_cache_path_
+                  << " is corrupt or outdated, repacking\"\n";
+        return kTfLiteOk;
+    }
+    std::cout << "UnitHandler : \"Loaded " << cache.num_entries()
+              << " packed weights (" << cache.bytes() << " bytes)\"\n";
+    return kTfLiteOk;
+}
+
+void UnitHandler::PersistWeightCache(){
+    if(weight_cache_path_.empty())
+        return;
+    SharedWeightCache& cache = SharedWeightCache::GetInstance();
+    if(cache.misses() == weight_cache_saved_misses_)
+        return;
+    if(cache.Save(weight_cache_path_) != kTfLiteOk){
+        std::cout << "UnitHandler : \"Can not write weight cache "
+                  << weight_cache_path_ << "\"\n";
+        return;
+    }
+    weight_cache_saved_misses_ = cache.misses();
+}
+
+TfLiteStatus UnitHandler::ApplyPartitionExecSpec(Interpreter* interpreter,
+                                    int partition_idx, const PartitionExecSpec& spec){
+    // Nodes a delegate does not take still run on the partition's CPU context
+    if(interpreter->SetPartitionNumThreads(partition_idx, spec.num_threads) != kTfLiteOk)
+        return kTfLiteError;
+    switch(spec.backend){
+        case PartitionBackend::BUILTIN:
+            return kTfLiteOk;
+        case PartitionBackend::XNNPACK:{
+#if defined(TFLITE_WITHOUT_XNNPACK)
+            PrintMsg("Built without XNNPACK");
+            return kTfLiteError;
+#else
+            TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+            options.num_threads = spec.num_threads;
+            Interpreter::TfLiteDelegatePtr delegate(
+                    TfLiteXNNPackDelegateCreate(&options), TfLiteXNNPackDelegateDelete);
+            return interpreter->ModifyPartitionWithDelegate(partition_idx,
+                                                            std::move(delegate));
+#endif
+        }
+        case PartitionBackend::GPU:{
+            TfLiteGpuDelegateOptionsV2 options = TfLiteGpuDelegateOptionsV2Default();
+            Interpreter::TfLiteDelegatePtr delegate(
+                    TfLiteGpuDelegateV2Create(&options), TfLiteGpuDelegateV2Delete);
+            return interpreter->ModifyPartitionWithDelegate(partition_idx,
+                                                            std::move(delegate));
+        }
+    }
+    return kTfLiteError;
+}
+
 // std::vector<double> b_delegation_optimizer;  // <-> ?? 
 
 // void UnitHandler::PrintTest(std::vector<double> b_delegation_optimizer){
@@ -276,6 +681,344 @@ TfLiteStatus UnitHandler::CreateAndInvokeGPU(UnitType eType,
     return kTfLiteOk;
 }
 
+TfLiteStatus UnitHandler::CreateBatchingUnitCPU(int max_batch, int max_delay_us){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    if(batcher_ != nullptr){
+        PrintMsg("Batching Unit already exists");
+        return kTfLiteError;
+    }
+    // Same builder CreateUnitCPU uses (quantized model if there are two).
+    tflite::InterpreterBuilder* builder = bUseTwoModel ? CPUBuilder_ : builder_;
+    if(builder == nullptr){
+        PrintMsg("InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    batcher_ = new UnitBatcher(builder, max_batch, max_delay_us, 4);
+    frontend_models_.push_back(cpu_builder_model_);
+    if(batcher_->WarmUp() != kTfLiteOk || batcher_->Start() != kTfLiteOk){
+        PrintMsg("Batching Unit start ERROR");
+        delete batcher_;
+        batcher_ = nullptr;
+        return kTfLiteError;
+    }
+    PrintMsg("Build Batching CPU Unit");
+    return kTfLiteOk;
+}
+
+std::future<BatchOutput> UnitHandler::SubmitFrame(cv::Mat frame){
+    if(batcher_ == nullptr){
+        PrintMsg("Batching Unit not created");
+        std::promise<BatchOutput> broken;
+        broken.set_exception(std::make_exception_ptr(
+                            std::runtime_error("Batching Unit not created")));
+        return broken.get_future();
+    }
+    return batcher_->Submit(frame);
+}
+
+TfLiteStatus UnitHandler::CreateTilingUnit(UnitTilerOptions options, bool on_units){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    if(tiler_ != nullptr){
+        PrintMsg("Tiling Unit already exists");
+        return kTfLiteError;
+    }
+    if(on_units){
+        if(vUnitContainer.empty()){
+            PrintMsg("No Unit to tile on");
+            return kTfLiteError;
+        }
+        tiler_ = new UnitTiler(vUnitContainer, options);
+    }else{
+        // Same builder CreateUnitCPU uses (quantized model if there are two).
+        tflite::InterpreterBuilder* builder = bUseTwoModel ? CPUBuilder_ : builder_;
+        if(builder == nullptr){
+            PrintMsg("InterpreterBuilder nullptr ERROR");
+            return kTfLiteError;
+        }
+        tiler_ = new UnitTiler(builder, options);
+        frontend_models_.push_back(cpu_builder_model_);
+    }
+    if(tiler_->Start() != kTfLiteOk){
+        PrintMsg("Tiling Unit start ERROR");
+        delete tiler_;
+        tiler_ = nullptr;
+        return kTfLiteError;
+    }
+    PrintMsg("Build Tiling Unit");
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::DetectTiled(cv::Mat frame,
+                                      std::vector<TileDetection>* detections){
+    if(tiler_ == nullptr){
+        PrintMsg("Tiling Unit not created");
+        return kTfLiteError;
+    }
+    return tiler_->Detect(frame, detections);
+}
+
+TfLiteStatus UnitHandler::CreateUnitPool(UnitPoolOptions options){
+    if(pool_ != nullptr){
+        PrintMsg("Unit Pool already exists");
+        return kTfLiteError;
+    }
+    pool_ = new UnitPool(options);
+    PrintMsg("Build Unit Pool");
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::EnableIdleMemoryRelease(int64_t idle_us,
+                                                  int64_t check_interval_us){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    if(releaser_ == nullptr)
+        releaser_ = new IdleMemoryReleaser(check_interval_us);
+    release_idle_us_ = idle_us;
+    for(size_t i=0; i<vUnitContainer.size(); ++i){
+        std::string name = "Unit" + std::to_string(i);
+        if(releaser_->Register(name, vUnitContainer[i]->GetInterpreter(), idle_us) != kTfLiteOk)
+            return kTfLiteError;
+    }
+    if(fallback_interpreter_ != nullptr &&
+       releaser_->Register("Fallback", fallback_interpreter_.get(), idle_us) != kTfLiteOk)
+        return kTfLiteError;
+    PrintMsg("Idle Memory Release enabled");
+    return releaser_->Start();
+}
+
+int UnitHandler::AddUnitsToPool(const char* name, PoolModelOptions options){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    if(pool_ == nullptr){
+        PrintMsg("Unit Pool not created");
+        return -1;
+    }
+    if(vUnitContainer.empty()){
+        PrintMsg("No Unit to add to the pool");
+        return -1;
+    }
+    units_pooled_ = true;
+    return pool_->AddModel(name, vUnitContainer, options);
+}
+
+TfLiteStatus UnitHandler::SetStreamGate(int stream_id, ChangeGateOptions options){
+    std::unique_lock<std::mutex> lock(mtx_gates);
+    // A gate in use by DetectGated() is never replaced.
+    if(gates_.count(stream_id)){
+        PrintMsg("Stream already has a gate");
+        return kTfLiteError;
+    }
+    gates_[stream_id] = new ChangeGate(options);
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::DetectGated(int stream_id, cv::Mat frame,
+                                      std::vector<TileDetection>* detections,
+                                      GateDecision* decision){
+    if(tiler_ == nullptr){
+        PrintMsg("Tiling Unit not created");
+        return kTfLiteError;
+    }
+    ChangeGate* gate;
+    {
+        std::unique_lock<std::mutex> lock(mtx_gates);
+        ChangeGate*& slot = gates_[stream_id];
+        if(slot == nullptr)
+            slot = new ChangeGate();
+        gate = slot;
+    }
+    return gate->Detect(tiler_, frame, detections, decision);
+}
+
+TfLiteStatus UnitHandler::OpenFrameRing(const char* name){
+    if(frame_ring_ != nullptr){
+        PrintMsg("Frame ring already opened");
+        return kTfLiteError;
+    }
+    ShmFrameRing* ring = new ShmFrameRing;
+    if(ring->Open(name) != kTfLiteOk){
+        delete ring;
+        return kTfLiteError;
+    }
+    frame_ring_ = ring;
+    frame_ring_sequence_ = 0;
+    PrintMsg("Frame ring opened");
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::InvokeFromFrameRing(UnitType eType, int64_t timeout_us,
+                                              ShmFrame* frame){
+    if(frame_ring_ == nullptr){
+        PrintMsg("Frame ring not opened");
+        return kTfLiteError;
+    }
+    Unit* unit = FindUnit(eType);
+    if(unit == nullptr){
+        PrintMsg("No Unit for frame ring invoke");
+        return kTfLiteError;
+    }
+    ShmFrame held;
+    if(frame_ring_->WaitFrame(frame_ring_sequence_, timeout_us, &held) != kTfLiteOk){
+        PrintMsg(frame_ring_->ProducerAlive() ? "No frame before timeout"
+                                              : "Capture process is gone");
+        return kTfLiteError;
+    }
+    frame_ring_sequence_ = held.sequence;
+    if(frame != nullptr)
+        *frame = held;
+    // Before binding, frame inputs on this unit would go to the ring now.
+    unit->SetExternalInput();
+    Interpreter* interpreter = unit->PinInterpreter();
+    TfLiteStatus status = frame_ring_->BindInput(interpreter, interpreter->inputs()[0]);
+    // Input tensor already holds the frame.
+    if(status == kTfLiteOk)
+        status = unit->InvokeOn(interpreter, {});
+    unit->UnpinInterpreter(interpreter);
+    return status;
+}
+
+TfLiteStatus UnitHandler::StartRecording(UnitType eType, const char* path,
+                                         WorkloadRecordOptions options){
+    Unit* unit = FindUnit(eType);
+    if(unit == nullptr || path == nullptr){
+        PrintMsg("No Unit to record");
+        return kTfLiteError;
+    }
+    StopRecording();
+    // Kept until the handler goes, invokes may still be recording into it.
+    if(recorder_ == nullptr)
+        recorder_ = new WorkloadRecorder;
+    if(recorder_->Open(path, options) != kTfLiteOk)
+        return kTfLiteError;
+    unit->SetRecorder(recorder_);
+    recorded_unit_ = unit;
+    return kTfLiteOk;
+}
+
+void UnitHandler::StopRecording(){
+    if(recorded_unit_ == nullptr)
+        return;
+    recorded_unit_->SetRecorder(nullptr);
+    recorded_unit_ = nullptr;
+    recorder_->Close();
+}
+
+TfLiteStatus UnitHandler::ReplayWorkload(UnitType eType, const char* path,
+                                         ReplayOptions options, ReplayStats* stats){
+    Unit* unit = FindUnit(eType);
+    if(unit == nullptr || path == nullptr){
+        PrintMsg("No Unit to replay on");
+        return kTfLiteError;
+    }
+    WorkloadReplayer replayer;
+    if(replayer.Load(path) != kTfLiteOk)
+        return kTfLiteError;
+    return replayer.Replay(unit, options, stats);
+}
+
+std::future<TfLiteStatus> UnitHandler::InvokeAsync(UnitType eType,
+                                                   std::vector<cv::Mat> input,
+                                                   InvokeCallback callback){
+    Unit* unit = FindUnit(eType);
+    if(unit != nullptr && unit->StartAsync() == kTfLiteOk)
+        return unit->InvokeAsync(input, callback);
+    PrintMsg("No Unit for async invoke");
+    std::promise<TfLiteStatus> failed;
+    failed.set_value(kTfLiteError);
+    return failed.get_future();
+}
+
+TfLiteStatus UnitHandler::PrepareFallback(){
+    std::unique_lock<std::mutex> lock(mtx_units);
+    if(fallback_interpreter_ != nullptr)
+        return kTfLiteOk;
+    tflite::InterpreterBuilder* builder = bUseTwoModel ? CPUBuilder_ : builder_;
+    if(builder == nullptr){
+        PrintMsg("Fallback InterpreterBuilder nullptr ERROR");
+        return kTfLiteError;
+    }
+    if((*builder)(&fallback_interpreter_, 4) != kTfLiteOk ||
+                    fallback_interpreter_ == nullptr){
+        PrintMsg("Fallback Interpreter build ERROR");
+        return kTfLiteError;
+    }
+    if(fallback_interpreter_->AllocateTensors() != kTfLiteOk){
+        PrintMsg("Fallback AllocateTensors ERROR");
+        fallback_interpreter_.reset();
+        return kTfLiteError;
+    }
+    // Keeps a swapped model alive as long as the fallback runs it.
+    fallback_model_ = cpu_builder_model_;
+    PrintMsg("Build Fallback CPU Interpreter");
+    return kTfLiteOk;
+}
+
+TfLiteStatus UnitHandler::InvokeWithDeadline(UnitType eType,
+                                             std::vector<cv::Mat> input,
+                                             int64_t budget_us,
+                                             DeadlineOutcome* outcome,
+                                             Interpreter** answered_by){
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(budget_us);
+    *outcome = DeadlineOutcome::MISSED;
+    *answered_by = nullptr;
+    Unit* unit = FindUnit(eType);
+    if(unit == nullptr){
+        PrintMsg("No Unit for deadline invoke");
+        return kTfLiteError;
+    }
+    if(PrepareFallback() != kTfLiteOk)
+        PrintMsg("Running deadline invoke without fallback");
+
+    Interpreter* primary = unit->PinInterpreter();
+    bool primary_fits = primary->EstimateInvokeUs(unit->GetUnitType())
+                                                    <= (double)budget_us;
+    if(primary_fits){
+        primary->SetDeadline(deadline);
+        TfLiteStatus status = unit->InvokeOn(primary, input);
+        primary->ClearDeadline();
+        const bool aborted = primary->DeadlineExceeded();
+        // answered_by is only valid until the next SwapModel().
+        unit->UnpinInterpreter(primary);
+        if(status == kTfLiteOk){
+            *outcome = DeadlineOutcome::ON_TIME;
+            *answered_by = primary;
+            return kTfLiteOk;
+        }
+        if(!aborted)
+            return kTfLiteError;
+        PrintMsg("Primary unit aborted on deadline");
+    }else{
+        unit->UnpinInterpreter(primary);
+        PrintMsg("Primary unit estimate exceeds budget, skipping it");
+    }
+    if(fallback_interpreter_ == nullptr)
+        return kTfLiteError;
+
+    Interpreter* fallback = fallback_interpreter_.get();
+    // The idle releaser must not free the inputs between filling and invoke.
+    fallback->PinNonPersistentMemory();
+    TfLiteStatus status = fallback->AcquireNonPersistentMemory();
+    for(size_t i=0; status == kTfLiteOk && i<input.size() &&
+                    i<fallback->inputs().size(); ++i){
+        TfLiteTensor* tensor = fallback->tensor(fallback->inputs()[i]);
+        status = CopyFrameToInputTensor(tensor, 0, input[i]);
+    }
+    if(status == kTfLiteOk){
+        fallback->SetDeadline(deadline);
+        status = fallback->Invoke();
+        fallback->ClearDeadline();
+        if(status != kTfLiteOk)
+            PrintMsg(fallback->DeadlineExceeded() ? "Fallback missed the deadline"
+                                                  : "Fallback Invoke ERROR");
+    }
+    fallback->UnpinNonPersistentMemory();
+    if(status != kTfLiteOk)
+        return kTfLiteError;
+    PrintMsg("Answered by fallback CPU interpreter");
+    *outcome = DeadlineOutcome::FALLBACK;
+    *answered_by = fallback;
+    return kTfLiteOk;
+}
+
 void UnitHandler::PrintMsg(const char* msg){
     std::cout << "UnitHandler : \"" << msg << "\"\n";
     return;
@@ -7,17 +7,30 @@
 #include <vector>
 #include <utility>
 #include <queue>
+#include <map>
 #include "condition_variable"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
 #include "tensorflow/lite/optional_debug_tools.h"
 #include "tensorflow/lite/delegates/gpu/delegate.h"
+#if !defined(TFLITE_WITHOUT_XNNPACK)
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
+#endif
 #include "tensorflow/lite/c/common.h"
 #include <functional>
 #include "thread"
 #include "future"
 #include "tensorflow/lite/unit.h"
+#include "tensorflow/lite/unit_batcher.h"
+#include "tensorflow/lite/unit_tiler.h"
+#include "tensorflow/lite/unit_gate.h"
+#include "tensorflow/lite/unit_pool.h"
+#include "tensorflow/lite/unit_memory.h"
+#include "tensorflow/lite/unit_shm.h"
+#include "tensorflow/lite/unit_sim.h"
+#include "tensorflow/lite/unit_workload.h"
+#include "tensorflow/lite/kernels/weight_cache.h"
 
 /*
 Unit handler class
@@ -27,6 +40,28 @@ test
 namespace tflite
 {
 
+/// How a deadline invoke was answered.
+enum class DeadlineOutcome{
+    ON_TIME,    // primary unit finished before the deadline
+    FALLBACK,   // primary unit aborted (or would not fit), fallback answered
+    MISSED      // neither finished in time, no valid output
+};
+
+/// Backend a single partition of a partitioned unit runs on.
+enum class PartitionBackend{
+    BUILTIN,    // builtin kernels (ruy/eigen) on the partition's own threads
+    XNNPACK,    // XNNPACK delegate with its own threadpool
+    GPU         // GPU delegate
+};
+
+/// Execution spec of one partition (subgraph) of a partitioned unit.
+/// num_threads is used by the CPU kernels of the partition (and by the
+/// XNNPACK threadpool). -1 lets the runtime decide.
+struct PartitionExecSpec{
+    PartitionBackend backend;
+    int num_threads;
+};
+
 
 class UnitHandler
 {
@@ -73,6 +108,115 @@ private:
     int C_Counter = 0;
     int G_Counter = 0;
 
+    /// Dynamic batching front-end for the CPU unit (nullptr until created)
+    UnitBatcher* batcher_ = nullptr;
+
+    /// Tiled high resolution front-end (nullptr until created)
+    UnitTiler* tiler_ = nullptr;
+
+    /// Shared execution pool (nullptr until created)
+    UnitPool* pool_ = nullptr;
+
+    /// Idle time memory release policy (nullptr until enabled)
+    IdleMemoryReleaser* releaser_ = nullptr;
+
+    /// Frames from the capture process (nullptr until opened)
+    ShmFrameRing* frame_ring_ = nullptr;
+    /// Sequence of the last frame invoked from frame_ring_
+    uint64_t frame_ring_sequence_ = 0;
+
+    /// Records the invokes of one unit (nullptr until started)
+    WorkloadRecorder* recorder_ = nullptr;
+    Unit* recorded_unit_ = nullptr;
+
+    /// Change gates of the streams fed to DetectGated(), by stream id
+    std::map<int, ChangeGate*> gates_;
+    std::mutex mtx_gates;
+
+    /// Cheaper interpreter used when a deadline can not be met
+    /// (quantized model if two models are loaded). Built on first use.
+    std::unique_ptr<tflite::Interpreter> fallback_interpreter_;
+
+    TfLiteStatus PrepareFallback();
+
+    /// How a unit was built, replayed on the new model by SwapModel().
+    struct UnitRecipe{
+        enum Kind{ CPU, GPU, PARTITIONED, SIM };
+        Kind kind;
+        UnitType eType;
+        int loop_num = 0;
+        int max_delegated_partition_num = 1;
+        std::vector<PartitionExecSpec> specs;
+        int num_threads = 4;
+    };
+    std::map<Unit*, UnitRecipe> recipes_;
+
+    /// A model loaded by SwapModel(). Kept alive by the units running it
+    /// and by the builders new units are created from.
+    struct SwappedModel{
+        std::unique_ptr<tflite::FlatBufferModel> model;
+        std::unique_ptr<tflite::ops::builtin::BuiltinOpResolver> resolver;
+        std::unique_ptr<tflite::InterpreterBuilder> builder;
+    };
+    std::map<Unit*, std::shared_ptr<SwappedModel>> unit_models_;
+    std::shared_ptr<SwappedModel> cpu_builder_model_;
+    std::shared_ptr<SwappedModel> gpu_builder_model_;
+    std::shared_ptr<SwappedModel> fallback_model_;
+    /// Models the batcher & tiler build their own interpreters from
+    std::vector<std::shared_ptr<SwappedModel>> frontend_models_;
+
+    /// One swap at a time
+    std::mutex mtx_swap_model;
+
+    /// Guards vUnitContainer, recipes_, the builders and their models,
+    /// unit_models_, units_pooled_ and releaser_ registrations. Held by unit
+    /// creation, pooling and the install step of a swap (not while the new
+    /// model builds, the old one keeps serving).
+    std::mutex mtx_units;
+
+    /// Units were handed to the pool (which keeps their interpreters)
+    bool units_pooled_ = false;
+
+    /// Idle time of the units registered to releaser_
+    int64_t release_idle_us_ = 0;
+
+    /// Interpreter creation of CreateUnitCPU/GPU/Partitioned.
+    TfLiteStatus BuildCPUInterpreter(UnitType eType, tflite::InterpreterBuilder* builder,
+                                     std::unique_ptr<tflite::Interpreter>* interpreter);
+    TfLiteStatus BuildGPUInterpreter(UnitType eType, tflite::InterpreterBuilder* builder,
+                                     int loop_num, int max_delegated_partition_num,
+                                     std::unique_ptr<tflite::Interpreter>* interpreter);
+    TfLiteStatus BuildPartitionedInterpreter(tflite::InterpreterBuilder* builder,
+                                     const std::vector<PartitionExecSpec>& specs,
+                                     std::unique_ptr<tflite::Interpreter>* interpreter);
+    TfLiteStatus BuildSimInterpreter(UnitType eType, tflite::InterpreterBuilder* builder,
+                                     int num_threads,
+                                     std::unique_ptr<tflite::Interpreter>* interpreter);
+
+    /// First unit of type eType (nullptr if none), looked up under mtx_units.
+    Unit* FindUnit(UnitType eType);
+
+    /// Body of SwapModel(), runs on its own thread.
+    TfLiteStatus SwapUnitModel(UnitType eType, std::string model_path);
+
+    /// One invoke on zero inputs with sync objects of its own, so the
+    /// unit's running invokes are not disturbed.
+    TfLiteStatus WarmUp(Interpreter* interpreter, UnitType eType);
+
+    /// Applies one exec spec to partition 'partition_idx' of 'interpreter'.
+    TfLiteStatus ApplyPartitionExecSpec(Interpreter* interpreter, int partition_idx,
+                                        const PartitionExecSpec& spec);
+
+    /// File the shared packed-weight cache is persisted to (empty : off)
+    std::string weight_cache_path_;
+
+    /// Cache misses already written to weight_cache_path_
+    int64_t weight_cache_saved_misses_ = 0;
+
+    /// Saves the shared weight cache if units packed new weights since the
+    /// last save.
+    void PersistWeightCache();
+
 
 public:
     UnitHandler();
@@ -81,11 +225,123 @@ public:
 
     TfLiteStatus CreateUnitCPU(UnitType eType, std::vector<cv::Mat> input, int partitioning);
     TfLiteStatus CreateUnitGPU(UnitType eType, std::vector<cv::Mat> input, int partitioning, int loop_num, int max_delegated_partition_num); // ignore partitoning
+
+    /// Builds a partitioned (GPU0) unit where every partition gets its own
+    /// backend & thread count. specs[i] is applied to partition i, so the
+    /// number of specs must match the partitioning plan.
+    ///   e.g. {{XNNPACK, 4}, {BUILTIN, 2}, {GPU, -1}}
+    TfLiteStatus CreateUnitPartitioned(std::vector<cv::Mat> input,
+                                       std::vector<PartitionExecSpec> specs);
+
+    /// Builds a simulated accelerator unit (see UnitSim) standing in for
+    /// the unit type eType, on CPU kernels with num_threads threads.
+    /// GPU0 is split into partitions like CreateUnitPartitioned(), so
+    /// partition plans and co-execution run unchanged without a GPU.
+    TfLiteStatus CreateUnitSim(UnitType eType, std::vector<cv::Mat> input,
+                               SimLatencyModel model, int num_threads = 4);
+
+    /// Packed conv weights are shared by every unit of the process.
+    /// With a cache file they also survive restarts : the file is loaded
+    /// here (if it exists) and rewritten whenever a created unit packed
+    /// weights that were not cached yet. Call before creating units.
+    TfLiteStatus UseWeightCacheFile(const char* path);
+
     TfLiteStatus Invoke(UnitType eType, UnitType eType_, std::vector<cv::Mat> input, int loop_num, int max_delegated_partition_num, int test_number);
 
     TfLiteStatus CreateAndInvokeCPU(UnitType eType, std::vector<cv::Mat> input);
     TfLiteStatus CreateAndInvokeGPU(UnitType eType, std::vector<cv::Mat> input, int loop_num, int max_delegated_partition_num, int test_num);
 
+    /// Batches frames submitted with SubmitFrame() into one CPU Invoke.
+    /// (max_batch frames or max_delay_us, whichever comes first)
+    TfLiteStatus CreateBatchingUnitCPU(int max_batch, int max_delay_us);
+    std::future<BatchOutput> SubmitFrame(cv::Mat frame);
+
+    /// Splits high resolution frames into overlapping model sized tiles
+    /// which run in parallel, then merges the detections (cross-tile NMS).
+    /// on_units : tiles run on the units already created (one worker per
+    /// unit) instead of options.num_workers CPU interpreters of their own.
+    TfLiteStatus CreateTilingUnit(UnitTilerOptions options, bool on_units = false);
+    TfLiteStatus DetectTiled(cv::Mat frame, std::vector<TileDetection>* detections);
+
+    /// Gated DetectTiled for static cameras : reuses the last detections of
+    /// the stream or only runs its changed regions (see ChangeGate).
+    /// Streams without SetStreamGate() (called before their first frame)
+    /// use the default ChangeGateOptions.
+    TfLiteStatus SetStreamGate(int stream_id, ChangeGateOptions options);
+    TfLiteStatus DetectGated(int stream_id, cv::Mat frame,
+                             std::vector<TileDetection>* detections,
+                             GateDecision* decision = nullptr);
+
+    /// Shared pool several models are co-scheduled on by priority and
+    /// latency target (see UnitPool). AddUnitsToPool() registers the units
+    /// created so far as one model, other models are added through
+    /// GetUnitPool()->AddModel(). Start it with GetUnitPool()->Start().
+    /// Pooled units belong to the pool from then on (their thread count is
+    /// changed, they can not be swapped) and live until the handler goes.
+    TfLiteStatus CreateUnitPool(UnitPoolOptions options);
+    int AddUnitsToPool(const char* name, PoolModelOptions options);
+    UnitPool* GetUnitPool() { return pool_; }
+
+    /// Releases the arenas of the units created so far (and of the deadline
+    /// fallback if built) after idle_us without invokes, see
+    /// IdleMemoryReleaser. They come back on the next invoke. Other
+    /// interpreters go through GetMemoryReleaser()->Register().
+    TfLiteStatus EnableIdleMemoryRelease(int64_t idle_us,
+                                         int64_t check_interval_us = 1000000);
+    IdleMemoryReleaser* GetMemoryReleaser() { return releaser_; }
+
+    /// Zero copy input from a capture process (see ShmFrameRing).
+    /// InvokeFromFrameRing() waits (up to timeout_us) for a frame newer than
+    /// the last one, binds the input tensor of the unit of the given type to
+    /// it and invokes. The frame stays held (unchanged) until the next call,
+    /// 'frame' (optional) receives its sequence, timestamp & drops.
+    /// The unit stays bound (see Unit::SetExternalInput()), frame inputs to
+    /// it are refused from the first call on. The ring is closed with the
+    /// handler only, so the binding never outlives it.
+    TfLiteStatus OpenFrameRing(const char* name);
+    TfLiteStatus InvokeFromFrameRing(UnitType eType, int64_t timeout_us,
+                                     ShmFrame* frame = nullptr);
+
+    /// Records every invoke of the unit of the given type into 'path'
+    /// (see WorkloadRecorder) until StopRecording(). One unit at a time.
+    TfLiteStatus StartRecording(UnitType eType, const char* path,
+                                WorkloadRecordOptions options = WorkloadRecordOptions());
+    void StopRecording();
+
+    /// Replays a recording on the unit of the given type (any partition
+    /// plan or unit kind with the same model input layout) from the
+    /// calling thread, see WorkloadReplayer.
+    TfLiteStatus ReplayWorkload(UnitType eType, const char* path,
+                                ReplayOptions options, ReplayStats* stats);
+
+    /// Queues one invoke on the (already created) unit of the given type.
+    /// Starts the unit's async worker on first use. Non blocking.
+    std::future<TfLiteStatus> InvokeAsync(UnitType eType, std::vector<cv::Mat> input,
+                                          InvokeCallback callback = nullptr);
+
+    /// Invokes the unit of the given type with a latency budget.
+    /// If the unit's latency history says it can not make it, or it aborts
+    /// mid-graph/at a partition boundary, the fallback (CPU) interpreter
+    /// answers instead. 'answered_by' receives the interpreter whose outputs
+    /// are valid (nullptr on MISSED).
+    /// With idle memory release on, read those outputs right away, the
+    /// releaser may free them once the interpreter is idle for idle_us.
+    TfLiteStatus InvokeWithDeadline(UnitType eType, std::vector<cv::Mat> input,
+                                    int64_t budget_us, DeadlineOutcome* outcome,
+                                    Interpreter** answered_by);
+
+    /// Hot model swap : loads 'model_path' and builds the unit of the given
+    /// type again the way it was created (partition plan, delegates, exec
+    /// specs) on a background thread while the old interpreter keeps
+    /// serving. After one warm up invoke, invokes starting from then on run
+    /// on the new interpreter, the old one is retired once the invokes
+    /// running on it drained. The model must keep the input layout.
+    /// Units created afterwards use the new model too. Units added to the
+    /// pool can not be swapped.
+    /// Interpreter pointers from GetInterpreter() / InvokeWithDeadline()
+    /// are invalid after the swap. Keep the future until it is ready.
+    std::future<TfLiteStatus> SwapModel(UnitType eType, const char* model_path);
+
     /* Not Impl*/
     void DeleteSharedContext(SharedContext* dataTobeCleared);
 
@@ -94,7 +350,19 @@ public:
     void PrintTest(std::vector<double> b_delegation_optimizer);
     int combination(int n, int r);
 
-    ~UnitHandler() {};
+    ~UnitHandler() {
+        StopRecording();
+        delete recorder_;
+        delete releaser_;
+        delete frame_ring_;
+        delete pool_;
+        for(auto& gate : gates_)
+            delete gate.second;
+        delete tiler_;
+        delete batcher_;
+        // Before the swapped models it may run.
+        fallback_interpreter_.reset();
+    };
     //tflite::Interpreter* GetInterpreter();
 };
 
@@ -0,0 +1,118 @@
+#include "unit_memory.h"
+#include "algorithm"
+
+namespace tflite
+{
+
+IdleMemoryReleaser::IdleMemoryReleaser(int64_t check_interval_us_)
+    : check_interval_us(std::max<int64_t>(1000, check_interval_us_)) {}
+
+IdleMemoryReleaser::~IdleMemoryReleaser(){
+    Stop();
+}
+
+TfLiteStatus IdleMemoryReleaser::Register(const std::string& name,
+                                          Interpreter* interpreter, int64_t idle_us){
+    if(interpreter == nullptr){
+        PrintMsg("Interpreter nullptr ERROR");
+        return kTfLiteError;
+    }
+    if(idle_us < kMinIdleUs){
+        PrintMsg("Idle time must be >= 100 ms");
+        return kTfLiteError;
+    }
+    std::unique_lock<std::mutex> lock(mtx_entries);
+    for(size_t i=0; i<entries.size(); ++i){
+        if(entries[i].interpreter == interpreter){
+            entries[i].idle_us = idle_us;
+            return kTfLiteOk;
+        }
+    }
+    entries.push_back({name, interpreter, idle_us});
+    return kTfLiteOk;
+}
+
+void IdleMemoryReleaser::Unregister(Interpreter* interpreter){
+    std::unique_lock<std::mutex> lock(mtx_entries);
+    for(size_t i=0; i<entries.size(); ++i){
+        if(entries[i].interpreter == interpreter){
+            entries.erase(entries.begin() + i);
+            return;
+        }
+    }
+}
+
+TfLiteStatus IdleMemoryReleaser::Start(){
+    std::unique_lock<std::mutex> lock(mtx_worker);
+    if(started)
+        return kTfLiteOk;
+    stop_flag = false;
+    worker = std::thread(&IdleMemoryReleaser::Worker, this);
+    started = true;
+    std::cout << "IdleMemoryReleaser : Checking every " << check_interval_us
+              << " us \n";
+    return kTfLiteOk;
+}
+
+void IdleMemoryReleaser::Stop(){
+    {
+        std::unique_lock<std::mutex> lock(mtx_worker);
+        if(!started)
+            return;
+        stop_flag = true;
+    }
+    Rcontroller.notify_all();
+    worker.join();
+    std::unique_lock<std::mutex> lock(mtx_worker);
+    started = false;
+}
+
+size_t IdleMemoryReleaser::ReleaseIdle(){
+    std::unique_lock<std::mutex> lock(mtx_entries);
+    size_t total = 0;
+    for(size_t i=0; i<entries.size(); ++i){
+        size_t bytes = 0;
+        if(entries[i].interpreter->ReleaseIdleMemory(entries[i].idle_us, &bytes) != kTfLiteOk)
+            PrintMsg("ReleaseIdleMemory ERROR");
+        if(bytes > 0){
+            std::cout << "IdleMemoryReleaser : " << entries[i].name << " released "
+                      << bytes << " bytes \n";
+        }
+        total += bytes;
+    }
+    return total;
+}
+
+MemoryReleaseStats IdleMemoryReleaser::GetStats(){
+    std::unique_lock<std::mutex> lock(mtx_entries);
+    MemoryReleaseStats total;
+    for(size_t i=0; i<entries.size(); ++i){
+        MemoryReleaseStats stats = entries[i].interpreter->GetMemoryReleaseStats();
+        total.releases += stats.releases;
+        total.reacquires += stats.reacquires;
+        total.reacquire_us += stats.reacquire_us;
+        total.released_bytes += stats.released_bytes;
+        total.resident_bytes += stats.resident_bytes;
+    }
+    return total;
+}
+
+void IdleMemoryReleaser::Worker(){
+    std::unique_lock<std::mutex> lock(mtx_worker);
+    while(!stop_flag){
+        Rcontroller.wait_for(lock, std::chrono::microseconds(check_interval_us),
+                             [this]{ return stop_flag; });
+        if(stop_flag)
+            break;
+        lock.unlock();
+        ReleaseIdle();
+        lock.lock();
+    }
+}
+
+void IdleMemoryReleaser::PrintMsg(const char* msg){
+    std::cout << "IdleMemoryReleaser : \"" << msg << "\"\n";
+    return;
+}
+
+} // End of namespace tflite
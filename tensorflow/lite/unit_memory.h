@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "condition_variable"
+#include "mutex"
+#include "thread"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/c/common.h"
+
+/*
+IdleMemoryReleaser : Idle time memory release policy
+
+    Hosting more models than fit in RAM when all of them are active.
+    Registered interpreters whose subgraphs (partitions included) were not
+    invoked for their idle time get their non-persistent arenas released
+    (Interpreter::ReleaseIdleMemory). The next Invoke of a released subgraph
+    reacquires its arena by itself, units reacquire before filling inputs.
+
+    One thread checks every check_interval_us. A running invoke is never
+    released, nor an interpreter pinned between filling its inputs and
+    reading its outputs (units and the pool pin theirs). The idle timer of
+    a subgraph restarts when its invoke returns.
+    Interpreters must stay alive until unregistered (or Stop()).
+
+    Usage
+        IdleMemoryReleaser releaser(500000);
+        releaser.Register("detector", interpreter, 10 * 1000000);
+        releaser.Start();
+        ...
+        MemoryReleaseStats stats = releaser.GetStats();
+*/
+
+namespace tflite{
+
+class IdleMemoryReleaser
+{
+    public:
+        IdleMemoryReleaser(int64_t check_interval_us = 1000000);
+        ~IdleMemoryReleaser();
+
+        /// Releases 'interpreter' after idle_us (>= kMinIdleUs) without
+        /// invokes.
+        TfLiteStatus Register(const std::string& name, Interpreter* interpreter,
+                              int64_t idle_us);
+
+        /// Shorter idle times would release between back to back invokes
+        /// and pay the reacquire on every one of them.
+        static constexpr int64_t kMinIdleUs = 100000;
+        void Unregister(Interpreter* interpreter);
+
+        /// Launches the checking thread.
+        TfLiteStatus Start();
+        void Stop();
+
+        /// One check of every registered interpreter, returns the bytes
+        /// released. (what the thread runs every interval)
+        size_t ReleaseIdle();
+
+        /// Counters summed over all registered interpreters.
+        MemoryReleaseStats GetStats();
+
+    private:
+        struct Entry{
+            std::string name;
+            Interpreter* interpreter;
+            int64_t idle_us;
+        };
+
+        void Worker();
+
+        void PrintMsg(const char* msg);
+
+        int64_t check_interval_us;
+
+        std::vector<Entry> entries;
+        std::mutex mtx_entries;
+
+        std::thread worker;
+        std::mutex mtx_worker;
+        std::condition_variable Rcontroller;
+        bool stop_flag = false;
+        bool started = false;
+};
+
+} // End of namespace tflite
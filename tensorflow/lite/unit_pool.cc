@@ -0,0 +1,342 @@
+#include "unit_pool.h"
+#include "algorithm"
+
+namespace tflite
+{
+
+UnitPool::UnitPool(UnitPoolOptions options_) : options(options_) {
+    if(options.max_threads <= 0)
+        options.max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    if(options.num_workers <= 0)
+        options.num_workers = options.max_threads;
+}
+
+UnitPool::~UnitPool(){
+    Stop();
+}
+
+int UnitPool::AddModel(const std::string& name, tflite::InterpreterBuilder* builder,
+                       PoolModelOptions model_options){
+    if(started){
+        PrintMsg("Models must be added before Start()");
+        return -1;
+    }
+    if(builder == nullptr){
+        PrintMsg("InterpreterBuilder nullptr ERROR");
+        return -1;
+    }
+    std::unique_ptr<PoolModel> model(new PoolModel);
+    model->name = name;
+    model->options = model_options;
+    for(int i=0; i<std::max(1, model_options.instances); ++i){
+        std::unique_ptr<PoolInstance> instance(new PoolInstance);
+        if((*builder)(&instance->owned, model_options.num_threads) != kTfLiteOk ||
+           instance->owned == nullptr){
+            PrintMsg("Interpreter build ERROR");
+            return -1;
+        }
+        if(instance->owned->AllocateTensors() != kTfLiteOk){
+            PrintMsg("AllocateTensors ERROR");
+            return -1;
+        }
+        instance->interpreter = instance->owned.get();
+        model->instances.push_back(std::move(instance));
+    }
+    models.push_back(std::move(model));
+    std::cout << "UnitPool : Model " << name << " added with "
+              << models.back()->instances.size() << " interpreters \n";
+    return (int)models.size() - 1;
+}
+
+int UnitPool::AddModel(const std::string& name, std::vector<Unit*> units,
+                       PoolModelOptions model_options){
+    if(started){
+        PrintMsg("Models must be added before Start()");
+        return -1;
+    }
+    if(units.empty()){
+        PrintMsg("No Unit for model");
+        return -1;
+    }
+    std::unique_ptr<PoolModel> model(new PoolModel);
+    model->name = name;
+    model->options = model_options;
+    for(size_t i=0; i<units.size(); ++i){
+        std::unique_ptr<PoolInstance> instance(new PoolInstance);
+        instance->interpreter = units[i]->GetInterpreter();
+        instance->type = units[i]->GetUnitType();
+        if(instance->interpreter == nullptr){
+            PrintMsg("Unit has no interpreter");
+            return -1;
+        }
+        if(units[i]->HasExternalInput()){
+            PrintMsg("Unit input is bound to a frame ring");
+            return -1;
+        }
+        // A step holds num_threads cores, so the interpreter must not run on
+        // more than that. The units are handed over (see AddModel doc), the
+        // new count stays after the pool stops.
+        if(instance->interpreter->SetNumThreads(model_options.num_threads) != kTfLiteOk){
+            PrintMsg("SetNumThreads ERROR");
+            return -1;
+        }
+        // Partitions of a partitioned unit are separate steps.
+        if(instance->type == UnitType::GPU0)
+            instance->num_steps = std::max(1, (int)instance->interpreter->subgraphs_size());
+        model->instances.push_back(std::move(instance));
+    }
+    models.push_back(std::move(model));
+    std::cout << "UnitPool : Model " << name << " added on "
+              << units.size() << " units \n";
+    return (int)models.size() - 1;
+}
+
+TfLiteStatus UnitPool::Start(){
+    if(started)
+        return kTfLiteOk;
+    if(models.empty()){
+        PrintMsg("No Model to run");
+        return kTfLiteError;
+    }
+    stop_flag = false;
+    free_threads = options.max_threads;
+    for(int i=0; i<options.num_workers; ++i)
+        workers.push_back(std::thread(&UnitPool::Worker, this));
+    started = true;
+    std::cout << "UnitPool : " << workers.size() << " workers on "
+              << options.max_threads << " threads started \n";
+    return kTfLiteOk;
+}
+
+void UnitPool::Stop(){
+    if(!started)
+        return;
+    {
+        std::unique_lock<std::mutex> lock(mtx_pool);
+        stop_flag = true;
+    }
+    Pcontroller.notify_all();
+    for(size_t i=0; i<workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+    std::vector<PoolJob*> left;
+    {
+        std::unique_lock<std::mutex> lock(mtx_pool);
+        left.swap(ready);
+    }
+    for(size_t i=0; i<left.size(); ++i)
+        FinishJob(left[i], kTfLiteError);
+    started = false;
+    for(size_t i=0; i<models.size(); ++i){
+        const PoolModelStats& stats = models[i]->stats;
+        std::cout << "UnitPool : " << models[i]->name << " " << stats.invokes
+                  << " invokes, " << stats.missed << " missed, "
+                  << stats.preempted << " preempted, avg "
+                  << stats.avg_latency_us << " us \n";
+    }
+}
+
+std::future<TfLiteStatus> UnitPool::Submit(int model_id, std::vector<cv::Mat> inputs,
+                                           InvokeCallback callback){
+    std::promise<TfLiteStatus> failed;
+    if(model_id < 0 || model_id >= (int)models.size()){
+        PrintMsg("No such model");
+        failed.set_value(kTfLiteError);
+        return failed.get_future();
+    }
+    PoolJob* job = new PoolJob;
+    job->model = models[model_id].get();
+    job->inputs = inputs;
+    job->callback = callback;
+    job->submitted = std::chrono::steady_clock::now();
+    int64_t target = job->model->options.latency_target_us;
+    job->deadline = target > 0 ? job->submitted + std::chrono::microseconds(target)
+                               : std::chrono::steady_clock::time_point::max();
+    std::future<TfLiteStatus> future = job->done.get_future();
+    {
+        std::unique_lock<std::mutex> lock(mtx_pool);
+        if(!started || stop_flag){
+            lock.unlock();
+            PrintMsg("Pool not running");
+            job->done.set_value(kTfLiteError);
+            delete job;
+            return future;
+        }
+        job->sequence = next_sequence++;
+        ready.push_back(job);
+    }
+    Pcontroller.notify_one();
+    return future;
+}
+
+PoolModelStats UnitPool::GetModelStats(int model_id){
+    std::unique_lock<std::mutex> lock(mtx_pool);
+    if(model_id < 0 || model_id >= (int)models.size())
+        return PoolModelStats();
+    return models[model_id]->stats;
+}
+
+bool UnitPool::RunsBefore(const PoolJob* a, const PoolJob* b){
+    if(a->model->options.priority != b->model->options.priority)
+        return a->model->options.priority > b->model->options.priority;
+    if(a->deadline != b->deadline)
+        return a->deadline < b->deadline;
+    return a->sequence < b->sequence;
+}
+
+UnitPool::PoolJob* UnitPool::PickJob(){
+    PoolInstance* free_instance = nullptr;
+    int best = -1;
+    for(size_t i=0; i<ready.size(); ++i){
+        PoolInstance* instance = ready[i]->instance;
+        if(instance == nullptr){
+            // Not started yet, needs an idle interpreter of its model.
+            std::vector<std::unique_ptr<PoolInstance>>& instances = ready[i]->model->instances;
+            for(size_t j=0; j<instances.size() && instance == nullptr; ++j){
+                if(!instances[j]->busy)
+                    instance = instances[j].get();
+            }
+            if(instance == nullptr)
+                continue;
+        }
+        if(best < 0 || RunsBefore(ready[i], ready[best])){
+            best = (int)i;
+            free_instance = instance;
+        }
+    }
+    if(best < 0)
+        return nullptr;
+    PoolJob* job = ready[best];
+    int threads = std::max(1, std::min(job->model->options.num_threads,
+                                       options.max_threads));
+    // The best job waits for its cores, nothing overtakes it meanwhile.
+    if(threads > free_threads)
+        return nullptr;
+    ready.erase(ready.begin() + best);
+    if(job->instance == nullptr){
+        job->instance = free_instance;
+        job->instance->busy = true;
+    }
+    job->threads = threads;
+    free_threads -= threads;
+    return job;
+}
+
+void UnitPool::Worker(){
+    while(true){
+        PoolJob* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mtx_pool);
+            Pcontroller.wait(lock, [this, &job]{
+                if(stop_flag)
+                    return true;
+                job = PickJob();
+                return job != nullptr;
+            });
+            if(job == nullptr)
+                return;
+        }
+        TfLiteStatus status = RunStep(job);
+        bool finished = false;
+        {
+            std::unique_lock<std::mutex> lock(mtx_pool);
+            free_threads += job->threads;
+            job->threads = 0;
+            job->next_step++;
+            if(status != kTfLiteOk || job->next_step >= job->instance->num_steps){
+                finished = true;
+            }else{
+                // Partition boundary : anything better queued runs first.
+                for(size_t i=0; i<ready.size(); ++i){
+                    if(RunsBefore(ready[i], job)){
+                        job->model->stats.preempted++;
+                        break;
+                    }
+                }
+                ready.push_back(job);
+            }
+        }
+        Pcontroller.notify_all();
+        if(finished)
+            FinishJob(job, status);
+    }
+}
+
+TfLiteStatus UnitPool::RunStep(PoolJob* job){
+    PoolInstance* instance = job->instance;
+    Interpreter* interpreter = instance->interpreter;
+    if(job->next_step == 0){
+        // Held until FinishJob() : intermediate tensors must survive the
+        // waits between partition steps, outputs the callback.
+        interpreter->PinNonPersistentMemory();
+        job->memory_pinned = true;
+        if(interpreter->AcquireNonPersistentMemory() != kTfLiteOk)
+            return kTfLiteError;
+        // Empty inputs means the caller filled the input tensors itself.
+        for(size_t i=0; i<job->inputs.size() && i<interpreter->inputs().size(); ++i){
+            TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[i]);
+            if(CopyFrameToInputTensor(input, 0, job->inputs[i]) != kTfLiteOk)
+                return kTfLiteError;
+        }
+    }
+    if(instance->num_steps > 1){
+        if(interpreter->InvokePartition(job->next_step, instance->type,
+                                        instance->mtx_invoke, instance->mtx_invoke_,
+                                        instance->mtx_invoke_debug,
+                                        instance->Icontroller,
+                                        &instance->qInvokeShared) != kTfLiteOk){
+            PrintMsg("Partition Invoke ERROR");
+            return kTfLiteError;
+        }
+        if(job->next_step == instance->num_steps - 1){
+            for(int tensor_index : interpreter->outputs()){
+                if(interpreter->EnsureTensorDataIsReadable(tensor_index) != kTfLiteOk)
+                    return kTfLiteError;
+            }
+        }
+        return kTfLiteOk;
+    }
+    if(instance->type == UnitType::CPU0 || instance->type == UnitType::GPU0){
+        return interpreter->Invoke(instance->type, instance->mtx_invoke,
+                                   instance->mtx_invoke_, instance->mtx_invoke_debug,
+                                   instance->Icontroller, &instance->qInvokeShared);
+    }
+    return interpreter->Invoke();
+}
+
+void UnitPool::FinishJob(PoolJob* job, TfLiteStatus status){
+    Interpreter* interpreter = job->instance ? job->instance->interpreter : nullptr;
+    if(job->callback)
+        job->callback(status, interpreter);
+    if(job->memory_pinned)
+        interpreter->UnpinNonPersistentMemory();
+    auto now = std::chrono::steady_clock::now();
+    double latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            now - job->submitted).count();
+    {
+        std::unique_lock<std::mutex> lock(mtx_pool);
+        PoolModelStats& stats = job->model->stats;
+        if(status == kTfLiteOk){
+            stats.invokes++;
+            job->model->total_latency_us += latency_us;
+            stats.avg_latency_us = job->model->total_latency_us / stats.invokes;
+            stats.max_latency_us = std::max(stats.max_latency_us, latency_us);
+            if(now > job->deadline)
+                stats.missed++;
+        }else{
+            stats.failed++;
+        }
+        if(job->instance != nullptr)
+            job->instance->busy = false;
+    }
+    Pcontroller.notify_all();
+    job->done.set_value(status);
+    delete job;
+}
+
+void UnitPool::PrintMsg(const char* msg){
+    std::cout << "UnitPool : \"" << msg << "\"\n";
+    return;
+}
+
+} // End of namespace tflite
@@ -0,0 +1,192 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include "condition_variable"
+#include "mutex"
+#include "thread"
+#include "future"
+#include "opencv2/opencv.hpp"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/interpreter_builder.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/unit.h"
+
+/*
+UnitPool : Shared execution pool for several models
+
+    Models (a detector, a downstream classifier, ..) register with a priority
+    and a latency target instead of running on threads of their own, and
+    their invokes are interleaved on the pool's workers.
+
+    One invoke is cut into steps : a whole Invoke for plain interpreters, one
+    step per partition for partitioned (GPU0) units. After every step the
+    job goes back to the ready queue and the best ready job runs next, so
+    high priority work preempts lower priority invokes at partition
+    boundaries. Ready jobs are ordered by
+        priority (higher first) > deadline (submit + latency target) > arrival
+
+    Core usage stays bounded : a running step holds num_threads of its model
+    out of max_threads. If the best ready job does not fit, lower ones wait
+    too, so small jobs can not starve it.
+
+    A job keeps its interpreter between steps (intermediate tensors live in
+    it), instances = invokes of the model that can be in flight at once.
+
+    Usage
+        UnitPool pool;
+        PoolModelOptions detector;
+        detector.priority = 10;
+        detector.latency_target_us = 33000;
+        detector.num_threads = 4;
+        int det = pool.AddModel("detector", det_builder, detector);
+        int cls = pool.AddModel("classifier", cls_builder, PoolModelOptions());
+        pool.Start();
+        std::future<TfLiteStatus> done = pool.Submit(det, {frame});
+*/
+
+namespace tflite{
+
+struct UnitPoolOptions{
+    /// Cores the pool may keep busy at once. 0 : every core
+    int max_threads = 0;
+    /// Worker threads (steps running at once). 0 : max_threads
+    int num_workers = 0;
+};
+
+struct PoolModelOptions{
+    /// Higher runs first and preempts lower at partition boundaries
+    int priority = 0;
+    /// Submit to done budget of one invoke (0 : none). Orders jobs of the
+    /// same priority (earliest deadline first), late invokes are counted.
+    int64_t latency_target_us = 0;
+    /// CPU threads of the model's interpreters (cores a step holds)
+    int num_threads = 1;
+    /// Interpreters built from the builder (ignored for units)
+    int instances = 1;
+};
+
+struct PoolModelStats{
+    int invokes = 0;
+    int failed = 0;
+    /// Invokes done after their latency target
+    int missed = 0;
+    /// Partition boundaries at which other work went first
+    int preempted = 0;
+    double avg_latency_us = 0;
+    double max_latency_us = 0;
+};
+
+class UnitPool
+{
+    public:
+        UnitPool(UnitPoolOptions options = UnitPoolOptions());
+        ~UnitPool();
+
+        /// Builds options.instances interpreters of the model. Returns the
+        /// model id used by Submit(), -1 on error. Call before Start().
+        int AddModel(const std::string& name, tflite::InterpreterBuilder* builder,
+                     PoolModelOptions options);
+        /// Runs the model on existing units (one instance per unit). The
+        /// units are handed over to the pool : it keeps raw pointers to their
+        /// interpreters, so units and interpreters must outlive the pool, and
+        /// must not be invoked, swapped or bound to a frame ring by any other
+        /// path meanwhile (units already bound are refused). Their
+        /// interpreters are set to options.num_threads threads for good, the
+        /// old thread count is not restored when the pool stops.
+        int AddModel(const std::string& name, std::vector<Unit*> units,
+                     PoolModelOptions options);
+
+        /// Launches the workers.
+        TfLiteStatus Start();
+
+        /// Joins the workers after their current step, queued and preempted
+        /// jobs fail.
+        void Stop();
+
+        /// Queues one invoke. The callback runs on a worker right after the
+        /// last step, outputs of the interpreter stay valid until it returns.
+        std::future<TfLiteStatus> Submit(int model_id, std::vector<cv::Mat> inputs,
+                                         InvokeCallback callback = nullptr);
+
+        PoolModelStats GetModelStats(int model_id);
+        int GetModelCount() { return (int)models.size(); }
+        int GetMaxThreads() { return options.max_threads; }
+
+    private:
+        struct PoolInstance{
+            Interpreter* interpreter = nullptr;
+            std::unique_ptr<tflite::Interpreter> owned;
+            UnitType type = UnitType::NONE;
+            int num_steps = 1;
+            bool busy = false;
+
+            /// Sync objects handed to Interpreter::Invoke/InvokePartition
+            std::mutex mtx_invoke;
+            std::mutex mtx_invoke_;
+            std::mutex mtx_invoke_debug;
+            std::condition_variable Icontroller;
+            std::queue<SharedContext*> qInvokeShared;
+        };
+
+        struct PoolModel{
+            std::string name;
+            PoolModelOptions options;
+            std::vector<std::unique_ptr<PoolInstance>> instances;
+            PoolModelStats stats;
+            double total_latency_us = 0;
+        };
+
+        struct PoolJob{
+            PoolModel* model;
+            std::vector<cv::Mat> inputs;
+            InvokeCallback callback;
+            std::promise<TfLiteStatus> done;
+            /// Reserved on the first step, kept until the last one
+            PoolInstance* instance = nullptr;
+            int next_step = 0;
+            /// Interpreter memory pinned from the first step to FinishJob()
+            bool memory_pinned = false;
+            /// Cores held by the running step
+            int threads = 0;
+            std::chrono::steady_clock::time_point submitted;
+            std::chrono::steady_clock::time_point deadline;
+            uint64_t sequence = 0;
+        };
+
+        void Worker();
+
+        /// True if 'a' should run before 'b'.
+        static bool RunsBefore(const PoolJob* a, const PoolJob* b);
+
+        /// Takes the best runnable ready job (instance & cores reserved),
+        /// nullptr if it has to wait. Call with mtx_pool held.
+        PoolJob* PickJob();
+
+        /// Runs the next step of the job (fills the inputs first).
+        TfLiteStatus RunStep(PoolJob* job);
+
+        /// Callback, stats, releases the instance and the promise.
+        void FinishJob(PoolJob* job, TfLiteStatus status);
+
+        void PrintMsg(const char* msg);
+
+        UnitPoolOptions options;
+
+        std::vector<std::unique_ptr<PoolModel>> models;
+
+        /// Jobs waiting for their next step
+        std::vector<PoolJob*> ready;
+        std::mutex mtx_pool;
+        std::condition_variable Pcontroller;
+        std::vector<std::thread> workers;
+        int free_threads = 0;
+        uint64_t next_sequence = 0;
+        bool stop_flag = false;
+        bool started = false;
+};
+
+} // End of namespace tflite
@@ -0,0 +1,405 @@
+#include "unit_shm.h"
+#include "algorithm"
+#include "cerrno"
+#include "chrono"
+#include "climits"
+#include "csignal"
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "tensorflow/lite/util.h"
+
+namespace tflite
+{
+
+namespace {
+
+constexpr uint32_t kShmRingMagic = 0x464e5247; // "FRNG"
+constexpr uint32_t kShmRingVersion = 1;
+constexpr int kShmRingMaxSlots = 64;
+
+// 32 bit (int) and 64 bit (long long) atomics, C++14 has no is_always_lock_free.
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "ring atomics are shared between processes");
+
+bool ProcessAlive(pid_t pid){
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+size_t AlignUp(size_t value){
+    return (value + kDefaultTensorAlignment - 1) / kDefaultTensorAlignment
+           * kDefaultTensorAlignment;
+}
+
+// Shared (not FUTEX_PRIVATE) futex : the waiter is in another process.
+int FutexWait(std::atomic<uint32_t>* word, uint32_t expected, int64_t timeout_us){
+    struct timespec timeout;
+    struct timespec* timeout_ptr = nullptr;
+    if(timeout_us >= 0){
+        timeout.tv_sec = timeout_us / 1000000;
+        timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+        timeout_ptr = &timeout;
+    }
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT,
+                   expected, timeout_ptr, nullptr, 0);
+}
+
+void FutexWakeAll(std::atomic<uint32_t>* word){
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+
+uint64_t PublishedSequence(uint64_t published) { return published >> 8; }
+int PublishedSlot(uint64_t published) { return (int)(published & 0xff); }
+
+} // namespace
+
+struct ShmFrameRing::ShmRingHeader{
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t type;
+    int32_t num_slots;
+    int32_t producer_pid;
+    uint64_t frame_bytes;
+    uint64_t slot_bytes;
+    uint64_t data_offset;
+    /// Newest frame : sequence << 8 | slot (0 : nothing published yet)
+    std::atomic<uint64_t> published;
+    /// Bumped on every publish, the consumer futex-waits on it
+    std::atomic<uint32_t> futex;
+    /// Consumers sleeping on 'futex' (no wake syscall when 0)
+    std::atomic<uint32_t> waiters;
+    /// Slot the consumer holds (-1 : none)
+    std::atomic<int32_t> held_slot;
+};
+
+struct ShmFrameRing::ShmSlotHeader{
+    /// Sequence of the frame in the slot, 0 while it is written
+    std::atomic<uint64_t> sequence;
+    uint64_t timestamp_us;
+};
+
+ShmFrameRing::ShmFrameRing() {}
+
+ShmFrameRing::~ShmFrameRing(){
+    Close();
+}
+
+TfLiteStatus ShmFrameRing::Map(int fd, size_t size, bool create){
+    if(create && ftruncate(fd, size) != 0){
+        PrintMsg("ftruncate ERROR");
+        close(fd);
+        return kTfLiteError;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the object alive
+    if(mapped == MAP_FAILED){
+        PrintMsg("mmap ERROR");
+        return kTfLiteError;
+    }
+    base = mapped;
+    mapped_bytes = size;
+    header = static_cast<ShmRingHeader*>(base);
+    return kTfLiteOk;
+}
+
+TfLiteStatus ShmFrameRing::Create(const std::string& name_, ShmRingLayout layout_){
+    if(base != nullptr){
+        PrintMsg("Ring already mapped");
+        return kTfLiteError;
+    }
+    if(layout_.num_slots < 3 || layout_.num_slots > kShmRingMaxSlots){
+        PrintMsg("num_slots must be in [3, 64]");
+        return kTfLiteError;
+    }
+    size_t element_bytes = 0;
+    if(layout_.width <= 0 || layout_.height <= 0 || layout_.channels <= 0 ||
+       GetSizeOfType(nullptr, layout_.type, &element_bytes) != kTfLiteOk){
+        PrintMsg("Invalid frame layout");
+        return kTfLiteError;
+    }
+    layout = layout_;
+    frame_bytes = (size_t)layout.width * layout.height * layout.channels * element_bytes;
+    slot_bytes = AlignUp(frame_bytes);
+    const size_t data_offset = AlignUp(sizeof(ShmRingHeader) +
+                                       layout.num_slots * sizeof(ShmSlotHeader));
+    const size_t size = data_offset + layout.num_slots * slot_bytes;
+
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0 && errno == EEXIST){
+        // Only a stale object (crashed producer) is replaced, its consumer
+        // reopens. A live producer keeps its ring.
+        if(!StaleRing(name_)){
+            PrintMsg("Ring owned by a live producer");
+            return kTfLiteError;
+        }
+        shm_unlink(name_.c_str());
+        fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if(fd < 0){
+        PrintMsg("shm_open ERROR");
+        return kTfLiteError;
+    }
+    if(Map(fd, size, true) != kTfLiteOk){
+        shm_unlink(name_.c_str());
+        return kTfLiteError;
+    }
+    name = name_;
+    owner = true;
+
+    // First, a producer racing with this one sees the object as live.
+    header->producer_pid = getpid();
+    header->width = layout.width;
+    header->height = layout.height;
+    header->channels = layout.channels;
+    header->type = layout.type;
+    header->num_slots = layout.num_slots;
+    header->frame_bytes = frame_bytes;
+    header->slot_bytes = slot_bytes;
+    header->data_offset = data_offset;
+    header->published.store(0);
+    header->futex.store(0);
+    header->waiters.store(0);
+    header->held_slot.store(-1);
+    for(int i=0; i<layout.num_slots; ++i){
+        Slot(i)->sequence.store(0);
+        Slot(i)->timestamp_us = 0;
+    }
+    header->version = kShmRingVersion;
+    // Consumers check the magic last.
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = kShmRingMagic;
+    std::cout << "ShmFrameRing : Created " << name << " (" << layout.num_slots
+              << " slots of " << slot_bytes << " bytes) \n";
+    return kTfLiteOk;
+}
+
+bool ShmFrameRing::StaleRing(const std::string& name_){
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0600);
+    if(fd < 0)
+        return errno == ENOENT; // unlinked meanwhile
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ShmRingHeader)){
+        // Being sized by its producer (or it died before), can not tell.
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        return false;
+    pid_t pid = static_cast<ShmRingHeader*>(mapped)->producer_pid;
+    munmap(mapped, sizeof(ShmRingHeader));
+    return pid > 0 && !ProcessAlive(pid);
+}
+
+TfLiteStatus ShmFrameRing::Open(const std::string& name_){
+    if(base != nullptr){
+        PrintMsg("Ring already mapped");
+        return kTfLiteError;
+    }
+    int fd = shm_open(name_.c_str(), O_RDWR, 0600);
+    if(fd < 0){
+        PrintMsg("shm_open ERROR (no producer yet?)");
+        return kTfLiteError;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ShmRingHeader)){
+        PrintMsg("Ring not initialized");
+        close(fd);
+        return kTfLiteError;
+    }
+    if(Map(fd, info.st_size, false) != kTfLiteOk)
+        return kTfLiteError;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(header->magic != kShmRingMagic || header->version != kShmRingVersion){
+        PrintMsg("Not a frame ring (or not initialized yet)");
+        Close();
+        return kTfLiteError;
+    }
+    layout.width = header->width;
+    layout.height = header->height;
+    layout.channels = header->channels;
+    layout.type = (TfLiteType)header->type;
+    layout.num_slots = header->num_slots;
+    frame_bytes = header->frame_bytes;
+    slot_bytes = header->slot_bytes;
+    if(header->data_offset + layout.num_slots * slot_bytes > mapped_bytes){
+        PrintMsg("Ring smaller than its layout");
+        Close();
+        return kTfLiteError;
+    }
+    name = name_;
+    owner = false;
+    // A crashed consumer may have left its slot held.
+    header->held_slot.store(-1);
+    held = ShmFrame();
+    std::cout << "ShmFrameRing : Opened " << name << " " << layout.width << "x"
+              << layout.height << "x" << layout.channels << " \n";
+    return kTfLiteOk;
+}
+
+void ShmFrameRing::Close(){
+    if(base == nullptr)
+        return;
+    if(!owner)
+        ReleaseFrame();
+    munmap(base, mapped_bytes);
+    if(owner)
+        shm_unlink(name.c_str());
+    base = nullptr;
+    header = nullptr;
+    mapped_bytes = 0;
+    owner = false;
+}
+
+ShmFrameRing::ShmSlotHeader* ShmFrameRing::Slot(int index){
+    ShmSlotHeader* slots = reinterpret_cast<ShmSlotHeader*>(
+        static_cast<uint8_t*>(base) + sizeof(ShmRingHeader));
+    return &slots[index];
+}
+
+uint8_t* ShmFrameRing::SlotData(int index){
+    return static_cast<uint8_t*>(base) + header->data_offset + index * slot_bytes;
+}
+
+uint8_t* ShmFrameRing::BeginFrame(){
+    if(header == nullptr || !owner){
+        PrintMsg("BeginFrame on a ring not created here");
+        return nullptr;
+    }
+    if(writing_slot >= 0)
+        return SlotData(writing_slot);
+    const int last = last_published ? PublishedSlot(header->published.load()) : -1;
+    for(int step=1; step<=layout.num_slots; ++step){
+        const int slot = (last + step + layout.num_slots) % layout.num_slots;
+        if(slot == last)
+            continue;
+        if(header->held_slot.load() == slot)
+            continue;
+        // Mark the slot as being written, then check again that the consumer
+        // did not take it meanwhile. Either it sees the mark and retries, or
+        // we see its hold here and leave the slot (its data is untouched).
+        const uint64_t previous = Slot(slot)->sequence.exchange(0);
+        if(header->held_slot.load() == slot){
+            Slot(slot)->sequence.store(previous);
+            continue;
+        }
+        writing_slot = slot;
+        return SlotData(slot);
+    }
+    PrintMsg("No free slot");
+    return nullptr;
+}
+
+uint64_t ShmFrameRing::PublishFrame(uint64_t timestamp_us){
+    if(header == nullptr || writing_slot < 0){
+        PrintMsg("PublishFrame without BeginFrame");
+        return 0;
+    }
+    const uint64_t sequence = ++last_published;
+    Slot(writing_slot)->timestamp_us = timestamp_us;
+    Slot(writing_slot)->sequence.store(sequence, std::memory_order_release);
+    header->published.store(sequence << 8 | (uint64_t)writing_slot,
+                            std::memory_order_release);
+    writing_slot = -1;
+    header->futex.fetch_add(1);
+    if(header->waiters.load() > 0)
+        FutexWakeAll(&header->futex);
+    return sequence;
+}
+
+TfLiteStatus ShmFrameRing::WaitFrame(uint64_t after_sequence, int64_t timeout_us,
+                                     ShmFrame* frame){
+    if(header == nullptr || owner){
+        PrintMsg("WaitFrame on a ring not opened here");
+        return kTfLiteError;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    while(true){
+        const uint32_t futex_value = header->futex.load();
+        const uint64_t published = header->published.load(std::memory_order_acquire);
+        const uint64_t sequence = PublishedSequence(published);
+        if(published != 0 && sequence > after_sequence){
+            const int slot = PublishedSlot(published);
+            header->held_slot.store(slot);
+            // The producer may have started overwriting it before the hold.
+            if(Slot(slot)->sequence.load(std::memory_order_acquire) == sequence){
+                frame->dropped = held.sequence && sequence > held.sequence + 1 ?
+                                 sequence - held.sequence - 1 : 0;
+                frame->sequence = sequence;
+                frame->timestamp_us = Slot(slot)->timestamp_us;
+                frame->slot = slot;
+                frame->data = SlotData(slot);
+                frame->bytes = frame_bytes;
+                held = *frame;
+                return kTfLiteOk;
+            }
+            continue; // a newer frame is on its way
+        }
+        int64_t wait_us = -1;
+        if(timeout_us >= 0){
+            const int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                                        std::chrono::steady_clock::now() - start).count();
+            if(elapsed >= timeout_us)
+                return kTfLiteError;
+            wait_us = timeout_us - elapsed;
+        }
+        header->waiters.fetch_add(1);
+        // Returns at once if a publish bumped the futex since it was read.
+        FutexWait(&header->futex, futex_value, wait_us);
+        header->waiters.fetch_sub(1);
+    }
+}
+
+void ShmFrameRing::ReleaseFrame(){
+    if(header == nullptr || owner || held.data == nullptr)
+        return;
+    header->held_slot.store(-1);
+    held.data = nullptr;
+    held.slot = -1;
+}
+
+TfLiteStatus ShmFrameRing::BindInput(Interpreter* interpreter, int tensor_index){
+    if(held.data == nullptr){
+        PrintMsg("No frame held");
+        return kTfLiteError;
+    }
+    TfLiteTensor* tensor = interpreter->tensor(tensor_index);
+    if(tensor == nullptr || tensor->dims == nullptr){
+        PrintMsg("No such tensor");
+        return kTfLiteError;
+    }
+    // Same check as CopyFrameToInputTensor() : NHWC, batch 1.
+    const TfLiteIntArray* dims = tensor->dims;
+    if(tensor->type != layout.type || dims->size != 4 || dims->data[0] != 1 ||
+       dims->data[1] != layout.height || dims->data[2] != layout.width ||
+       dims->data[3] != layout.channels){
+        PrintMsg("Frame layout does not match the input tensor");
+        return kTfLiteError;
+    }
+    TfLiteCustomAllocation allocation = {held.data, slot_bytes};
+    return interpreter->SetCustomAllocationForTensor(tensor_index, allocation);
+}
+
+bool ShmFrameRing::ProducerAlive(){
+    if(header == nullptr)
+        return false;
+    if(owner)
+        return true;
+    return ProcessAlive(header->producer_pid);
+}
+
+void ShmFrameRing::PrintMsg(const char* msg){
+    std::cout << "ShmFrameRing : \"" << msg << "\"\n";
+    return;
+}
+
+} // End of namespace tflite
@@ -0,0 +1,159 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/c/common.h"
+
+/*
+ShmFrameRing : Shared memory frame ring between a capture process and the
+               inference process
+
+    The capture process (producer) writes frames straight in the model's
+    input layout (NHWC, input tensor type) into the slots of a POSIX shared
+    memory object, the inference process (consumer) binds the input tensor
+    of its interpreter to the slot of the newest frame (custom allocation),
+    so frames are never copied on the inference side (no SetInput, no copy
+    to the input tensor). Capture and inference crash independently.
+
+    Layout of the shared object
+        ShmRingHeader | ShmSlotHeader x num_slots | slot data x num_slots
+    Slot data is 64 byte aligned (kDefaultTensorAlignment).
+
+    Every published frame gets a sequence number (1, 2, ..). The consumer
+    always takes the newest frame (older ones are dropped, like a camera).
+    The slot it holds is never written by the producer until the consumer
+    moves on, the producer cycles through the other slots (num_slots >= 3).
+    The consumer sleeps on a futex the producer bumps on every publish.
+
+    One producer & one consumer per ring.
+    A bound interpreter points into the mapping : keep the ring open as long
+    as the interpreter runs.
+
+    Usage
+        Producer (capture process)
+            ShmRingLayout layout = {300, 300, 3, kTfLiteUInt8, 4};
+            ShmFrameRing ring;
+            ring.Create("/camera0", layout);
+            uint8_t* slot = ring.BeginFrame();
+            ... write the frame ...
+            ring.PublishFrame();
+
+        Consumer (inference process)
+            ShmFrameRing ring;
+            ring.Open("/camera0");
+            ShmFrame frame;
+            ring.WaitFrame(last_sequence, 100000, &frame);
+            ring.BindInput(interpreter, interpreter->inputs()[0]);
+            interpreter->Invoke();
+*/
+
+namespace tflite{
+
+/// Frame format of a ring, chosen by the producer.
+struct ShmRingLayout{
+    int width;
+    int height;
+    int channels;
+    /// Type of one element (kTfLiteUInt8, kTfLiteInt8, kTfLiteFloat32)
+    TfLiteType type;
+    /// Frames in the ring (>= 3 : one held by the consumer, one being
+    /// written, one published)
+    int num_slots;
+};
+
+/// One frame held by the consumer.
+struct ShmFrame{
+    uint64_t sequence = 0;
+    /// Producer's timestamp of the frame (us, as given to PublishFrame)
+    uint64_t timestamp_us = 0;
+    /// Frames published since the previous one that were never taken
+    uint64_t dropped = 0;
+    int slot = -1;
+    void* data = nullptr;
+    size_t bytes = 0;
+};
+
+class ShmFrameRing
+{
+    public:
+        ShmFrameRing();
+        ~ShmFrameRing();
+
+        /// Producer : creates the shared memory object 'name' (POSIX shm
+        /// name, e.g. "/camera0") and maps it. An existing object is only
+        /// replaced if its producer is dead, otherwise kTfLiteError.
+        TfLiteStatus Create(const std::string& name, ShmRingLayout layout);
+
+        /// Consumer : maps the ring a producer created.
+        TfLiteStatus Open(const std::string& name);
+
+        /// Unmaps (and unlinks if created here) the ring.
+        void Close();
+
+        /// Producer : slot memory the next frame is written into. The slot
+        /// the consumer holds is never returned.
+        uint8_t* BeginFrame();
+
+        /// Producer : publishes the frame written since BeginFrame() and
+        /// wakes the consumer. Returns its sequence number.
+        uint64_t PublishFrame(uint64_t timestamp_us = 0);
+
+        /// Consumer : waits (up to timeout_us, < 0 : for ever) for a frame
+        /// newer than 'after_sequence' and holds the newest one until the
+        /// next WaitFrame() / ReleaseFrame(). kTfLiteError on timeout.
+        TfLiteStatus WaitFrame(uint64_t after_sequence, int64_t timeout_us,
+                               ShmFrame* frame);
+
+        /// Consumer : lets the producer reuse the held slot.
+        void ReleaseFrame();
+
+        /// Consumer : points tensor 'tensor_index' of 'interpreter' at the
+        /// held frame (no copy). Layout and tensor must match. The binding
+        /// can not be undone, the tensor must not be written afterwards and
+        /// the interpreter not invoked once the ring is closed.
+        TfLiteStatus BindInput(Interpreter* interpreter, int tensor_index);
+
+        /// False if the producer process is gone (consumer side), the ring
+        /// then has to be reopened once a new producer created it.
+        bool ProducerAlive();
+
+        const ShmRingLayout& GetLayout() { return layout; }
+        size_t GetSlotBytes() { return slot_bytes; }
+        /// Bytes of one frame (w * h * c * element size)
+        size_t GetFrameBytes() { return frame_bytes; }
+
+    private:
+        struct ShmRingHeader;
+        struct ShmSlotHeader;
+
+        TfLiteStatus Map(int fd, size_t size, bool create);
+        /// True if the existing object 'name' was created by a dead producer.
+        bool StaleRing(const std::string& name);
+
+        ShmSlotHeader* Slot(int index);
+        uint8_t* SlotData(int index);
+
+        void PrintMsg(const char* msg);
+
+        std::string name;
+        bool owner = false;
+        void* base = nullptr;
+        size_t mapped_bytes = 0;
+        ShmRingHeader* header = nullptr;
+
+        ShmRingLayout layout;
+        size_t frame_bytes = 0;
+        size_t slot_bytes = 0;
+
+        /// Producer : slot between BeginFrame() & PublishFrame()
+        int writing_slot = -1;
+        uint64_t last_published = 0;
+
+        /// Consumer : frame currently held
+        ShmFrame held;
+};
+
+} // End of namespace tflite
@@ -0,0 +1,234 @@
+#include "unit_sim.h"
+#include "algorithm"
+#include "thread"
+#include "future"
+
+namespace tflite
+{
+
+// SimLatencyInjector
+SimLatencyInjector::SimLatencyInjector(SimLatencyModel model_) : model(model_) {
+    if(model.default_speedup <= 0)
+        model.default_speedup = 1.0;
+    if(model.time_scale <= 0)
+        model.time_scale = 1.0;
+}
+
+TfLiteStatus SimLatencyInjector::Attach(Interpreter* interpreter){
+    if(interpreter == nullptr){
+        std::cout << "SimLatencyInjector : \"Interpreter nullptr ERROR\"\n";
+        return kTfLiteError;
+    }
+    std::unique_lock<std::mutex> lock(mtx_sim);
+    const int num_subgraphs = interpreter->subgraphs_size();
+    transfer_bytes.assign(num_subgraphs, std::vector<int64_t>());
+    calibrated_us.assign(num_subgraphs, std::vector<double>());
+    samples.assign(num_subgraphs, std::vector<int>());
+    first_node.assign(num_subgraphs, -1);
+    for(int s=0; s<num_subgraphs; ++s){
+        Subgraph* subgraph = interpreter->subgraph(s);
+        const size_t num_nodes = subgraph->nodes_size();
+        transfer_bytes[s].assign(num_nodes, 0);
+        calibrated_us[s].assign(num_nodes, 0.0);
+        samples[s].assign(num_nodes, 0);
+        if(!subgraph->execution_plan().empty())
+            first_node[s] = subgraph->execution_plan()[0];
+        const std::vector<int>& inputs = subgraph->inputs();
+        const std::vector<int>& outputs = subgraph->outputs();
+        for(size_t n=0; n<num_nodes; ++n){
+            const TfLiteNode& node = subgraph->node_and_registration(n)->first;
+            int64_t bytes = 0;
+            // Crossing the partition boundary : in from the host, out to it.
+            for(int i=0; i<node.inputs->size; ++i){
+                int tensor_index = node.inputs->data[i];
+                if(tensor_index == kTfLiteOptionalTensor)
+                    continue;
+                if(std::find(inputs.begin(), inputs.end(), tensor_index) != inputs.end())
+                    bytes += subgraph->tensor(tensor_index)->bytes;
+            }
+            for(int i=0; i<node.outputs->size; ++i){
+                int tensor_index = node.outputs->data[i];
+                if(std::find(outputs.begin(), outputs.end(), tensor_index) != outputs.end())
+                    bytes += subgraph->tensor(tensor_index)->bytes;
+            }
+            transfer_bytes[s][n] = bytes;
+        }
+    }
+    stats = SimStats();
+    return kTfLiteOk;
+}
+
+uint32_t SimLatencyInjector::BeginEvent(const char* tag, EventType event_type,
+                                        int64_t event_metadata1,
+                                        int64_t event_metadata2){
+    if(event_type != EventType::OPERATOR_INVOKE_EVENT)
+        return 0;
+    OpEvent event;
+    event.op = tag ? tag : "";
+    event.node = (int)event_metadata1;
+    event.subgraph = (int)event_metadata2;
+    event.begin = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mtx_sim);
+    uint32_t handle = next_handle++;
+    if(next_handle == 0)
+        next_handle = 1;
+    events[handle] = event;
+    return handle;
+}
+
+void SimLatencyInjector::EndEvent(uint32_t event_handle){
+    if(event_handle == 0)
+        return;
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point until;
+    {
+        std::unique_lock<std::mutex> lock(mtx_sim);
+        auto found = events.find(event_handle);
+        if(found == events.end())
+            return;
+        OpEvent event = found->second;
+        events.erase(found);
+        const int s = event.subgraph;
+        const int n = event.node;
+        if(s < 0 || s >= (int)transfer_bytes.size() ||
+           n < 0 || n >= (int)transfer_bytes[s].size() || !Simulated(s))
+            return;
+        double cpu_us = std::chrono::duration<double, std::micro>(
+                            end - event.begin).count();
+        double base_us = cpu_us;
+        if(model.calibration_invokes == 0 || samples[s][n] <= model.calibration_invokes){
+            // Still measuring : running mean of the warm runs (the first,
+            // cold run packs weights & touches the arena).
+            if(samples[s][n] > 0)
+                calibrated_us[s][n] += (cpu_us - calibrated_us[s][n]) / samples[s][n];
+            samples[s][n]++;
+            stats.calibrating_ops++;
+        }else{
+            base_us = calibrated_us[s][n];
+        }
+        double transfer_us = 0;
+        if(model.transfer_mb_per_s > 0)
+            transfer_us = transfer_bytes[s][n] / model.transfer_mb_per_s; // MB/s == B/us
+        double modeled_us = model.time_scale *
+                            (base_us / Speedup(event.op) + model.launch_overhead_us + transfer_us);
+        if(n == first_node[s])
+            stats.invokes++;
+        stats.modeled_us += modeled_us;
+        stats.cpu_us += cpu_us;
+        stats.launch_us += model.time_scale * model.launch_overhead_us;
+        stats.transfer_us += model.time_scale * transfer_us;
+        stats.transferred_bytes += transfer_bytes[s][n];
+        if(cpu_us > modeled_us)
+            stats.overruns++;
+        until = event.begin + std::chrono::microseconds((int64_t)modeled_us);
+    }
+    HoldUntil(until);
+}
+
+SimStats SimLatencyInjector::GetStats(){
+    std::unique_lock<std::mutex> lock(mtx_sim);
+    return stats;
+}
+
+bool SimLatencyInjector::Simulated(int subgraph){
+    if(model.partitions.empty())
+        return true;
+    return std::find(model.partitions.begin(), model.partitions.end(), subgraph)
+                                                    != model.partitions.end();
+}
+
+double SimLatencyInjector::Speedup(const std::string& op){
+    auto found = model.op_speedup.find(op);
+    if(found != model.op_speedup.end() && found->second > 0)
+        return found->second;
+    return model.default_speedup;
+}
+
+void SimLatencyInjector::HoldUntil(std::chrono::steady_clock::time_point until){
+    // Sleeping alone overshoots by the scheduler's wake up latency.
+    const auto spin = std::chrono::microseconds(100);
+    auto now = std::chrono::steady_clock::now();
+    if(until - now > spin)
+        std::this_thread::sleep_until(until - spin);
+    while(std::chrono::steady_clock::now() < until)
+        std::this_thread::yield();
+}
+
+// UnitSim
+UnitSim::UnitSim() : name("NONE"), interpreterSim(nullptr){}
+
+UnitSim::UnitSim(UnitType eType_, std::unique_ptr<tflite::Interpreter>* interpreter,
+                 SimLatencyModel model_)
+            : eType(eType_), interpreterSim(interpreter), model(model_) {
+    injector = Install(interpreterSim->get());
+    // The simulated device queue
+    if(StartAsync() != kTfLiteOk)
+        std::cout << "UnitSim : \"Device thread not started\"\n";
+}
+
+UnitSim::~UnitSim(){
+    StopAsync();
+}
+
+TfLiteStatus UnitSim::Invoke(UnitType eType, std::mutex& mtx_lock,
+                            std::mutex& mtx_lock_,
+                            std::mutex& mtx_lock_timing,
+                            std::mutex& mtx_lock_debug,
+                            std::condition_variable& Ucontroller,
+                            std::condition_variable& Outcontroller,
+                            std::queue<SharedContext*>* qSharedData,
+                            int* C_Counter, int* G_Counter){
+    std::cout << "Starting SIM Job" << "\n";
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if(InvokeAsync(input).get() != kTfLiteOk)
+        return kTfLiteError;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    {
+        std::unique_lock<std::mutex> lock(mtx_lock_timing);
+        if(eType >= UnitType::GPU0)
+            *G_Counter += 1;
+        else
+            *C_Counter += 1;
+    }
+    double time = (end.tv_sec - begin.tv_sec) + ((end.tv_nsec - begin.tv_nsec) / 1000000000.0);
+    SimStats stats = GetSimStats();
+    printf("Simulated invoke time : \033[0;31m%0.6f\033[0m ms (kernels %0.6f ms total, %d overruns) \n",
+           time*1000, stats.cpu_us/1000, stats.overruns);
+    std::cout << "SIM All Jobs done" << "\n";
+    return kTfLiteOk;
+}
+
+Interpreter* UnitSim::GetInterpreter(){return interpreterSim->get();}
+
+std::unique_ptr<tflite::Interpreter>* UnitSim::ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next){
+    std::unique_ptr<tflite::Interpreter>* old = interpreterSim;
+    // The old injector retires with the old interpreter.
+    injector = Install(next->get());
+    interpreterSim = next;
+    return old;
+}
+
+SimLatencyInjector* UnitSim::Install(Interpreter* interpreter){
+    SimLatencyInjector* installed = new SimLatencyInjector(model);
+    if(installed->Attach(interpreter) != kTfLiteOk)
+        std::cout << "UnitSim : \"Latency model attach ERROR\"\n";
+    interpreter->SetProfiler(std::unique_ptr<Profiler>(installed));
+    return installed;
+}
+
+SimStats UnitSim::GetSimStats(){
+    std::unique_lock<std::mutex> lock(mtx_swap);
+    return injector->GetStats();
+}
+
+void UnitSim::SetInput(std::vector<cv::Mat> input_){
+    input = input_;
+}
+
+UnitType UnitSim::GetUnitType(){
+    return eType;
+}
+
+} // End of namespace tflite
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include "mutex"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/core/api/profiler.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/unit.h"
+
+/*
+UnitSim : Simulated accelerator unit
+
+    Stands in for a device unit (GPU0 by default) on machines without one.
+    Partitions run on the CPU kernels, but every op is held until the time
+    the latency model gives it, so co-execution, queueing and partitioning
+    see device like timings.
+
+    Modeled time of one op
+        time_scale * (cpu_us / speedup(op) + launch_overhead_us
+                      + boundary bytes / transfer bandwidth)
+    Boundary bytes are the op's inputs that are inputs of its partition
+    (host to device) and its outputs that are outputs of the partition
+    (device to host), so every partition handoff pays a transfer.
+    Partitions not listed in SimLatencyModel::partitions run at CPU speed.
+
+    cpu_us is averaged over calibration_invokes runs of every op (after
+    its first, cold run) and then frozen, so later invokes take the same time on any host as
+    long as the kernels run faster than the model (slower ops are counted
+    as overruns, raise time_scale then).
+
+    The latency is injected by a profiler the interpreter owns, so every
+    path invoking it (InvokeOnce, InvokeAsync, the pool, deadlines) gets
+    it. InvokeAsync() jobs run on the unit's own worker thread, the
+    simulated device queue, started when the unit is created.
+
+    Usage
+        SimLatencyModel model;
+        model.default_speedup = 3.0;
+        model.op_speedup["CONV_2D"] = 6.0;
+        model.launch_overhead_us = 20;
+        model.transfer_mb_per_s = 2000;
+        model.calibration_invokes = 5;
+        handler.CreateUnitSim(UnitType::GPU0, input, model);
+        handler.InvokeAsync(UnitType::GPU0, input);
+*/
+
+namespace tflite{
+
+struct SimLatencyModel{
+    /// cpu_us / speedup for ops without an entry in op_speedup
+    double default_speedup = 1.0;
+    /// Per op speedup by builtin name ("CONV_2D", "DEPTHWISE_CONV_2D", ..)
+    std::map<std::string, double> op_speedup;
+    /// Fixed cost of every op (kernel launch)
+    double launch_overhead_us = 0;
+    /// Host <-> device bandwidth, 0 : transfers are free
+    double transfer_mb_per_s = 0;
+    /// Scales the whole model (> 1 when the host CPU is slower than it)
+    double time_scale = 1.0;
+    /// Warm runs of every op averaged before cpu_us is frozen,
+    /// 0 : measure every run
+    int calibration_invokes = 0;
+    /// Partitions (subgraphs) on the simulated device, empty : all
+    std::vector<int> partitions;
+};
+
+struct SimStats{
+    /// Partition invokes on the simulated device
+    int invokes = 0;
+    /// Time the ops were held for in total
+    double modeled_us = 0;
+    /// Time the CPU kernels took
+    double cpu_us = 0;
+    double launch_us = 0;
+    double transfer_us = 0;
+    int64_t transferred_bytes = 0;
+    /// Ops whose kernels took longer than their modeled time
+    int overruns = 0;
+    /// Ops modeled from their measured cpu_us (not frozen yet)
+    int calibrating_ops = 0;
+};
+
+/// Holds every op of the interpreter it is installed on until its modeled
+/// time elapsed. Owned by that interpreter (Interpreter::SetProfiler).
+class SimLatencyInjector : public Profiler
+{
+    public:
+        SimLatencyInjector(SimLatencyModel model);
+
+        /// Reads the partitions' boundary tensors, call after allocation.
+        TfLiteStatus Attach(Interpreter* interpreter);
+
+        uint32_t BeginEvent(const char* tag, EventType event_type,
+                            int64_t event_metadata1,
+                            int64_t event_metadata2) override;
+        void EndEvent(uint32_t event_handle) override;
+
+        SimStats GetStats();
+
+    private:
+        struct OpEvent{
+            std::string op;
+            int subgraph;
+            int node;
+            std::chrono::steady_clock::time_point begin;
+        };
+
+        bool Simulated(int subgraph);
+        double Speedup(const std::string& op);
+        /// Sleeps, then spins the last stretch so short ops keep their time.
+        void HoldUntil(std::chrono::steady_clock::time_point until);
+
+        SimLatencyModel model;
+        /// Boundary bytes per [subgraph][node]
+        std::vector<std::vector<int64_t>> transfer_bytes;
+        /// Mean cpu_us per [subgraph][node] while calibrating, then frozen
+        std::vector<std::vector<double>> calibrated_us;
+        std::vector<std::vector<int>> samples;
+        /// First node of each partition's execution plan (counts invokes)
+        std::vector<int> first_node;
+
+        std::map<uint32_t, OpEvent> events;
+        uint32_t next_handle = 1;
+        SimStats stats;
+        std::mutex mtx_sim;
+};
+
+//Unit Class for the simulated accelerator
+class UnitSim : public Unit
+{
+    public:
+        UnitSim();
+        /// eType_ : unit type it stands in for (GPU0 runs the partitions)
+        UnitSim(UnitType eType_, std::unique_ptr<tflite::Interpreter>* interpreter,
+                SimLatencyModel model);
+        ~UnitSim();
+        /// Runs the input once on the unit's device thread.
+        TfLiteStatus Invoke(UnitType eType, std::mutex& mtx_lock,
+                                    std::mutex& mtx_lock_,
+                                    std::mutex& mtx_lock_timing,
+                                    std::mutex& mtx_lock_debug,
+                                    std::condition_variable& Ucontroller,
+                                    std::condition_variable& Outcontroller,
+                                    std::queue<SharedContext*>* qSharedData,
+                                    int* C_Count, int* G_Count);
+        Interpreter* GetInterpreter();
+        UnitType GetUnitType();
+        void SetInput(std::vector<cv::Mat> input_);
+
+        /// Stats of the current interpreter (since creation or last swap)
+        SimStats GetSimStats();
+        const SimLatencyModel& GetLatencyModel() { return model; }
+
+        UnitType eType;
+        std::vector<cv::Mat> input;
+        std::unique_ptr<tflite::Interpreter>* interpreterSim;
+        std::string name;
+
+    protected:
+        std::unique_ptr<tflite::Interpreter>* ExchangeInterpreter(
+                                std::unique_ptr<tflite::Interpreter>* next);
+
+    private:
+        /// Installs a new injector on 'interpreter' (which owns it)
+        SimLatencyInjector* Install(Interpreter* interpreter);
+
+        SimLatencyModel model;
+        /// Injector of interpreterSim
+        SimLatencyInjector* injector = nullptr;
+};
+
+} // End of namespace tflite
@@ -0,0 +1,378 @@
+#include "unit_tiler.h"
+#include "algorithm"
+#include "cmath"
+#include "tensorflow/lite/kernels/kernel_util.h"
+
+namespace tflite
+{
+
+namespace {
+
+float OutputValue(const TfLiteTensor* tensor, int index){
+    switch(tensor->type){
+        case kTfLiteFloat32:
+            return tensor->data.f[index];
+        case kTfLiteUInt8:
+            return tensor->params.scale *
+                   ((int)tensor->data.uint8[index] - tensor->params.zero_point);
+        case kTfLiteInt8:
+            return tensor->params.scale *
+                   ((int)tensor->data.int8[index] - tensor->params.zero_point);
+        default:
+            return 0;
+    }
+}
+
+float IntersectionOverUnion(const TileDetection& a, const TileDetection& b){
+    float area_a = (a.xmax - a.xmin) * (a.ymax - a.ymin);
+    float area_b = (b.xmax - b.xmin) * (b.ymax - b.ymin);
+    if(area_a <= 0 || area_b <= 0)
+        return 0;
+    float w = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
+    float h = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
+    if(w <= 0 || h <= 0)
+        return 0;
+    float intersection = w * h;
+    return intersection / (area_a + area_b - intersection);
+}
+
+/// Tile origins along one axis. The last tile is aligned to the frame edge
+/// so nothing is left out and no tile is padded.
+std::vector<int> TileStarts(int frame, int tile, float overlap){
+    std::vector<int> starts;
+    if(frame <= tile){
+        starts.push_back(0);
+        return starts;
+    }
+    int stride = std::max(1, (int)std::lround(tile * (1.0f - overlap)));
+    for(int start = 0; ; start += stride){
+        if(start + tile >= frame){
+            starts.push_back(frame - tile);
+            break;
+        }
+        starts.push_back(start);
+    }
+    return starts;
+}
+
+} // namespace
+
+TfLiteStatus DecodeDetectionPostProcess(Interpreter* interpreter, int slot,
+                                        std::vector<TileDetection>* detections){
+    if(interpreter->outputs().size() < 4){
+        std::cout << "DecodeDetectionPostProcess : expected 4 outputs \n";
+        return kTfLiteError;
+    }
+    const TfLiteTensor* boxes = interpreter->tensor(interpreter->outputs()[0]);
+    const TfLiteTensor* classes = interpreter->tensor(interpreter->outputs()[1]);
+    const TfLiteTensor* scores = interpreter->tensor(interpreter->outputs()[2]);
+    const TfLiteTensor* count = interpreter->tensor(interpreter->outputs()[3]);
+    const int batch = boxes->dims->size == 3 ? boxes->dims->data[0] : 1;
+    if(slot >= batch){
+        std::cout << "DecodeDetectionPostProcess : no batch slot " << slot << "\n";
+        return kTfLiteError;
+    }
+    const int max_detections = NumElements(scores) / batch;
+    int num = (int)OutputValue(count, NumElements(count) == batch ? slot : 0);
+    num = std::max(0, std::min(num, max_detections));
+    for(int i=0; i<num; ++i){
+        const int idx = slot * max_detections + i;
+        TileDetection detection;
+        detection.ymin = OutputValue(boxes, idx * 4);
+        detection.xmin = OutputValue(boxes, idx * 4 + 1);
+        detection.ymax = OutputValue(boxes, idx * 4 + 2);
+        detection.xmax = OutputValue(boxes, idx * 4 + 3);
+        detection.score = OutputValue(scores, idx);
+        detection.class_id = (int)OutputValue(classes, idx);
+        detections->push_back(detection);
+    }
+    return kTfLiteOk;
+}
+
+void MergeTileDetections(std::vector<TileDetection>* detections,
+                         float iou_threshold, bool class_aware){
+    std::vector<TileDetection>& boxes = *detections;
+    std::stable_sort(boxes.begin(), boxes.end(),
+                     [](const TileDetection& a, const TileDetection& b){
+                         return a.score > b.score;
+                     });
+    std::vector<TileDetection> kept;
+    for(size_t i=0; i<boxes.size(); ++i){
+        bool suppressed = false;
+        for(size_t k=0; k<kept.size(); ++k){
+            if(class_aware && kept[k].class_id != boxes[i].class_id)
+                continue;
+            if(IntersectionOverUnion(kept[k], boxes[i]) > iou_threshold){
+                suppressed = true;
+                break;
+            }
+        }
+        if(!suppressed)
+            kept.push_back(boxes[i]);
+    }
+    boxes.swap(kept);
+}
+
+UnitTiler::UnitTiler(tflite::InterpreterBuilder* builder,
+                     UnitTilerOptions options_, TileDecoder decoder_)
+                    : builder_(builder), options(options_), decoder(decoder_) {}
+
+UnitTiler::UnitTiler(std::vector<Unit*> units, UnitTilerOptions options_,
+                     TileDecoder decoder_)
+                    : units_(units), options(options_), decoder(decoder_) {
+    // Units keep their input shape, one tile per invoke.
+    options.tiles_per_invoke = 1;
+}
+
+UnitTiler::~UnitTiler(){
+    Stop();
+}
+
+TfLiteStatus UnitTiler::Start(){
+    if(started)
+        return kTfLiteOk;
+    options.overlap = std::min(0.9f, std::max(0.0f, options.overlap));
+    if(options.tiles_per_invoke < 1)
+        options.tiles_per_invoke = 1;
+    if(!units_.empty()){
+        for(size_t i=0; i<units_.size(); ++i){
+            std::unique_ptr<TileWorker> worker(new TileWorker);
+            worker->unit = units_[i];
+            workers.push_back(std::move(worker));
+        }
+    }else{
+        if(builder_ == nullptr){
+            PrintMsg("InterpreterBuilder nullptr ERROR");
+            return kTfLiteError;
+        }
+        int num_workers = options.num_workers;
+        if(num_workers < 1){
+            int cores = (int)std::thread::hardware_concurrency();
+            num_workers = std::max(1, cores / std::max(1, options.num_threads));
+        }
+        for(int i=0; i<num_workers; ++i){
+            std::unique_ptr<TileWorker> worker(new TileWorker);
+            worker->batch = options.tiles_per_invoke;
+            if(BuildInterpreter(worker.get()) != kTfLiteOk){
+                workers.clear();
+                return kTfLiteError;
+            }
+            workers.push_back(std::move(worker));
+        }
+    }
+    // Every worker runs the same model, the first one tells the tile size.
+    TileWorker* first = workers[0].get();
+    Interpreter* interpreter = first->unit ? first->unit->GetInterpreter()
+                                           : first->interpreter.get();
+    TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[0]);
+    if(input->dims->size != 4){
+        PrintMsg("Input tensor is not NHWC");
+        workers.clear();
+        return kTfLiteError;
+    }
+    tile_height = input->dims->data[1];
+    tile_width = input->dims->data[2];
+
+    stop_flag = false;
+    for(size_t i=0; i<workers.size(); ++i)
+        workers[i]->thread = std::thread(&UnitTiler::Worker, this, workers[i].get());
+    started = true;
+    std::cout << "UnitTiler : " << workers.size() << " workers, tile "
+              << tile_width << "x" << tile_height << "\n";
+    return kTfLiteOk;
+}
+
+void UnitTiler::Stop(){
+    if(!started)
+        return;
+    {
+        std::unique_lock<std::mutex> lock(mtx_queue);
+        stop_flag = true;
+    }
+    Tcontroller.notify_all();
+    for(size_t i=0; i<workers.size(); ++i)
+        workers[i]->thread.join();
+    // Nobody will run what is left, do not leave Detect() waiting.
+    for(size_t i=0; i<qJob.size(); ++i)
+        FinishJob(qJob[i], kTfLiteError, nullptr);
+    qJob.clear();
+    workers.clear();
+    started = false;
+    std::cout << "UnitTiler : " << tile_count << " tiles in "
+              << invoke_count << " invokes \n";
+}
+
+TfLiteStatus UnitTiler::BuildInterpreter(TileWorker* worker){
+    if((*builder_)(&worker->interpreter, options.num_threads) != kTfLiteOk ||
+        worker->interpreter == nullptr){
+        PrintMsg("Interpreter build ERROR");
+        return kTfLiteError;
+    }
+    Interpreter* interpreter = worker->interpreter.get();
+    int input_idx = interpreter->inputs()[0];
+    if(worker->batch > 1){
+        TfLiteIntArray* dims = interpreter->tensor(input_idx)->dims;
+        std::vector<int> batch_dims(dims->data, dims->data + dims->size);
+        batch_dims[0] = worker->batch;
+        if(interpreter->ResizeInputTensor(input_idx, batch_dims) != kTfLiteOk){
+            PrintMsg("ResizeInputTensor ERROR");
+            return kTfLiteError;
+        }
+    }
+    if(interpreter->AllocateTensors() != kTfLiteOk){
+        PrintMsg("AllocateTensors ERROR");
+        return kTfLiteError;
+    }
+    return kTfLiteOk;
+}
+
+std::vector<cv::Rect> UnitTiler::MakeTiles(cv::Size frame_size){
+    std::vector<cv::Rect> tiles;
+    std::vector<int> xs = TileStarts(frame_size.width, tile_width, options.overlap);
+    std::vector<int> ys = TileStarts(frame_size.height, tile_height, options.overlap);
+    int width = std::min(tile_width, frame_size.width);
+    int height = std::min(tile_height, frame_size.height);
+    for(size_t y=0; y<ys.size(); ++y)
+        for(size_t x=0; x<xs.size(); ++x)
+            tiles.push_back(cv::Rect(xs[x], ys[y], width, height));
+    if(options.include_full_frame && tiles.size() > 1)
+        tiles.push_back(cv::Rect(0, 0, frame_size.width, frame_size.height));
+    return tiles;
+}
+
+TfLiteStatus UnitTiler::Detect(const cv::Mat& frame,
+                               std::vector<TileDetection>* detections){
+    if(!started){
+        PrintMsg("Tiler not started");
+        return kTfLiteError;
+    }
+    return DetectRegions(frame, MakeTiles(frame.size()), detections);
+}
+
+TfLiteStatus UnitTiler::DetectRegions(const cv::Mat& frame,
+                                      const std::vector<cv::Rect>& regions,
+                                      std::vector<TileDetection>* detections){
+    if(!started){
+        PrintMsg("Tiler not started");
+        return kTfLiteError;
+    }
+    detections->clear();
+    const cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+    TileRequest request;
+    std::vector<TileJob> jobs;
+    for(size_t i=0; i<regions.size(); ++i){
+        cv::Rect region = regions[i] & frame_rect;
+        if(region.area() == 0)
+            continue;
+        TileJob job;
+        job.tile = frame(region); // view, copied into the input tensor
+        job.region = region;
+        job.request = &request;
+        jobs.push_back(job);
+    }
+    if(jobs.empty())
+        return kTfLiteOk;
+    // Set before any worker can see the jobs.
+    request.pending = jobs.size();
+    {
+        std::unique_lock<std::mutex> lock(mtx_queue);
+        qJob.insert(qJob.end(), jobs.begin(), jobs.end());
+    }
+    Tcontroller.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(request.mtx);
+        request.done.wait(lock, [&request]{ return request.pending == 0; });
+    }
+    if(request.status != kTfLiteOk)
+        return request.status;
+    MergeTileDetections(&request.detections, options.iou_threshold,
+                        options.class_aware_nms);
+    detections->swap(request.detections);
+    return kTfLiteOk;
+}
+
+void UnitTiler::Worker(TileWorker* worker){
+    std::vector<TileJob> jobs;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mtx_queue);
+            Tcontroller.wait(lock, [this]{ return stop_flag || !qJob.empty(); });
+            if(stop_flag)
+                return;
+            // Tiles are already waiting, batch whatever is there.
+            while(!qJob.empty() && (int)jobs.size() < worker->batch){
+                jobs.push_back(qJob.front());
+                qJob.pop_front();
+            }
+        }
+        RunTiles(worker, jobs);
+        jobs.clear();
+    }
+}
+
+void UnitTiler::RunTiles(TileWorker* worker, std::vector<TileJob>& jobs){
+    TfLiteStatus status = kTfLiteOk;
+    Interpreter* interpreter;
+    if(worker->unit != nullptr){
+        // Pinned until the tiles are decoded (hot swap).
+        interpreter = worker->unit->PinInterpreter();
+        status = worker->unit->InvokeOn(interpreter, {jobs[0].tile});
+    }else{
+        interpreter = worker->interpreter.get();
+        status = interpreter->AcquireNonPersistentMemory();
+        TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[0]);
+        // Unused slots of a partial batch are zero filled and dropped.
+        for(int slot=0; slot<worker->batch && status == kTfLiteOk; ++slot){
+            cv::Mat empty;
+            const cv::Mat& tile = slot < (int)jobs.size() ? jobs[slot].tile : empty;
+            status = CopyFrameToInputTensor(input, slot, tile);
+        }
+        if(status == kTfLiteOk)
+            status = interpreter->Invoke();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mtx_queue);
+        invoke_count++;
+        tile_count += jobs.size();
+    }
+    for(size_t slot=0; slot<jobs.size(); ++slot){
+        std::vector<TileDetection> tile_detections;
+        TfLiteStatus tile_status = status;
+        if(tile_status == kTfLiteOk)
+            tile_status = decoder(interpreter, slot, &tile_detections);
+        FinishJob(jobs[slot], tile_status, &tile_detections);
+    }
+    if(worker->unit != nullptr)
+        worker->unit->UnpinInterpreter(interpreter);
+}
+
+void UnitTiler::FinishJob(TileJob& job, TfLiteStatus status,
+                          std::vector<TileDetection>* tile_detections){
+    TileRequest* request = job.request;
+    std::unique_lock<std::mutex> lock(request->mtx);
+    if(status != kTfLiteOk){
+        request->status = status;
+    }else{
+        // Tile normalized -> frame pixel coordinates
+        const cv::Rect& region = job.region;
+        for(size_t i=0; i<tile_detections->size(); ++i){
+            TileDetection detection = (*tile_detections)[i];
+            if(detection.score < options.score_threshold)
+                continue;
+            detection.xmin = region.x + detection.xmin * region.width;
+            detection.xmax = region.x + detection.xmax * region.width;
+            detection.ymin = region.y + detection.ymin * region.height;
+            detection.ymax = region.y + detection.ymax * region.height;
+            request->detections.push_back(detection);
+        }
+    }
+    if(--request->pending == 0)
+        request->done.notify_all();
+}
+
+void UnitTiler::PrintMsg(const char* msg){
+    std::cout << "UnitTiler : \"" << msg << "\"\n";
+    return;
+}
+
+} // End of namespace tflite
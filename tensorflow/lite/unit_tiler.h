@@ -0,0 +1,182 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include "condition_variable"
+#include "mutex"
+#include "thread"
+#include "opencv2/opencv.hpp"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/interpreter_builder.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/unit.h"
+
+/*
+UnitTiler : Tiled high resolution detection front-end
+
+    A large frame (1080p, 4K) is split into overlapping tiles of the model's
+    input size, cropped at full resolution instead of downscaling the whole
+    frame (small objects survive).
+    Tiles are queued and picked up by one worker thread per interpreter (or
+    unit), so a frame's tiles run in parallel.
+    Every tile's detections are mapped back to frame coordinates and merged
+    with a cross-tile NMS.
+
+    Workers either own interpreters built from the InterpreterBuilder (then
+    tiles_per_invoke tiles can share one batched Invoke) or run on existing
+    units through Unit::InvokeOnce (one tile per invoke, do not use the
+    unit's async path at the same time).
+
+    Usage
+        UnitTilerOptions options;
+        options.overlap = 0.25;
+        options.num_workers = 4;
+        UnitTiler tiler(builder, options);
+        tiler.Start();
+        std::vector<TileDetection> detections;
+        tiler.Detect(frame, &detections);
+*/
+
+namespace tflite{
+
+/// A detection in frame pixel coordinates
+/// (tile normalized [0,1] coordinates when returned by a TileDecoder).
+struct TileDetection{
+    float xmin;
+    float ymin;
+    float xmax;
+    float ymax;
+    float score;
+    int class_id;
+};
+
+/// Reads the detections of batch slot 'slot' out of an invoked interpreter,
+/// in coordinates normalized to the tile.
+typedef std::function<TfLiteStatus(Interpreter*, int slot,
+                                   std::vector<TileDetection>*)> TileDecoder;
+
+/// Decoder for models ending with TFLite_Detection_PostProcess (SSD) :
+/// boxes [N,4] (ymin, xmin, ymax, xmax), classes [N], scores [N], count.
+TfLiteStatus DecodeDetectionPostProcess(Interpreter* interpreter, int slot,
+                                        std::vector<TileDetection>* detections);
+
+/// Greedy NMS over detections of every tile, highest score first.
+/// class_aware : only boxes of the same class suppress each other.
+void MergeTileDetections(std::vector<TileDetection>* detections,
+                         float iou_threshold, bool class_aware);
+
+struct UnitTilerOptions{
+    /// Fraction of a tile shared with its neighbour, in [0, 0.9]
+    float overlap = 0.2;
+    /// Tiles run in one Invoke (owned interpreters only, the input batch
+    /// dimension is resized). 1 for models which only take a single frame.
+    int tiles_per_invoke = 1;
+    /// Worker threads = interpreters built. 0 : cores / num_threads
+    int num_workers = 0;
+    /// CPU threads of every owned interpreter
+    int num_threads = 1;
+    /// Detections below this score are dropped before merging
+    float score_threshold = 0.3;
+    float iou_threshold = 0.5;
+    bool class_aware_nms = true;
+    /// Also runs the whole frame downscaled to the model size, for objects
+    /// larger than a tile.
+    bool include_full_frame = false;
+};
+
+class UnitTiler
+{
+    public:
+        /// Workers own interpreters built from 'builder'.
+        UnitTiler(tflite::InterpreterBuilder* builder, UnitTilerOptions options,
+                  TileDecoder decoder = DecodeDetectionPostProcess);
+        /// One worker per unit. Units stay owned by the caller.
+        UnitTiler(std::vector<Unit*> units, UnitTilerOptions options,
+                  TileDecoder decoder = DecodeDetectionPostProcess);
+        ~UnitTiler();
+
+        /// Builds the interpreters and launches the workers.
+        TfLiteStatus Start();
+
+        /// Fails queued tiles and joins the workers.
+        void Stop();
+
+        /// Tiles the frame, runs every tile and merges the detections.
+        /// Blocking, can be called from several threads at once.
+        TfLiteStatus Detect(const cv::Mat& frame,
+                            std::vector<TileDetection>* detections);
+
+        /// Same as Detect but only on the given regions of the frame (each
+        /// resized to the model input if it is not model sized).
+        TfLiteStatus DetectRegions(const cv::Mat& frame,
+                                   const std::vector<cv::Rect>& regions,
+                                   std::vector<TileDetection>* detections);
+
+        /// Tile grid Detect uses for a frame of this size.
+        std::vector<cv::Rect> MakeTiles(cv::Size frame_size);
+
+        cv::Size GetTileSize() { return cv::Size(tile_width, tile_height); }
+        int GetWorkerCount() { return (int)workers.size(); }
+        int GetInvokeCount() { return invoke_count; }
+        int GetTileCount() { return tile_count; }
+
+    private:
+        /// One Detect/DetectRegions call
+        struct TileRequest{
+            std::mutex mtx;
+            std::condition_variable done;
+            int pending = 0;
+            TfLiteStatus status = kTfLiteOk;
+            std::vector<TileDetection> detections;
+        };
+
+        struct TileJob{
+            cv::Mat tile;
+            cv::Rect region;
+            TileRequest* request;
+        };
+
+        struct TileWorker{
+            Unit* unit = nullptr;
+            std::unique_ptr<tflite::Interpreter> interpreter;
+            int batch = 1;
+            std::thread thread;
+        };
+
+        void Worker(TileWorker* worker);
+
+        /// Runs one batch of tiles and hands the detections to their requests.
+        void RunTiles(TileWorker* worker, std::vector<TileJob>& jobs);
+
+        void FinishJob(TileJob& job, TfLiteStatus status,
+                       std::vector<TileDetection>* tile_detections);
+
+        TfLiteStatus BuildInterpreter(TileWorker* worker);
+
+        void PrintMsg(const char* msg);
+
+        tflite::InterpreterBuilder* builder_ = nullptr;
+        std::vector<Unit*> units_;
+        UnitTilerOptions options;
+        TileDecoder decoder;
+
+        std::vector<std::unique_ptr<TileWorker>> workers;
+
+        std::deque<TileJob> qJob;
+        std::mutex mtx_queue;
+        std::condition_variable Tcontroller;
+        bool stop_flag = false;
+        bool started = false;
+
+        /// Model input size
+        int tile_width = 0;
+        int tile_height = 0;
+
+        int invoke_count = 0;
+        int tile_count = 0;
+};
+
+} // End of namespace tflite
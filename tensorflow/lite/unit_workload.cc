@@ -0,0 +1,396 @@
+#include "unit_workload.h"
+#include "tensorflow/lite/unit.h"
+#include "algorithm"
+#include "cmath"
+#include "cstring"
+#include "thread"
+
+namespace tflite
+{
+
+namespace {
+
+const char kWorkloadMagic[4] = {'F', 'B', 'F', 'W'};
+const uint32_t kWorkloadVersion = 1;
+const uint32_t kWorkloadFlagBoundaries = 1;
+const uint32_t kFrameMarker = 0x4d415246; // "FRAM"
+
+template <typename T>
+void Put(std::ofstream& out, T value){
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool Get(std::ifstream& in, T* value){
+    in.read(reinterpret_cast<char*>(value), sizeof(T));
+    return (bool)in;
+}
+
+// Size of the element types boundaries are compared for, 0 for others.
+size_t ComparedElementSize(TfLiteType type){
+    switch(type){
+        case kTfLiteFloat32: return sizeof(float);
+        case kTfLiteInt32:   return sizeof(int32_t);
+        case kTfLiteUInt8:   return sizeof(uint8_t);
+        case kTfLiteInt8:    return sizeof(int8_t);
+        default: return 0;
+    }
+}
+
+double ElementAt(TfLiteType type, const uint8_t* data, size_t i){
+    switch(type){
+        case kTfLiteFloat32: return reinterpret_cast<const float*>(data)[i];
+        case kTfLiteInt32:   return reinterpret_cast<const int32_t*>(data)[i];
+        case kTfLiteUInt8:   return data[i];
+        default:             return reinterpret_cast<const int8_t*>(data)[i];
+    }
+}
+
+} // namespace
+
+double RecordedFrame::InvokeUs() const {
+    double total = 0;
+    for(size_t i=0; i<latencies.size(); ++i)
+        total += latencies[i].us;
+    return total;
+}
+
+// WorkloadRecorder
+WorkloadRecorder::WorkloadRecorder(){}
+
+WorkloadRecorder::~WorkloadRecorder(){
+    Close();
+}
+
+TfLiteStatus WorkloadRecorder::Open(const std::string& path,
+                                    WorkloadRecordOptions options_){
+    std::unique_lock<std::mutex> lock(mtx_record);
+    if(file.is_open())
+        file.close();
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if(!file.is_open()){
+        PrintMsg("Recording file open ERROR");
+        return kTfLiteError;
+    }
+    options = options_;
+    frames = 0;
+    file.write(kWorkloadMagic, sizeof(kWorkloadMagic));
+    Put<uint32_t>(file, kWorkloadVersion);
+    Put<uint32_t>(file, options.record_boundaries ? kWorkloadFlagBoundaries : 0);
+    std::cout << "WorkloadRecorder : Recording to " << path << "\n";
+    return kTfLiteOk;
+}
+
+void WorkloadRecorder::Close(){
+    std::unique_lock<std::mutex> lock(mtx_record);
+    if(!file.is_open())
+        return;
+    file.close();
+    std::cout << "WorkloadRecorder : " << frames << " invokes recorded \n";
+}
+
+TfLiteStatus WorkloadRecorder::Record(Interpreter* interpreter,
+                                      std::chrono::steady_clock::time_point arrival){
+    std::unique_lock<std::mutex> lock(mtx_record);
+    if(!file.is_open() || (options.max_frames > 0 && frames >= options.max_frames))
+        return kTfLiteOk;
+    if(frames == 0)
+        first_arrival = arrival;
+    const int num_subgraphs = interpreter->subgraphs_size();
+
+    Put<uint32_t>(file, kFrameMarker);
+    Put<uint64_t>(file, std::chrono::duration_cast<std::chrono::microseconds>(
+                            arrival - first_arrival).count());
+
+    // Inputs are preserved by the memory planner, still intact after invoke.
+    Put<uint32_t>(file, interpreter->inputs().size());
+    for(int tensor_index : interpreter->inputs())
+        WriteTensor(interpreter->subgraph(0), 0, tensor_index);
+
+    uint32_t num_latencies = 0;
+    for(int s=0; s<num_subgraphs; ++s){
+        const std::vector<double>& latencies = interpreter->subgraph(s)->last_node_latency_us();
+        num_latencies += std::count_if(latencies.begin(), latencies.end(),
+                                       [](double us){ return us > 0; });
+    }
+    Put<uint32_t>(file, num_latencies);
+    for(int s=0; s<num_subgraphs; ++s){
+        const std::vector<double>& latencies = interpreter->subgraph(s)->last_node_latency_us();
+        for(size_t node=0; node<latencies.size(); ++node){
+            if(latencies[node] <= 0)
+                continue;
+            Put<int32_t>(file, s);
+            Put<int32_t>(file, node);
+            Put<float>(file, latencies[node]);
+        }
+    }
+
+    if(!options.record_boundaries){
+        Put<uint32_t>(file, 0);
+    }else{
+        uint32_t num_boundaries = 0;
+        for(int s=0; s<num_subgraphs; ++s)
+            num_boundaries += interpreter->subgraph(s)->outputs().size();
+        Put<uint32_t>(file, num_boundaries);
+        for(int s=0; s<num_subgraphs; ++s){
+            Subgraph* subgraph = interpreter->subgraph(s);
+            for(int tensor_index : subgraph->outputs())
+                WriteTensor(subgraph, s, tensor_index);
+        }
+    }
+    if(!file){
+        PrintMsg("Recording write ERROR, closing");
+        file.close();
+        return kTfLiteError;
+    }
+    frames++;
+    return kTfLiteOk;
+}
+
+void WorkloadRecorder::WriteTensor(Subgraph* subgraph, int subgraph_index,
+                                   int tensor_index){
+    // Delegated outputs may only live in the delegate's buffer.
+    subgraph->EnsureTensorDataIsReadable(tensor_index);
+    const TfLiteTensor* tensor = subgraph->tensor(tensor_index);
+    const int ndims = tensor->dims ? tensor->dims->size : 0;
+    const uint64_t bytes = tensor->data.raw ? tensor->bytes : 0;
+    Put<int32_t>(file, subgraph_index);
+    Put<int32_t>(file, tensor_index);
+    Put<int32_t>(file, tensor->type);
+    Put<int32_t>(file, ndims);
+    for(int i=0; i<ndims; ++i)
+        Put<int32_t>(file, tensor->dims->data[i]);
+    Put<uint64_t>(file, bytes);
+    if(bytes > 0)
+        file.write(tensor->data.raw_const, bytes);
+}
+
+int WorkloadRecorder::GetFrameCount(){
+    std::unique_lock<std::mutex> lock(mtx_record);
+    return frames;
+}
+
+void WorkloadRecorder::PrintMsg(const char* msg){
+    std::cout << "WorkloadRecorder : \"" << msg << "\"\n";
+    return;
+}
+
+// WorkloadReplayer
+TfLiteStatus WorkloadReplayer::Load(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    if(!in.is_open()){
+        PrintMsg("Recording file open ERROR");
+        return kTfLiteError;
+    }
+    char magic[4];
+    uint32_t version, flags;
+    in.read(magic, sizeof(magic));
+    if(!in || memcmp(magic, kWorkloadMagic, sizeof(magic)) != 0 ||
+       !Get(in, &version) || version != kWorkloadVersion || !Get(in, &flags)){
+        PrintMsg("Not a workload recording");
+        return kTfLiteError;
+    }
+    frames.clear();
+    uint32_t marker;
+    while(Get(in, &marker)){
+        RecordedFrame frame;
+        uint32_t count;
+        bool ok = marker == kFrameMarker && Get(in, &frame.arrival_us) && Get(in, &count);
+        for(uint32_t i=0; ok && i<count; ++i){
+            frame.inputs.emplace_back();
+            ok = ReadTensor(in, &frame.inputs.back());
+        }
+        ok = ok && Get(in, &count);
+        for(uint32_t i=0; ok && i<count; ++i){
+            int32_t subgraph, node;
+            float us;
+            ok = Get(in, &subgraph) && Get(in, &node) && Get(in, &us);
+            frame.latencies.push_back({subgraph, node, us});
+        }
+        ok = ok && Get(in, &count);
+        for(uint32_t i=0; ok && i<count; ++i){
+            frame.boundaries.emplace_back();
+            ok = ReadTensor(in, &frame.boundaries.back());
+        }
+        if(!ok){
+            // A recording cut short (crashed run) keeps its whole frames.
+            PrintMsg("Truncated frame at the end of the recording, ignored");
+            break;
+        }
+        frames.push_back(std::move(frame));
+    }
+    std::cout << "WorkloadReplayer : " << frames.size() << " invokes loaded from "
+              << path << "\n";
+    return frames.empty() ? kTfLiteError : kTfLiteOk;
+}
+
+bool WorkloadReplayer::ReadTensor(std::ifstream& in, RecordedTensor* tensor){
+    int32_t subgraph, tensor_index, type, ndims;
+    if(!Get(in, &subgraph) || !Get(in, &tensor_index) || !Get(in, &type) ||
+       !Get(in, &ndims) || ndims < 0 || ndims > 16)
+        return false;
+    tensor->subgraph = subgraph;
+    tensor->tensor_index = tensor_index;
+    tensor->type = (TfLiteType)type;
+    tensor->dims.resize(ndims);
+    for(int i=0; i<ndims; ++i){
+        int32_t dim;
+        if(!Get(in, &dim))
+            return false;
+        tensor->dims[i] = dim;
+    }
+    uint64_t bytes;
+    if(!Get(in, &bytes) || bytes > ((uint64_t)1 << 32))
+        return false;
+    tensor->data.resize(bytes);
+    if(bytes > 0)
+        in.read(reinterpret_cast<char*>(tensor->data.data()), bytes);
+    return (bool)in;
+}
+
+TfLiteStatus WorkloadReplayer::Replay(Unit* unit, ReplayOptions options,
+                                      ReplayStats* stats){
+    *stats = ReplayStats();
+    if(unit == nullptr || frames.empty()){
+        PrintMsg("Nothing to replay");
+        return kTfLiteError;
+    }
+    // One loop lasts the recording plus one mean frame interval.
+    uint64_t loop_us = frames.back().arrival_us;
+    if(frames.size() > 1)
+        loop_us += loop_us / (frames.size() - 1);
+
+    std::vector<double> latencies;
+    double total_invoke_us = 0;
+    double total_recorded_us = 0;
+    TfLiteStatus result = kTfLiteOk;
+    auto start = std::chrono::steady_clock::now();
+    for(int loop=0; loop<options.loops && result == kTfLiteOk; ++loop){
+        for(size_t i=0; i<frames.size(); ++i){
+            const RecordedFrame& frame = frames[i];
+            auto due = std::chrono::steady_clock::now();
+            if(options.speed > 0){
+                double due_us = (loop * loop_us + frame.arrival_us) / options.speed;
+                due = start + std::chrono::microseconds((int64_t)due_us);
+                std::this_thread::sleep_until(due);
+            }
+            if(options.max_lag_us > 0 &&
+               std::chrono::steady_clock::now() - due > std::chrono::microseconds(options.max_lag_us)){
+                stats->dropped++;
+                continue;
+            }
+            Interpreter* interpreter = unit->PinInterpreter();
+            TfLiteStatus status = FillInputs(interpreter, frame);
+            if(status != kTfLiteOk){
+                unit->UnpinInterpreter(interpreter);
+                result = kTfLiteError;
+                break;
+            }
+            // Inputs are filled already
+            status = unit->InvokeOn(interpreter, std::vector<cv::Mat>());
+            double latency_us = std::chrono::duration<double, std::micro>(
+                                    std::chrono::steady_clock::now() - due).count();
+            if(status != kTfLiteOk){
+                unit->UnpinInterpreter(interpreter);
+                stats->failed++;
+                result = kTfLiteError;
+                continue;
+            }
+            double invoke_us = 0;
+            for(int s=0; s<interpreter->subgraphs_size(); ++s){
+                const std::vector<double>& nodes = interpreter->subgraph(s)->last_node_latency_us();
+                for(size_t n=0; n<nodes.size(); ++n)
+                    invoke_us += nodes[n];
+            }
+            if(options.compare_boundaries)
+                CompareBoundaries(interpreter, frame, stats);
+            unit->UnpinInterpreter(interpreter);
+            latencies.push_back(latency_us);
+            total_invoke_us += invoke_us;
+            total_recorded_us += frame.InvokeUs();
+            stats->frames++;
+        }
+    }
+    if(!latencies.empty()){
+        std::sort(latencies.begin(), latencies.end());
+        double total = 0;
+        for(double latency : latencies)
+            total += latency;
+        stats->avg_latency_us = total / latencies.size();
+        stats->p50_latency_us = latencies[latencies.size() / 2];
+        stats->p99_latency_us = latencies[std::min(latencies.size() - 1,
+                                                   (size_t)(latencies.size() * 0.99))];
+        stats->max_latency_us = latencies.back();
+        stats->avg_invoke_us = total_invoke_us / stats->frames;
+        stats->recorded_invoke_us = total_recorded_us / stats->frames;
+    }
+    std::cout << "WorkloadReplayer : " << stats->frames << " invokes, "
+              << stats->dropped << " dropped, " << stats->failed << " failed, "
+              << "latency avg " << stats->avg_latency_us << " us p99 "
+              << stats->p99_latency_us << " us, invoke " << stats->avg_invoke_us
+              << " us (recorded " << stats->recorded_invoke_us << " us) \n";
+    if(options.regression_threshold > 0 && stats->recorded_invoke_us > 0 &&
+       stats->avg_invoke_us > stats->recorded_invoke_us * options.regression_threshold){
+        PrintMsg("Invoke time regressed beyond the threshold");
+        result = kTfLiteError;
+    }
+    return result;
+}
+
+TfLiteStatus WorkloadReplayer::FillInputs(Interpreter* interpreter,
+                                          const RecordedFrame& frame){
+    if(frame.inputs.size() != interpreter->inputs().size()){
+        PrintMsg("Recorded inputs do not match the unit's model");
+        return kTfLiteError;
+    }
+    // Inputs live in the arena, which may have been released while idle.
+    if(interpreter->AcquireNonPersistentMemory() != kTfLiteOk)
+        return kTfLiteError;
+    for(size_t i=0; i<frame.inputs.size(); ++i){
+        const RecordedTensor& recorded = frame.inputs[i];
+        TfLiteTensor* input = interpreter->tensor(interpreter->inputs()[i]);
+        if(input->type != recorded.type || input->bytes != recorded.data.size() ||
+           input->data.raw == nullptr){
+            PrintMsg("Recorded input layout does not match the unit's model");
+            return kTfLiteError;
+        }
+        memcpy(input->data.raw, recorded.data.data(), recorded.data.size());
+    }
+    return kTfLiteOk;
+}
+
+void WorkloadReplayer::CompareBoundaries(Interpreter* interpreter,
+                                         const RecordedFrame& frame,
+                                         ReplayStats* stats){
+    for(size_t i=0; i<frame.boundaries.size(); ++i){
+        const RecordedTensor& recorded = frame.boundaries[i];
+        // Only the same partition plan has the same boundaries.
+        if(recorded.subgraph >= interpreter->subgraphs_size())
+            continue;
+        Subgraph* subgraph = interpreter->subgraph(recorded.subgraph);
+        if(recorded.tensor_index < 0 ||
+           recorded.tensor_index >= (int)subgraph->tensors_size())
+            continue;
+        subgraph->EnsureTensorDataIsReadable(recorded.tensor_index);
+        const TfLiteTensor* tensor = subgraph->tensor(recorded.tensor_index);
+        const size_t element_size = ComparedElementSize(tensor->type);
+        if(element_size == 0 || tensor->type != recorded.type ||
+           tensor->bytes != recorded.data.size() || tensor->data.raw == nullptr)
+            continue;
+        const uint8_t* replayed = reinterpret_cast<const uint8_t*>(tensor->data.raw_const);
+        double diff = 0;
+        for(size_t e=0; e<tensor->bytes / element_size; ++e){
+            diff = std::max(diff, std::fabs(ElementAt(tensor->type, recorded.data.data(), e) -
+                                            ElementAt(tensor->type, replayed, e)));
+        }
+        stats->boundaries_compared++;
+        stats->max_boundary_diff = std::max(stats->max_boundary_diff, diff);
+    }
+}
+
+void WorkloadReplayer::PrintMsg(const char* msg){
+    std::cout << "WorkloadReplayer : \"" << msg << "\"\n";
+    return;
+}
+
+} // End of namespace tflite
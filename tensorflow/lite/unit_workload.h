@@ -0,0 +1,185 @@
+#pragma once
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "mutex"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/c/common.h"
+
+/*
+WorkloadRecorder / WorkloadReplayer : Record a live run, replay it offline
+
+    The recorder captures every invoke of a unit (Unit::SetRecorder()) into
+    a compact binary file
+        input tensors (raw, already preprocessed)
+        per node latencies of every partition (subgraph)
+        boundary tensors : outputs of every partition (optional, large)
+        arrival time of the invoke
+    It writes on the invoking thread right after the invoke returned.
+
+    The replayer feeds the recorded inputs into any unit whose model has the
+    same input layout, at the recorded frame timing (speed 1), accelerated
+    (speed 2 : twice as fast) or back to back (speed 0). A unit still busy
+    when the next frame is due makes it wait, like a camera queue, so the
+    reported latency (due time to done) includes queueing. That way
+    partition plans, unit types and scheduling policies can be compared on
+    real traffic shapes.
+
+    Kernel time of an invoke (sum of its node latencies) is compared with
+    the recording, a slowdown beyond regression_threshold fails the replay.
+    Recorded boundary tensors of the same partition plan are compared with
+    the replayed ones (max abs diff).
+
+    File layout (host byte order)
+        "FBFW" | u32 version | u32 flags
+        per invoke
+            u32 'FRAM' | u64 arrival_us (since the first invoke)
+            u32 n | n x tensor                       (inputs)
+            u32 n | n x {i32 subgraph, i32 node, f32 us}
+            u32 n | n x tensor                       (boundaries)
+        tensor : i32 subgraph | i32 tensor index | i32 type | i32 ndims
+                 | i32 dims[ndims] | u64 bytes | data
+
+    Usage
+        WorkloadRecorder recorder;
+        recorder.Open("traffic.fbfw", WorkloadRecordOptions());
+        unit->SetRecorder(&recorder);
+        ... live run ...
+        unit->SetRecorder(nullptr);
+        recorder.Close();
+
+        WorkloadReplayer replayer;
+        replayer.Load("traffic.fbfw");
+        ReplayOptions options;
+        options.speed = 2.0;
+        ReplayStats stats;
+        replayer.Replay(other_unit, options, &stats);
+*/
+
+namespace tflite{
+
+class Unit; //Forward declare of Unit since Unit uses the recorder
+
+struct WorkloadRecordOptions{
+    /// Also record the outputs of every partition
+    bool record_boundaries = false;
+    /// Stop recording after this many invokes, 0 : no limit
+    int max_frames = 0;
+};
+
+/// One tensor of a recording.
+struct RecordedTensor{
+    int subgraph = 0;
+    int tensor_index = 0;
+    TfLiteType type = kTfLiteNoType;
+    std::vector<int> dims;
+    std::vector<uint8_t> data;
+};
+
+struct RecordedNodeLatency{
+    int subgraph;
+    int node;
+    float us;
+};
+
+/// One recorded invoke.
+struct RecordedFrame{
+    uint64_t arrival_us = 0;
+    std::vector<RecordedTensor> inputs;
+    std::vector<RecordedNodeLatency> latencies;
+    std::vector<RecordedTensor> boundaries;
+
+    /// Kernel time of the invoke (sum of its node latencies)
+    double InvokeUs() const;
+};
+
+struct ReplayOptions{
+    /// Frame timing : 1 as recorded, 2 twice as fast, 0 back to back
+    double speed = 1.0;
+    /// Times the recording is replayed
+    int loops = 1;
+    /// Frames more than this behind their due time are dropped, 0 : never
+    int64_t max_lag_us = 0;
+    /// Compare the recorded boundary tensors with the replayed ones
+    bool compare_boundaries = false;
+    /// Fail if the mean kernel time exceeds recorded * threshold, 0 : off
+    double regression_threshold = 0;
+};
+
+struct ReplayStats{
+    int frames = 0;
+    int dropped = 0;
+    int failed = 0;
+    /// Due time to done (includes waiting for the unit)
+    double avg_latency_us = 0;
+    double p50_latency_us = 0;
+    double p99_latency_us = 0;
+    double max_latency_us = 0;
+    /// Mean kernel time of an invoke, replayed and recorded
+    double avg_invoke_us = 0;
+    double recorded_invoke_us = 0;
+    /// Boundary tensors compared and their largest element difference
+    int boundaries_compared = 0;
+    double max_boundary_diff = 0;
+};
+
+class WorkloadRecorder
+{
+    public:
+        WorkloadRecorder();
+        ~WorkloadRecorder();
+
+        /// Creates (truncates) the recording file.
+        TfLiteStatus Open(const std::string& path,
+                          WorkloadRecordOptions options = WorkloadRecordOptions());
+        void Close();
+
+        /// Appends the invoke that just ran on 'interpreter' and arrived at
+        /// 'arrival'. No-op when closed or full.
+        TfLiteStatus Record(Interpreter* interpreter,
+                            std::chrono::steady_clock::time_point arrival);
+
+        int GetFrameCount();
+
+    private:
+        void WriteTensor(Subgraph* subgraph, int subgraph_index, int tensor_index);
+        void PrintMsg(const char* msg);
+
+        std::ofstream file;
+        WorkloadRecordOptions options;
+        std::chrono::steady_clock::time_point first_arrival;
+        int frames = 0;
+        std::mutex mtx_record;
+};
+
+class WorkloadReplayer
+{
+    public:
+        /// Reads the whole recording (replay does no file I/O).
+        TfLiteStatus Load(const std::string& path);
+
+        /// Replays the recording on 'unit' from the calling thread.
+        /// kTfLiteError on input layout mismatch, failed invokes or a
+        /// regression beyond options.regression_threshold. 'stats' is filled
+        /// in every case.
+        TfLiteStatus Replay(Unit* unit, ReplayOptions options, ReplayStats* stats);
+
+        const std::vector<RecordedFrame>& GetFrames() { return frames; }
+
+    private:
+        static bool ReadTensor(std::ifstream& in, RecordedTensor* tensor);
+        /// Writes the frame's inputs into the input tensors of 'interpreter'.
+        TfLiteStatus FillInputs(Interpreter* interpreter, const RecordedFrame& frame);
+        /// Largest element difference of the comparable boundaries
+        void CompareBoundaries(Interpreter* interpreter, const RecordedFrame& frame,
+                               ReplayStats* stats);
+        void PrintMsg(const char* msg);
+
+        std::vector<RecordedFrame> frames;
+};
+
+} // End of namespace tflite